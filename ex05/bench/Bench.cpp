@@ -0,0 +1,134 @@
+#include "Bench.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+std::string escapeJson(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buffer[8];
+            std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out += buffer;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+}
+
+BenchSuite::BenchSuite(double minSeconds, int repetitions, const std::string& filter)
+    : minSeconds(minSeconds), repetitions(std::max(1, repetitions)), filter(filter) {}
+
+bool BenchSuite::matches(const std::string& name) const {
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+double BenchSuite::measure(const BenchFunction& function, long long iterations) {
+    Clock::time_point start = Clock::now();
+    function(iterations);
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void BenchSuite::run(const std::string& name, const std::string& unit, double bytesPerOp,
+                     const BenchFunction& function) {
+    if (!matches(name)) {
+        return;
+    }
+
+    // 1回の計測がminSeconds以上になる操作数を探す
+    long long iterations = 1;
+    while (true) {
+        double seconds = measure(function, iterations);
+        if (seconds >= minSeconds || iterations >= (1LL << 40)) {
+            break;
+        }
+        double scale = seconds > 0.0 ? minSeconds / seconds * 1.2 : 100.0;
+        iterations = std::max(iterations * 2, static_cast<long long>(iterations * std::min(scale, 100.0)));
+    }
+
+    std::vector<double> samples;
+    for (int r = 0; r < repetitions; ++r) {
+        samples.push_back(measure(function, iterations) * 1.0e9 / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.name = name;
+    result.unit = unit;
+    result.iterations = iterations;
+    result.nsPerOp = samples[samples.size() / 2];
+    result.minNsPerOp = samples.front();
+    result.bytesPerOp = bytesPerOp;
+    results.push_back(result);
+
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-36s %14.1f ns/%-8s %14.1f %s/s", name.c_str(), result.nsPerOp,
+                  unit.c_str(), 1.0e9 / result.nsPerOp, unit.c_str());
+    std::cout << line;
+    if (bytesPerOp > 0.0) {
+        std::snprintf(line, sizeof(line), " %10.1f MB/s", bytesPerOp / result.nsPerOp * 1.0e3);
+        std::cout << line;
+    }
+    std::cout << std::endl;
+}
+
+void BenchSuite::setContext(const std::string& key, const std::string& value) {
+    for (auto& entry : context) {
+        if (entry.first == key) {
+            entry.second = value;
+            return;
+        }
+    }
+    context.emplace_back(key, value);
+}
+
+bool BenchSuite::writeJson(const std::string& path) const {
+    std::ofstream ofs(path);
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    char number[64];
+    ofs << "{\n";
+    ofs << "  \"schema\": 1,\n";
+    ofs << "  \"suite\": \"tinyPaint\",\n";
+    ofs << "  \"context\": {\n";
+    std::snprintf(number, sizeof(number), "%.3f", minSeconds);
+    ofs << "    \"min_seconds\": " << number << ",\n";
+    ofs << "    \"repetitions\": " << repetitions;
+    for (const auto& entry : context) {
+        ofs << ",\n    \"" << escapeJson(entry.first) << "\": \"" << escapeJson(entry.second) << "\"";
+    }
+    ofs << "\n  },\n";
+    ofs << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        ofs << (i == 0 ? "\n" : ",\n");
+        ofs << "    {\"name\": \"" << escapeJson(r.name) << "\", \"unit\": \"" << escapeJson(r.unit) << "\"";
+        ofs << ", \"iterations\": " << r.iterations;
+        std::snprintf(number, sizeof(number), "%.3f", r.nsPerOp);
+        ofs << ", \"ns_per_op\": " << number;
+        std::snprintf(number, sizeof(number), "%.3f", r.minNsPerOp);
+        ofs << ", \"min_ns_per_op\": " << number;
+        std::snprintf(number, sizeof(number), "%.3f", 1.0e9 / r.nsPerOp);
+        ofs << ", \"ops_per_second\": " << number;
+        if (r.bytesPerOp > 0.0) {
+            std::snprintf(number, sizeof(number), "%.3f", r.bytesPerOp / r.nsPerOp * 1.0e3);
+            ofs << ", \"mb_per_second\": " << number;
+        }
+        ofs << "}";
+    }
+    ofs << "\n  ]\n";
+    ofs << "}\n";
+    return ofs.good();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ベンチマーク1件の結果
+struct BenchResult {
+    std::string name;
+    std::string unit;           // 1回の操作の単位(tile, segment, line, image)
+    long long iterations = 0;   // 1回の計測での操作数
+    double nsPerOp = 0.0;       // 計測ごとの値の中央値
+    double minNsPerOp = 0.0;
+    double bytesPerOp = 0.0;    // 0なら帯域を出さない
+};
+
+// 計測対象: iterations回の操作を行う(準備は呼び出し側で済ませておく)
+using BenchFunction = std::function<void(long long iterations)>;
+
+// ベンチマークの実行と結果の出力
+//
+// 1回の計測がminSeconds以上になるよう操作数を倍々に増やして決め(これがウォームアップを兼ねる)、
+// その操作数でrepetitions回計測して1操作あたりの時間の中央値と最小値を記録する。
+// JSONはキーと結果の順序が固定で、数値の桁も揃えるため、実行ごとの差分を取りやすい。
+class BenchSuite {
+public:
+    BenchSuite(double minSeconds, int repetitions, const std::string& filter);
+
+    // 名前がフィルタを含むか(フィルタが空なら常にtrue)
+    bool matches(const std::string& name) const;
+
+    // 名前がフィルタに一致すれば計測して結果に加え、1行で表示する
+    void run(const std::string& name, const std::string& unit, double bytesPerOp, const BenchFunction& function);
+
+    // 実行環境(GL_RENDERER等)をJSONのcontextに記録
+    void setContext(const std::string& key, const std::string& value);
+
+    bool writeJson(const std::string& path) const;
+    const std::vector<BenchResult>& getResults() const { return results; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    double minSeconds;
+    int repetitions;
+    std::string filter;
+    std::vector<std::pair<std::string, std::string>> context;
+    std::vector<BenchResult> results;
+
+    static double measure(const BenchFunction& function, long long iterations);
+};
+
+// 領域ごとのベンチマーク(登録順にJSONへ出力される)
+void runHistoryBenchmarks(BenchSuite& suite);
+void runTileBenchmarks(BenchSuite& suite);
+// GLコンテキストがカレントであること
+void runGpuBenchmarks(BenchSuite& suite);
@@ -0,0 +1,119 @@
+#include "Bench.hpp"
+#include "Graphics/FrameBuffer.hpp"
+#include "Graphics/LayerTexture.hpp"
+#include "IO/ImageExporter.hpp"
+#include "Tools/Brush.hpp"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int CANVAS_SIZE = 2048;
+constexpr int TILE_SIZE = 128;
+constexpr float SEGMENT_PIXELS = 16.0f;
+
+const char* EXPORT_FILE = "bench_export.png";
+
+// 保存用の画像: グラデーションに弱いノイズを乗せる(塗りと描き込みが混ざったキャンバスの代わり)
+std::vector<uint8_t> makeImage(int size) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+    uint32_t state = 12345;
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            state = state * 1664525u + 1013904223u;
+            uint8_t noise = static_cast<uint8_t>(state >> 28);
+            uint8_t* p = &pixels[(static_cast<size_t>(y) * size + x) * 4];
+            p[0] = static_cast<uint8_t>(x * 255 / size) + noise;
+            p[1] = static_cast<uint8_t>(y * 255 / size);
+            p[2] = static_cast<uint8_t>((x + y) * 127 / size) + noise;
+            p[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+// キャンバス上を往復するn本の区間(NDC、始点と終点の組)
+std::vector<StrokePoint> makeSegments(long long n) {
+    float step = SEGMENT_PIXELS / CANVAS_SIZE * 2.0f;
+    float x = -0.9f;
+    float y = -0.9f;
+    float dx = step * 0.8f;
+    float dy = step * 0.6f;
+    std::vector<StrokePoint> segments;
+    segments.reserve(static_cast<size_t>(n) * 2);
+    for (long long i = 0; i < n; ++i) {
+        if (x + dx > 0.9f || x + dx < -0.9f) {
+            dx = -dx;
+        }
+        if (y + dy > 0.9f || y + dy < -0.9f) {
+            dy = -dy;
+        }
+        segments.push_back({x, y});
+        segments.push_back({x + dx, y + dy});
+        x += dx;
+        y += dy;
+    }
+    return segments;
+}
+
+}
+
+void runGpuBenchmarks(BenchSuite& suite) {
+    LayerTexture texture(CANVAS_SIZE, CANVAS_SIZE);
+    texture.allocate();
+    FrameBuffer fbo(texture.getId());
+    texture.clear(1.0f, 1.0f, 1.0f, 0.0f);
+
+    // 区間1本あたりの描画。draw_lineはBrush::drawLineで1本ずつ(1本ごとに頂点転送とドローコール)、
+    // draw_segmentsはdrawSegmentsでまとめて(全区間で1回)描き、ドローコールをまとめた効果を比べる。GPUの完了までを含める
+    Brush brush;
+    brush.setColor(40, 80, 160, 128);
+    const StrokeMode modes[] = {StrokeMode::Stamp, StrokeMode::Capsule};
+    const char* modeNames[] = {"stamp", "capsule"};
+    for (bool batched : {false, true}) {
+        for (int m = 0; m < 2; ++m) {
+            for (int brushSize : {4, 32}) {
+                std::string name = std::string(batched ? "brush.draw_segments." : "brush.draw_line.") + modeNames[m]
+                    + ".size_" + std::to_string(brushSize);
+                suite.run(name, "segment", 0.0, [&](long long n) {
+                    std::vector<StrokePoint> segments = makeSegments(n);
+                    fbo.bind();
+                    glViewport(0, 0, CANVAS_SIZE, CANVAS_SIZE);
+                    glEnable(GL_BLEND);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    brush.setStrokeMode(modes[m]);
+                    brush.setSize(static_cast<float>(brushSize));
+                    brush.begin();
+                    brush.beginStroke();
+                    if (batched) {
+                        brush.drawSegments(segments, static_cast<float>(CANVAS_SIZE));
+                    } else {
+                        for (size_t i = 0; i + 1 < segments.size(); i += 2) {
+                            brush.drawLine(segments[i].x, segments[i].y, segments[i + 1].x, segments[i + 1].y,
+                                           static_cast<float>(CANVAS_SIZE));
+                        }
+                    }
+                    glFinish();
+                    fbo.unbind();
+                });
+            }
+        }
+    }
+
+    // 帯単位のストリーミング保存(スナップショットのコピー、読み出し、並列圧縮、書き込み)
+    std::vector<uint8_t> image = makeImage(CANVAS_SIZE);
+    texture.updateTile(0, 0, CANVAS_SIZE, CANVAS_SIZE, image.data());
+    double imageBytes = static_cast<double>(image.size());
+    ImageExporter exporter;
+    suite.run("export.png.size_" + std::to_string(CANVAS_SIZE), "image", imageBytes, [&](long long n) {
+        for (long long i = 0; i < n; ++i) {
+            if (!exporter.begin(texture.getId(), CANVAS_SIZE, CANVAS_SIZE, TILE_SIZE, EXPORT_FILE)) {
+                std::fprintf(stderr, "export failed to start\n");
+                return;
+            }
+            exporter.finish();
+        }
+    });
+    std::remove(EXPORT_FILE);
+}
@@ -0,0 +1,186 @@
+#include "Bench.hpp"
+#include "History/HistoryStorage.hpp"
+#include "History/HistoryWorker.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+// アプリと同じタイルサイズ
+constexpr int TILE_SIZE = 128;
+constexpr size_t TILE_BYTES = static_cast<size_t>(TILE_SIZE) * TILE_SIZE * 4;
+// 書き込み系の計測で履歴ファイルがこれを超えたら空にする(ディスクを使い切らないため)
+constexpr size_t MAX_FILE_BYTES = 256u << 20;
+
+const char* HISTORY_FILE = "bench_history.bin";
+
+// 書き込みキューの予算を使う計測での上限(予算を超えた分が圧縮・待ちの対象になる)
+constexpr size_t QUEUE_BUDGET_BYTES = 16 * TILE_BYTES;
+
+// 下半分に描いたタイル(ストロークの端を含む典型的なタイル)
+std::vector<uint8_t> makeStrokeTile() {
+    std::vector<uint8_t> pixels(TILE_BYTES, 0);
+    for (int y = TILE_SIZE / 2; y < TILE_SIZE; ++y) {
+        for (int x = 0; x < TILE_SIZE; ++x) {
+            uint8_t* p = &pixels[(static_cast<size_t>(y) * TILE_SIZE + x) * 4];
+            p[0] = static_cast<uint8_t>(x * 2);
+            p[1] = static_cast<uint8_t>(y * 2);
+            p[2] = 200;
+            p[3] = 255;
+        }
+    }
+    return pixels;
+}
+
+TileData makeTileData(const std::vector<uint8_t>& pixels, long long i) {
+    TileData data;
+    data.layerID = 0;
+    data.tileX = static_cast<int>(i % 64) * TILE_SIZE;
+    data.tileY = static_cast<int>(i / 64 % 64) * TILE_SIZE;
+    data.stepID = static_cast<int>(i);
+    data.pixels = pixels;
+    return data;
+}
+
+}
+
+void runHistoryBenchmarks(BenchSuite& suite) {
+    const std::vector<uint8_t> strokeTile = makeStrokeTile();
+    const std::vector<uint8_t> blankTile(TILE_BYTES, 0);
+    // 最後の画素だけが不透明(空でないタイルの判定で最も遅い場合)
+    std::vector<uint8_t> lateTile(TILE_BYTES, 0);
+    lateTile[TILE_BYTES - 1] = 255;
+
+    suite.run("history.is_tile_empty.blank", "tile", TILE_BYTES, [&](long long n) {
+        int empty = 0;
+        for (long long i = 0; i < n; ++i) {
+            empty += HistoryStorage::isTileEmpty(blankTile);
+        }
+        if (empty != n) {
+            std::fprintf(stderr, "unexpected isTileEmpty result\n");
+        }
+    });
+    suite.run("history.is_tile_empty.last_pixel", "tile", TILE_BYTES, [&](long long n) {
+        int empty = 0;
+        for (long long i = 0; i < n; ++i) {
+            empty += HistoryStorage::isTileEmpty(lateTile);
+        }
+        if (empty != 0) {
+            std::fprintf(stderr, "unexpected isTileEmpty result\n");
+        }
+    });
+
+    {
+        HistoryStorage storage(HISTORY_FILE, TILE_SIZE);
+        TileData raw = makeTileData(strokeTile, 0);
+        TileData blank = makeTileData(blankTile, 0);
+
+        suite.run("history.storage.write_raw", "tile", TILE_BYTES, [&](long long n) {
+            for (long long i = 0; i < n; ++i) {
+                if (storage.getCurrentOffset() > MAX_FILE_BYTES) {
+                    storage.clear();
+                }
+                storage.writeTile(raw);
+            }
+        });
+        // エンコードスレッド1つあたりの空の判定と圧縮
+        suite.run("history.storage.encode_zlib", "tile", TILE_BYTES, [&](long long n) {
+            size_t total = 0;
+            for (long long i = 0; i < n; ++i) {
+                total += HistoryStorage::encodeTile(makeTileData(strokeTile, i), true).payload.size();
+            }
+            if (total == 0) {
+                std::fprintf(stderr, "unexpected encodeTile result\n");
+            }
+        });
+        suite.run("history.storage.write_empty", "tile", 0.0, [&](long long n) {
+            for (long long i = 0; i < n; ++i) {
+                if (storage.getCurrentOffset() > MAX_FILE_BYTES) {
+                    storage.clear();
+                }
+                storage.writeTile(blank);
+            }
+        });
+
+        // Undo/Redoと同じく、1ステップ分(16タイル)の記録をまとめて読む
+        storage.clear();
+        std::vector<TileRecord> records;
+        for (int i = 0; i < 256; ++i) {
+            records.push_back(storage.writeTile(makeTileData(strokeTile, i)));
+        }
+        constexpr size_t STEP_TILES = 16;
+        size_t next = 0;
+        suite.run("history.storage.read_raw", "tile", TILE_BYTES, [&](long long n) {
+            for (long long done = 0; done < n; ) {
+                size_t count = std::min<size_t>(STEP_TILES, static_cast<size_t>(n - done));
+                std::vector<TileRecord> step;
+                for (size_t k = 0; k < count; ++k) {
+                    step.push_back(records[(next + k) % records.size()]);
+                }
+                next = (next + count) % records.size();
+                std::vector<TileData> tiles = storage.readTiles(step);
+                done += static_cast<long long>(tiles.size());
+            }
+        });
+        storage.clear();
+    }
+
+    // 描画スレッド側のenqueue(タイルのコピーを含む)からワーカーが処理し終えるまで
+    suite.run("history.worker.enqueue", "tile", TILE_BYTES, [&](long long n) {
+        HistoryWorker worker(SIZE_MAX, QueuePolicy::Block, 1);
+        worker.start(
+            [](TileData&& data) {
+                return HistoryStorage::encodeTile(std::move(data), false);
+            },
+            [](const EncodedTile& tile) {
+                TileRecord record{};
+                record.layerID = tile.layerID;
+                return record;
+            });
+        for (long long i = 0; i < n; ++i) {
+            worker.enqueue(makeTileData(strokeTile, i));
+        }
+        worker.waitUntilEmpty();
+    });
+
+    {
+        HistoryStorage storage(HISTORY_FILE, TILE_SIZE);
+        // アプリと同じく圧縮して書き込む
+        // 予算なし、予算を超えたら待つ、予算を超えたら圧縮して積む、エンコードスレッド数を変える
+        const struct {
+            const char* name;
+            size_t budget;
+            QueuePolicy policy;
+            int encoders;
+        } configs[] = {
+            {"history.worker.enqueue_storage", SIZE_MAX, QueuePolicy::Block, 1},
+            {"history.worker.budget_block", QUEUE_BUDGET_BYTES, QueuePolicy::Block, 1},
+            {"history.worker.budget_compress", QUEUE_BUDGET_BYTES, QueuePolicy::Compress, 1},
+            {"history.worker.encoders_2", SIZE_MAX, QueuePolicy::Block, 2},
+            {"history.worker.encoders_4", SIZE_MAX, QueuePolicy::Block, 4},
+            {"history.worker.encoders_8", SIZE_MAX, QueuePolicy::Block, 8},
+        };
+        for (const auto& config : configs) {
+            suite.run(config.name, "tile", TILE_BYTES, [&](long long n) {
+                HistoryWorker worker(config.budget, config.policy, config.encoders);
+                worker.start(
+                    [](TileData&& data) {
+                        return HistoryStorage::encodeTile(std::move(data), true);
+                    },
+                    [&](const EncodedTile& tile) {
+                        if (storage.getCurrentOffset() > MAX_FILE_BYTES) {
+                            storage.clear();
+                        }
+                        return storage.writeEncoded(tile);
+                    });
+                for (long long i = 0; i < n; ++i) {
+                    worker.enqueue(makeTileData(strokeTile, i));
+                }
+                worker.waitUntilEmpty();
+            });
+        }
+        storage.clear();
+    }
+    std::remove(HISTORY_FILE);
+}
@@ -0,0 +1,44 @@
+#include "Bench.hpp"
+#include "Rendering/TileSystem.hpp"
+#include <string>
+
+namespace {
+
+constexpr int CANVAS_SIZE = 16384;
+constexpr int TILE_SIZE = 128;
+// 1ストロークの区間数(ストローク終了でダーティタイルを消去する)
+constexpr long long STROKE_SEGMENTS = 512;
+constexpr float SEGMENT_LENGTH = 8.0f;
+
+}
+
+void runTileBenchmarks(BenchSuite& suite) {
+    // PBOは最初のキャプチャまで作られないため、GLコンテキストは不要
+    TileSystem tiles(CANVAS_SIZE, TILE_SIZE);
+    std::vector<TileCoord> collected;
+
+    // 区間ごとに、描画で変わるタイルを列挙してダーティとして記録する(App::flushStrokeと同じ流れ)
+    for (int brushSize : {4, 32, 128, 512}) {
+        std::string name = "tiles.mark_dirty.size_" + std::to_string(brushSize);
+        suite.run(name, "segment", 0.0, [&](long long n) {
+            float x = 1000.0f;
+            float y = 1000.0f;
+            for (long long i = 0; i < n; ++i) {
+                if (i % STROKE_SEGMENTS == 0) {
+                    tiles.clearDirtyTiles();
+                    x = 1000.0f + static_cast<float>(i / STROKE_SEGMENTS % 8) * 1000.0f;
+                    y = 1000.0f;
+                }
+                // 斜めに進む
+                float nextX = x + SEGMENT_LENGTH * 0.8f;
+                float nextY = y + SEGMENT_LENGTH * 0.6f;
+                collected.clear();
+                tiles.collectTiles(x, y, nextX, nextY, static_cast<float>(brushSize), collected);
+                tiles.markDirtyTiles(collected);
+                x = nextX;
+                y = nextY;
+            }
+            tiles.clearDirtyTiles();
+        });
+    }
+}
@@ -0,0 +1,67 @@
+#include "Bench.hpp"
+#include "Core/HeadlessWindow.hpp"
+#include "Graphics/ShaderCache.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+static void printUsage(const char* name) {
+    std::cerr << "Usage: " << name << " [--filter TEXT] [--json FILE] [--min-time SEC] [--repetitions N]"
+              << " [--quick] [--no-gpu]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    const char* filter = "";
+    const char* jsonPath = "bench.json";
+    double minSeconds = 0.5;
+    int repetitions = 5;
+    bool gpu = true;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            minSeconds = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            repetitions = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--quick") == 0) {
+            minSeconds = 0.05;
+            repetitions = 3;
+        } else if (std::strcmp(argv[i], "--no-gpu") == 0) {
+            gpu = false;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    BenchSuite suite(minSeconds, repetitions, filter);
+    suite.setContext("hardware_threads", std::to_string(std::thread::hardware_concurrency()));
+
+    try {
+        runHistoryBenchmarks(suite);
+        runTileBenchmarks(suite);
+
+        if (gpu) {
+            // 計測がキャッシュの有無に左右されないよう、シェーダーは毎回コンパイルする
+            ShaderCache::setDirectory("");
+            HeadlessWindow window(64, 64);
+            suite.setContext("gl_renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+            suite.setContext("gl_version", reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+            runGpuBenchmarks(suite);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!suite.writeJson(jsonPath)) {
+        return 1;
+    }
+    std::cout << "Results written to " << jsonPath << " (" << suite.getResults().size() << " benchmarks)" << std::endl;
+    return 0;
+}
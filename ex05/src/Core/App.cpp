@@ -1,200 +1,1021 @@
 #include "App.hpp"
-#include "../external/lodepng/lodepng.h"
+#include "GlfwWindow.hpp"
+#include "HeadlessWindow.hpp"
+#include "Graphics/ShaderCache.hpp"
+#include "Profiling/Trace.hpp"
+#include "Replay/StressGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <vector>
-#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <GLFW/glfw3.h>
 
-App::App(int width, int height, const char* title, float canvasSize)
-    : canvasSize(canvasSize) {
-    window = std::make_unique<Window>(width, height, title);
-    inputManager = std::make_unique<InputManager>(window->getHandle());
-    canvas = std::make_unique<Canvas>(static_cast<int>(canvasSize), tileSize);
-    renderer = std::make_unique<Renderer>();
-    brush = std::make_unique<Brush>();
-    historyManager = std::make_unique<HistoryManager>("history.bin", tileSize);
+App::App(const AppConfig& config)
+    : openPath(config.openPath ? config.openPath : ""), savePath(config.savePath), canvasSize(config.canvasSize), maxFrames(config.maxFrames) {
+    // プロジェクトファイルを開くときは、キャンバスサイズをファイルに合わせる
+    if (!openPath.empty() && isProjectFilename(openPath)) {
+        ProjectReader reader;
+        if (reader.open(openPath)) {
+            canvasSize = static_cast<float>(reader.getInfo().canvasSize);
+        }
+    }
+
+    int size = static_cast<int>(canvasSize);
+    if (size <= 0 || size % tileSize != 0) {
+        throw std::invalid_argument("canvas size must be a positive multiple of " + std::to_string(tileSize));
+    }
+
+    if (config.shaderCacheDir) {
+        ShaderCache::setDirectory(config.shaderCacheDir);
+    }
+
+    // 起動から最初のフレームまでをサブシステムごとに計測
+    startup = std::make_unique<StartupProfiler>();
+    {
+        StartupProfiler::Scope scope(*startup, StartupPhase::Window);
+        if (config.headless) {
+            window = std::make_unique<HeadlessWindow>(config.width, config.height);
+        } else {
+            window = std::make_unique<GlfwWindow>(config.width, config.height, config.title);
+            inputManager = std::make_unique<InputManager>(window->getHandle());
+        }
+        // 拡張が無ければ共有コンテキストのワーカーでコンパイルする
+        ShaderCompiler::Mode compileMode = config.shaderCompile;
+        std::unique_ptr<SharedContext> sharedContext;
+        if (compileMode == ShaderCompiler::Mode::Thread ||
+            (compileMode == ShaderCompiler::Mode::Auto && !ShaderCompiler::hasParallelExtension())) {
+            sharedContext = window->createSharedContext();
+        }
+        shaderCompiler = std::make_unique<ShaderCompiler>(compileMode, std::move(sharedContext));
+    }
+
+    // 以降のシェーダーはビルドを発行するだけで、最初に使うときに完了を待つ
+    {
+        StartupProfiler::Scope scope(*startup, StartupPhase::Canvas);
+        canvas = std::make_unique<Canvas>(static_cast<int>(canvasSize), tileSize);
+    }
+    {
+        StartupProfiler::Scope scope(*startup, StartupPhase::Renderer);
+        renderer = std::make_unique<Renderer>();
+    }
+    {
+        StartupProfiler::Scope scope(*startup, StartupPhase::Brush);
+        brush = std::make_unique<Brush>();
+    }
+    {
+        StartupProfiler::Scope scope(*startup, StartupPhase::History);
+        historyManager = std::make_unique<HistoryManager>("history.bin", tileSize, config.historyQueueMB << 20,
+                                                          config.historyQueuePolicy, config.historyEncoders,
+                                                          config.historyCompress);
+    }
+    {
+        StartupProfiler::Scope scope(*startup, StartupPhase::IO);
+        exporter = std::make_unique<ImageExporter>();
+        importer = std::make_unique<ImageImporter>();
+        if (isProjectFilename(savePath)) {
+            // 時間やステップ数では保存せず、Sキーの要求を受けて保存する
+            projectSaver = std::make_unique<Autosaver>(*canvas, savePath, 0.0, 0, SaveTarget::Project);
+        }
+
+        if (config.autosavePath) {
+            std::string autosavePath = config.autosavePath;
+            if (!isProjectFilename(autosavePath) || autosavePath == savePath) {
+                throw std::invalid_argument("autosave file must be a .tpp other than the save file: " + autosavePath);
+            }
+            std::ifstream existing(autosavePath);
+            if (existing.is_open() && autosavePath != openPath) {
+                std::cerr << "Autosave file " << autosavePath << " will be overwritten; open it with --open to recover" << std::endl;
+            }
+            autosaver = std::make_unique<Autosaver>(*canvas, autosavePath, config.autosaveInterval, config.autosaveSteps);
+        }
+    }
+
+    if (config.view) {
+        // ズーム,中心X,中心Y(キャンバスのピクセル座標、左下が原点),回転(度)。省略した値は既定のまま
+        float zoom = 1.0f, x = canvasSize / 2.0f, y = canvasSize / 2.0f, degrees = 0.0f;
+        if (std::sscanf(config.view, "%f,%f,%f,%f", &zoom, &x, &y, &degrees) < 1 || zoom <= 0.0f) {
+            throw std::invalid_argument(std::string("invalid --view: ") + config.view);
+        }
+        inputView.zoom = std::max(ViewTransform::MIN_ZOOM, std::min(zoom, ViewTransform::MAX_ZOOM));
+        inputView.centerX = x / canvasSize * 2.0f - 1.0f;
+        inputView.centerY = y / canvasSize * 2.0f - 1.0f;
+        inputView.rotation = degrees * 3.1415926f / 180.0f;
+    }
+
+    if (config.profile || config.profileCsvPath) {
+        profiler = std::make_unique<FrameProfiler>(config.profileCsvPath ? config.profileCsvPath : "");
+    }
+
+    if (config.stressStrokes > 0) {
+        // 合成したストロークログを1フレームごとに一定数ずつ再生する
+        // (最大速度では1フレームに数千件がまとめて届き、実際の入力とかけ離れた数フレームで終わってしまう)
+        if (config.replayPath) {
+            throw std::invalid_argument("--stress cannot be combined with --replay");
+        }
+        StressGenerator(size, config.stressSeed).write(config.stressLogPath, config.stressStrokes);
+        replayer = std::make_unique<StrokeReplayer>(config.stressLogPath, size);
+        replaySpeed = ReplaySpeed::Frame;
+    } else if (config.replayPath) {
+        replayer = std::make_unique<StrokeReplayer>(config.replayPath, size);
+        replaySpeed = config.replaySpeed;
+    }
+    if (config.stressStrokes > 0 || config.stressReport) {
+        stressReport = std::make_unique<StressReport>();
+    }
+    smoothStrokes = config.smoothStrokes;
+    if (config.recordPath) {
+        recorder = std::make_unique<StrokeRecorder>(config.recordPath, size);
+
+        // 再生時に同じ初期状態から始まるよう、現在のブラシ設定を先頭に記録
+        Command initial;
+        initial.type = CommandType::SetBrush;
+        initial.color[3] = 255;
+        initial.size = brush->getSize();
+        recorder->record(initial);
+        // 補間は既定でOFFのため、ONで記録したログは再生時に切り替えてから始める
+        if (smoothStrokes) {
+            Command smoothing;
+            smoothing.type = CommandType::ToggleSmoothing;
+            recorder->record(smoothing);
+        }
+    }
+}
+
+void App::computeScale(int width, int height, float& scaleX, float& scaleY) {
+    scaleX = 1.0f;
+    scaleY = 1.0f;
+
+    if (width > height) {
+        scaleX = static_cast<float>(height) / static_cast<float>(width);
+    } else {
+        scaleY = static_cast<float>(width) / static_cast<float>(height);
+    }
 }
 
 void App::run() {
-    while (!window->shouldClose()) {
+    window->getFramebufferSize(inputWidth, inputHeight);
+    Command resize;
+    resize.type = CommandType::Resize;
+    resize.width = inputWidth;
+    resize.height = inputHeight;
+    submit(resize);
+    submitView();
+
+    // 再生時はログに記録されたImportで読み込む
+    if (!openPath.empty() && !replayer) {
+        Command import;
+        import.type = CommandType::Import;
+        import.time = glfwGetTime();
+        submit(import);
+    }
+
+    // GLコンテキストを描画スレッドへ移す
+    window->releaseContext();
+    renderRunning = true;
+    renderThread = std::thread(&App::renderLoop, this);
+    replayStart = std::chrono::steady_clock::now();
+
+    // メインスレッド: イベント受付のみを行い、描画やI/Oでは決してブロックしない
+    TRACE_THREAD_NAME("main");
+    while (!window->shouldClose() && renderRunning) {
+        if (replayer && replaySpeed != ReplaySpeed::WallClock && !replayer->atEnd()) {
+            window->pollEvents();
+            std::this_thread::yield();
+        } else {
+            window->waitEvents(1.0 / 240.0);
+        }
+
         int width, height;
         window->getFramebufferSize(width, height);
+        if (width != inputWidth || height != inputHeight) {
+            inputWidth = width;
+            inputHeight = height;
+            Command cmd;
+            cmd.type = CommandType::Resize;
+            cmd.width = width;
+            cmd.height = height;
+            submit(cmd);
+        }
 
-        float scaleX = 1.0f;
-        float scaleY = 1.0f;
+        // ヘッドレスでは入力デバイスが無く、コマンドはsubmitで外部から与える
+        if (inputManager) {
+            float scaleX, scaleY;
+            computeScale(width, height, scaleX, scaleY);
 
-        if (width > height) {
-            scaleX = static_cast<float>(height) / static_cast<float>(width);
-        } else {
-            scaleY = static_cast<float>(width) / static_cast<float>(height);
+            inputManager->update();
+            translateKeyboardInput();
+            translateMouseInput(width, height, scaleX, scaleY);
+        }
+        if (replayer) {
+            pumpReplay();
+        }
+        flushOverflow();
+    }
+
+    Command quit;
+    quit.type = CommandType::Quit;
+    submit(quit);
+    while (!overflow.empty() && renderRunning) {
+        flushOverflow();
+        std::this_thread::yield();
+    }
+
+    if (renderThread.joinable()) {
+        renderThread.join();
+    }
+
+    // 後片付けのためコンテキストをメインスレッドへ戻す
+    window->makeContextCurrent();
+}
+
+void App::submit(const Command& command) {
+    if (!overflow.empty() || !commandQueue.tryPush(command)) {
+        overflow.push_back(command);
+    }
+}
+
+void App::pumpReplay() {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+
+    // フレームごとの再生は、描画スレッドが新しいフレームを終えるたびに決まった数だけ投入する
+    int budget = -1;
+    if (replaySpeed == ReplaySpeed::Frame) {
+        uint64_t frame = renderedFrames.load();
+        budget = frame != replayFrame ? REPLAY_COMMANDS_PER_FRAME : 0;
+        replayFrame = frame;
+    }
+
+    Command cmd;
+    while (!replayer->atEnd()) {
+        if (replaySpeed == ReplaySpeed::WallClock && replayer->peekTime() > elapsed) {
+            break;
+        }
+        if (budget == 0) {
+            break;
+        }
+        // 最大速度でもキューを溢れさせず、描画スレッドの消費に合わせて投入
+        if (replaySpeed == ReplaySpeed::Max
+            && (!overflow.empty() || commandQueue.size() >= commandQueue.capacity() / 2)) {
+            break;
+        }
+        replayer->next(cmd);
+        submit(cmd);
+        if (budget > 0) {
+            budget--;
         }
+    }
+
+    // ヘッドレスでは再生し終えたら終了(投入済みのコマンドは全て実行される)
+    if (replayer->atEnd() && window->isHeadless()) {
+        window->requestClose();
+    }
+}
+
+void App::submitView() {
+    Command cmd;
+    cmd.type = CommandType::SetView;
+    cmd.view = inputView;
+    submit(cmd);
+}
+
+void App::flushOverflow() {
+    while (!overflow.empty() && commandQueue.tryPush(overflow.front())) {
+        overflow.pop_front();
+    }
+}
+
+void App::renderLoop() {
+    TRACE_THREAD_NAME("render");
+    window->makeContextCurrent();
+    startup->beginPhase(StartupPhase::FirstFrame);
+
+    try {
+        int frameCount = 0;
+        while (true) {
+            auto frameStart = std::chrono::steady_clock::now();
+            if (profiler) {
+                profiler->beginFrame();
+            }
+            if (!processCommands()) {
+                if (profiler) {
+                    profiler->endFrame();
+                }
+                break;
+            }
+            {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Import);
+                if (importer->isBusy()) {
+                    importer->update(*historyManager);
+                }
+                markImportedRows();
+            }
+            {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Restore);
+                applyRestoredTiles();
+            }
+
+            float scaleX, scaleY;
+            computeScale(viewWidth, viewHeight, scaleX, scaleY);
 
-        inputManager->update();
-        processInput(width, height, scaleX, scaleY);
-        render(width, height, scaleX, scaleY);
-        canvas->processPendingCaptures(*historyManager);
+            // 表示用シェーダーのビルドが終わるまでは背景だけを表示し、最初のフレームを待たせない
+            if (!displayReady) {
+                displayReady = canvas->isDisplayReady() && renderer->isReady();
+            }
+            if (displayReady) {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Composite);
+                updateDisplay(scaleX, scaleY);
+            }
+
+            {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Render);
+                render(viewWidth, viewHeight, scaleX, scaleY);
+            }
+            {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Captures);
+                canvas->processPendingCaptures(*historyManager);
+            }
+            {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Export);
+                exporter->update();
+                if (projectSaver) {
+                    projectSaver->update(!isDrawing && !isCanvasBusy() && deferredCommands.empty());
+                }
+            }
+            if (autosaver) {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Autosave);
+                // ストロークや読み込みの途中は区切りがつくまで待つ
+                autosaver->update(!isDrawing && !isCanvasBusy() && deferredCommands.empty());
+            }
+            {
+                FrameProfiler::Scope scope(profiler.get(), FramePhase::Swap);
+                TRACE_SCOPE("swapBuffers");
+                window->swapBuffers();
+            }
+            if (profiler) {
+                profiler->endFrame();
+            }
+            if (stressReport) {
+                stressReport->addLatency(LatencyMetric::Frame, std::chrono::duration<double, std::milli>(
+                                                                   std::chrono::steady_clock::now() - frameStart).count());
+                stressReport->sampleFrame(historyManager->getQueueDepth(), canvas->getPendingCaptures());
+            }
+            startup->frameDone(displayReady);
+            renderedFrames++;
+
+            if (maxFrames > 0 && ++frameCount >= maxFrames) {
+                window->requestClose();
+                break;
+            }
+        }
 
-        window->swapBuffers();
-        window->pollEvents();
+        if (isDrawing) {
+            endStroke();
+        }
+        startup->finish();
+        finishRestore();
+        importer->finish(*historyManager);
+        exporter->finish();
+        if (projectSaver) {
+            projectSaver->drain();
+        }
+        if (autosaver) {
+            autosaver->flush();
+        }
+        if (stressReport) {
+            // 履歴ファイルのサイズは書き込みが終わってから数える
+            historyManager->waitForPendingWrites();
+            StressReport::Totals totals;
+            totals.historyFileBytes = historyManager->getFileSize();
+            totals.historyQueue = historyManager->getQueueStats();
+            totals.droppedCaptures = canvas->getDroppedCaptures();
+            stressReport->print(totals);
+        }
+    } catch (const std::exception& e) {
+        // 描画スレッドの例外はメインスレッドへ伝播しないためここで報告
+        std::cerr << "Render thread error: " << e.what() << std::endl;
+    }
+
+    window->releaseContext();
+    renderRunning = false;
+}
+
+bool App::processCommands() {
+    TRACE_SCOPE("App::processCommands");
+    TRACE_COUNTER("commandQueueDepth", commandQueue.size());
+    runDeferredCommands();
+
+    // フレームの開始時点で届いていた分だけ実行する(最大速度の再生などで投入が続いても、
+    // 画面の更新とPBOの回収を止めない)
+    size_t budget = commandQueue.size();
+    Command command;
+    while (budget > 0 && commandQueue.tryPop(command)) {
+        budget--;
+        if (command.type == CommandType::Quit) {
+            // 待たせていたコマンドも実行してから終了する
+            while (!deferredCommands.empty()) {
+                importer->finish(*historyManager);
+                if (projectSaver) {
+                    projectSaver->finish();
+                }
+                if (autosaver) {
+                    autosaver->finish();
+                }
+                finishRestore();
+                markImportedRows();
+                runDeferredCommands();
+            }
+            return false;
+        }
+        // 読み込み中・自動保存のコピー中・Undo/Redoの復元中はキャンバスに触れるコマンドを待たせる(画面の更新は続ける)
+        // 復元中に続けて届いたUndo/Redoは待たせずに復元の列へ加える
+        if (isCanvasBusy() || !deferredCommands.empty()) {
+            if (command.type == CommandType::Resize || command.type == CommandType::SetView
+                || (deferredCommands.empty() && joinsRestore(command))) {
+                executeCommand(command);
+            } else {
+                deferredCommands.push_back(command);
+            }
+            continue;
+        }
+        executeCommand(command);
+    }
+
+    // このフレームで受け取った点をまとめて描画
+    if (isDrawing) {
+        flushStroke();
+    }
+    return true;
+}
+
+bool App::isCanvasBusy() const {
+    return importer->isBusy() || isSaverCapturing() || historyManager->isRestoring();
+}
+
+bool App::isSaverCapturing() const {
+    return (projectSaver && projectSaver->isCapturing()) || (autosaver && autosaver->isCapturing());
+}
+
+bool App::joinsRestore(const Command& command) const {
+    // 復元だけが進行中なら、Undo/Redoは前の復元の後に読み込まれるため順序は崩れない
+    return (command.type == CommandType::Undo || command.type == CommandType::Redo)
+        && !importer->isBusy() && !isSaverCapturing();
+}
+
+void App::runDeferredCommands() {
+    // 読み込みが終わったら、待たせていたコマンドを届いた順に実行(途中で次の読み込みが始まれば中断)
+    while (!deferredCommands.empty() && (!isCanvasBusy() || joinsRestore(deferredCommands.front()))) {
+        Command deferred = deferredCommands.front();
+        deferredCommands.pop_front();
+        executeCommand(deferred);
+    }
+}
+
+void App::executeCommand(const Command& command) {
+    if (recorder) {
+        recorder->record(command);
+    }
+
+    switch (command.type) {
+        case CommandType::StrokeBegin:
+            if (isDrawing) {
+                endStroke();
+            }
+            beginStroke();
+            addStrokePoint({command.x, command.y});
+            break;
+        case CommandType::StrokePoint:
+            if (isDrawing) {
+                addStrokePoint({command.x, command.y});
+            }
+            break;
+        case CommandType::StrokeEnd:
+            if (isDrawing) {
+                addStrokePoint({command.x, command.y});
+                endStroke();
+            }
+            break;
+        case CommandType::SetBrush:
+            if (isDrawing) {
+                endStroke();
+            }
+            brush->setColor(command.color[0], command.color[1], command.color[2], command.color[3]);
+            brush->setSize(command.size);
+            isEraser = command.eraser;
+            break;
+        case CommandType::ToggleStrokeMode: {
+            bool toCapsule = brush->getStrokeMode() == StrokeMode::Stamp;
+            brush->setStrokeMode(toCapsule ? StrokeMode::Capsule : StrokeMode::Stamp);
+            std::cout << "Stroke mode: " << (toCapsule ? "capsule" : "stamp") << std::endl;
+            break;
+        }
+        case CommandType::ToggleSmoothing:
+            smoothStrokes = !smoothStrokes;
+            std::cout << "Stroke smoothing: " << (smoothStrokes ? "on" : "off") << std::endl;
+            break;
+        case CommandType::Save: {
+            FrameProfiler::Scope scope(profiler.get(), FramePhase::Export);
+            saveImage(savePath.c_str());
+            break;
+        }
+        case CommandType::Import: {
+            if (isDrawing) {
+                endStroke();
+            }
+            FrameProfiler::Scope scope(profiler.get(), FramePhase::Import);
+            importImage(openPath.c_str());
+            if (autosaver) {
+                autosaver->countStep();
+            }
+            break;
+        }
+        case CommandType::Undo: {
+            if (isDrawing) {
+                endStroke();
+            }
+            FrameProfiler::Scope scope(profiler.get(), FramePhase::Restore);
+            StressReport::Scope latency(stressReport.get(), LatencyMetric::Undo);
+            // 直前のストロークの描画前タイルがPBOに残っていると、そのステップを取り消せない
+            canvas->processPendingCaptures(*historyManager);
+            if (historyManager->requestUndo()) {
+                beginRestore();
+            }
+            break;
+        }
+        case CommandType::Redo: {
+            if (isDrawing) {
+                endStroke();
+            }
+            FrameProfiler::Scope scope(profiler.get(), FramePhase::Restore);
+            StressReport::Scope latency(stressReport.get(), LatencyMetric::Redo);
+            if (historyManager->requestRedo()) {
+                beginRestore();
+            }
+            break;
+        }
+        case CommandType::AddLayer:
+        case CommandType::SelectLayerUp:
+        case CommandType::SelectLayerDown:
+        case CommandType::ToggleLayerVisibility:
+        case CommandType::LayerOpacityUp:
+        case CommandType::LayerOpacityDown:
+        case CommandType::CycleLayerBlendMode:
+            // ストロークはレイヤーをまたがない
+            if (isDrawing) {
+                endStroke();
+            }
+            executeLayerCommand(command.type);
+            break;
+        case CommandType::SetView:
+            view = command.view;
+            break;
+        case CommandType::Resize:
+            viewWidth = command.width;
+            viewHeight = command.height;
+            break;
+        case CommandType::Quit:
+            break;
     }
 }
 
-void App::processInput(int width, int height, float scaleX, float scaleY) {
-    handleKeyboardInput();
-    handleMouseInput(width, height, scaleX, scaleY);
+void App::executeLayerCommand(CommandType type) {
+    switch (type) {
+        case CommandType::AddLayer:
+            canvas->addLayer();
+            break;
+        case CommandType::SelectLayerUp:
+            canvas->selectLayer(1);
+            break;
+        case CommandType::SelectLayerDown:
+            canvas->selectLayer(-1);
+            break;
+        case CommandType::ToggleLayerVisibility:
+            canvas->toggleLayerVisibility();
+            break;
+        case CommandType::LayerOpacityUp:
+            canvas->adjustLayerOpacity(0.1f);
+            break;
+        case CommandType::LayerOpacityDown:
+            canvas->adjustLayerOpacity(-0.1f);
+            break;
+        case CommandType::CycleLayerBlendMode:
+            canvas->cycleLayerBlendMode();
+            break;
+        default:
+            break;
+    }
 }
 
-void App::handleKeyboardInput() {
+void App::translateKeyboardInput() {
     InputAction action = inputManager->getTriggeredAction();
 
-    static bool ctrlzPressed = false;
-    static bool ctrlyPressed = false;
+    // キーを押し続けても1回だけ発行する
+    if (action == heldAction) {
+        return;
+    }
+    heldAction = action;
+
+    Command cmd;
+    cmd.time = glfwGetTime();
+    cmd.type = CommandType::SetBrush;
+    cmd.size = 30.0f;
     switch (action) {
         case InputAction::SetEraser:
-            brush->setColor(0, 0, 0, 0);
-            brush->setSize(30.0f);
-            isEraser = true;
+            cmd.color[0] = 0; cmd.color[1] = 0; cmd.color[2] = 0; cmd.color[3] = 0;
+            cmd.eraser = true;
             break;
         case InputAction::SetBrushBlack:
-            brush->setColor(0, 0, 0, 255);
-            brush->setSize(30.0f);
-            isEraser = false;
+            cmd.color[0] = 0; cmd.color[1] = 0; cmd.color[2] = 0; cmd.color[3] = 255;
             break;
         case InputAction::SetBrushRed:
-            brush->setColor(255, 0, 0, 255);
-            brush->setSize(30.0f);
-            isEraser = false;
+            cmd.color[0] = 255; cmd.color[1] = 0; cmd.color[2] = 0; cmd.color[3] = 255;
             break;
         case InputAction::SetBrushGreen:
-            brush->setColor(0, 255, 0, 255);
-            brush->setSize(30.0f);
-            isEraser = false;
+            cmd.color[0] = 0; cmd.color[1] = 255; cmd.color[2] = 0; cmd.color[3] = 255;
             break;
         case InputAction::SetBrushBlue:
-            brush->setColor(0, 0, 255, 255);
-            brush->setSize(30.0f);
-            isEraser = false;
+            cmd.color[0] = 0; cmd.color[1] = 0; cmd.color[2] = 255; cmd.color[3] = 255;
             break;
         case InputAction::Save:
-            saveImage("output.png");
+            cmd.type = CommandType::Save;
             break;
-        case InputAction::Undo: {
-            if (!ctrlzPressed) {
-                std::vector<TileData> restore = historyManager->undo();
-                if (!restore.empty()) {
-                    canvas->restoreTiles(restore);
-                }
-                ctrlzPressed = true;
-            }
+        case InputAction::Undo:
+            cmd.type = CommandType::Undo;
             break;
-        }
-        case InputAction::Redo: {
-            if (!ctrlyPressed) {
-                std::vector<TileData> restore = historyManager->redo();
-                if (!restore.empty()) {
-                    canvas->restoreTiles(restore);
-                }
-                ctrlyPressed = true;
-            }
+        case InputAction::Redo:
+            cmd.type = CommandType::Redo;
             break;
-        }
-        default:
-            ctrlzPressed = false;
-            ctrlyPressed = false;
+        case InputAction::ToggleStrokeMode:
+            cmd.type = CommandType::ToggleStrokeMode;
+            break;
+        case InputAction::ToggleSmoothing:
+            cmd.type = CommandType::ToggleSmoothing;
+            break;
+        case InputAction::AddLayer:
+            cmd.type = CommandType::AddLayer;
+            break;
+        case InputAction::SelectLayerUp:
+            cmd.type = CommandType::SelectLayerUp;
+            break;
+        case InputAction::SelectLayerDown:
+            cmd.type = CommandType::SelectLayerDown;
             break;
+        case InputAction::ToggleLayerVisibility:
+            cmd.type = CommandType::ToggleLayerVisibility;
+            break;
+        case InputAction::LayerOpacityUp:
+            cmd.type = CommandType::LayerOpacityUp;
+            break;
+        case InputAction::LayerOpacityDown:
+            cmd.type = CommandType::LayerOpacityDown;
+            break;
+        case InputAction::CycleLayerBlendMode:
+            cmd.type = CommandType::CycleLayerBlendMode;
+            break;
+        case InputAction::RotateViewLeft:
+        case InputAction::RotateViewRight:
+        case InputAction::ResetView:
+            // 表示の変換は入力側で持ち、描画スレッドへは結果だけを送る
+            if (action == InputAction::ResetView) {
+                inputView = ViewTransform{};
+            } else {
+                float step = 15.0f * 3.1415926f / 180.0f;
+                inputView.rotation += action == InputAction::RotateViewLeft ? step : -step;
+            }
+            submitView();
+            return;
+        default:
+            return;
     }
+    submit(cmd);
 }
 
-void App::handleMouseInput(int width, int height, float scaleX, float scaleY) {
+void App::translateMouseInput(int width, int height, float scaleX, float scaleY) {
     const MouseState& mouse = inputManager->getMouseState();
+    bool viewChanged = false;
 
-    if (mouse.leftPressed) {
-        if (mouse.leftJustPressed) {
-            historyManager->incrementStepID();
-            canvas->clearDirtyTiles();
+    // 前回以降の全イベントを発生順にキャンバス座標のコマンドへ変換
+    for (const MouseEvent& ev : mouse.events) {
+        // 座標変換(画面のNDC座標 -> 表示の変換を戻してキャンバスのNDC座標)
+        float ndcX = (static_cast<float>(ev.x) / width) * 2.0f - 1.0f;
+        float ndcY = 1.0f - (static_cast<float>(ev.y) / height) * 2.0f;
+
+        // スペースを押しながらのドラッグは描画せず表示を動かす
+        if (ev.type == MouseEventType::Press && !strokeActive && inputManager->isPanHeld()) {
+            panning = true;
         }
+        if (panning) {
+            if (ev.type != MouseEventType::Press) {
+                inputView.panBy(panLastX, panLastY, ndcX, ndcY, scaleX, scaleY);
+                viewChanged = true;
+            }
+            if (ev.type == MouseEventType::Release) {
+                panning = false;
+            }
+            panLastX = ndcX;
+            panLastY = ndcY;
+            continue;
+        }
+
+        Command cmd;
+        cmd.time = ev.time;
+        inputView.toCanvas(ndcX, ndcY, scaleX, scaleY, cmd.x, cmd.y);
+
+        switch (ev.type) {
+            case MouseEventType::Press:
+                cmd.type = CommandType::StrokeBegin;
+                strokeActive = true;
+                break;
+            case MouseEventType::Move:
+                if (!strokeActive) {
+                    continue;
+                }
+                cmd.type = CommandType::StrokePoint;
+                break;
+            case MouseEventType::Release:
+                if (!strokeActive) {
+                    continue;
+                }
+                cmd.type = CommandType::StrokeEnd;
+                strokeActive = false;
+                break;
+        }
+        submit(cmd);
+    }
 
-        // 座標変換
+    // ホイールでカーソル位置を中心に拡大・縮小
+    if (mouse.scroll != 0.0) {
         float ndcX = (static_cast<float>(mouse.x) / width) * 2.0f - 1.0f;
         float ndcY = 1.0f - (static_cast<float>(mouse.y) / height) * 2.0f;
-        float canvasX = ndcX / scaleX;
-        float canvasY = ndcY / scaleY;
+        inputView.zoomAt(static_cast<float>(std::pow(1.1, mouse.scroll)), ndcX, ndcY, scaleX, scaleY);
+        viewChanged = true;
+    }
+    if (viewChanged) {
+        submitView();
+    }
+}
+
+void App::beginStroke() {
+    historyManager->incrementStepID();
+    canvas->clearDirtyTiles();
+    brush->beginStroke();
+    smoother.reset();
+    pendingPoints.clear();
+    hasLastPoint = false;
+    isDrawing = true;
+}
+
+void App::addStrokePoint(const StrokePoint& p) {
+    if (smoothStrokes) {
+        float spacing = (brush->getSize() / canvasSize) * 2.0f * 0.25f;
+        smoother.push(p, spacing, pendingPoints);
+    } else {
+        pendingPoints.push_back(p);
+    }
+}
 
-        bool inside = (canvasX >= -1.0f && canvasX <= 1.0f && canvasY >= -1.0f && canvasY <= 1.0f);
+void App::flushStroke() {
+    if (pendingPoints.empty()) {
+        return;
+    }
+
+    // 描画する区間を(始点, 終点)の組で列挙
+    std::vector<StrokePoint> segments;
+    segments.reserve(pendingPoints.size() * 2);
+    for (const StrokePoint& p : pendingPoints) {
+        bool inside = (p.x >= -1.0f && p.x <= 1.0f && p.y >= -1.0f && p.y <= 1.0f);
         if (inside) {
-            canvas->bind();
-            glViewport(0, 0, static_cast<int>(canvasSize), static_cast<int>(canvasSize));
+            StrokePoint start = hasLastPoint ? StrokePoint{lastX, lastY} : p;
+            segments.push_back(start);
+            segments.push_back(p);
+        }
+        lastX = p.x;
+        lastY = p.y;
+        hasLastPoint = true;
+    }
+    pendingPoints.clear();
 
-            if (isEraser) {
-                glBlendFunc(GL_ONE, GL_ZERO);
-            } else {
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            }
+    if (segments.empty()) {
+        return;
+    }
 
-            float pxCurrentX = (canvasX + 1.0f) / 2.0f * canvasSize;
-            float pxCurrentY = (canvasY + 1.0f) / 2.0f * canvasSize;
-            float pxLastX = (lastX + 1.0f) / 2.0f * canvasSize;
-            float pxLastY = (lastY + 1.0f) / 2.0f * canvasSize;
+    FrameProfiler::Scope scope(profiler.get(), FramePhase::Stroke);
+    TRACE_SCOPE("App::flushStroke");
+    canvas->bind();
+    glViewport(0, 0, static_cast<int>(canvasSize), static_cast<int>(canvasSize));
 
-            if (!isDrawing) {
-                pxLastX = pxCurrentX;
-                pxLastY = pxCurrentY;
-            }
+    if (isEraser) {
+        glBlendFunc(GL_ONE, GL_ZERO);
+    } else {
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
 
-            // ダーティタイルをマーク
-            float brushRadius = brush->getSize();
-            canvas->markDirtyTiles(
-                isDrawing ? pxLastX : pxCurrentX,
-                isDrawing ? pxLastY : pxCurrentY,
-                pxCurrentX, pxCurrentY, brushRadius);
+    // ダーティタイルをマーク(描画前に全区間分)
+    float brushRadius = brush->getSize();
+    for (size_t i = 0; i < segments.size(); i += 2) {
+        canvas->markDirtyTiles(
+            (segments[i].x + 1.0f) / 2.0f * canvasSize,
+            (segments[i].y + 1.0f) / 2.0f * canvasSize,
+            (segments[i + 1].x + 1.0f) / 2.0f * canvasSize,
+            (segments[i + 1].y + 1.0f) / 2.0f * canvasSize,
+            brushRadius);
+    }
 
-            // ダーティタイルのPBOキャプチャを開始
-            canvas->capturePendingTiles(historyManager->getCurrentStepID());
+    // ダーティタイルのPBOキャプチャを開始
+    canvas->capturePendingTiles(historyManager->getCurrentStepID(), *historyManager);
 
-            brush->begin();
-            if (isDrawing) {
-                brush->drawLine(lastX, lastY, canvasX, canvasY, canvasSize);
-            } else {
-                brush->drawLine(canvasX, canvasY, canvasX, canvasY, canvasSize);
-            }
+    brush->begin();
+    brush->drawSegments(segments, canvasSize);
 
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            canvas->unbind();
-        }
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    canvas->unbind();
+}
 
-        lastX = canvasX;
-        lastY = canvasY;
-        isDrawing = true;
-        wasDrawing = true;
-    } else {
-        if (wasDrawing && canvas->hasDirtyTiles()) {
-            canvas->saveAfterTiles(*historyManager);
+void App::endStroke() {
+    StressReport::Scope latency(stressReport.get(), LatencyMetric::StrokeEnd);
+    if (smoothStrokes) {
+        float spacing = (brush->getSize() / canvasSize) * 2.0f * 0.25f;
+        smoother.finish(spacing, pendingPoints);
+    }
+    flushStroke();
+
+    if (canvas->hasDirtyTiles()) {
+        FrameProfiler::Scope scope(profiler.get(), FramePhase::StrokeEnd);
+        canvas->saveAfterTiles(*historyManager);
+        if (autosaver) {
+            autosaver->countStep();
         }
-        isDrawing = false;
-        wasDrawing = false;
     }
+    isDrawing = false;
+}
+
+void App::updateDisplay(float scaleX, float scaleY) {
+    // 画面に映るタイルだけを表示用ミップマップへ反映する(映っていないタイルは映ったときに反映)
+    float minX, minY, maxX, maxY;
+    if (!view.getVisibleBounds(scaleX, scaleY, minX, minY, maxX, maxY)) {
+        canvas->updateDisplay(0, 0, 0, 0);
+        return;
+    }
+    int x0 = static_cast<int>(std::floor((minX + 1.0f) / 2.0f * canvasSize));
+    int y0 = static_cast<int>(std::floor((minY + 1.0f) / 2.0f * canvasSize));
+    int x1 = static_cast<int>(std::ceil((maxX + 1.0f) / 2.0f * canvasSize));
+    int y1 = static_cast<int>(std::ceil((maxY + 1.0f) / 2.0f * canvasSize));
+    canvas->updateDisplay(x0, y0, x1 - x0, y1 - y0);
 }
 
 void App::render(int width, int height, float scaleX, float scaleY) {
+    TRACE_SCOPE("App::render");
     renderer->setViewport(width, height);
     renderer->clear(200, 200, 200, 255);
-    renderer->renderCanvas(canvas->getTexture(), scaleX, scaleY);
+    if (!displayReady) {
+        return;
+    }
+    renderer->renderCanvas(canvas->getDisplayTexture(), view, scaleX, scaleY);
 }
 
 void App::saveImage(const char* filename) {
-    std::vector<uint8_t> pixels = canvas->readPixels();
+    TRACE_SCOPE("App::saveImage");
 
-    // 画像を上下反転
+    if (isProjectFilename(filename)) {
+        saveProject(filename);
+        return;
+    }
+
+    // 全レイヤーを合成して保存する。GPUからの読み出しとエンコードは非同期に進み、描画は止まらない
     int size = static_cast<int>(canvasSize);
-    std::vector<uint8_t> flippedPixels(size * size * 4);
-    for (int y = 0; y < size; ++y) {
-        memcpy(&flippedPixels[y * size * 4],
-               &pixels[(size - 1 - y) * size * 4],
-               size * 4);
+    exporter->begin(canvas->flatten(), size, size, tileSize, filename);
+}
+
+void App::beginRestore() {
+    // 連続したUndo/Redoは最初の要求から最後のタイルの反映までを1回の復元として計る
+    if (!restorePending) {
+        restorePending = true;
+        restoreStart = std::chrono::steady_clock::now();
     }
+    if (autosaver) {
+        autosaver->countStep();
+    }
+}
+
+void App::applyRestoredTiles() {
+    if (!restorePending) {
+        return;
+    }
+    TRACE_SCOPE("App::applyRestoredTiles");
+    // 読み込めたタイルから反映する(1フレームで反映する枚数を抑え、画面の更新を止めない)
+    std::vector<TileData> tiles;
+    if (historyManager->takeRestoredTiles(tiles, RESTORE_TILES_PER_FRAME, false)) {
+        canvas->restoreTiles(tiles);
+    }
+    if (!historyManager->isRestoring()) {
+        endRestore();
+    }
+}
+
+void App::finishRestore() {
+    if (!restorePending) {
+        return;
+    }
+    std::vector<TileData> tiles;
+    while (historyManager->takeRestoredTiles(tiles, RESTORE_TILES_PER_FRAME, true)) {
+        canvas->restoreTiles(tiles);
+    }
+    endRestore();
+}
+
+void App::endRestore() {
+    restorePending = false;
+    if (stressReport) {
+        stressReport->addLatency(LatencyMetric::Restore, std::chrono::duration<double, std::milli>(
+                                                             std::chrono::steady_clock::now() - restoreStart).count());
+    }
+}
 
-    unsigned error = lodepng::encode(filename, flippedPixels, static_cast<unsigned>(size), static_cast<unsigned>(size));
-    if (error) {
-        // throwせずユーザーに保存の再試行の機会を与える
-        std::cerr << "Error saving image: " << lodepng_error_text(error) << std::endl;
+void App::markImportedRows() {
+    // 読み込み先はアクティブレイヤーなので、アップロードした帯だけ合成・表示を作り直す
+    int pixelY, height;
+    if (importer->takeUploadedRows(pixelY, height)) {
+        canvas->markActiveLayerRows(pixelY, height);
+    }
+}
+
+void App::importImage(const char* filename) {
+    TRACE_SCOPE("App::importImage");
+    if (filename[0] == '\0') {
+        std::cerr << "No image to import (use --open FILE)" << std::endl;
+        return;
+    }
+
+    if (isProjectFilename(filename)) {
+        loadProject(filename);
+        return;
+    }
+
+    // デコードはワーカーで進み、帯ごとのアップロードは以降のフレームに分散される
+    int size = static_cast<int>(canvasSize);
+    // 読み込み先はアクティブレイヤー
+    importer->begin(canvas->getTexture(), canvas->getActiveLayerID(), canvas->getTileSystem(), size, tileSize,
+                    filename, *historyManager);
+}
+
+void App::saveProject(const std::string& filename) {
+    TRACE_SCOPE("App::saveProject");
+    if (!projectSaver || filename != projectSaver->getFilename()) {
+        std::cerr << "Projects can only be saved to the --save file: " << filename << std::endl;
+        return;
+    }
+    // 自動保存と同じく、タイルはアトラスとPBOを通して数フレームに分けて読み出し、1024タイルずつ書き込む
+    // ストロークの途中なら、描き終えてから読み出す
+    projectSaver->requestSave(!isDrawing);
+}
+
+void App::loadProject(const std::string& filename) {
+    TRACE_SCOPE("App::loadProject");
+    // 読み込み前の履歴は別のレイヤー構成を指すため、空の文書にだけ開ける
+    if (historyManager->canUndo() || historyManager->canRedo()) {
+        std::cerr << "Projects can only be opened into an empty document: " << filename << std::endl;
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    ProjectReader reader;
+    if (!reader.open(filename)) {
+        return;
+    }
+    const ProjectInfo& info = reader.getInfo();
+    if (info.canvasSize != static_cast<int>(canvasSize) || info.tileSize != tileSize) {
+        std::cerr << "Project " << filename << " is " << info.canvasSize << "px with " << info.tileSize
+                  << "px tiles; expected " << canvasSize << "px with " << tileSize << "px tiles" << std::endl;
+        return;
+    }
+
+    std::vector<LayerProperties> properties;
+    for (const ProjectLayer& layer : info.layers) {
+        BlendMode mode = layer.blendMode < static_cast<uint8_t>(BlendMode::Count)
+            ? static_cast<BlendMode>(layer.blendMode) : BlendMode::Normal;
+        properties.push_back({layer.id, layer.opacity, layer.visible, mode});
+    }
+    canvas->resetLayers(properties, info.activeIndex);
+
+    size_t loaded = 0;
+    reader.readTiles([&](int layerID, int tileX, int tileY, const uint8_t* pixels) {
+        canvas->uploadLayerTile(layerID, tileX, tileY, pixels);
+        loaded++;
+    });
+
+    // 次の保存はこのファイルへの差分になる
+    if (projectSaver && filename == projectSaver->getFilename()) {
+        projectSaver->adopt(reader.getIndex());
+    }
+    if (autosaver && filename == autosaver->getFilename()) {
+        // 自動保存のファイルから復元したなら、読み込んだタイルを保存し直さない
+        std::map<int, std::set<TileCoord>> loadedTiles;
+        canvas->takeUnsavedTiles(SaveTarget::Autosave, loadedTiles);
+        autosaver->adopt(reader.getIndex());
     }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Project loaded: " << filename << " (" << info.layers.size() << " layers, "
+              << loaded << " tiles, " << ms << " ms)" << std::endl;
 }
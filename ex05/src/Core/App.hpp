@@ -1,40 +1,150 @@
 #pragma once
 #include <memory>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <chrono>
+#include <string>
 #include "Window.hpp"
+#include "Graphics/ShaderCompiler.hpp"
+#include "AppConfig.hpp"
 #include "InputManager.hpp"
+#include "Command.hpp"
+#include "CommandQueue.hpp"
 #include "Rendering/Canvas.hpp"
 #include "Rendering/Renderer.hpp"
 #include "Tools/Brush.hpp"
+#include "Tools/StrokeSmoother.hpp"
 #include "History/HistoryManager.hpp"
+#include "Replay/StrokeRecorder.hpp"
+#include "Replay/StrokeReplayer.hpp"
+#include "Profiling/FrameProfiler.hpp"
+#include "Profiling/StartupProfiler.hpp"
+#include "Profiling/StressReport.hpp"
+#include "IO/ImageExporter.hpp"
+#include "IO/ImageImporter.hpp"
+#include "IO/ProjectFile.hpp"
+#include "IO/Autosaver.hpp"
 
 class App {
 public:
-    App(int width, int height, const char* title, float canvasSize);
+    explicit App(const AppConfig& config);
     ~App() = default;
 
     void run();
     void saveImage(const char* filename);
+    void importImage(const char* filename);
+
+    // 描画スレッドへコマンドを送る(メインスレッド専用、ブロックしない)
+    void submit(const Command& command);
 
 private:
     std::unique_ptr<Window> window;
+    std::unique_ptr<ShaderCompiler> shaderCompiler;  // シェーダーより後に破棄する
     std::unique_ptr<InputManager> inputManager;
     std::unique_ptr<Canvas> canvas;
     std::unique_ptr<Renderer> renderer;
     std::unique_ptr<Brush> brush;
     std::unique_ptr<HistoryManager> historyManager;
+    std::unique_ptr<ImageExporter> exporter;
+    std::unique_ptr<ImageImporter> importer;
+    std::unique_ptr<Autosaver> projectSaver;  // Sキーでの.tppへの保存(保存先が.tppでなければnullptr)
+    std::unique_ptr<Autosaver> autosaver;  // 無効時はnullptr
+
+    // ストロークログ(記録は描画スレッド、再生はメインスレッドで扱う)
+    std::unique_ptr<StrokeRecorder> recorder;
+    std::unique_ptr<StrokeReplayer> replayer;
+    ReplaySpeed replaySpeed = ReplaySpeed::WallClock;
+    std::chrono::steady_clock::time_point replayStart;
+    // ReplaySpeed::Frameで1フレームに投入するコマンド数(1000Hzのマウスで60fpsのときの点の数)
+    static constexpr int REPLAY_COMMANDS_PER_FRAME = 16;
+    std::atomic<uint64_t> renderedFrames{0};  // 描画スレッドが終えたフレーム数
+    uint64_t replayFrame = 0;                 // 最後に投入したときのrenderedFrames
+
+    // フレームプロファイラ(無効時はnullptr)
+    std::unique_ptr<FrameProfiler> profiler;
+    // 起動時間の計測(常に有効、最初にキャンバスを表示した後に1度だけ出力)
+    std::unique_ptr<StartupProfiler> startup;
+    // 負荷時の遅延・メモリの集計(--stress、--stress-report。無効時はnullptr)
+    std::unique_ptr<StressReport> stressReport;
 
+    std::string openPath;
+    std::string savePath;
     float canvasSize;
     const int tileSize = 128;
+    int maxFrames = 0;
+
+    // スレッド間通信
+    CommandQueue<Command> commandQueue{8192};
+    std::deque<Command> overflow;  // キュー満杯時にメインスレッドで保持
+    std::thread renderThread;
+    std::atomic<bool> renderRunning{false};
+
+    // --- メインスレッド(入力)側の状態 ---
+    int inputWidth = 0;
+    int inputHeight = 0;
+    bool strokeActive = false;
+    InputAction heldAction = InputAction::None;  // 押し続けているキーの操作(1回だけ発行する)
+    ViewTransform inputView;     // 入力の逆変換に使う表示の変換(変えたらSetViewで描画スレッドへ送る)
+    bool panning = false;
+    float panLastX = 0.0f;       // パン中の直前のカーソル(画面のNDC座標)
+    float panLastY = 0.0f;
+
+    void translateKeyboardInput();
+    void translateMouseInput(int width, int height, float scaleX, float scaleY);
+    void submitView();
+    void flushOverflow();
+    void pumpReplay();
+
+    // --- 描画スレッド側の状態 ---
+    int viewWidth = 0;
+    int viewHeight = 0;
+    ViewTransform view;
+    bool displayReady = false;  // 表示用シェーダーのビルドが完了した
 
     // 描画状態
     bool isDrawing = false;
-    bool wasDrawing = false;
     bool isEraser = false;
+    bool hasLastPoint = false;
     float lastX = 0.0f;
     float lastY = 0.0f;
 
-    void processInput(int width, int height, float scaleX, float scaleY);
-    void handleKeyboardInput();
-    void handleMouseInput(int width, int height, float scaleX, float scaleY);
+    // 画像読み込み中・自動保存のコピー中・Undo/Redoの復元中に届いたコマンド(完了後に順に実行)
+    std::deque<Command> deferredCommands;
+
+    // Undo/Redoの復元: 復元スレッドが読み込んだタイルを毎フレーム最大RESTORE_TILES_PER_FRAME枚反映する
+    static constexpr size_t RESTORE_TILES_PER_FRAME = 128;
+    bool restorePending = false;
+    std::chrono::steady_clock::time_point restoreStart;
+
+    // 入力点の補間
+    bool smoothStrokes = false;
+    StrokeSmoother smoother;
+    std::vector<StrokePoint> pendingPoints;
+
+    void renderLoop();
+    bool processCommands();
+    void runDeferredCommands();
+    bool isCanvasBusy() const;
+    bool isSaverCapturing() const;  // 保存のためにタイルをアトラスへコピー中
+    bool joinsRestore(const Command& command) const;
+    void beginRestore();
+    void applyRestoredTiles();
+    void finishRestore();
+    void endRestore();
+    void markImportedRows();
+    void saveProject(const std::string& filename);
+    void loadProject(const std::string& filename);
+    void updateDisplay(float scaleX, float scaleY);
+    void executeCommand(const Command& command);
+    void executeLayerCommand(CommandType type);
     void render(int width, int height, float scaleX, float scaleY);
+
+    // ストローク処理
+    void beginStroke();
+    void addStrokePoint(const StrokePoint& p);
+    void flushStroke();
+    void endStroke();
+
+    static void computeScale(int width, int height, float& scaleX, float& scaleY);
 };
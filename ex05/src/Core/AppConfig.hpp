@@ -0,0 +1,67 @@
+#pragma once
+#include "Replay/StrokeReplayer.hpp"
+#include "Graphics/ShaderCompiler.hpp"
+#include "History/HistoryTypes.hpp"
+
+// 起動時オプション
+struct AppConfig {
+    int width = 800;
+    int height = 600;
+    const char* title = "tinyPaint";
+    float canvasSize = 4096.0f;
+
+    // ヘッドレス(EGL pbuffer)で起動
+    bool headless = false;
+
+    // 指定フレーム数描画したら終了(0なら無制限)
+    int maxFrames = 0;
+
+    // ストロークログの記録先・再生元(nullptrなら無効)
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    ReplaySpeed replaySpeed = ReplaySpeed::WallClock;
+
+    // 履歴の書き込みキューの上限(MB)と、超えたときの動作
+    size_t historyQueueMB = 64;
+    QueuePolicy historyQueuePolicy = QueuePolicy::Block;
+    // 描画前タイルをエンコードするスレッド数(0ならハードウェアスレッド数の半分)と、zlibで圧縮するか
+    int historyEncoders = 0;
+    bool historyCompress = true;
+
+    // 負荷試験: 合成したストローク数(0なら無効)、乱数のシード、生成したログの書き出し先
+    int stressStrokes = 0;
+    uint32_t stressSeed = 1;
+    const char* stressLogPath = "stress.tpsl";
+    // 終了時に遅延・メモリを出力(--stressでは常に有効。通常の操作や--replayでも使える)
+    bool stressReport = false;
+
+    // フレームプロファイラ(CSVパスが指定されればフレームごとに出力)
+    bool profile = false;
+    const char* profileCsvPath = nullptr;
+
+    // ストロークのスプライン補間(既定はOFF。Lキーでも切り替えられる)
+    bool smoothStrokes = false;
+
+    // 起動時に読み込む画像(.png/.qoi/.rgba、nullptrなら空のキャンバス)
+    const char* openPath = nullptr;
+
+    // Sキーでの保存先(拡張子.png/.qoi/.rgbaで形式を選択)
+    const char* savePath = "output.png";
+
+    // 自動保存先(.tpp、nullptrなら無効)と間隔(秒、履歴のステップ数。0ならその条件では保存しない)
+    const char* autosavePath = nullptr;
+    double autosaveInterval = 60.0;
+    int autosaveSteps = 0;
+
+    // 起動時の表示の変換("ズーム,中心X,中心Y,回転(度)"、nullptrなら全体表示)
+    const char* view = nullptr;
+
+    // シェーダーのバイナリキャッシュの置き場所(nullptrなら既定の場所、空文字列なら無効)
+    const char* shaderCacheDir = nullptr;
+
+    // シェーダーのコンパイル方法(並列拡張・共有コンテキストのワーカー・同期)
+    ShaderCompiler::Mode shaderCompile = ShaderCompiler::Mode::Auto;
+
+    // Chrome trace JSONの出力先(TRACE=1でビルドした場合のみ有効)
+    const char* tracePath = nullptr;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include "Rendering/ViewTransform.hpp"
+
+// 入力スレッドから描画スレッドへ送るコマンドの種類
+enum class CommandType : uint8_t {
+    StrokeBegin,
+    StrokePoint,
+    StrokeEnd,
+    SetBrush,
+    ToggleStrokeMode,
+    ToggleSmoothing,
+    Undo,
+    Redo,
+    Save,
+    Import,  // 起動時に--openで指定した画像を読み込む
+    AddLayer,
+    SelectLayerUp,
+    SelectLayerDown,
+    ToggleLayerVisibility,
+    LayerOpacityUp,
+    LayerOpacityDown,
+    CycleLayerBlendMode,
+    SetView,  // 表示の変換(記録しない)
+    Resize,
+    Quit
+};
+
+// 描画スレッドへのコマンド(リングバッファに載せるため固定長)
+struct Command {
+    CommandType type = CommandType::Quit;
+    double time = 0.0;       // 入力発生時刻(glfwGetTime()の秒)
+
+    // StrokeBegin/StrokePoint/StrokeEnd: キャンバスのNDC座標
+    float x = 0.0f;
+    float y = 0.0f;
+
+    // SetBrush
+    uint8_t color[4] = {0, 0, 0, 255};
+    float size = 0.0f;
+    bool eraser = false;
+
+    // SetView: 入力側で更新した表示の変換
+    ViewTransform view;
+
+    // Resize: フレームバッファサイズ
+    int width = 0;
+    int height = 0;
+};
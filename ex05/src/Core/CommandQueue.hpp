@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+// 単一プロデューサ・単一コンシューマのロックフリーリングバッファ
+// プロデューサとコンシューマはそれぞれ1スレッドに限る
+template <typename T>
+class CommandQueue {
+public:
+    // capacityは2の冪
+    explicit CommandQueue(size_t capacity)
+        : buffer(capacity), mask(capacity - 1) {
+        if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("CommandQueue capacity must be a power of two");
+        }
+    }
+
+    // コピー禁止
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // 満杯ならfalseを返し、呼び出し側をブロックしない
+    bool tryPush(const T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_acquire);
+        if (h - t == buffer.size()) {
+            return false;
+        }
+        buffer[h & mask] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 空ならfalse
+    bool tryPop(T& out) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t h = head.load(std::memory_order_acquire);
+        if (t == h) {
+            return false;
+        }
+        out = buffer[t & mask];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return buffer.size(); }
+
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t mask;
+
+    // 偽共有を避けるため別キャッシュラインに配置
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
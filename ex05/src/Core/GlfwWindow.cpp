@@ -0,0 +1,86 @@
+#include "GlfwWindow.hpp"
+#include <cstdlib>
+
+namespace {
+
+// 非表示の1x1ウィンドウのコンテキスト
+// GLFWのウィンドウはメインスレッドで作成・破棄する必要がある
+class GlfwSharedContext : public SharedContext {
+public:
+    explicit GlfwSharedContext(GLFWwindow* window) : window(window) {}
+    ~GlfwSharedContext() override { glfwDestroyWindow(window); }
+    void makeCurrent() override { glfwMakeContextCurrent(window); }
+    void release() override { glfwMakeContextCurrent(nullptr); }
+
+private:
+    GLFWwindow* window;
+};
+
+}
+
+GlfwWindow::GlfwWindow(int width, int height, const char* title) {
+    if (!glfwInit()) {
+        throw std::runtime_error("glfwInit dailed");
+    }
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+
+    window = glfwCreateWindow(width, height, title, nullptr, nullptr);
+    if (!window) {
+        glfwTerminate();
+        throw std::runtime_error("glfwCreateWindow dailed");
+    }
+    glfwMakeContextCurrent(window);
+
+    glewInit();
+}
+
+GlfwWindow::~GlfwWindow() {
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
+
+bool GlfwWindow::shouldClose() const {
+    return glfwWindowShouldClose(window);
+}
+
+void GlfwWindow::requestClose() {
+    glfwSetWindowShouldClose(window, GLFW_TRUE);
+    glfwPostEmptyEvent();
+}
+
+void GlfwWindow::swapBuffers() {
+    glfwSwapBuffers(window);
+}
+
+void GlfwWindow::pollEvents() {
+    glfwPollEvents();
+}
+
+void GlfwWindow::waitEvents(double timeoutSeconds) {
+    glfwWaitEventsTimeout(timeoutSeconds);
+}
+
+void GlfwWindow::makeContextCurrent() {
+    glfwMakeContextCurrent(window);
+}
+
+void GlfwWindow::releaseContext() {
+    glfwMakeContextCurrent(nullptr);
+}
+
+std::unique_ptr<SharedContext> GlfwWindow::createSharedContext() {
+    // コンテキストのバージョンは本体と同じヒントのまま
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* shared = glfwCreateWindow(1, 1, "", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    if (!shared) {
+        return nullptr;
+    }
+    return std::make_unique<GlfwSharedContext>(shared);
+}
+
+void GlfwWindow::getFramebufferSize(int& width, int& height) const {
+    glfwGetFramebufferSize(window, &width, &height);
+}
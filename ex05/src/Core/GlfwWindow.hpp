@@ -0,0 +1,26 @@
+#pragma once
+#include "Window.hpp"
+
+// GLFWによる画面表示ありのウィンドウ
+class GlfwWindow : public Window {
+public:
+    GlfwWindow(int width, int height, const char* title);
+    ~GlfwWindow() override;
+
+    bool shouldClose() const override;
+    void requestClose() override;
+    void swapBuffers() override;
+    void pollEvents() override;
+    void waitEvents(double timeoutSeconds) override;
+
+    void makeContextCurrent() override;
+    void releaseContext() override;
+
+    void getFramebufferSize(int& width, int& height) const override;
+    std::unique_ptr<SharedContext> createSharedContext() override;
+    GLFWwindow* getHandle() const override { return window; }
+    bool isHeadless() const override { return false; }
+
+private:
+    GLFWwindow* window;
+};
@@ -0,0 +1,166 @@
+#include "HeadlessWindow.hpp"
+#include <EGL/eglext.h>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// 1x1のpbufferをカレントにする共有コンテキスト
+class EglSharedContext : public SharedContext {
+public:
+    EglSharedContext(EGLDisplay display, EGLSurface surface, EGLContext context)
+        : display(display), surface(surface), context(context) {}
+    ~EglSharedContext() override {
+        eglDestroyContext(display, context);
+        eglDestroySurface(display, surface);
+    }
+    void makeCurrent() override {
+        if (!eglMakeCurrent(display, surface, surface, context)) {
+            throw std::runtime_error("eglMakeCurrent failed (shared context)");
+        }
+    }
+    void release() override {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    }
+
+private:
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+};
+
+// GlfwWindowと同じGL 4.1(Core)を要求
+const EGLint contextAttribs[] = {
+    EGL_CONTEXT_MAJOR_VERSION, 4,
+    EGL_CONTEXT_MINOR_VERSION, 1,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+    EGL_NONE
+};
+
+}
+
+HeadlessWindow::HeadlessWindow(int width, int height)
+    : width(width), height(height) {
+    display = openDisplay();
+    if (display == EGL_NO_DISPLAY) {
+        throw std::runtime_error("eglGetDisplay failed");
+    }
+
+    EGLint major, minor;
+    if (!eglInitialize(display, &major, &minor)) {
+        throw std::runtime_error("eglInitialize failed");
+    }
+
+    // デスクトップOpenGL(ESではない)を使用
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        eglTerminate(display);
+        throw std::runtime_error("eglBindAPI(EGL_OPENGL_API) failed");
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+        eglTerminate(display);
+        throw std::runtime_error("eglChooseConfig failed");
+    }
+
+    // Rendererがデフォルトフレームバッファへ描画するためpbufferを用意
+    const EGLint surfaceAttribs[] = {
+        EGL_WIDTH, width,
+        EGL_HEIGHT, height,
+        EGL_NONE
+    };
+    surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE) {
+        eglTerminate(display);
+        throw std::runtime_error("eglCreatePbufferSurface failed");
+    }
+
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        eglDestroySurface(display, surface);
+        eglTerminate(display);
+        throw std::runtime_error("eglCreateContext failed (OpenGL 4.1 core required)");
+    }
+
+    makeContextCurrent();
+
+    // GLXを前提としたGLEWはGLXディスプレイが無いとエラーを返すが、
+    // その時点でコアの関数ポインタは取得済みのため戻り値は無視する
+    glewExperimental = GL_TRUE;
+    glewInit();
+    glGetError();
+
+    std::cout << "Headless context: " << glGetString(GL_RENDERER)
+              << " (" << glGetString(GL_VERSION) << ")" << std::endl;
+}
+
+HeadlessWindow::~HeadlessWindow() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglDestroySurface(display, surface);
+    eglTerminate(display);
+}
+
+EGLDisplay HeadlessWindow::openDisplay() {
+    // Mesaのsurfacelessプラットフォームを優先し、無ければ既定のディスプレイ
+    const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+    if (extensions && getPlatformDisplay
+        && std::strstr(extensions, "EGL_MESA_platform_surfaceless")) {
+        EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (d != EGL_NO_DISPLAY) {
+            return d;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+void HeadlessWindow::swapBuffers() {
+    eglSwapBuffers(display, surface);
+}
+
+void HeadlessWindow::waitEvents(double timeoutSeconds) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(timeoutSeconds));
+}
+
+void HeadlessWindow::makeContextCurrent() {
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        throw std::runtime_error("eglMakeCurrent failed");
+    }
+}
+
+void HeadlessWindow::releaseContext() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+std::unique_ptr<SharedContext> HeadlessWindow::createSharedContext() {
+    const EGLint surfaceAttribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    EGLSurface sharedSurface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (sharedSurface == EGL_NO_SURFACE) {
+        return nullptr;
+    }
+    EGLContext sharedContext = eglCreateContext(display, config, context, contextAttribs);
+    if (sharedContext == EGL_NO_CONTEXT) {
+        eglDestroySurface(display, sharedSurface);
+        return nullptr;
+    }
+    return std::make_unique<EglSharedContext>(display, sharedSurface, sharedContext);
+}
+
+void HeadlessWindow::getFramebufferSize(int& w, int& h) const {
+    w = width;
+    h = height;
+}
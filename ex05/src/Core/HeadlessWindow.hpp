@@ -0,0 +1,37 @@
+#pragma once
+#include <EGL/egl.h>
+#include <atomic>
+#include "Window.hpp"
+
+// EGLのpbufferによる画面なしのGLコンテキスト
+// ディスプレイのないLinux環境(llvmpipe等)で描画パイプラインを動かすために使う
+class HeadlessWindow : public Window {
+public:
+    HeadlessWindow(int width, int height);
+    ~HeadlessWindow() override;
+
+    bool shouldClose() const override { return closeRequested.load(); }
+    void requestClose() override { closeRequested = true; }
+    void swapBuffers() override;
+    void pollEvents() override {}
+    void waitEvents(double timeoutSeconds) override;
+
+    void makeContextCurrent() override;
+    void releaseContext() override;
+
+    void getFramebufferSize(int& width, int& height) const override;
+    std::unique_ptr<SharedContext> createSharedContext() override;
+    GLFWwindow* getHandle() const override { return nullptr; }
+    bool isHeadless() const override { return true; }
+
+private:
+    int width;
+    int height;
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLSurface surface = EGL_NO_SURFACE;
+    EGLConfig config = nullptr;
+    EGLContext context = EGL_NO_CONTEXT;
+    std::atomic<bool> closeRequested{false};
+
+    static EGLDisplay openDisplay();
+};
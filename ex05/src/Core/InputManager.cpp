@@ -2,18 +2,66 @@
 
 InputManager::InputManager(GLFWwindow* window)
     : window(window) {
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+
+    // フレーム単位のポーリングでは中間の移動が失われるため、コールバックで全イベントを記録
+    glfwSetWindowUserPointer(window, this);
+    glfwSetCursorPosCallback(window, cursorPosCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetScrollCallback(window, scrollCallback);
+}
+
+void InputManager::cursorPosCallback(GLFWwindow* window, double x, double y) {
+    auto* self = static_cast<InputManager*>(glfwGetWindowUserPointer(window));
+    self->cursorX = x;
+    self->cursorY = y;
+    self->pendingEvents.push_back({MouseEventType::Move, x, y, glfwGetTime()});
+}
+
+void InputManager::mouseButtonCallback(GLFWwindow* window, int button, int action, int /*mods*/) {
+    if (button != GLFW_MOUSE_BUTTON_LEFT) {
+        return;
+    }
+    auto* self = static_cast<InputManager*>(glfwGetWindowUserPointer(window));
+    if (action == GLFW_PRESS) {
+        self->leftDown = true;
+        self->pendingEvents.push_back({MouseEventType::Press, self->cursorX, self->cursorY, glfwGetTime()});
+    } else if (action == GLFW_RELEASE) {
+        self->leftDown = false;
+        self->pendingEvents.push_back({MouseEventType::Release, self->cursorX, self->cursorY, glfwGetTime()});
+    }
+}
+
+void InputManager::scrollCallback(GLFWwindow* window, double /*xOffset*/, double yOffset) {
+    auto* self = static_cast<InputManager*>(glfwGetWindowUserPointer(window));
+    self->pendingScroll += yOffset;
 }
 
 void InputManager::update() {
-    // マウス状態更新
-    glfwGetCursorPos(window, &mouseState.x, &mouseState.y);
-    bool currentLeftPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    // 溜まったイベントをこのフレームのバッチとして引き渡す
+    mouseState.events.clear();
+    mouseState.events.swap(pendingEvents);
 
-    mouseState.leftJustPressed = currentLeftPressed && !prevLeftPressed;
-    mouseState.leftJustReleased = !currentLeftPressed && prevLeftPressed;
-    mouseState.leftPressed = currentLeftPressed;
+    mouseState.x = cursorX;
+    mouseState.y = cursorY;
+    mouseState.scroll = pendingScroll;
+    pendingScroll = 0.0;
 
-    prevLeftPressed = currentLeftPressed;
+    bool justPressed = false;
+    bool justReleased = false;
+    for (const auto& ev : mouseState.events) {
+        if (ev.type == MouseEventType::Press) {
+            justPressed = true;
+        } else if (ev.type == MouseEventType::Release) {
+            justReleased = true;
+        }
+    }
+
+    mouseState.leftJustPressed = justPressed || (leftDown && !prevLeftPressed);
+    mouseState.leftJustReleased = justReleased || (!leftDown && prevLeftPressed);
+    mouseState.leftPressed = leftDown;
+
+    prevLeftPressed = leftDown;
 }
 
 bool InputManager::isKeyPressed(int key) const {
@@ -27,6 +75,10 @@ bool InputManager::isKeyTriggered(int key) {
     return currentPressed && !wasPressed;
 }
 
+bool InputManager::isPanHeld() const {
+    return isKeyPressed(GLFW_KEY_SPACE);
+}
+
 bool InputManager::isCtrlPressed() const {
     return isKeyPressed(GLFW_KEY_LEFT_CONTROL) || isKeyPressed(GLFW_KEY_RIGHT_CONTROL);
 }
@@ -59,6 +111,42 @@ InputAction InputManager::getTriggeredAction() const {
     if (isKeyPressed(GLFW_KEY_B)) {
         return InputAction::SetBrushBlue;
     }
+    if (isKeyPressed(GLFW_KEY_M)) {
+        return InputAction::ToggleStrokeMode;
+    }
+    if (isKeyPressed(GLFW_KEY_L)) {
+        return InputAction::ToggleSmoothing;
+    }
+    if (isKeyPressed(GLFW_KEY_N)) {
+        return InputAction::AddLayer;
+    }
+    if (isKeyPressed(GLFW_KEY_UP)) {
+        return InputAction::SelectLayerUp;
+    }
+    if (isKeyPressed(GLFW_KEY_DOWN)) {
+        return InputAction::SelectLayerDown;
+    }
+    if (isKeyPressed(GLFW_KEY_H)) {
+        return InputAction::ToggleLayerVisibility;
+    }
+    if (isKeyPressed(GLFW_KEY_RIGHT_BRACKET)) {
+        return InputAction::LayerOpacityUp;
+    }
+    if (isKeyPressed(GLFW_KEY_LEFT_BRACKET)) {
+        return InputAction::LayerOpacityDown;
+    }
+    if (isKeyPressed(GLFW_KEY_K)) {
+        return InputAction::CycleLayerBlendMode;
+    }
+    if (isKeyPressed(GLFW_KEY_LEFT)) {
+        return InputAction::RotateViewLeft;
+    }
+    if (isKeyPressed(GLFW_KEY_RIGHT)) {
+        return InputAction::RotateViewRight;
+    }
+    if (isKeyPressed(GLFW_KEY_F)) {
+        return InputAction::ResetView;
+    }
 
     return InputAction::None;
 }
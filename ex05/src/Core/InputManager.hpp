@@ -2,6 +2,7 @@
 #include <GLFW/glfw3.h>
 #include <functional>
 #include <unordered_map>
+#include <vector>
 
 // 入力アクションの種類
 enum class InputAction {
@@ -13,7 +14,33 @@ enum class InputAction {
     SetBrushRed,
     SetBrushGreen,
     SetBrushBlue,
-    SetEraser
+    SetEraser,
+    ToggleStrokeMode,
+    ToggleSmoothing,
+    AddLayer,
+    SelectLayerUp,
+    SelectLayerDown,
+    ToggleLayerVisibility,
+    LayerOpacityUp,
+    LayerOpacityDown,
+    CycleLayerBlendMode,
+    RotateViewLeft,
+    RotateViewRight,
+    ResetView
+};
+
+// マウスイベントの種類
+enum class MouseEventType {
+    Move,
+    Press,
+    Release
+};
+
+// コールバックで記録したマウスイベント(ウィンドウ座標)
+struct MouseEvent {
+    MouseEventType type;
+    double x, y;
+    double time;  // glfwGetTime()の秒
 };
 
 // マウス状態
@@ -23,6 +50,12 @@ struct MouseState {
     bool leftPressed = false;
     bool leftJustPressed = false;   // このフレームで押された
     bool leftJustReleased = false;  // このフレームで離された
+
+    // 前回のupdate以降に発生した全イベント(発生順)
+    std::vector<MouseEvent> events;
+
+    // 前回のupdate以降のホイールの回転量(上が正)
+    double scroll = 0.0;
 };
 
 class InputManager {
@@ -37,11 +70,25 @@ public:
     // マウス入力
     const MouseState& getMouseState() const { return mouseState; }
 
+    // 押している間は左ドラッグで描画せず表示を動かす(スペースキー)
+    bool isPanHeld() const;
+
 private:
     GLFWwindow* window;
     MouseState mouseState;
     bool prevLeftPressed = false;
 
+    // フレーム間にコールバックで溜めたイベント
+    std::vector<MouseEvent> pendingEvents;
+    double cursorX = 0.0;
+    double cursorY = 0.0;
+    bool leftDown = false;
+    double pendingScroll = 0.0;
+
+    static void cursorPosCallback(GLFWwindow* window, double x, double y);
+    static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+    static void scrollCallback(GLFWwindow* window, double xOffset, double yOffset);
+
     // キー状態管理(トリガー検出用)
     std::unordered_map<int, bool> prevKeyState;
 
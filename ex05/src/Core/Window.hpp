@@ -2,19 +2,33 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <memory>
+#include "Graphics/SharedContext.hpp"
 
+// GLコンテキストと表示先を抽象化するインターフェース
+// 画面表示あり(GlfwWindow)とヘッドレス(HeadlessWindow)の2実装がある
 class Window {
 public:
-    Window(int width, int height, const char* title);
-    ~Window();
+    virtual ~Window() = default;
 
-    bool shouldClose() const;
-    void swapBuffers();
-    void pollEvents();
+    virtual bool shouldClose() const = 0;
+    virtual void requestClose() = 0;
+    virtual void swapBuffers() = 0;
+    virtual void pollEvents() = 0;
 
-    void getFramebufferSize(int& width, int& height) const;
-    GLFWwindow* getHandle() const { return window; }
+    // イベントが届くかタイムアウトするまで待機
+    virtual void waitEvents(double timeoutSeconds) = 0;
 
-private:
-    GLFWwindow* window;
+    // GLコンテキストを呼び出しスレッドでカレントにする/手放す
+    virtual void makeContextCurrent() = 0;
+    virtual void releaseContext() = 0;
+
+    virtual void getFramebufferSize(int& width, int& height) const = 0;
+
+    // 描画用コンテキストと共有する別スレッド用のコンテキスト(メインスレッドで呼ぶ、作れなければnullptr)
+    virtual std::unique_ptr<SharedContext> createSharedContext() = 0;
+
+    // ヘッドレスではnullptr
+    virtual GLFWwindow* getHandle() const = 0;
+    virtual bool isHeadless() const = 0;
 };
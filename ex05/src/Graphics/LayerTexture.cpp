@@ -10,10 +10,18 @@ LayerTexture::LayerTexture(int width, int height)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void LayerTexture::allocate() {
+    if (allocated) {
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, textureId);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
                  GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-
     glBindTexture(GL_TEXTURE_2D, 0);
+    allocated = true;
 }
 
 LayerTexture::~LayerTexture() {
@@ -23,10 +31,11 @@ LayerTexture::~LayerTexture() {
 }
 
 LayerTexture::LayerTexture(LayerTexture&& other) noexcept
-    : textureId(other.textureId), width(other.width), height(other.height) {
+    : textureId(other.textureId), width(other.width), height(other.height), allocated(other.allocated) {
     other.textureId = 0;
     other.width = 0;
     other.height = 0;
+    other.allocated = false;
 }
 
 LayerTexture& LayerTexture::operator=(LayerTexture&& other) noexcept {
@@ -37,9 +46,11 @@ LayerTexture& LayerTexture::operator=(LayerTexture&& other) noexcept {
         textureId = other.textureId;
         width = other.width;
         height = other.height;
+        allocated = other.allocated;
         other.textureId = 0;
         other.width = 0;
         other.height = 0;
+        other.allocated = false;
     }
     return *this;
 }
@@ -65,20 +76,3 @@ void LayerTexture::clear(float r, float g, float b, float a) {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glDeleteFramebuffers(1, &tempFbo);
 }
-
-std::vector<uint8_t> LayerTexture::readAllPixels() const {
-    std::vector<uint8_t> pixels(width * height * 4);
-
-    // 一時的なFBOを使用して読み取り
-    GLuint tempFbo;
-    glGenFramebuffers(1, &tempFbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, tempFbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureId, 0);
-
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glDeleteFramebuffers(1, &tempFbo);
-
-    return pixels;
-}
@@ -1,9 +1,9 @@
 #pragma once
 #include <GL/glew.h>
-#include <vector>
 #include <cstdint>
 
 // レイヤーテクスチャ: 描画データを格納する2次元メモリ領域
+// 画素の領域(width*height*4バイト)はallocate()まで確保しない
 class LayerTexture {
 public:
     LayerTexture(int width, int height);
@@ -21,17 +21,19 @@ public:
     int getWidth() const { return width; }
     int getHeight() const { return height; }
 
+    // 画素の領域を確保する(内容は未定義。確保済みなら何もしない)
+    void allocate();
+    bool isAllocated() const { return allocated; }
+
     // タイルの部分更新
     void updateTile(int x, int y, int tileWidth, int tileHeight, const uint8_t* data);
 
     // 全体クリア
     void clear(float r, float g, float b, float a);
 
-    // 全ピクセル読み取り
-    std::vector<uint8_t> readAllPixels() const;
-
 private:
     GLuint textureId = 0;
     int width = 0;
     int height = 0;
+    bool allocated = false;
 };
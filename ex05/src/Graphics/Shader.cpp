@@ -1,125 +1,79 @@
 #include "Shader.hpp"
+#include "ShaderCache.hpp"
+#include <stdexcept>
 
-Shader::Shader(const char* vertexSource, const char* fragmentSource, const std::string& cacheFilePath) {
-    bool loadSuccess = loadFromBinary(cacheFilePath);
-
-    if (!loadSuccess) {
-        compileFromSource(vertexSource, fragmentSource);
-        saveBinary(cacheFilePath);
-    }
-}
-
-bool Shader::loadFromBinary(const std::string& cacheFilePath) {
-    std::ifstream ifs(cacheFilePath, std::ios::binary);
-
+Shader::Shader(const char* vertexSource, const char* fragmentSource, const std::string& cacheName)
+    : cacheName(cacheName) {
     ID = glCreateProgram();
-    
-    if (ifs.is_open()) {
-        GLenum format;
-        GLsizei length;
-
-        ifs.read(reinterpret_cast<char *>(&format), sizeof(format));
-        ifs.read(reinterpret_cast<char *>(&length), sizeof(length));
-
-        if (length > 0) {
-            std::vector<char> buffer(length);
-            ifs.read(buffer.data(), length);
-
-            glProgramBinary(ID, format, buffer.data(), length);
 
-            GLint ok;
-            glGetProgramiv(ID, GL_LINK_STATUS, &ok);
+    cacheKey = ShaderCache::makeKey(vertexSource, fragmentSource);
+    if (ShaderCache::load(ID, cacheName, cacheKey)) {
+        ready = true;
+        return;
+    }
 
-            if (ok) {
-                std::cout << "Successfully loaded program from binary cache: " << cacheFilePath << std::endl;
-                ifs.close();
-                return true;
-            }
-        }
-        ifs.close();
+    ShaderCompiler* compiler = ShaderCompiler::getActive();
+    if (compiler && compiler->getMode() == ShaderCompiler::Mode::Thread) {
+        job = compiler->submit(ID, vertexSource, fragmentSource, cacheName, cacheKey);
+    } else {
+        ShaderCompiler::startBuild(ID, vertexSource, fragmentSource, vertex, fragment);
     }
-    std::cout << "Cache file not found or unreadable. Compiling from source..." << std::endl;
-    return false;
 }
 
-void Shader::compileFromSource(const char* vertexSource, const char* fragmentSource) {
-    unsigned int vertex, fragment;
-
-    // Vertex Shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vertexSource, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
-
-    // Fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fragmentSource, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
-
-    // Shader Program
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
-
-    // リンク後に個別のシェーダーオブジェクトは不要になるので削除
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    std::cout << "Successfully compiled and linked program from source." << std::endl;
+bool Shader::isReady() const {
+    if (ready) {
+        return true;
+    }
+    if (job) {
+        return ShaderCompiler::getActive()->isDone(*job);
+    }
+    ShaderCompiler* compiler = ShaderCompiler::getActive();
+    if (!compiler || compiler->getMode() != ShaderCompiler::Mode::Parallel) {
+        // 完了を問い合わせる手段がないため、使うときに待つ
+        return true;
+    }
+    GLint completed = GL_FALSE;
+    glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
 }
 
-void Shader::saveBinary(const std::string& cacheFilePath) {
-    GLint formats = 0;
-    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
-
-    if (formats > 0) {
-        GLint length = 0;
-        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
-
-        if (length > 0) {
-            std::vector<char> buffer(length);
-            GLenum format = 0;
-
-            glGetProgramBinary(ID, length, NULL, &format, buffer.data());
+void Shader::wait() const {
+    if (ready) {
+        return;
+    }
+    ready = true;
 
-            std::ofstream ofs(cacheFilePath, std::ios::binary);
-            if (ofs.is_open()) {
-                ofs.write(reinterpret_cast<char *>(&format), sizeof(format));
-                ofs.write(reinterpret_cast<char *>(&length), sizeof(length));
-                ofs.write(buffer.data(), length);
-                std::cout << "Shader binary successfully saved to: " << cacheFilePath << std::endl;
-                ofs.close();
-                return;
-            }
+    std::string error;
+    if (job) {
+        ShaderCompiler::getActive()->wait(*job);
+        error = job->error;
+        job.reset();
+    } else {
+        error = ShaderCompiler::finishBuild(ID, vertex, fragment);
+        vertex = fragment = 0;
+        if (error.empty()) {
+            ShaderCache::store(ID, cacheName, cacheKey);
         }
     }
-    std::cout << "Binary saving skipped." << std::endl;
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    std::cout << "Successfully compiled and linked program from source: " << cacheName << std::endl;
 }
 
 void Shader::use() const {
+    wait();
     glUseProgram(ID);
 }
 
 Shader::~Shader() {
+    // ワーカーがまだプログラムに触れている間は削除しない
+    if (job && ShaderCompiler::getActive()) {
+        ShaderCompiler::getActive()->wait(*job);
+    }
+    if (vertex != 0) {
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+    }
     glDeleteProgram(ID);
 }
-
-void Shader::checkCompileErrors(unsigned int shader, std::string type) {
-    int success;
-    char infoLog[1024];
-
-    if (type != "PROGRAM") {
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-            throw std::runtime_error("Shader compilation error: " + std::string(infoLog));
-        }
-    } else {
-        glGetProgramiv(shader, GL_LINK_STATUS, &success);
-        if (!success) {
-            glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-            throw std::runtime_error("Program linking error: " + std::string(infoLog));
-        }
-    }
-}
\ No newline at end of file
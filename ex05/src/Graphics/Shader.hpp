@@ -3,24 +3,37 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <vector>
+#include "ShaderCompiler.hpp"
 
 class Shader {
     public:
         unsigned int ID; // Shader program ID
 
-        // コンストラクタでソースコードを受けとり、ビルドする
-        Shader(const char* vertexSource, const char* fragmentSource, const std::string& cacheFilePath);
+        // コンストラクタでソースコードを受けとり、ビルドを開始する(完了は最初のuse()まで待たない)
+        // cacheName: バイナリキャッシュのエントリ名(ShaderCache)
+        Shader(const char* vertexSource, const char* fragmentSource, const std::string& cacheName);
 
-        // シェーダー有効化
+        // シェーダー有効化(ビルド中なら完了まで待つ)
         void use() const;
 
+        // ビルドが完了したか(待たない)
+        bool isReady() const;
+
+        // ビルドの完了を待つ(失敗していればruntime_error)
+        void wait() const;
+
         // デストラクタでシェーダーを削除
         ~Shader();
     
     private:
-        bool loadFromBinary(const std::string& cacheFilePath);
-        void compileFromSource(const char* vertexSource, const char* fragmentSource);
-        void saveBinary(const std::string& cacheFilePath);
-        void checkCompileErrors(unsigned int shader, std::string type);
+        std::string cacheName;
+        uint64_t cacheKey = 0;
+
+        // ビルド中の状態(use()から完了させるためmutable)
+        mutable bool ready = false;
+        mutable GLuint vertex = 0;    // Parallel/Sync: リンク結果の確認まで保持
+        mutable GLuint fragment = 0;
+        mutable std::shared_ptr<ShaderCompiler::Job> job;  // Thread: ワーカーの処理
 };
@@ -0,0 +1,277 @@
+#include "ShaderCache.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// エントリのヘッダー(32バイト、キャッシュは同じマシンでしか読まないためホストのバイト順)
+// "TPSB"、バージョン、キー(u64)、バイナリフォーマット、バイナリの長さ、バイナリのCRC-32、予約
+constexpr char MAGIC[4] = {'T', 'P', 'S', 'B'};
+constexpr uint32_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 32;
+
+// この日数読まれていないエントリは削除する(読み込むたびに更新日時を進める)
+constexpr int UNUSED_DAYS = 30;
+// エントリの合計がこれを超えたら、読まれていない順に削除する
+constexpr uintmax_t MAX_TOTAL_BYTES = 64ull * 1024 * 1024;
+
+std::mutex mutex;
+std::string directory = ShaderCache::defaultDirectory();
+bool prepared = false;
+
+uint64_t fnv1a(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t fnv1a(uint64_t hash, const char* text) {
+    // 区切りの0も含め、"ab"+"c"と"a"+"bc"を別のキーにする
+    return fnv1a(hash, text ? text : "", (text ? std::strlen(text) : 0) + 1);
+}
+
+const char* glString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+std::string entryPath(const std::string& name, uint64_t key) {
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+    return directory + "/" + name + "-" + hex + ".bin";
+}
+
+
+// 初回の読み書きの前にディレクトリを作り、書きかけの一時ファイルと長く使われていないエントリを削除する
+// 残ったエントリの合計が上限を超えていれば、更新日時の古い(長く読まれていない)ものから削除する
+void prepare() {
+    if (prepared) {
+        return;
+    }
+    prepared = true;
+    if (directory.empty()) {
+        return;
+    }
+
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Shader cache disabled: cannot create " << directory << " (" << ec.message() << ")" << std::endl;
+        directory.clear();
+        return;
+    }
+
+    struct Entry {
+        fs::path path;
+        fs::file_time_type modified;
+        uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t totalBytes = 0;
+
+    auto now = fs::file_time_type::clock::now();
+    int removed = 0;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::path& path = it->path();
+        std::string filename = path.filename().string();
+        bool isTemporary = filename.find(".tmp") != std::string::npos;
+        if (!isTemporary && path.extension() != ".bin") {
+            continue;
+        }
+        std::error_code timeError;
+        auto modified = fs::last_write_time(path, timeError);
+        if (timeError) {
+            continue;
+        }
+        // 一時ファイルは別のプロセスが書いている途中かもしれないため、1時間経ったものだけ消す
+        auto limit = isTemporary ? std::chrono::hours(1) : std::chrono::hours(24 * UNUSED_DAYS);
+        if (now - modified > limit) {
+            if (fs::remove(path, timeError)) {
+                removed++;
+            }
+            continue;
+        }
+        if (!isTemporary) {
+            uintmax_t size = fs::file_size(path, timeError);
+            if (!timeError) {
+                entries.push_back({path, modified, size});
+                totalBytes += size;
+            }
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.modified < b.modified; });
+    for (const Entry& entry : entries) {
+        if (totalBytes <= MAX_TOTAL_BYTES) {
+            break;
+        }
+        std::error_code removeError;
+        if (fs::remove(entry.path, removeError)) {
+            totalBytes -= entry.size;
+            removed++;
+        }
+    }
+    if (removed > 0) {
+        std::cout << "Shader cache: evicted " << removed << " unused entries from " << directory << std::endl;
+    }
+}
+
+void removeEntry(const std::string& path, const char* reason) {
+    std::cerr << "Shader cache entry " << path << " " << reason << "; removing" << std::endl;
+    std::remove(path.c_str());
+}
+
+}
+
+namespace ShaderCache {
+
+void setDirectory(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(mutex);
+    directory = dir;
+    prepared = false;
+}
+
+std::string defaultDirectory() {
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) {
+        return std::string(xdg) + "/tinyPaint/shaders";
+    }
+    const char* home = std::getenv("HOME");
+    if (home && *home) {
+        return std::string(home) + "/.cache/tinyPaint/shaders";
+    }
+    return "shader_cache";
+}
+
+uint64_t makeKey(const char* vertexSource, const char* fragmentSource) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = fnv1a(hash, vertexSource);
+    hash = fnv1a(hash, fragmentSource);
+    hash = fnv1a(hash, glString(GL_VENDOR));
+    hash = fnv1a(hash, glString(GL_RENDERER));
+    hash = fnv1a(hash, glString(GL_VERSION));
+    return hash;
+}
+
+bool load(GLuint program, const std::string& name, uint64_t key) {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        prepare();
+        if (directory.empty()) {
+            return false;
+        }
+        path = entryPath(name, key);
+    }
+
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open()) {
+        std::cout << "Shader cache miss: " << name << ". Compiling from source..." << std::endl;
+        return false;
+    }
+    std::streamoff fileSize = ifs.tellg();
+    ifs.seekg(0);
+
+    char header[HEADER_SIZE];
+    uint32_t version = 0, format = 0, length = 0, crc = 0;
+    uint64_t storedKey = 0;
+    if (fileSize < static_cast<std::streamoff>(HEADER_SIZE) || !ifs.read(header, HEADER_SIZE)) {
+        removeEntry(path, "is truncated");
+        return false;
+    }
+    std::memcpy(&version, header + 4, 4);
+    std::memcpy(&storedKey, header + 8, 8);
+    std::memcpy(&format, header + 16, 4);
+    std::memcpy(&length, header + 20, 4);
+    std::memcpy(&crc, header + 24, 4);
+    if (std::memcmp(header, MAGIC, 4) != 0 || version != VERSION || storedKey != key ||
+        fileSize != static_cast<std::streamoff>(HEADER_SIZE + length) || length == 0) {
+        removeEntry(path, "has an invalid header");
+        return false;
+    }
+
+    std::vector<char> binary(length);
+    if (!ifs.read(binary.data(), length) ||
+        crc32(0L, reinterpret_cast<const Bytef*>(binary.data()), length) != crc) {
+        removeEntry(path, "failed the checksum");
+        return false;
+    }
+    ifs.close();
+
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(length));
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        removeEntry(path, "was rejected by the driver");
+        return false;
+    }
+
+    // 使われているエントリは削除の対象にならないよう更新日時を進める
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    std::cout << "Successfully loaded program from binary cache: " << path << std::endl;
+    return true;
+}
+
+void store(GLuint program, const std::string& name, uint64_t key) {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (formats <= 0 || length <= 0) {
+        std::cout << "Binary saving skipped." << std::endl;
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    char header[HEADER_SIZE] = {};
+    uint32_t size = static_cast<uint32_t>(length);
+    uint32_t crc = static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(binary.data()), size));
+    uint32_t binaryFormat = static_cast<uint32_t>(format);
+    std::memcpy(header, MAGIC, 4);
+    std::memcpy(header + 4, &VERSION, 4);
+    std::memcpy(header + 8, &key, 8);
+    std::memcpy(header + 16, &binaryFormat, 4);
+    std::memcpy(header + 20, &size, 4);
+    std::memcpy(header + 24, &crc, 4);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    prepare();
+    if (directory.empty()) {
+        return;
+    }
+
+    // 同時に起動した別のプロセスと衝突しないようPID付きの一時ファイルへ書き、renameで置き換える
+    std::string path = entryPath(name, key);
+    std::string tmpName = path + ".tmp" + std::to_string(getpid());
+    std::ofstream ofs(tmpName, std::ios::binary | std::ios::trunc);
+    ofs.write(header, HEADER_SIZE);
+    ofs.write(binary.data(), size);
+    ofs.close();
+    if (ofs.fail() || std::rename(tmpName.c_str(), path.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        std::cerr << "Failed to write shader cache entry: " << path << std::endl;
+        return;
+    }
+    std::cout << "Shader binary successfully saved to: " << path << std::endl;
+}
+
+}
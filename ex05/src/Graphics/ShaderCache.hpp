@@ -0,0 +1,31 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+
+// シェーダープログラムのバイナリキャッシュ
+//
+// エントリは「名前-キー.bin」としてキャッシュディレクトリに置く。
+// キーはシェーダーのソースとドライバ(GL_VENDOR/GL_RENDERER/GL_VERSION)のハッシュで、
+// ソースの変更やドライバの更新があれば別のエントリとなり、古いものは読まれない。
+// ヘッダーにキー・フォーマット・長さ・CRC-32を持ち、一致しないエントリは削除する。
+// 不要になったエントリは、読まれない期間と合計サイズの上限による古い順(LRU)の削除で消える。
+namespace ShaderCache {
+
+// キャッシュの置き場所(空文字列なら無効)。最初のシェーダーを作る前に呼ぶ
+void setDirectory(const std::string& directory);
+
+// 既定の置き場所($XDG_CACHE_HOME/tinyPaint/shaders、なければ~/.cache/tinyPaint/shaders)
+std::string defaultDirectory();
+
+// ソースと現在のコンテキストのドライバからキーを求める
+uint64_t makeKey(const char* vertexSource, const char* fragmentSource);
+
+// エントリをprogramへ読み込む(無い・壊れている・ドライバが受け付けないときはfalse)
+bool load(GLuint program, const std::string& name, uint64_t key);
+
+// リンク済みのprogramをエントリとして書き込む(同じ名前でキーの違うエントリは残す)
+// 古いエントリは初回の読み書きの前に、長く読まれていないものと合計サイズの上限を超えた分を古い順に削除する
+void store(GLuint program, const std::string& name, uint64_t key);
+
+}
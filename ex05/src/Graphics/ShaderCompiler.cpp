@@ -0,0 +1,175 @@
+#include "ShaderCompiler.hpp"
+#include "ShaderCache.hpp"
+#include "Profiling/Trace.hpp"
+#include <iostream>
+
+ShaderCompiler* ShaderCompiler::active = nullptr;
+
+ShaderCompiler::ShaderCompiler(Mode requested, std::unique_ptr<SharedContext> context)
+    : mode(requested), sharedContext(std::move(context)) {
+    bool parallel = hasParallelExtension();
+    if (mode == Mode::Auto) {
+        mode = parallel ? Mode::Parallel : (sharedContext ? Mode::Thread : Mode::Sync);
+    } else if (mode == Mode::Parallel && !parallel) {
+        std::cerr << "parallel_shader_compile is not supported; compiling synchronously" << std::endl;
+        mode = Mode::Sync;
+    } else if (mode == Mode::Thread && !sharedContext) {
+        std::cerr << "Shared context unavailable; compiling synchronously" << std::endl;
+        mode = Mode::Sync;
+    }
+
+    if (mode == Mode::Parallel) {
+        // コンパイラスレッド数は実装に任せる
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        } else {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        }
+    } else if (mode == Mode::Thread) {
+        worker = std::thread(&ShaderCompiler::workerLoop, this);
+    }
+    if (mode != Mode::Thread) {
+        sharedContext.reset();
+    }
+    active = this;
+    std::cout << "Shader compile mode: " << modeName(mode) << std::endl;
+}
+
+ShaderCompiler::~ShaderCompiler() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAdded.notify_all();
+        worker.join();
+    }
+    if (active == this) {
+        active = nullptr;
+    }
+}
+
+bool ShaderCompiler::hasParallelExtension() {
+    return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+}
+
+const char* ShaderCompiler::modeName(Mode mode) {
+    switch (mode) {
+        case Mode::Auto: return "auto";
+        case Mode::Parallel: return "parallel";
+        case Mode::Thread: return "thread";
+        case Mode::Sync: return "sync";
+    }
+    return "unknown";
+}
+
+void ShaderCompiler::startBuild(GLuint program, const char* vertexSource, const char* fragmentSource,
+                                GLuint& vertex, GLuint& fragment) {
+    vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vertexSource, NULL);
+    glCompileShader(vertex);
+
+    fragment = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(fragment, 1, &fragmentSource, NULL);
+    glCompileShader(fragment);
+
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    glLinkProgram(program);
+}
+
+std::string ShaderCompiler::finishBuild(GLuint program, GLuint vertex, GLuint fragment) {
+    TRACE_SCOPE("ShaderCompiler::finishBuild");
+    char infoLog[1024];
+    std::string error;
+
+    // GL_LINK_STATUSの問い合わせがリンクの完了を待つ
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLuint shaders[2] = {vertex, fragment};
+        for (GLuint shader : shaders) {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success) {
+                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+                error = "Shader compilation error: " + std::string(infoLog);
+                break;
+            }
+        }
+        if (error.empty()) {
+            glGetProgramInfoLog(program, 1024, NULL, infoLog);
+            error = "Program linking error: " + std::string(infoLog);
+        }
+    }
+
+    // リンク後に個別のシェーダーオブジェクトは不要になるので削除
+    glDetachShader(program, vertex);
+    glDetachShader(program, fragment);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+    return error;
+}
+
+std::shared_ptr<ShaderCompiler::Job> ShaderCompiler::submit(GLuint program, const char* vertexSource,
+                                                            const char* fragmentSource,
+                                                            const std::string& cacheName, uint64_t cacheKey) {
+    auto job = std::make_shared<Job>();
+    job->program = program;
+    job->vertexSource = vertexSource;
+    job->fragmentSource = fragmentSource;
+    job->cacheName = cacheName;
+    job->cacheKey = cacheKey;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+    }
+    jobAdded.notify_one();
+    return job;
+}
+
+bool ShaderCompiler::isDone(const Job& job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return job.done;
+}
+
+void ShaderCompiler::wait(const Job& job) {
+    TRACE_SCOPE("ShaderCompiler::wait");
+    std::unique_lock<std::mutex> lock(mutex);
+    jobDone.wait(lock, [&] { return job.done; });
+}
+
+void ShaderCompiler::workerLoop() {
+    TRACE_THREAD_NAME("shaderCompiler");
+    sharedContext->makeCurrent();
+    while (true) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAdded.wait(lock, [&] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                break;
+            }
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        build(*job);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->done = true;
+        }
+        jobDone.notify_all();
+    }
+    sharedContext->release();
+}
+
+void ShaderCompiler::build(Job& job) {
+    TRACE_SCOPE("ShaderCompiler::build");
+    GLuint vertex, fragment;
+    startBuild(job.program, job.vertexSource.c_str(), job.fragmentSource.c_str(), vertex, fragment);
+    job.error = finishBuild(job.program, vertex, fragment);
+    if (job.error.empty()) {
+        ShaderCache::store(job.program, job.cacheName, job.cacheKey);
+    }
+    // 描画スレッドのコンテキストから結果が見えるよう、完了まで待ってから知らせる
+    glFinish();
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <GL/glew.h>
+#include "SharedContext.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// シェーダープログラムのコンパイルを描画スレッドから切り離す
+//
+// Shaderはコンストラクタでコンパイルとリンクを発行するだけで待たず、最初にuse()されたときに
+// そのプログラムの完了だけを待つ。起動時に全プログラムを登録すれば、並行してコンパイルされる。
+// - Parallel: KHR(ARB)_parallel_shader_compileでドライバのスレッドがコンパイルし、完了を問い合わせる
+// - Thread: 拡張が無いとき、共有コンテキストを持つワーカースレッドでコンパイル・リンクする
+// - Sync: 従来どおり(リンク結果の確認を最初のuse()まで遅らせるだけ)
+class ShaderCompiler {
+public:
+    enum class Mode {
+        Auto,      // Parallel、使えなければThread、それも無理ならSync
+        Parallel,
+        Thread,
+        Sync
+    };
+
+    // ワーカースレッドでコンパイルするプログラム
+    struct Job {
+        GLuint program = 0;
+        std::string vertexSource;
+        std::string fragmentSource;
+        std::string cacheName;
+        uint64_t cacheKey = 0;
+        bool done = false;     // mutexで保護
+        std::string error;     // 失敗時のメッセージ
+    };
+
+    // 描画用コンテキストがカレントのスレッドで作る(Thread以外ではsharedContextは不要)
+    ShaderCompiler(Mode mode, std::unique_ptr<SharedContext> sharedContext);
+    ~ShaderCompiler();
+
+    // コピー禁止
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+    // 現在のコンテキストでparallel_shader_compileが使えるか
+    static bool hasParallelExtension();
+
+    // Shaderが使う、現在有効なコンパイラ(無ければnullptr、Syncと同じ扱い)
+    static ShaderCompiler* getActive() { return active; }
+
+    Mode getMode() const { return mode; }
+    static const char* modeName(Mode mode);
+
+    // コンパイルとリンクを発行する(完了は待たない)
+    static void startBuild(GLuint program, const char* vertexSource, const char* fragmentSource,
+                           GLuint& vertex, GLuint& fragment);
+    // リンクの完了を待ってシェーダーオブジェクトを削除し、失敗ならエラーメッセージを返す
+    static std::string finishBuild(GLuint program, GLuint vertex, GLuint fragment);
+
+    // ワーカーへ渡す(Threadのみ)
+    std::shared_ptr<Job> submit(GLuint program, const char* vertexSource, const char* fragmentSource,
+                                const std::string& cacheName, uint64_t cacheKey);
+    bool isDone(const Job& job);
+    void wait(const Job& job);
+
+private:
+    static ShaderCompiler* active;
+
+    Mode mode;
+    std::unique_ptr<SharedContext> sharedContext;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobAdded;
+    std::condition_variable jobDone;
+    std::deque<std::shared_ptr<Job>> jobs;
+    bool stopping = false;
+
+    void workerLoop();
+    void build(Job& job);
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+// 描画用のコンテキストとオブジェクト(プログラム・テクスチャ等)を共有する、別スレッド用のGLコンテキスト
+// Windowの実装が作り、作ったスレッドとは別のスレッドでカレントにして使う
+class SharedContext {
+public:
+    virtual ~SharedContext() = default;
+
+    // 呼び出しスレッドでカレントにする/手放す
+    virtual void makeCurrent() = 0;
+    virtual void release() = 0;
+};
@@ -1,27 +1,48 @@
 #include "HistoryManager.hpp"
 #include <iostream>
+#include <iterator>
+#include "Profiling/Trace.hpp"
 
-HistoryManager::HistoryManager(const std::string& filename, int tileSize)
-    : tileSize(tileSize) {
+HistoryManager::HistoryManager(const std::string& filename, int tileSize, size_t queueBudgetBytes, QueuePolicy queuePolicy,
+                               int encoderCount, bool compress)
+    : tileSize(tileSize), queuePolicy(queuePolicy) {
     storage = std::make_unique<HistoryStorage>(filename, tileSize);
-    worker = std::make_unique<HistoryWorker>();
+    worker = std::make_unique<HistoryWorker>(queueBudgetBytes, queuePolicy, encoderCount);
 
-    // ワーカースレッドを開始し、書き込み完了時のコールバックを設定
-    worker->start([this](const TileData& data) {
-        return storage->writeTile(data);
-    });
+    // ワーカースレッドを開始し、エンコード(圧縮)・書き込み完了時のコールバックを設定
+    worker->start(
+        [compress](TileData&& data) {
+            return HistoryStorage::encodeTile(std::move(data), compress);
+        },
+        [this](const EncodedTile& tile) {
+            return storage->writeEncoded(tile);
+        });
 
     worker->setRecordCallback([this](int stepID, const TileRecord& record) {
         onBeforeTileWritten(stepID, record);
     });
+
+    restorer = std::make_unique<HistoryRestorer>(RESTORE_READY_TILES);
+    restorer->start([this](const TileRecord& record) {
+        return storage->readTile(record);
+    });
 }
 
 HistoryManager::~HistoryManager() {
+    // 復元スレッドは書き込みの完了を待つことがあるため先に止める
+    restorer->stop();
     worker->stop();
 }
 
-void HistoryManager::pushBeforeTile(int tileX, int tileY, int stepID, const uint8_t* data) {
+void HistoryManager::pushBeforeTile(int layerID, int tileX, int tileY, int stepID, const uint8_t* data) {
+    size_t tileBytes = static_cast<size_t>(tileSize) * tileSize * 4;
+    if (queuePolicy == QueuePolicy::Coalesce && !worker->hasRoomFor(tileBytes)
+        && coalesceBeforeTile(layerID, tileX, tileY, stepID)) {
+        return;
+    }
+
     TileData tileData;
+    tileData.layerID = layerID;
     tileData.tileX = tileX;
     tileData.tileY = tileY;
     tileData.stepID = stepID;
@@ -31,8 +52,9 @@ void HistoryManager::pushBeforeTile(int tileX, int tileY, int stepID, const uint
     worker->enqueue(std::move(tileData));
 }
 
-void HistoryManager::pushAfterTile(int tileX, int tileY, int stepID, const uint8_t* data) {
+void HistoryManager::pushAfterTile(int layerID, int tileX, int tileY, int stepID, const uint8_t* data) {
     TileData tileData;
+    tileData.layerID = layerID;
     tileData.tileX = tileX;
     tileData.tileY = tileY;
     tileData.stepID = stepID;
@@ -41,17 +63,45 @@ void HistoryManager::pushAfterTile(int tileX, int tileY, int stepID, const uint8
     // 同期的に書き込み(ストローク終了時なので即時保存)
     TileRecord record = storage->writeTile(tileData);
 
+    std::unique_lock<std::mutex> lock(indexMutex, std::defer_lock);
     {
-        std::lock_guard<std::mutex> lock(indexMutex);
-        afterIndex[stepID].push_back(record);
+        TRACE_SCOPE("indexMutex.lock");
+        lock.lock();
     }
+    afterIndex[stepID].push_back(record);
 }
 
 void HistoryManager::onBeforeTileWritten(int stepID, const TileRecord& record) {
-    std::lock_guard<std::mutex> lock(indexMutex);
+    std::unique_lock<std::mutex> lock(indexMutex, std::defer_lock);
+    {
+        TRACE_SCOPE("indexMutex.lock");
+        lock.lock();
+    }
     beforeIndex[stepID].push_back(record);
 }
 
+bool HistoryManager::coalesceBeforeTile(int layerID, int tileX, int tileY, int stepID) {
+    // ステップは全て変えたタイルの描画後を保存するため、stepIDより前で最後にこのタイルを変えたステップの
+    // 描画後タイルは、stepIDの描画前タイルと同じ内容になる
+    std::lock_guard<std::mutex> lock(indexMutex);
+    for (auto it = std::make_reverse_iterator(afterIndex.lower_bound(stepID)); it != afterIndex.rend(); ++it) {
+        for (const TileRecord& record : it->second) {
+            if (record.layerID == layerID && record.tileX == tileX && record.tileY == tileY) {
+                beforeIndex[stepID].push_back(record);
+                coalescedTiles++;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+HistoryQueueStats HistoryManager::getQueueStats() {
+    HistoryQueueStats stats = worker->getStats();
+    stats.coalescedTiles = coalescedTiles.load();
+    return stats;
+}
+
 void HistoryManager::incrementStepID() {
     currentStepID++;
     int newStepID = currentStepID.load();
@@ -95,8 +145,8 @@ size_t HistoryManager::calculateMaxOffset(int upToStepID) const {
     for (const auto& entry : beforeIndex) {
         if (entry.first < upToStepID) {
             for (const auto& record : entry.second) {
-                size_t endOffset = record.offset + 12 + 1;  // ヘッダー + タイプフラグ
-                if (record.type == TILE_TYPE_RAW) {
+                size_t endOffset = record.offset + TILE_RECORD_HEADER_SIZE;
+                if (record.type != TILE_TYPE_EMPTY) {
                     endOffset += record.size;
                 }
                 maxOffset = std::max(maxOffset, endOffset);
@@ -107,8 +157,8 @@ size_t HistoryManager::calculateMaxOffset(int upToStepID) const {
     for (const auto& entry : afterIndex) {
         if (entry.first < upToStepID) {
             for (const auto& record : entry.second) {
-                size_t endOffset = record.offset + 12 + 1;
-                if (record.type == TILE_TYPE_RAW) {
+                size_t endOffset = record.offset + TILE_RECORD_HEADER_SIZE;
+                if (record.type != TILE_TYPE_EMPTY) {
                     endOffset += record.size;
                 }
                 maxOffset = std::max(maxOffset, endOffset);
@@ -119,65 +169,53 @@ size_t HistoryManager::calculateMaxOffset(int upToStepID) const {
     return maxOffset;
 }
 
-std::vector<TileData> HistoryManager::undo() {
-    waitForPendingWrites();
-
-    std::vector<TileData> result;
+bool HistoryManager::requestUndo() {
+    TRACE_SCOPE("HistoryManager::requestUndo");
     int targetStepID = currentStepID.load();
-
     if (targetStepID <= 0) {
-        return result;
+        return false;
     }
+    currentStepID--;
 
-    std::vector<TileRecord> records;
-    {
+    // 描画前タイルはワーカーが書き込み中のことがあるため、完了を待ってから記録を引く(復元スレッドで行う)
+    RestoreJob job;
+    job.stepID = targetStepID;
+    job.resolve = [this, targetStepID]() {
+        waitForPendingWrites();
         std::lock_guard<std::mutex> lock(indexMutex);
         auto it = beforeIndex.find(targetStepID);
-        if (it == beforeIndex.end()) {
-            currentStepID--;
-            return result;
-        }
-        records = it->second;
-        currentStepID--;
-    }
-
-    // タイルデータを読み込み
-    result = storage->readTiles(records);
-    for (auto& tile : result) {
-        tile.stepID = targetStepID;
-    }
-
-    return result;
+        return it != beforeIndex.end() ? it->second : std::vector<TileRecord>();
+    };
+    restorer->enqueue(std::move(job));
+    return true;
 }
 
-std::vector<TileData> HistoryManager::redo() {
-    waitForPendingWrites();
-
-    std::vector<TileData> result;
+bool HistoryManager::requestRedo() {
+    TRACE_SCOPE("HistoryManager::requestRedo");
     int targetStepID = currentStepID.load() + 1;
-
     if (targetStepID > maxStepID.load()) {
-        return result;
+        return false;
     }
 
+    // 描画後タイルはストローク終了時に同期的に書き込むため、記録はすでに揃っている
     std::vector<TileRecord> records;
     {
         std::lock_guard<std::mutex> lock(indexMutex);
         auto it = afterIndex.find(targetStepID);
         if (it == afterIndex.end()) {
-            return result;
+            return false;
         }
         records = it->second;
-        currentStepID++;
-    }
-
-    // タイルデータを読み込み
-    result = storage->readTiles(records);
-    for (auto& tile : result) {
-        tile.stepID = targetStepID;
     }
+    currentStepID++;
 
-    return result;
+    RestoreJob job;
+    job.stepID = targetStepID;
+    job.resolve = [records = std::move(records)]() {
+        return records;
+    };
+    restorer->enqueue(std::move(job));
+    return true;
 }
 
 void HistoryManager::waitForPendingWrites() {
@@ -7,26 +7,38 @@
 #include "HistoryTypes.hpp"
 #include "HistoryStorage.hpp"
 #include "HistoryWorker.hpp"
+#include "HistoryRestorer.hpp"
 
 // 履歴管理: Undo/Redoロジックを担当
 class HistoryManager {
 public:
-    HistoryManager(const std::string& filename, int tileSize);
+    // queueBudgetBytes/queuePolicy: 描画前タイルの書き込みキューの上限と、超えたときの動作
+    // encoderCount: 描画前タイルをエンコードするスレッド数(0なら自動)、compress: zlibで圧縮するか
+    HistoryManager(const std::string& filename, int tileSize, size_t queueBudgetBytes, QueuePolicy queuePolicy,
+                   int encoderCount, bool compress);
     ~HistoryManager();
 
     // タイルデータの保存(描画前: Undo用)
-    void pushBeforeTile(int tileX, int tileY, int stepID, const uint8_t* data);
+    void pushBeforeTile(int layerID, int tileX, int tileY, int stepID, const uint8_t* data);
 
     // タイルデータの保存(描画後: Redo用)
-    void pushAfterTile(int tileX, int tileY, int stepID, const uint8_t* data);
+    void pushAfterTile(int layerID, int tileX, int tileY, int stepID, const uint8_t* data);
 
     // stepID管理
     int getCurrentStepID() const { return currentStepID.load(); }
     void incrementStepID();
 
-    // Undo/Redo操作
-    std::vector<TileData> undo();
-    std::vector<TileData> redo();
+    // Undo/Redo操作: stepIDはすぐに移し、戻すタイルは復元スレッドが読み込む(takeRestoredTilesで受け取る)
+    // 動かせるステップが無ければfalse
+    bool requestUndo();
+    bool requestRedo();
+
+    // 読み込めた復元タイルを最大maxTiles枚、リクエストした順に取り出す(waitなら届くか復元が終わるまで待つ)
+    bool takeRestoredTiles(std::vector<TileData>& out, size_t maxTiles, bool wait) {
+        return restorer->take(out, maxTiles, wait);
+    }
+    // 取り出していない復元タイルが残っているか
+    bool isRestoring() { return restorer->isBusy(); }
 
     bool canUndo() const { return currentStepID.load() > 0; }
     bool canRedo() const { return currentStepID.load() < maxStepID.load(); }
@@ -34,13 +46,24 @@ public:
     // ワーカースレッドの同期
     void waitForPendingWrites();
 
+    // 計測用: 書き込み待ちのタイル数、キューの計測値、履歴ファイルの使用量(waitForPendingWritesの後に読む)
+    size_t getQueueDepth() { return worker->getQueueDepth(); }
+    HistoryQueueStats getQueueStats();
+    size_t getFileSize() const { return storage->getCurrentOffset(); }
+
 private:
+    // 復元スレッドが読み込んで取り出しを待たせるタイル数の上限
+    static constexpr size_t RESTORE_READY_TILES = 1024;
+
     int tileSize;
+    QueuePolicy queuePolicy;
+    std::atomic<size_t> coalescedTiles{0};
     std::atomic<int> currentStepID{0};
     std::atomic<int> maxStepID{0};
 
     std::unique_ptr<HistoryStorage> storage;
     std::unique_ptr<HistoryWorker> worker;
+    std::unique_ptr<HistoryRestorer> restorer;
 
     // インデックスマップ(stepID -> タイルレコード一覧)
     std::map<int, std::vector<TileRecord>> beforeIndex;  // Undo用
@@ -50,6 +73,9 @@ private:
     // インデックスにレコードを追加(ワーカーからのコールバック用)
     void onBeforeTileWritten(int stepID, const TileRecord& record);
 
+    // 同じタイルの保存済みの描画後タイルを、stepIDの描画前タイルとして登録する(見つからなければfalse)
+    bool coalesceBeforeTile(int layerID, int tileX, int tileY, int stepID);
+
     // 不要な履歴を削除
     void clearHistoryAfter(int stepID);
 
@@ -0,0 +1,103 @@
+#include "HistoryRestorer.hpp"
+#include <algorithm>
+#include "Profiling/Trace.hpp"
+
+HistoryRestorer::HistoryRestorer(size_t maxReadyTiles)
+    : maxReadyTiles(maxReadyTiles) {
+}
+
+HistoryRestorer::~HistoryRestorer() {
+    stop();
+}
+
+void HistoryRestorer::start(ReadCallback callback) {
+    readCallback = std::move(callback);
+    isRunning = true;
+    restoreThread = std::thread(&HistoryRestorer::restoreLoop, this);
+}
+
+void HistoryRestorer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isRunning = false;
+    }
+    jobCond.notify_all();
+    spaceCond.notify_all();
+    readyCond.notify_all();
+
+    if (restoreThread.joinable()) {
+        restoreThread.join();
+    }
+}
+
+void HistoryRestorer::enqueue(RestoreJob job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobCond.notify_one();
+}
+
+bool HistoryRestorer::take(std::vector<TileData>& out, size_t maxTiles, bool wait) {
+    out.clear();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (wait) {
+            readyCond.wait(lock, [this]() {
+                return !readyTiles.empty() || (jobs.empty() && !active) || !isRunning;
+            });
+        }
+        size_t count = std::min(maxTiles, readyTiles.size());
+        for (size_t i = 0; i < count; ++i) {
+            out.push_back(std::move(readyTiles.front()));
+            readyTiles.pop_front();
+        }
+    }
+    if (!out.empty()) {
+        spaceCond.notify_one();
+    }
+    return !out.empty();
+}
+
+bool HistoryRestorer::isBusy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !jobs.empty() || active || !readyTiles.empty();
+}
+
+void HistoryRestorer::restoreLoop() {
+    TRACE_THREAD_NAME("history-restore");
+    while (true) {
+        RestoreJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobCond.wait(lock, [this]() { return !jobs.empty() || !isRunning; });
+            if (!isRunning) {
+                break;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            active = true;
+        }
+
+        TRACE_SCOPE("HistoryRestorer::restore");
+        std::vector<TileRecord> records = job.resolve();
+        for (const TileRecord& record : records) {
+            TileData tile = readCallback(record);
+            tile.stepID = job.stepID;
+
+            std::unique_lock<std::mutex> lock(mutex);
+            spaceCond.wait(lock, [this]() { return readyTiles.size() < maxReadyTiles || !isRunning; });
+            if (!isRunning) {
+                break;
+            }
+            readyTiles.push_back(std::move(tile));
+            readyCond.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active = false;
+        }
+        readyCond.notify_all();
+    }
+}
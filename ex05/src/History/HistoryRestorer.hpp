@@ -0,0 +1,61 @@
+#pragma once
+#include <thread>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "HistoryTypes.hpp"
+
+// Undo/Redo 1回分の復元
+struct RestoreJob {
+    int stepID;
+    // 読み込むタイルの記録を決める(復元スレッドで呼ぶ。書き込みの完了待ちを含んでよい)
+    std::function<std::vector<TileRecord>()> resolve;
+};
+
+// Undo/Redoで戻すタイルをバックグラウンドスレッドで読み込む
+// 復元はリクエストした順に行い、読み込めたタイルから描画スレッドが取り出して反映する
+class HistoryRestorer {
+public:
+    using ReadCallback = std::function<TileData(const TileRecord&)>;
+
+    // maxReadyTiles: 読み込み済みで取り出しを待つタイル数の上限(超えたら読み込みを待たせる)
+    explicit HistoryRestorer(size_t maxReadyTiles);
+    ~HistoryRestorer();
+
+    // コピー禁止
+    HistoryRestorer(const HistoryRestorer&) = delete;
+    HistoryRestorer& operator=(const HistoryRestorer&) = delete;
+
+    void start(ReadCallback callback);
+    // 未処理の復元は捨てて停止
+    void stop();
+
+    void enqueue(RestoreJob job);
+
+    // 読み込み済みのタイルを最大maxTiles枚、リクエストした順にoutへ取り出す
+    // waitならタイルが届くか全ての復元が終わるまで待つ。取り出せなければfalse
+    bool take(std::vector<TileData>& out, size_t maxTiles, bool wait);
+
+    // 読み込み中・取り出し待ちの復元があるか
+    bool isBusy();
+
+private:
+    const size_t maxReadyTiles;
+
+    std::thread restoreThread;
+    bool isRunning = false;
+
+    // 以下はmutexで保護
+    std::deque<RestoreJob> jobs;
+    std::deque<TileData> readyTiles;
+    bool active = false;  // 取り出した復元を読み込み中
+    std::mutex mutex;
+    std::condition_variable jobCond;    // 復元が積まれた
+    std::condition_variable readyCond;  // タイルが届いた、または全ての復元が終わった
+    std::condition_variable spaceCond;  // 取り出し待ちのタイルが減った
+
+    ReadCallback readCallback;
+
+    void restoreLoop();
+};
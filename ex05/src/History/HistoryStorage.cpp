@@ -2,6 +2,8 @@
 #include <fstream>
 #include <iostream>
 #include <unistd.h>
+#include <zlib.h>
+#include "Profiling/Trace.hpp"
 
 HistoryStorage::HistoryStorage(const std::string& filename, int tileSize)
     : filename(filename), tileSize(tileSize), currentOffset(0) {
@@ -16,7 +18,7 @@ void HistoryStorage::clear() {
     currentOffset = 0;
 }
 
-bool HistoryStorage::isTileEmpty(const std::vector<uint8_t>& pixels) const {
+bool HistoryStorage::isTileEmpty(const std::vector<uint8_t>& pixels) {
     size_t pixelCount = pixels.size() / 4;
     for (size_t i = 0; i < pixelCount; ++i) {
         if (pixels[i * 4 + 3] != 0) {  // Alphaチャネルが0でない
@@ -27,6 +29,50 @@ bool HistoryStorage::isTileEmpty(const std::vector<uint8_t>& pixels) const {
 }
 
 TileRecord HistoryStorage::writeTile(const TileData& data) {
+    TRACE_SCOPE("HistoryStorage::writeTile");
+    if (isTileEmpty(data.pixels)) {
+        return writeRecord(data.stepID, data.layerID, data.tileX, data.tileY, TILE_TYPE_EMPTY, nullptr, 0);
+    }
+    return writeRecord(data.stepID, data.layerID, data.tileX, data.tileY, TILE_TYPE_RAW,
+                       data.pixels.data(), data.pixels.size());
+}
+
+EncodedTile HistoryStorage::encodeTile(TileData&& data, bool compress) {
+    TRACE_SCOPE("HistoryStorage::encodeTile");
+    EncodedTile tile;
+    tile.layerID = data.layerID;
+    tile.tileX = data.tileX;
+    tile.tileY = data.tileY;
+    tile.stepID = data.stepID;
+
+    if (isTileEmpty(data.pixels)) {
+        tile.type = TILE_TYPE_EMPTY;
+        return tile;
+    }
+
+    if (compress) {
+        uLongf compressedSize = compressBound(data.pixels.size());
+        tile.payload.resize(compressedSize);
+        if (compress2(tile.payload.data(), &compressedSize, data.pixels.data(), data.pixels.size(), Z_BEST_SPEED) == Z_OK
+            && compressedSize < data.pixels.size()) {
+            tile.payload.resize(compressedSize);
+            tile.type = TILE_TYPE_ZLIB;
+            return tile;
+        }
+    }
+    tile.type = TILE_TYPE_RAW;
+    tile.payload = std::move(data.pixels);
+    return tile;
+}
+
+TileRecord HistoryStorage::writeEncoded(const EncodedTile& tile) {
+    TRACE_SCOPE("HistoryStorage::writeEncoded");
+    return writeRecord(tile.stepID, tile.layerID, tile.tileX, tile.tileY, tile.type,
+                       tile.payload.data(), tile.payload.size());
+}
+
+TileRecord HistoryStorage::writeRecord(int stepID, int layerID, int tileX, int tileY, uint8_t type,
+                                       const uint8_t* payload, size_t size) {
     std::lock_guard<std::mutex> lock(fileMutex);
 
     std::ofstream ofs(filename, std::ios::binary | std::ios::app);
@@ -37,37 +83,27 @@ TileRecord HistoryStorage::writeTile(const TileData& data) {
 
     size_t startOffset = currentOffset;
 
-    // ヘッダー書き込み: stepID, tileX, tileY (各4バイト = 12バイト)
-    ofs.write(reinterpret_cast<const char*>(&data.stepID), sizeof(int));
-    ofs.write(reinterpret_cast<const char*>(&data.tileX), sizeof(int));
-    ofs.write(reinterpret_cast<const char*>(&data.tileY), sizeof(int));
-    currentOffset += 12;
+    // ヘッダー書き込み: stepID, layerID, tileX, tileY (各4バイト = 16バイト) + タイプフラグ
+    ofs.write(reinterpret_cast<const char*>(&stepID), sizeof(int));
+    ofs.write(reinterpret_cast<const char*>(&layerID), sizeof(int));
+    ofs.write(reinterpret_cast<const char*>(&tileX), sizeof(int));
+    ofs.write(reinterpret_cast<const char*>(&tileY), sizeof(int));
+    ofs.write(reinterpret_cast<const char*>(&type), sizeof(uint8_t));
+    currentOffset += TILE_RECORD_HEADER_SIZE;
+
+    // データあり(空タイルはタイプフラグのみ)
+    if (size > 0) {
+        ofs.write(reinterpret_cast<const char*>(payload), size);
+        currentOffset += size;
+    }
 
     TileRecord record;
-    record.tileX = data.tileX;
-    record.tileY = data.tileY;
+    record.layerID = layerID;
+    record.tileX = tileX;
+    record.tileY = tileY;
+    record.type = type;
     record.offset = startOffset;
-
-    bool isEmpty = isTileEmpty(data.pixels);
-
-    if (isEmpty) {
-        // 空タイル: タイプフラグのみ
-        ofs.write(reinterpret_cast<const char*>(&TILE_TYPE_EMPTY), sizeof(uint8_t));
-        currentOffset += 1;
-        record.type = TILE_TYPE_EMPTY;
-        record.size = 0;
-    } else {
-        // データあり: タイプフラグ + ピクセルデータ
-        ofs.write(reinterpret_cast<const char*>(&TILE_TYPE_RAW), sizeof(uint8_t));
-        currentOffset += 1;
-
-        ofs.write(reinterpret_cast<const char*>(data.pixels.data()), data.pixels.size());
-        currentOffset += data.pixels.size();
-
-        record.type = TILE_TYPE_RAW;
-        record.size = data.pixels.size();
-    }
-
+    record.size = size;
     return record;
 }
 
@@ -75,6 +111,7 @@ TileData HistoryStorage::readTile(const TileRecord& record) const {
     std::lock_guard<std::mutex> lock(fileMutex);
 
     TileData tile;
+    tile.layerID = record.layerID;
     tile.tileX = record.tileX;
     tile.tileY = record.tileY;
 
@@ -91,22 +128,38 @@ TileData HistoryStorage::readTile(const TileRecord& record) const {
     }
 
     tile.pixels.resize(tileSize * tileSize * 4);
-    
-    // ヘッダー(12バイト) + タイプフラグ(1バイト) の後がデータ
-    size_t dataOffset = record.offset + 12 + 1;
+    std::vector<uint8_t> compressed;
+    uint8_t* dest = tile.pixels.data();
+    if (record.type == TILE_TYPE_ZLIB) {
+        compressed.resize(record.size);
+        dest = compressed.data();
+    }
+
+    // ヘッダー + タイプフラグの後がデータ
+    size_t dataOffset = record.offset + TILE_RECORD_HEADER_SIZE;
     ifs.seekg(dataOffset);
-    ifs.read(reinterpret_cast<char*>(tile.pixels.data()), record.size);
+    ifs.read(reinterpret_cast<char*>(dest), record.size);
 
     if (ifs.gcount() != static_cast<std::streamsize>(record.size)) {
         std::cerr << "Error reading tile data at offset " << dataOffset
                   << " (expected " << record.size << " bytes, got " 
                   << ifs.gcount() << " bytes)" << std::endl;
+        return tile;
+    }
+
+    if (record.type == TILE_TYPE_ZLIB) {
+        uLongf rawSize = tile.pixels.size();
+        if (uncompress(tile.pixels.data(), &rawSize, compressed.data(), compressed.size()) != Z_OK
+            || rawSize != tile.pixels.size()) {
+            std::cerr << "Failed to decompress history tile at offset " << record.offset << std::endl;
+        }
     }
 
     return tile;
 }
 
 std::vector<TileData> HistoryStorage::readTiles(const std::vector<TileRecord>& records) const {
+    TRACE_SCOPE("HistoryStorage::readTiles");
     std::vector<TileData> result;
     result.reserve(records.size());
 
@@ -11,9 +11,15 @@ public:
     explicit HistoryStorage(const std::string& filename, int tileSize);
     ~HistoryStorage() = default;
 
-    // タイルデータの書き込み
+    // タイルデータの書き込み(圧縮せずに書く。ストローク終了時の描画後タイル用)
     TileRecord writeTile(const TileData& data);
 
+    // 空の判定とzlib(最速)での圧縮。ファイルに触れないため複数スレッドから同時に呼べる
+    // 圧縮しても小さくならなければ無圧縮のまま
+    static EncodedTile encodeTile(TileData&& data, bool compress);
+    // エンコード済みのタイルを追記
+    TileRecord writeEncoded(const EncodedTile& tile);
+
     // タイルデータの読み込み
     TileData readTile(const TileRecord& record) const;
     std::vector<TileData> readTiles(const std::vector<TileRecord>& records) const;
@@ -26,11 +32,15 @@ public:
     size_t getCurrentOffset() const { return currentOffset; }
     void setCurrentOffset(size_t offset) { currentOffset = offset; }
 
+    // 全画素のアルファが0か(空タイルはタイプフラグだけを書き込む)
+    static bool isTileEmpty(const std::vector<uint8_t>& pixels);
+
 private:
     std::string filename;
+
+    TileRecord writeRecord(int stepID, int layerID, int tileX, int tileY, uint8_t type,
+                           const uint8_t* payload, size_t size);
     int tileSize;
     size_t currentOffset = 0;
     mutable std::mutex fileMutex;
-
-    bool isTileEmpty(const std::vector<uint8_t>& pixels) const;
 };
@@ -5,15 +5,26 @@
 
 // タイルデータ
 struct TileData {
+    int layerID;
     int tileX, tileY;
     int stepID;
     std::vector<uint8_t> pixels;
 };
 
+// 書き込み用にエンコードしたタイル(空の判定と圧縮はワーカーのエンコードスレッドで並列に行う)
+struct EncodedTile {
+    int layerID;
+    int tileX, tileY;
+    int stepID;
+    uint8_t type;                  // TILE_TYPE_*
+    std::vector<uint8_t> payload;  // タイプフラグの後に書き込むデータ(空タイルなら無し)
+};
+
 // ファイル内のタイル記録情報
 struct TileRecord {
+    int layerID;
     int tileX, tileY;
-    uint8_t type;    // TYPE_EMPTY or TYPE_RAW
+    uint8_t type;    // TYPE_EMPTY, TYPE_RAW or TYPE_ZLIB
     size_t offset;   // ファイル内のオフセット
     size_t size;     // ピクセルデータのサイズ
 };
@@ -21,3 +32,30 @@ struct TileRecord {
 // タイルタイプ定数
 constexpr uint8_t TILE_TYPE_EMPTY = 0;
 constexpr uint8_t TILE_TYPE_RAW = 1;
+constexpr uint8_t TILE_TYPE_ZLIB = 2;  // zlibで圧縮したピクセルデータ(sizeは圧縮後)
+
+// ファイル内のタイル記録のヘッダー: stepID, layerID, tileX, tileY (各4バイト) + タイプフラグ(1バイト)
+constexpr size_t TILE_RECORD_HEADER_SIZE = 4 * sizeof(int32_t) + sizeof(uint8_t);
+
+// 書き込みキューが予算(バイト数)を超えたときの動作
+enum class QueuePolicy {
+    Block,     // 書き込みが進んで空きができるまで呼び出し側を短時間待たせる
+    Compress,  // キューに積むタイルをzlibで圧縮して保持する(それでも入らなければ待たせる)
+    Coalesce   // 同じタイル座標の保存済みの描画後タイルを描画前タイルとして使い回す(無ければ待たせる)
+};
+
+// 書き込みキューの計測値
+struct HistoryQueueStats {
+    size_t depth = 0;             // 現在のタイル数
+    size_t bytes = 0;             // 現在のバイト数(圧縮したタイルは圧縮後のサイズ)
+    size_t peakDepth = 0;
+    size_t peakBytes = 0;
+    size_t blockedEnqueues = 0;   // 予算超過で待たせた回数
+    double blockedMs = 0.0;       // 待たせた時間の合計
+    size_t blockTimeouts = 0;     // 待っても空かず、予算を超えて積んだ回数
+    size_t compressedTiles = 0;   // 圧縮して積んだタイル数
+    size_t compressedSavedBytes = 0;
+    size_t coalescedTiles = 0;    // 保存済みの記録を使い回したタイル数
+    size_t encodedRawBytes = 0;   // エンコードしたタイルの元のバイト数と、エンコード後のバイト数
+    size_t encodedBytes = 0;
+};
@@ -1,15 +1,29 @@
 #include "HistoryWorker.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <zlib.h>
+#include "Profiling/Trace.hpp"
 
-HistoryWorker::HistoryWorker() = default;
+HistoryWorker::HistoryWorker(size_t budgetBytes, QueuePolicy policy, int encoderCount)
+    : encoderCount(encoderCount), budgetBytes(budgetBytes), policy(policy) {
+    if (this->encoderCount <= 0) {
+        this->encoderCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+    }
+}
 
 HistoryWorker::~HistoryWorker() {
     stop();
 }
 
-void HistoryWorker::start(WriteCallback callback) {
-    writeCallback = std::move(callback);
+void HistoryWorker::start(EncodeCallback encode, WriteCallback write) {
+    encodeCallback = std::move(encode);
+    writeCallback = std::move(write);
     isRunning = true;
-    workerThread = std::thread(&HistoryWorker::workerLoop, this);
+    for (int i = 0; i < encoderCount; ++i) {
+        encoderThreads.emplace_back(&HistoryWorker::encoderLoop, this);
+    }
+    writerThread = std::thread(&HistoryWorker::writerLoop, this);
 }
 
 void HistoryWorker::stop() {
@@ -18,55 +32,214 @@ void HistoryWorker::stop() {
         isRunning = false;
     }
     queueCond.notify_all();
+    writeCond.notify_all();
+    spaceCondition.notify_all();
+
+    // エンコードスレッドは積まれたタイルを処理し終えてから、書き込みスレッドは全て書き込んでから終了する
+    for (std::thread& thread : encoderThreads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    encoderThreads.clear();
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+}
+
+bool HistoryWorker::hasRoomLocked(size_t bytes) const {
+    return nextSequence == nextWrite || stats.bytes + bytes <= budgetBytes;
+}
+
+bool HistoryWorker::hasRoomFor(size_t bytes) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return hasRoomLocked(bytes);
+}
 
-    if (workerThread.joinable()) {
-        workerThread.join();
+void HistoryWorker::compressTile(QueuedTile& tile) {
+    TRACE_SCOPE("HistoryWorker::compress");
+    uLongf compressedSize = compressBound(tile.rawSize);
+    std::vector<uint8_t> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, tile.data.pixels.data(), tile.rawSize, Z_BEST_SPEED) != Z_OK
+        || compressedSize >= tile.rawSize) {
+        return;
     }
+    compressed.resize(compressedSize);
+    tile.data.pixels = std::move(compressed);
+    tile.bytes = compressedSize;
+    tile.compressed = true;
+}
+
+bool HistoryWorker::decompressTile(QueuedTile& tile) {
+    std::vector<uint8_t> pixels(tile.rawSize);
+    uLongf rawSize = tile.rawSize;
+    if (uncompress(pixels.data(), &rawSize, tile.data.pixels.data(), tile.bytes) != Z_OK || rawSize != tile.rawSize) {
+        return false;
+    }
+    tile.data.pixels = std::move(pixels);
+    tile.compressed = false;
+    return true;
 }
 
 void HistoryWorker::enqueue(TileData&& data) {
+    TRACE_SCOPE("HistoryWorker::enqueue");
+    QueuedTile tile;
+    tile.rawSize = data.pixels.size();
+    tile.bytes = tile.rawSize;
+    tile.data = std::move(data);
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        workQueue.push(std::move(data));
+        std::unique_lock<std::mutex> lock(queueMutex);
+        if (policy == QueuePolicy::Compress && !hasRoomLocked(tile.bytes)) {
+            // 圧縮はワーカーの書き込みを止めないようロックの外で行う
+            lock.unlock();
+            compressTile(tile);
+            lock.lock();
+            if (tile.compressed) {
+                stats.compressedTiles++;
+                stats.compressedSavedBytes += tile.rawSize - tile.bytes;
+            }
+        }
+        if (!hasRoomLocked(tile.bytes)) {
+            TRACE_SCOPE("HistoryWorker::blocked");
+            auto start = std::chrono::steady_clock::now();
+            bool room = spaceCondition.wait_for(lock, std::chrono::milliseconds(MAX_BLOCK_MS),
+                                                [this, &tile]() { return hasRoomLocked(tile.bytes) || !isRunning; });
+            stats.blockedEnqueues++;
+            stats.blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (!room) {
+                // 書き込みが止まっている。まだなら圧縮して小さくし、予算を超えたまま積む
+                stats.blockTimeouts++;
+                if (policy != QueuePolicy::Compress) {
+                    lock.unlock();
+                    compressTile(tile);
+                    lock.lock();
+                    if (tile.compressed) {
+                        stats.compressedTiles++;
+                        stats.compressedSavedBytes += tile.rawSize - tile.bytes;
+                    }
+                }
+            }
+        }
+
+        tile.sequence = nextSequence++;
+        stats.bytes += tile.bytes;
+        workQueue.push(std::move(tile));
+        size_t depth = static_cast<size_t>(nextSequence - nextWrite);
+        stats.peakDepth = std::max(stats.peakDepth, depth);
+        stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+        TRACE_COUNTER("historyQueueDepth", depth);
+        TRACE_COUNTER("historyQueueBytes", stats.bytes);
     }
     queueCond.notify_one();
 }
 
+size_t HistoryWorker::getQueueDepth() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return static_cast<size_t>(nextSequence - nextWrite);
+}
+
+HistoryQueueStats HistoryWorker::getStats() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    HistoryQueueStats result = stats;
+    result.depth = static_cast<size_t>(nextSequence - nextWrite);
+    return result;
+}
+
 void HistoryWorker::waitUntilEmpty() {
+    TRACE_SCOPE("HistoryWorker::waitUntilEmpty");
     std::unique_lock<std::mutex> lock(queueMutex);
-    emptyCondition.wait(lock, [this]() { return workQueue.empty(); });
+    emptyCondition.wait(lock, [this]() { return nextWrite == nextSequence; });
 }
 
-void HistoryWorker::workerLoop() {
+void HistoryWorker::encoderLoop() {
+    TRACE_THREAD_NAME("history-encoder");
     while (true) {
-        TileData data;
+        QueuedTile tile;
         {
             std::unique_lock<std::mutex> lock(queueMutex);
-            queueCond.wait(lock, [this]() { 
-                return !workQueue.empty() || !isRunning; 
+            queueCond.wait(lock, [this]() {
+                return !workQueue.empty() || !isRunning;
             });
 
             if (!isRunning && workQueue.empty()) {
                 break;
             }
 
-            data = std::move(workQueue.front());
+            tile = std::move(workQueue.front());
             workQueue.pop();
+        }
 
-            // キューが空になったら通知
-            if (workQueue.empty()) {
-                emptyCondition.notify_all();
+        // 空の判定・圧縮(他のエンコードスレッドと並列に行う)
+        EncodedSlot slot;
+        if (tile.compressed && !decompressTile(tile)) {
+            std::cerr << "Failed to decompress queued history tile (" << tile.data.tileX << ", " << tile.data.tileY
+                      << ") of step " << tile.data.stepID << std::endl;
+        } else if (encodeCallback) {
+            TRACE_SCOPE("HistoryWorker::encode");
+            slot.tile = encodeCallback(std::move(tile.data));
+            slot.valid = true;
+        }
+        size_t encodedBytes = slot.tile.payload.size();
+
+        bool next;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            // 書き込むまではエンコード後のサイズで予算に数える
+            stats.bytes = stats.bytes - tile.bytes + encodedBytes;
+            stats.encodedRawBytes += tile.rawSize;
+            stats.encodedBytes += encodedBytes;
+            next = tile.sequence == nextWrite;
+            encodedTiles.emplace(tile.sequence, std::move(slot));
+        }
+        if (next) {
+            writeCond.notify_one();
+        }
+        if (encodedBytes < tile.bytes) {
+            spaceCondition.notify_one();
+        }
+    }
+}
+
+void HistoryWorker::writerLoop() {
+    TRACE_THREAD_NAME("history-writer");
+    while (true) {
+        EncodedSlot slot;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            // enqueueした順に書き込む(先に終わった後ろのタイルは順番が来るまで待たせる)
+            writeCond.wait(lock, [this]() {
+                return encodedTiles.count(nextWrite) > 0 || (!isRunning && nextWrite == nextSequence);
+            });
+
+            if (encodedTiles.count(nextWrite) == 0) {
+                break;
             }
+
+            auto it = encodedTiles.find(nextWrite);
+            slot = std::move(it->second);
+            encodedTiles.erase(it);
         }
 
         // ファイル書き込み実行
-        if (writeCallback) {
-            TileRecord record = writeCallback(data);
+        if (slot.valid && writeCallback) {
+            TRACE_SCOPE("HistoryWorker::write");
+            TileRecord record = writeCallback(slot.tile);
 
             // レコード情報をコールバックで通知
             if (recordCallback) {
-                recordCallback(data.stepID, record);
+                recordCallback(slot.tile.stepID, record);
+            }
+        }
+
+        // 書き込み中のタイルも含めて全て終わったら通知(インデックスへの登録まで済んでいる)
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stats.bytes -= slot.tile.payload.size();
+            nextWrite++;
+            if (nextWrite == nextSequence) {
+                emptyCondition.notify_all();
             }
         }
+        spaceCondition.notify_one();
     }
 }
@@ -1,6 +1,8 @@
 #pragma once
 #include <thread>
 #include <queue>
+#include <map>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -8,40 +10,94 @@
 #include "HistoryTypes.hpp"
 
 // バックグラウンドスレッドでのタイル書き込みを管理
+// 複数のエンコードスレッドが並列に空の判定・圧縮を行い、1つの書き込みスレッドがenqueueした順に追記する
 class HistoryWorker {
 public:
-    using WriteCallback = std::function<TileRecord(const TileData&)>;
+    using EncodeCallback = std::function<EncodedTile(TileData&&)>;
+    using WriteCallback = std::function<TileRecord(const EncodedTile&)>;
 
-    HistoryWorker();
+    // budgetBytes: 書き込み前のタイル(エンコード済みを含む)のバイト数の上限。超えたらpolicyに従う
+    // encoderCount: エンコードスレッド数(0ならハードウェアスレッド数の半分、最低1)
+    HistoryWorker(size_t budgetBytes, QueuePolicy policy, int encoderCount = 0);
     ~HistoryWorker();
 
-    // ワーカースレッドを開始
-    void start(WriteCallback callback);
+    // エンコード・書き込みスレッドを開始
+    // encodeは複数スレッドから同時に呼ばれる。writeと完了の通知はenqueueした順に1スレッドから呼ばれる
+    void start(EncodeCallback encode, WriteCallback write);
 
     // ワーカースレッドを停止
     void stop();
 
-    // 書き込みタスクをキューに追加
+    // 書き込みタスクをキューに追加(予算を超える場合は圧縮するか、空きができるまで待つ)
+    // 待つのはMAX_BLOCK_MSまでで、それでも空かなければ圧縮を試して予算を超えたまま積む
     void enqueue(TileData&& data);
 
-    // キューが空になるまで待機
+    // bytesのタイルを待たずに積めるか
+    bool hasRoomFor(size_t bytes);
+
+    // enqueueした全てのタイルの書き込みと完了の通知が終わるまで待機
     void waitUntilEmpty();
 
+    // 書き込みが終わっていないタイル数(エンコード待ち・エンコード中・書き込み待ち)
+    size_t getQueueDepth();
+    // キューの計測値(coalescedTilesはHistoryManagerが数える)
+    HistoryQueueStats getStats();
+
+    int getEncoderCount() const { return static_cast<int>(encoderThreads.size()); }
+
     // 処理完了したレコードを取得(コールバック経由で通知)
     using RecordCallback = std::function<void(int stepID, const TileRecord&)>;
     void setRecordCallback(RecordCallback callback) { recordCallback = callback; }
 
 private:
-    std::thread workerThread;
+    // 描画スレッドを待たせる時間の上限(ディスクが止まっても画面を止めない)
+    static constexpr int MAX_BLOCK_MS = 4;
+
+    std::vector<std::thread> encoderThreads;
+    std::thread writerThread;
     std::atomic<bool> isRunning{false};
+    int encoderCount;
+
+    // キュー上のタイル(予算超過時は圧縮して保持し、エンコードの前に展開する)
+    struct QueuedTile {
+        uint64_t sequence = 0;  // enqueueした順番(書き込み順)
+        TileData data;
+        size_t bytes = 0;       // キュー上のサイズ
+        size_t rawSize = 0;     // 展開後のサイズ
+        bool compressed = false;
+    };
 
-    std::queue<TileData> workQueue;
+    // エンコード済みで書き込みを待つタイル
+    struct EncodedSlot {
+        EncodedTile tile;
+        bool valid = false;  // 展開に失敗したタイルは書き込まずに順番だけ進める
+    };
+
+    const size_t budgetBytes;
+    const QueuePolicy policy;
+
+    // 以下はqueueMutexで保護
+    std::queue<QueuedTile> workQueue;
+    std::map<uint64_t, EncodedSlot> encodedTiles;  // 順番 -> エンコード済みのタイル
+    uint64_t nextSequence = 0;  // 次にenqueueするタイルの順番
+    uint64_t nextWrite = 0;     // 次に書き込むタイルの順番(これより前は通知まで完了)
+    HistoryQueueStats stats;
     std::mutex queueMutex;
-    std::condition_variable queueCond;
+    std::condition_variable queueCond;       // エンコード待ちのタイルが積まれた
+    std::condition_variable writeCond;       // 次に書き込む順番のタイルのエンコードが終わった
     std::condition_variable emptyCondition;
+    std::condition_variable spaceCondition;  // キューに空きができた
 
+    EncodeCallback encodeCallback;
     WriteCallback writeCallback;
     RecordCallback recordCallback;
 
-    void workerLoop();
+    void encoderLoop();
+    void writerLoop();
+
+    // queueMutexを取った状態で呼ぶ(空のキューには予算を超えるタイルも積む)
+    bool hasRoomLocked(size_t bytes) const;
+
+    static void compressTile(QueuedTile& tile);
+    static bool decompressTile(QueuedTile& tile);
 };
@@ -0,0 +1,361 @@
+#include "Autosaver.hpp"
+#include "Profiling/Trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+Autosaver::Autosaver(Canvas& canvas, const std::string& filename, double intervalSeconds, int stepInterval,
+                     SaveTarget target)
+    : canvas(canvas), filename(filename), intervalSeconds(intervalSeconds), stepInterval(stepInterval), target(target),
+      name(target == SaveTarget::Autosave ? "Autosave" : "Project save"), lastCapture(Clock::now()),
+      writer(target == SaveTarget::Autosave ? "Autosave written" : "Project saved") {}
+
+Autosaver::~Autosaver() {
+    finish();
+}
+
+bool Autosaver::isDue() const {
+    // 上限を超えて残ったタイルは続けて保存する
+    if (requested || !pending.empty() || writer.isPartial()) {
+        return true;
+    }
+    if (stepInterval > 0 && steps >= stepInterval) {
+        return true;
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - lastCapture).count();
+    return intervalSeconds > 0.0 && elapsed >= intervalSeconds;
+}
+
+void Autosaver::update(bool canCapture) {
+    if (state == State::Idle) {
+        if (!canCapture || !isDue() || !capture()) {
+            return;
+        }
+    }
+    advance(Clock::now() + std::chrono::microseconds(static_cast<int64_t>(FRAME_BUDGET_MS * 1000.0)));
+}
+
+void Autosaver::requestSave(bool canCapture) {
+    requested = true;
+    if (state == State::Idle && canCapture) {
+        capture();
+    }
+}
+
+void Autosaver::advance(Clock::time_point deadline) {
+    switch (state) {
+        case State::Capturing:
+            blitTiles(deadline);
+            break;
+        case State::Reading:
+            readRows(deadline);
+            break;
+        case State::Waiting: {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                TRACE_SCOPE("Autosaver::map");
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+                mapped = static_cast<const uint8_t*>(glMapBufferRange(
+                    GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(atlasWidth) * atlasHeight * 4, GL_MAP_READ_BIT));
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                if (!mapped) {
+                    std::cerr << name << " failed to map readback buffer" << std::endl;
+                    cancel();
+                    break;
+                }
+                workerDone = false;
+                worker = std::thread(&Autosaver::copyLoop, this);
+                state = State::Copying;
+            } else if (status == GL_WAIT_FAILED) {
+                std::cerr << name << " readback failed" << std::endl;
+                cancel();
+            }
+            break;
+        }
+        case State::Copying:
+            if (workerDone) {
+                worker.join();
+                releaseGpuResources();
+                startWrite();
+            }
+            break;
+        case State::Writing:
+            writer.update();
+            if (!writer.isBusy()) {
+                state = State::Idle;
+            }
+            break;
+        case State::Idle:
+            break;
+    }
+}
+
+bool Autosaver::capture() {
+    TRACE_SCOPE("Autosaver::capture");
+    steps = 0;
+    lastCapture = Clock::now();
+
+    // 前の保存の残りの回があれば、その後の変更と保存の要求は次の保存に回す
+    bool continuing = !pending.empty() || writer.isPartial();
+    bool forced = false;
+    if (!continuing) {
+        canvas.takeUnsavedTiles(target, pending);
+        forced = requested;
+        requested = false;
+    }
+
+    std::vector<LayerProperties> layers = canvas.getLayerProperties();
+    // 書き込んだはずのファイルが無い・変わっているなら、全タイルを書き直す
+    // (Sキーの保存先は読み込んだタイルを変更として記録しないため、初回も全タイルを読む)
+    full = writer.isPartial() || !writer.canAppend(filename);
+    if (full && !continuing && (hasFile || target == SaveTarget::Project)) {
+        int tileCount = canvas.getSize() / canvas.getTileSize();
+        for (const LayerProperties& layer : layers) {
+            for (int tx = 0; tx < tileCount; ++tx) {
+                for (int ty = 0; ty < tileCount; ++ty) {
+                    pending[layer.id].insert({tx, ty});
+                }
+            }
+        }
+    }
+
+    info = ProjectInfo{};
+    info.canvasSize = canvas.getSize();
+    info.tileSize = canvas.getTileSize();
+    info.activeIndex = canvas.getActiveIndex();
+    std::set<int> layerIDs;
+    for (const LayerProperties& p : layers) {
+        info.layers.push_back({p.id, p.opacity, p.visible, static_cast<uint8_t>(p.blendMode)});
+        layerIDs.insert(p.id);
+    }
+
+    // 上限までのタイルを取り出し、残りは次の回に回す(作り直されて無くなったレイヤーのタイルは捨てる)
+    tiles.clear();
+    for (auto it = pending.begin(); it != pending.end() && tiles.size() < MAX_TILES;) {
+        std::set<TileCoord>& coords = it->second;
+        while (!coords.empty() && tiles.size() < MAX_TILES) {
+            if (layerIDs.count(it->first)) {
+                tiles.push_back({it->first, coords.begin()->x, coords.begin()->y, {}});
+            }
+            coords.erase(coords.begin());
+        }
+        it = coords.empty() ? pending.erase(it) : std::next(it);
+    }
+    if (tiles.empty()) {
+        // 要求された保存と全体保存の最後の回は、タイルが無くてもINDX(レイヤー情報)を書く
+        if (!forced && !writer.isPartial()) {
+            return false;
+        }
+        captureStart = Clock::now();
+        blitMs = 0.0;
+        readMs = 0.0;
+        copyMs = 0.0;
+        blitFrames = 0;
+        readFrames = 0;
+        startWrite();
+        return true;
+    }
+
+    tileSize = info.tileSize;
+    int count = static_cast<int>(tiles.size());
+    atlasWidth = std::min(count, ATLAS_COLUMNS) * tileSize;
+    atlasHeight = (count + ATLAS_COLUMNS - 1) / ATLAS_COLUMNS * tileSize;
+
+    glGenTextures(1, &atlasTexture);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasWidth, atlasHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &atlasFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, atlasFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlasTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    captureStart = Clock::now();
+    nextBlit = 0;
+    nextRow = 0;
+    blitMs = 0.0;
+    readMs = 0.0;
+    blitFrames = 0;
+    readFrames = 0;
+    state = State::Capturing;
+    return true;
+}
+
+void Autosaver::blitTiles(Clock::time_point deadline) {
+    TRACE_SCOPE("Autosaver::blit");
+    Clock::time_point start = Clock::now();
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, atlasFbo);
+    do {
+        const ProjectTile& tile = tiles[nextBlit];
+        int dstX = static_cast<int>(nextBlit % ATLAS_COLUMNS) * tileSize;
+        int dstY = static_cast<int>(nextBlit / ATLAS_COLUMNS) * tileSize;
+        canvas.blitLayerTile(tile.layerID, tile.tileX, tile.tileY, dstX, dstY);
+        nextBlit++;
+    } while (nextBlit < tiles.size() && Clock::now() < deadline);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    blitMs += millisecondsSince(start);
+    blitFrames++;
+
+    if (nextBlit < tiles.size()) {
+        return;
+    }
+    // 全タイルをコピーし終えた時点がスナップショット。ここから先はキャンバスを書き換えてよい
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(atlasWidth) * atlasHeight * 4, nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    // 読み出しはコピーの完了後に始め、読み出し命令がコピーの完了待ちで止まらないようにする
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    state = State::Reading;
+}
+
+void Autosaver::readRows(Clock::time_point deadline) {
+    if (fence) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            return;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    TRACE_SCOPE("Autosaver::readRows");
+    Clock::time_point start = Clock::now();
+    glBindFramebuffer(GL_FRAMEBUFFER, atlasFbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    do {
+        // 読み出しのたびに描画の完了待ちが入る実装もあるため、タイル1行分ずつまとめて読む
+        glReadPixels(0, nextRow, atlasWidth, tileSize, GL_RGBA, GL_UNSIGNED_BYTE,
+                     reinterpret_cast<void*>(static_cast<size_t>(nextRow) * atlasWidth * 4));
+        nextRow += tileSize;
+    } while (nextRow < atlasHeight && Clock::now() < deadline);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    readMs += millisecondsSince(start);
+    readFrames++;
+
+    if (nextRow >= atlasHeight) {
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // フェンスが評価されるようコマンドをGPUへ送る
+        glFlush();
+        state = State::Waiting;
+    }
+}
+
+void Autosaver::copyLoop() {
+    TRACE_THREAD_NAME("autosave");
+    TRACE_SCOPE("Autosaver::copy");
+    Clock::time_point start = Clock::now();
+    size_t rowBytes = static_cast<size_t>(tileSize) * 4;
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        int column = static_cast<int>(i % ATLAS_COLUMNS);
+        int row = static_cast<int>(i / ATLAS_COLUMNS);
+        const uint8_t* src = mapped + (static_cast<size_t>(row) * tileSize * atlasWidth + column * tileSize) * 4;
+
+        // 初期状態(白の透明)のタイルはファイルから除く
+        bool blank = true;
+        for (int y = 0; y < tileSize && blank; ++y) {
+            const uint8_t* line = src + static_cast<size_t>(y) * atlasWidth * 4;
+            for (size_t p = 0; p < rowBytes && blank; p += 4) {
+                blank = line[p] == 255 && line[p + 1] == 255 && line[p + 2] == 255 && line[p + 3] == 0;
+            }
+        }
+        if (blank) {
+            continue;
+        }
+        std::vector<uint8_t>& pixels = tiles[i].pixels;
+        pixels.resize(rowBytes * tileSize);
+        for (int y = 0; y < tileSize; ++y) {
+            std::memcpy(pixels.data() + y * rowBytes, src + static_cast<size_t>(y) * atlasWidth * 4, rowBytes);
+        }
+    }
+    copyMs = millisecondsSince(start);
+    workerDone = true;
+}
+
+void Autosaver::startWrite() {
+    std::cout << name << " captured: " << tiles.size() << " tiles (blit " << blitMs << " ms over " << blitFrames
+              << " frames, readback " << readMs << " ms over " << readFrames << " frames, copy " << copyMs
+              << " ms, ready after " << millisecondsSince(captureStart) << " ms"
+              << (pending.empty() ? "" : ", more tiles pending") << ")" << std::endl;
+
+    // 書き込みに失敗しても、次の回はファイルを確かめて全体を書き直す
+    hasFile = true;
+    state = writer.begin(filename, info, std::move(tiles), full, pending.empty()) ? State::Writing : State::Idle;
+    tiles.clear();
+}
+
+void Autosaver::cancel() {
+    // 取り出したタイルは次の回に回す
+    for (const ProjectTile& tile : tiles) {
+        pending[tile.layerID].insert({tile.tileX, tile.tileY});
+    }
+    tiles.clear();
+    releaseGpuResources();
+    state = State::Idle;
+}
+
+void Autosaver::adopt(const ProjectIndex& index) {
+    finish();
+    writer.adopt(filename, index);
+    hasFile = true;
+    pending.clear();
+    steps = 0;
+    lastCapture = Clock::now();
+}
+
+void Autosaver::finish() {
+    while (state != State::Idle) {
+        // コピー・読み出し・書き込みの完了をブロックして待つ
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        } else if (state == State::Copying) {
+            while (!workerDone) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        } else if (state == State::Writing) {
+            writer.finish();
+        }
+        advance(Clock::time_point::max());
+    }
+}
+
+void Autosaver::flush() {
+    finish();
+    while (capture()) {
+        finish();
+    }
+}
+
+void Autosaver::drain() {
+    finish();
+    while ((requested || !pending.empty() || writer.isPartial()) && capture()) {
+        finish();
+    }
+}
+
+void Autosaver::releaseGpuResources() {
+    if (fence) {
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    if (mapped) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        mapped = nullptr;
+    }
+    glDeleteBuffers(1, &pbo);
+    glDeleteFramebuffers(1, &atlasFbo);
+    glDeleteTextures(1, &atlasTexture);
+    pbo = 0;
+    atlasFbo = 0;
+    atlasTexture = 0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <GL/glew.h>
+#include "ProjectFile.hpp"
+#include "Rendering/Canvas.hpp"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 描画を止めない自動保存(プロジェクトファイルへの差分追記)
+// Sキーでのプロジェクト保存(SaveTarget::Project)も同じ手順で、requestSaveを受けて保存する
+//
+// 1. Capturing: 前回以降に変わったタイルをGPU上でアトラステクスチャへコピー
+//    コピーし終えた時点がスナップショットとなる。コピー中はAppがキャンバスに触れるコマンドを待たせる
+// 2. Reading: コピーのフェンス通過後、アトラスをタイル1行ずつPBOへ読み出し、最後にフェンスを置く
+// 3. Copying: フェンス通過後にマップし、ワーカーが初期状態のタイルを除いてバッファへ写す
+// 4. Writing: ProjectWriterで圧縮・追記(初回やファイルが変わっていたときは全体保存)
+//
+// 描画スレッドで行うコピーと読み出し命令は1フレームあたりの時間の目安を超えたら次のフレームへ回す。
+// 1回に扱うタイル数の上限を超えた分は、続けて次の回で保存する。
+// 全体保存が何回かにまたがるときは一時ファイルへ書き足し、最後の回で置き換える。
+// 回の間に描き変わったタイルは、次の保存で書き直される。
+class Autosaver {
+public:
+    // intervalSeconds: 前回からこの秒数が経てば保存(0以下なら時間では保存しない)
+    // stepInterval: 履歴のステップがこの数だけ増えれば保存(0以下ならステップ数では保存しない)
+    // target: 変わったタイルを取り出す保存先(Projectなら全体保存では全タイルを読み、メッセージも保存として出す)
+    Autosaver(Canvas& canvas, const std::string& filename, double intervalSeconds, int stepInterval,
+              SaveTarget target = SaveTarget::Autosave);
+    ~Autosaver();
+
+    // コピー禁止
+    Autosaver(const Autosaver&) = delete;
+    Autosaver& operator=(const Autosaver&) = delete;
+
+    // 履歴のステップが1つ増えた(ストローク・Undo/Redo・画像読み込み)
+    void countStep() { steps++; }
+
+    // 今の状態を保存する(Sキー)。変わったタイルが無くてもレイヤー情報を書く
+    // canCapture: 今すぐコピーを始めてよいか(だめなら次のupdateで始める)
+    void requestSave(bool canCapture);
+
+    // 毎フレーム描画スレッドから呼び、状態を進める
+    // canCapture: ストローク中・読み込み中でなく、キャンバスが区切りの良い状態か
+    void update(bool canCapture);
+
+    // 自動保存先のファイルを読み込んだ(以降はそのファイルへの差分になる)
+    void adopt(const ProjectIndex& index);
+
+    // 実行中の保存を完了まで待機
+    void finish();
+
+    // 残りの変更もすべて保存し、完了まで待機(終了時用)
+    void flush();
+
+    // 要求された保存と、分けて保存している残りの回を完了まで進める(それ以降の変更は保存しない、終了時用)
+    void drain();
+
+    const std::string& getFilename() const { return filename; }
+    bool isBusy() const { return state != State::Idle; }
+    // アトラスへのコピー中(キャンバスを書き換えてはいけない)
+    bool isCapturing() const { return state == State::Capturing; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // 1回で扱うタイル数の上限(128pxタイルで64MB)
+    static constexpr size_t MAX_TILES = 1024;
+    // アトラスの横に並べるタイル数
+    static constexpr int ATLAS_COLUMNS = 32;
+    // 1フレームにコピーと読み出し命令へ使う時間の目安
+    static constexpr double FRAME_BUDGET_MS = 4.0;
+
+    enum class State {
+        Idle,
+        Capturing,  // タイルをアトラスへコピー中
+        Reading,    // コピーの完了待ちとPBOへの読み出しの発行
+        Waiting,    // フェンスの通過待ち
+        Copying,    // ワーカーがマップしたPBOからタイルを写している
+        Writing     // ProjectWriterが圧縮・書き込み中
+    };
+
+    Canvas& canvas;
+    std::string filename;
+    double intervalSeconds;
+    int stepInterval;
+    SaveTarget target;
+    const char* name;  // メッセージの見出し
+    int steps = 0;
+    bool requested = false;  // requestSaveを受けてまだ始めていない
+    Clock::time_point lastCapture;
+
+    State state = State::Idle;
+    ProjectWriter writer;
+    bool hasFile = false;  // 一度でも書き込んだ(または読み込んだ)か
+
+    // 取り出したがまだ保存していないタイル(layerID -> タイル)
+    std::map<int, std::set<TileCoord>> pending;
+
+    // 実行中の回の内容
+    ProjectInfo info;
+    std::vector<ProjectTile> tiles;  // アトラス上のi番目のタイル
+    bool full = false;
+    int tileSize = 0;
+    int atlasWidth = 0;
+    int atlasHeight = 0;
+    size_t nextBlit = 0;  // 次にアトラスへコピーするタイル
+    int nextRow = 0;      // 次にPBOへ読み出すアトラスの行
+
+    GLuint atlasTexture = 0;
+    GLuint atlasFbo = 0;
+    GLuint pbo = 0;
+    GLsync fence = nullptr;
+    const uint8_t* mapped = nullptr;
+
+    std::thread worker;
+    std::atomic<bool> workerDone{false};
+
+    // 計測
+    Clock::time_point captureStart;
+    double blitMs = 0.0;   // 描画スレッドでのアトラスへのコピー
+    double readMs = 0.0;   // 描画スレッドでの読み出し命令
+    int blitFrames = 0;
+    int readFrames = 0;
+    double copyMs = 0.0;   // ワーカーでのタイルへの書き写し
+
+    bool isDue() const;
+    bool capture();
+    void advance(Clock::time_point deadline);
+    void blitTiles(Clock::time_point deadline);
+    void readRows(Clock::time_point deadline);
+    void copyLoop();
+    void startWrite();
+    void cancel();
+    void releaseGpuResources();
+};
@@ -0,0 +1,335 @@
+#include "ImageExporter.hpp"
+#include "Profiling/Trace.hpp"
+#include <iostream>
+#include <algorithm>
+
+namespace {
+
+// 1本の帯の目安サイズ(これをタイル行単位に丸める)
+constexpr size_t BAND_BYTES = 8 * 1024 * 1024;
+
+}  // namespace
+
+ImageExporter::~ImageExporter() {
+    finish();
+}
+
+bool ImageExporter::begin(GLuint texture, int width, int height, int tileSize, const std::string& filename) {
+    if (state != State::Idle) {
+        std::cerr << "Export already in progress: " << this->filename << std::endl;
+        return false;
+    }
+    ImageFormat format = imageFormatFromFilename(filename);
+    if (format == ImageFormat::Unknown) {
+        std::cerr << "Unsupported image format (use .png, .qoi or .rgba): " << filename << std::endl;
+        return false;
+    }
+    TRACE_SCOPE("ImageExporter::begin");
+
+    this->filename = filename;
+    this->format = format;
+    this->width = width;
+    this->height = height;
+    startTime = Clock::now();
+    encodeMs = 0.0;
+    progress = 0.0f;
+    lastReportedPercent = -1;
+
+    // 帯の高さはタイル行の倍数(最低1タイル行)
+    size_t tileRowBytes = static_cast<size_t>(width) * 4 * tileSize;
+    int tileRows = static_cast<int>(std::max<size_t>(1, BAND_BYTES / tileRowBytes));
+    bandRows = std::min(height, tileRows * tileSize);
+    bandCount = (height + bandRows - 1) / bandRows;
+    nextRead = 0;
+
+    createSnapshot(texture);
+
+    size_t bandBytes = static_cast<size_t>(bandRows) * width * 4;
+    for (Band& band : bands) {
+        glGenBuffers(1, &band.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, band.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(bandBytes), nullptr, GL_STREAM_READ);
+        band.stage = BandStage::Free;
+        band.index = -1;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (Band& band : bands) {
+        if (nextRead < bandCount) {
+            issueReadback(band);
+        }
+    }
+    // フェンスが評価されるようコマンドをGPUへ送る
+    glFlush();
+
+    workerDone = false;
+    workerSucceeded = false;
+    worker = std::thread(&ImageExporter::encodeLoop, this);
+    state = State::Exporting;
+
+    std::cout << "Export started: " << filename << " (" << bandCount << " bands of " << bandRows
+              << " rows, " << (bandBytes * RING_SIZE) / (1024 * 1024) << " MB in flight)" << std::endl;
+    return true;
+}
+
+void ImageExporter::createSnapshot(GLuint texture) {
+    // 保存中も描画を続けられるよう、GPU上でキャンバス全体をコピーしておく
+    glGenTextures(1, &snapshotTexture);
+    glBindTexture(GL_TEXTURE_2D, snapshotTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &snapshotFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, snapshotFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, snapshotTexture, 0);
+
+    GLuint sourceFbo;
+    glGenFramebuffers(1, &sourceFbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFbo);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, snapshotFbo);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &sourceFbo);
+}
+
+void ImageExporter::issueReadback(Band& band) {
+    TRACE_SCOPE("ImageExporter::readBand");
+    int index = nextRead++;
+    int firstRow = index * bandRows;
+    band.index = index;
+    band.rows = std::min(bandRows, height - firstRow);
+
+    // PNG/QOIは画像の上(GLの最終行側)から、下から上の並びで書くRAWはGLの先頭行から読む
+    band.glY = (format == ImageFormat::Raw) ? firstRow : height - firstRow - band.rows;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, snapshotFbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, band.pbo);
+    glReadPixels(0, band.glY, width, band.rows, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    band.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    band.stage = BandStage::Reading;
+}
+
+void ImageExporter::update() {
+    if (state != State::Exporting) {
+        return;
+    }
+
+    bool issued = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Band& band : bands) {
+            // エンコード済みの帯をアンマップし、次の帯の読み出しに使う
+            if (band.stage == BandStage::Encoded) {
+                if (band.mapped) {
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, band.pbo);
+                    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                    band.mapped = nullptr;
+                }
+                band.stage = BandStage::Free;
+                band.index = -1;
+            }
+
+            if (band.stage == BandStage::Free && nextRead < bandCount) {
+                issueReadback(band);
+                issued = true;
+            }
+
+            // 読み出しが完了した帯をマップしてワーカーへ渡す
+            if (band.stage == BandStage::Reading) {
+                GLenum status = glClientWaitSync(band.fence, 0, 0);
+                if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                    TRACE_SCOPE("ImageExporter::map");
+                    glDeleteSync(band.fence);
+                    band.fence = nullptr;
+
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, band.pbo);
+                    band.mapped = static_cast<const uint8_t*>(glMapBufferRange(
+                        GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(band.rows) * width * 4,
+                        GL_MAP_READ_BIT));
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                    if (!band.mapped) {
+                        std::cerr << "Export failed: could not map pixel buffer" << std::endl;
+                    }
+                    band.stage = BandStage::Encoding;
+                    bandReady.notify_one();
+                }
+            }
+        }
+    }
+    if (issued) {
+        glFlush();
+    }
+
+    if (workerDone.load()) {
+        completeExport();
+    }
+    reportProgress();
+}
+
+void ImageExporter::finish() {
+    while (state == State::Exporting) {
+        // 読み出し中の帯はGPUの完了までブロックして待つ
+        for (Band& band : bands) {
+            if (band.fence) {
+                glClientWaitSync(band.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            }
+        }
+        update();
+        if (state == State::Exporting) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+void ImageExporter::completeExport() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+    releaseGpuResources();
+    pngWriter.reset();
+    qoiWriter.reset();
+    rawWriter.reset();
+
+    if (workerSucceeded) {
+        double totalMs = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+        std::cout << "Export saved: " << filename << " (total " << totalMs
+                  << " ms, encode+write " << encodeMs << " ms)" << std::endl;
+    }
+    state = State::Idle;
+}
+
+void ImageExporter::releaseGpuResources() {
+    for (Band& band : bands) {
+        if (band.fence) {
+            glDeleteSync(band.fence);
+            band.fence = nullptr;
+        }
+        if (band.mapped) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, band.pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            band.mapped = nullptr;
+        }
+        glDeleteBuffers(1, &band.pbo);
+        band.pbo = 0;
+        band.stage = BandStage::Free;
+        band.index = -1;
+    }
+    glDeleteFramebuffers(1, &snapshotFbo);
+    glDeleteTextures(1, &snapshotTexture);
+    snapshotFbo = 0;
+    snapshotTexture = 0;
+}
+
+void ImageExporter::encodeLoop() {
+    TRACE_THREAD_NAME("export");
+    TRACE_SCOPE("ImageExporter::encode");
+
+    bool ok = openWriter();
+    for (int next = 0; next < bandCount; ++next) {
+        // 帯は読み出し完了順にマップされるため、書き出し順の帯を待つ
+        Band* band = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bandReady.wait(lock, [&]() {
+                for (Band& b : bands) {
+                    if (b.index == next && b.stage == BandStage::Encoding) {
+                        band = &b;
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+
+        // 失敗後も帯を解放するため最後まで回す
+        if (ok) {
+            auto t0 = Clock::now();
+            ok = writeBand(*band);
+            encodeMs += std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        band->stage = BandStage::Encoded;
+    }
+    ok = finishWriter() && ok;
+
+    if (!ok) {
+        // throwせずユーザーに保存の再試行の機会を与える
+        std::cerr << "Error saving image: " << filename << std::endl;
+    } else {
+        workerSucceeded = true;
+    }
+    progress = 1.0f;
+    workerDone = true;
+}
+
+bool ImageExporter::openWriter() {
+    switch (format) {
+        case ImageFormat::Png:
+            pngWriter = std::make_unique<PngWriter>(filename, width, height);
+            pngWriter->setProgress(&progress);
+            return pngWriter->isOpen();
+        case ImageFormat::Qoi:
+            qoiWriter = std::make_unique<QoiWriter>(filename, width, height);
+            qoiWriter->setProgress(&progress);
+            return qoiWriter->isOpen();
+        case ImageFormat::Raw:
+            // GLの行順のまま書き、反転は読み込み側で行う
+            rawWriter = std::make_unique<RawImageWriter>(filename, width, height, RAW_BOTTOM_UP);
+            rawWriter->setProgress(&progress);
+            return rawWriter->isOpen();
+        case ImageFormat::Unknown:
+            break;
+    }
+    return false;
+}
+
+bool ImageExporter::writeBand(const Band& band) {
+    TRACE_SCOPE("ImageExporter::writeBand");
+    if (!band.mapped) {
+        return false;
+    }
+    if (format == ImageFormat::Raw) {
+        // マップしたPBOをそのまま書き出す
+        return rawWriter->writeRows(band.mapped, band.rows);
+    }
+
+    // 帯は下から上の行順のため、帯の最終行から負のストライドで読み、エンコードしながら反転する
+    ptrdiff_t stride = static_cast<ptrdiff_t>(width) * 4;
+    const uint8_t* topRow = band.mapped + stride * (band.rows - 1);
+    if (format == ImageFormat::Png) {
+        return pngWriter->writeRows(topRow, band.rows, -stride);
+    }
+    return qoiWriter->writeRows(topRow, band.rows, -stride);
+}
+
+bool ImageExporter::finishWriter() {
+    if (pngWriter) {
+        return pngWriter->finish();
+    }
+    if (qoiWriter) {
+        return qoiWriter->finish();
+    }
+    if (rawWriter) {
+        return rawWriter->finish();
+    }
+    return false;
+}
+
+void ImageExporter::reportProgress() {
+    if (state == State::Idle) {
+        return;
+    }
+    int percent = static_cast<int>(progress.load() * 100.0f) / PROGRESS_STEP_PERCENT * PROGRESS_STEP_PERCENT;
+    if (percent != lastReportedPercent && percent > 0 && percent < 100) {
+        lastReportedPercent = percent;
+        std::cout << "Exporting " << filename << ": " << percent << "%" << std::endl;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <GL/glew.h>
+#include "ImageFormat.hpp"
+#include "PngWriter.hpp"
+#include "QoiCodec.hpp"
+#include "RawImage.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// 描画を止めない、帯単位のストリーミング画像保存
+//
+// 1. begin: キャンバスをGPU上のスナップショットテクスチャへコピー
+//    (以降の描画は保存内容に影響しない)
+// 2. update: タイル行の帯ごとにPBOへ読み出し、フェンス通過後にマップしてワーカーへ渡す
+// 3. ワーカー: 帯を画像の上から順にエンコーダへ流し込む(反転とフィルタは帯ごとに行う)
+// 4. update: エンコード済みの帯をアンマップしてPBOを次の帯に再利用
+//
+// CPU側で同時に保持するのはPBOリングの数本の帯だけで、キャンバスサイズに依存しない。
+// 形式はファイル名の拡張子(.png/.qoi/.rgba)で選ぶ。
+class ImageExporter {
+public:
+    enum class State {
+        Idle,
+        Exporting
+    };
+
+    ImageExporter() = default;
+    ~ImageExporter();
+
+    // コピー禁止
+    ImageExporter(const ImageExporter&) = delete;
+    ImageExporter& operator=(const ImageExporter&) = delete;
+
+    // 保存を開始(実行中や未対応の拡張子ならfalse)。描画スレッドから呼ぶ
+    // tileSize: 帯の高さはこの倍数に揃える
+    bool begin(GLuint texture, int width, int height, int tileSize, const std::string& filename);
+
+    // 毎フレーム描画スレッドから呼び、状態を進める
+    void update();
+
+    // 完了まで待機(終了時用)
+    void finish();
+
+    bool isBusy() const { return state != State::Idle; }
+    State getState() const { return state; }
+
+    // 0.0〜1.0の進捗
+    float getProgress() const { return progress.load(); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // 同時に読み出し・エンコードする帯の数
+    static constexpr int RING_SIZE = 3;
+
+    enum class BandStage {
+        Free,
+        Reading,   // GPUからの読み出し待ち
+        Encoding,  // マップ済み、ワーカーが処理中または待ち
+        Encoded    // アンマップ待ち
+    };
+
+    struct Band {
+        GLuint pbo = 0;
+        GLsync fence = nullptr;
+        const uint8_t* mapped = nullptr;
+        int index = -1;  // 書き出し順の帯番号
+        int glY = 0;     // 読み出すGL座標の先頭行
+        int rows = 0;
+        BandStage stage = BandStage::Free;
+    };
+
+    State state = State::Idle;
+    std::string filename;
+    ImageFormat format = ImageFormat::Png;
+    int width = 0;
+    int height = 0;
+    int bandRows = 0;
+    int bandCount = 0;
+    int nextRead = 0;  // 次に読み出す帯番号(描画スレッド)
+
+    // スナップショット(読み出し元)
+    GLuint snapshotTexture = 0;
+    GLuint snapshotFbo = 0;
+
+    // bandsのstageとmappedはmutexで保護
+    Band bands[RING_SIZE];
+    std::mutex mutex;
+    std::condition_variable bandReady;
+
+    std::thread worker;
+    std::atomic<bool> workerDone{false};
+    std::atomic<bool> workerSucceeded{false};
+    std::atomic<float> progress{0.0f};
+    int lastReportedPercent = -1;
+    // 進捗を出力する刻み(開始と完了は別の行で出力する)
+    static constexpr int PROGRESS_STEP_PERCENT = 10;
+
+    std::unique_ptr<PngWriter> pngWriter;
+    std::unique_ptr<QoiWriter> qoiWriter;
+    std::unique_ptr<RawImageWriter> rawWriter;
+
+    Clock::time_point startTime;
+    double encodeMs = 0.0;  // ワーカーでの累計(完了後に描画スレッドが読む)
+
+    void createSnapshot(GLuint texture);
+    void releaseGpuResources();
+    void issueReadback(Band& band);
+    void completeExport();
+    void encodeLoop();
+    bool openWriter();
+    bool writeBand(const Band& band);
+    bool finishWriter();
+    void reportProgress();
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+// 保存・読み込みに対応する画像形式(拡張子で選択)
+enum class ImageFormat {
+    Png,      // .png  圧縮率重視
+    Qoi,      // .qoi  高速な可逆圧縮
+    Raw,      // .rgba ヘッダー付き無圧縮RGBA
+    Unknown
+};
+
+// 小文字にした拡張子(無ければ空)
+inline std::string filenameExtension(const std::string& filename) {
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos) {
+        return "";
+    }
+    std::string ext = filename.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext;
+}
+
+inline ImageFormat imageFormatFromFilename(const std::string& filename) {
+    std::string ext = filenameExtension(filename);
+    if (ext == "png") {
+        return ImageFormat::Png;
+    }
+    if (ext == "qoi") {
+        return ImageFormat::Qoi;
+    }
+    if (ext == "rgba") {
+        return ImageFormat::Raw;
+    }
+    return ImageFormat::Unknown;
+}
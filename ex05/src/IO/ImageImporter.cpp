@@ -0,0 +1,268 @@
+#include "ImageImporter.hpp"
+#include "History/HistoryManager.hpp"
+#include "Rendering/TileSystem.hpp"
+#include "Profiling/Trace.hpp"
+#include <algorithm>
+#include <iostream>
+
+ImageImporter::~ImageImporter() {
+    // GLリソースは描画スレッドのfinishで解放済みの前提。ワーカーだけは確実に止める
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborting = true;
+    }
+    bandReady.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+bool ImageImporter::begin(GLuint texture, int layerID, TileSystem& tileSystem, int canvasSize, int tileSize,
+                          const std::string& filename, HistoryManager& historyManager) {
+    if (busy) {
+        std::cerr << "Import already in progress: " << this->filename << std::endl;
+        return false;
+    }
+    reader = openImageReader(filename);
+    if (!reader) {
+        std::cerr << "Failed to import image: " << filename << std::endl;
+        return false;
+    }
+    TRACE_SCOPE("ImageImporter::begin");
+
+    this->filename = filename;
+    this->texture = texture;
+    this->layerID = layerID;
+    this->tileSystem = &tileSystem;
+    this->canvasSize = canvasSize;
+    this->tileSize = tileSize;
+    imageWidth = reader->getWidth();
+    copyWidth = std::min(imageWidth, canvasSize);
+    copyHeight = std::min(reader->getHeight(), canvasSize);
+    bandCount = (copyHeight + tileSize - 1) / tileSize;
+    bandRowBytes = static_cast<size_t>(imageWidth) * 4;
+    nextDecode = 0;
+    uploadedBands = 0;
+    aborting = false;
+    startTime = Clock::now();
+
+    if (imageWidth > canvasSize || reader->getHeight() > canvasSize) {
+        std::cout << "Image is larger than the canvas; clipped to " << copyWidth << "x" << copyHeight << std::endl;
+    }
+
+    // 読み込み全体を1つの履歴ステップにする
+    historyManager.incrementStepID();
+    stepID = historyManager.getCurrentStepID();
+
+    glGenFramebuffers(1, &readFbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, readFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // 帯はタイル1行分(画像の全幅)
+    for (Band& band : bands) {
+        glGenBuffers(1, &band.pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, band.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bandRowBytes * tileSize), nullptr, GL_STREAM_DRAW);
+        band.stage = BandStage::Free;
+        band.index = -1;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    busy = true;
+    worker = std::thread(&ImageImporter::decodeLoop, this);
+    std::cout << "Import started: " << filename << " (" << reader->getWidth() << "x"
+              << reader->getHeight() << ")" << std::endl;
+
+    update(historyManager);
+    return true;
+}
+
+void ImageImporter::update(HistoryManager& historyManager) {
+    if (!busy) {
+        return;
+    }
+    TRACE_SCOPE("ImageImporter::update");
+
+    Band* decoded = nullptr;
+    bool mapFailed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (Band& band : bands) {
+            // 空いたPBOをマップし、ワーカーに次の帯を直接デコードさせる
+            if (band.stage == BandStage::Free && nextDecode < bandCount) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, band.pbo);
+                band.mapped = static_cast<uint8_t*>(glMapBufferRange(
+                    GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bandRowBytes * tileSize),
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                if (!band.mapped) {
+                    mapFailed = true;
+                    break;
+                }
+                band.index = nextDecode++;
+                band.stage = BandStage::Decoding;
+                bandReady.notify_all();
+            }
+
+            // 1フレームにアップロードするのは最も上の1帯だけ
+            if (band.stage == BandStage::Decoded && (!decoded || band.index < decoded->index)) {
+                decoded = &band;
+            }
+        }
+    }
+    if (mapFailed) {
+        std::cerr << "Import failed: could not map pixel buffer" << std::endl;
+        complete(false);
+        return;
+    }
+    if (!decoded) {
+        return;
+    }
+    if (!decoded->ok) {
+        complete(false);
+        return;
+    }
+
+    uploadBand(*decoded, historyManager);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded->stage = BandStage::Free;
+        decoded->index = -1;
+    }
+    if (++uploadedBands == bandCount) {
+        complete(true);
+    }
+}
+
+void ImageImporter::finish(HistoryManager& historyManager) {
+    while (busy) {
+        update(historyManager);
+        if (busy) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+bool ImageImporter::takeUploadedRows(int& pixelY, int& height) {
+    if (uploadedBottom < 0) {
+        return false;
+    }
+    pixelY = uploadedBottom;
+    height = uploadedTop - uploadedBottom;
+    uploadedBottom = -1;
+    uploadedTop = -1;
+    return true;
+}
+
+void ImageImporter::uploadBand(Band& band, HistoryManager& historyManager) {
+    TRACE_SCOPE("ImageImporter::uploadBand");
+    int firstRow = band.index * tileSize;
+    int rows = std::min(tileSize, copyHeight - firstRow);
+    int pixelY = canvasSize - (band.index + 1) * tileSize;  // GL座標(下が0)でのタイル行
+    int skip = tileSize - rows;  // 帯の下側で画像が無い行数
+    int tilesX = (copyWidth + tileSize - 1) / tileSize;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, band.pbo);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    band.mapped = nullptr;
+
+    // 描画前のタイルをPBOへ読み出す(Undo用)。GLは発行順に処理するため、下の転送より前の内容が入る
+    glBindFramebuffer(GL_FRAMEBUFFER, readFbo);
+    tileSystem->captureTileRow(0, pixelY, tilesX, stepID, layerID, false, historyManager);
+
+    // PBOからタイル単位でテクスチャへ転送(帯の行長は画像の全幅)
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, imageWidth);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (int tx = 0; tx < tilesX; ++tx) {
+        int pixelX = tx * tileSize;
+        int width = std::min(tileSize, copyWidth - pixelX);
+        size_t offset = skip * bandRowBytes + static_cast<size_t>(pixelX) * 4;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, pixelX, pixelY + skip, width, rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    // 描画後のタイルもPBOへ読み出す(Redo用、画像が一部しか掛からないタイルもあるため読み戻す)
+    tileSystem->captureTileRow(0, pixelY, tilesX, stepID, layerID, true, historyManager);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    uploadedBottom = uploadedBottom < 0 ? pixelY : std::min(uploadedBottom, pixelY);
+    uploadedTop = std::max(uploadedTop, pixelY + tileSize);
+}
+
+void ImageImporter::decodeLoop() {
+    TRACE_THREAD_NAME("import");
+    for (int next = 0; next < bandCount; ++next) {
+        Band* band = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            bandReady.wait(lock, [&]() {
+                if (aborting) {
+                    return true;
+                }
+                for (Band& b : bands) {
+                    if (b.index == next && b.stage == BandStage::Decoding) {
+                        band = &b;
+                        return true;
+                    }
+                }
+                return false;
+            });
+            if (aborting) {
+                return;
+            }
+        }
+
+        // 帯はGLの行順(下から上)で置くため、帯の最終行から負のストライドで書く
+        TRACE_SCOPE("ImageImporter::decodeBand");
+        int rows = std::min(tileSize, copyHeight - next * tileSize);
+        uint8_t* topRow = band->mapped + (tileSize - 1) * bandRowBytes;
+        bool ok = reader->readRows(topRow, rows, -static_cast<ptrdiff_t>(bandRowBytes));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        band->ok = ok;
+        band->stage = BandStage::Decoded;
+        if (!ok) {
+            return;
+        }
+    }
+}
+
+void ImageImporter::complete(bool succeeded) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborting = true;
+    }
+    bandReady.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    for (Band& band : bands) {
+        if (band.mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, band.pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            band.mapped = nullptr;
+        }
+        glDeleteBuffers(1, &band.pbo);
+        band.pbo = 0;
+        band.stage = BandStage::Free;
+        band.index = -1;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteFramebuffers(1, &readFbo);
+    readFbo = 0;
+    reader.reset();
+    busy = false;
+
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+    if (succeeded) {
+        std::cout << "Import finished: " << filename << " (" << bandCount << " bands, " << ms << " ms)" << std::endl;
+    } else {
+        // 反映済みのタイルも履歴ステップに含まれるため、Undoで元に戻せる
+        std::cerr << "Import failed: " << filename << std::endl;
+    }
+}
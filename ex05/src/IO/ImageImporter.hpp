@@ -0,0 +1,109 @@
+#pragma once
+#include <GL/glew.h>
+#include "ImageReader.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class HistoryManager;
+class TileSystem;
+
+// 描画を止めない画像の読み込み(PNG/QOI/RAW)
+//
+// 1. begin: 新しい履歴ステップを開始し、デコード用ワーカーを起動
+// 2. update: 空いたPBOをマップしてワーカーへ渡し、タイル1行分の帯をデコードさせる
+// 3. update: デコード済みの帯について、描画前の帯をTileSystemのPBOへ読み出してから
+//    PBO経由でタイル単位にアップロードし、描画後の帯も読み出す(1フレームに1帯)
+//    読み出した帯はフレームの終わりにストロークのキャプチャと同じ処理でタイルごとに履歴へ渡る
+//
+// 画像はキャンバスの左上に置き、はみ出した部分は切り捨てる。
+// 読み込み全体が1つの履歴ステップになるため、1回のUndoで元に戻る。
+class ImageImporter {
+public:
+    ImageImporter() = default;
+    ~ImageImporter();
+
+    // コピー禁止
+    ImageImporter(const ImageImporter&) = delete;
+    ImageImporter& operator=(const ImageImporter&) = delete;
+
+    // textureのレイヤー(layerID)へ読み込みを開始(実行中や開けない場合はfalse)。描画スレッドから呼ぶ
+    // 描画前・描画後のタイルはtileSystemのPBOでキャプチャする(読み込み中は同じものが生きている前提)
+    bool begin(GLuint texture, int layerID, TileSystem& tileSystem, int canvasSize, int tileSize,
+               const std::string& filename, HistoryManager& historyManager);
+
+    // 毎フレーム描画スレッドから呼び、状態を進める
+    void update(HistoryManager& historyManager);
+
+    // 完了まで待機(終了時用)
+    void finish(HistoryManager& historyManager);
+
+    bool isBusy() const { return busy; }
+
+    // 前回の呼び出し以降にアップロードした行の範囲(GL座標)を取り出す。無ければfalse
+    // 表示の更新を書き換えた帯だけに絞るために使う
+    bool takeUploadedRows(int& pixelY, int& height);
+
+    // 0.0〜1.0の進捗
+    float getProgress() const { return bandCount > 0 ? static_cast<float>(uploadedBands) / bandCount : 1.0f; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // 同時にデコード・アップロードする帯の数
+    static constexpr int RING_SIZE = 3;
+
+    enum class BandStage {
+        Free,
+        Decoding,  // マップ済み、ワーカーがデコード中または待ち
+        Decoded    // アップロード待ち
+    };
+
+    struct Band {
+        GLuint pbo = 0;
+        uint8_t* mapped = nullptr;
+        int index = -1;  // 上から数えたタイル行
+        bool ok = false;
+        BandStage stage = BandStage::Free;
+    };
+
+    bool busy = false;
+    std::string filename;
+    std::unique_ptr<ImageReader> reader;  // 実行中はワーカー専用
+
+    GLuint texture = 0;
+    int layerID = 0;
+    TileSystem* tileSystem = nullptr;
+    GLuint readFbo = 0;  // 描画前・描画後タイルの読み出し用
+    int canvasSize = 0;
+    int tileSize = 0;
+    int imageWidth = 0;
+    int copyWidth = 0;   // キャンバスに収まる幅
+    int copyHeight = 0;  // キャンバスに収まる高さ
+    int bandCount = 0;
+    int nextDecode = 0;
+    int uploadedBands = 0;
+    int stepID = 0;
+    size_t bandRowBytes = 0;
+    int uploadedBottom = -1;  // 未取り出しのアップロード範囲(GL座標、無ければ-1)
+    int uploadedTop = -1;
+
+    // bandsのstage・mapped・okはmutexで保護
+    Band bands[RING_SIZE];
+    std::mutex mutex;
+    std::condition_variable bandReady;
+    bool aborting = false;
+
+    std::thread worker;
+    Clock::time_point startTime;
+
+    void decodeLoop();
+    void uploadBand(Band& band, HistoryManager& historyManager);
+    void complete(bool succeeded);
+};
@@ -0,0 +1,28 @@
+#include "ImageReader.hpp"
+#include "ImageFormat.hpp"
+#include "PngReader.hpp"
+#include "QoiCodec.hpp"
+#include "RawImage.hpp"
+#include <iostream>
+
+std::unique_ptr<ImageReader> openImageReader(const std::string& filename) {
+    std::unique_ptr<ImageReader> reader;
+    switch (imageFormatFromFilename(filename)) {
+        case ImageFormat::Png:
+            reader = std::make_unique<PngReader>(filename);
+            break;
+        case ImageFormat::Qoi:
+            reader = std::make_unique<QoiReader>(filename);
+            break;
+        case ImageFormat::Raw:
+            reader = std::make_unique<RawImageReader>(filename);
+            break;
+        case ImageFormat::Unknown:
+            std::cerr << "Unsupported image format (use .png, .qoi or .rgba): " << filename << std::endl;
+            return nullptr;
+    }
+    if (!reader->isOpen()) {
+        return nullptr;
+    }
+    return reader;
+}
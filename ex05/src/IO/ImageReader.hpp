@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// 画像を上から順に行単位で取り出す読み込みの共通インターフェース
+class ImageReader {
+public:
+    virtual ~ImageReader() = default;
+
+    // ヘッダーが正しく読めたか
+    virtual bool isOpen() const = 0;
+    virtual int getWidth() const = 0;
+    virtual int getHeight() const = 0;
+
+    // 次のcount行を8bit RGBAでdstへ展開(stride: dstの行間バイト数、負も可)
+    virtual bool readRows(uint8_t* dst, int count, ptrdiff_t stride) = 0;
+};
+
+// 拡張子(.png/.qoi/.rgba)に応じたリーダーを開く(未対応・失敗時はnullptr)
+std::unique_ptr<ImageReader> openImageReader(const std::string& filename);
@@ -0,0 +1,341 @@
+#include "PngReader.hpp"
+#include "../external/lodepng/lodepng.h"
+#include "Profiling/Trace.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr uint8_t SIGNATURE[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+constexpr size_t INPUT_SIZE = 64 * 1024;
+
+uint32_t getU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16)
+         | (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+int channelsOf(uint8_t colorType) {
+    switch (colorType) {
+        case 0: return 1;  // グレー
+        case 2: return 3;  // RGB
+        case 3: return 1;  // パレット
+        case 4: return 2;  // グレー+アルファ
+        case 6: return 4;  // RGBA
+        default: return 0;
+    }
+}
+
+bool validDepth(uint8_t colorType, uint8_t depth) {
+    switch (colorType) {
+        case 0: return depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+        case 3: return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+        case 2:
+        case 4:
+        case 6: return depth == 8 || depth == 16;
+        default: return false;
+    }
+}
+
+}  // namespace
+
+PngReader::PngReader(const std::string& filename)
+    : ifs(filename, std::ios::binary), input(INPUT_SIZE) {
+    std::memset(&zs, 0, sizeof(zs));
+    if (!ifs.is_open()) {
+        std::cerr << "Failed to open PNG: " << filename << std::endl;
+        return;
+    }
+    valid = parseHeader(filename);
+}
+
+PngReader::~PngReader() {
+    if (zsInitialized) {
+        inflateEnd(&zs);
+    }
+}
+
+bool PngReader::parseHeader(const std::string& filename) {
+    uint8_t signature[8];
+    if (!ifs.read(reinterpret_cast<char*>(signature), sizeof(signature))
+        || std::memcmp(signature, SIGNATURE, sizeof(SIGNATURE)) != 0) {
+        std::cerr << "Not a PNG file: " << filename << std::endl;
+        return false;
+    }
+
+    // 最初のIDATまでのチャンクを読む
+    bool hasHeader = false;
+    while (true) {
+        uint8_t chunkHeader[8];
+        if (!ifs.read(reinterpret_cast<char*>(chunkHeader), sizeof(chunkHeader))) {
+            std::cerr << "PNG has no image data: " << filename << std::endl;
+            return false;
+        }
+        uint32_t length = getU32(chunkHeader);
+        const char* type = reinterpret_cast<const char*>(chunkHeader + 4);
+
+        if (std::memcmp(type, "IDAT", 4) == 0) {
+            idatRemaining = length;
+            break;
+        }
+
+        std::vector<uint8_t> data(length);
+        if (!ifs.read(reinterpret_cast<char*>(data.data()), length)) {
+            break;
+        }
+        ifs.seekg(4, std::ios::cur);  // CRC
+
+        if (std::memcmp(type, "IHDR", 4) == 0 && length == 13) {
+            width = static_cast<int>(getU32(data.data()));
+            height = static_cast<int>(getU32(data.data() + 4));
+            bitDepth = data[8];
+            colorType = data[9];
+            if (width <= 0 || height <= 0 || !validDepth(colorType, bitDepth) || data[10] != 0 || data[11] != 0) {
+                std::cerr << "Unsupported PNG header: " << filename << std::endl;
+                return false;
+            }
+            if (data[12] != 0) {
+                // インターレースは行単位で取り出せないため全体を展開する
+                return loadFallback(filename);
+            }
+            hasHeader = true;
+        } else if (std::memcmp(type, "PLTE", 4) == 0) {
+            for (uint32_t i = 0; i < length / 3 && i < 256; ++i) {
+                palette[i * 4 + 0] = data[i * 3 + 0];
+                palette[i * 4 + 1] = data[i * 3 + 1];
+                palette[i * 4 + 2] = data[i * 3 + 2];
+                palette[i * 4 + 3] = 255;
+            }
+        } else if (std::memcmp(type, "tRNS", 4) == 0) {
+            if (colorType == 3) {
+                for (uint32_t i = 0; i < length && i < 256; ++i) {
+                    palette[i * 4 + 3] = data[i];
+                }
+            } else if ((colorType == 0 && length >= 2) || (colorType == 2 && length >= 6)) {
+                hasColorKey = true;
+                for (uint32_t i = 0; i < length / 2 && i < 3; ++i) {
+                    colorKey[i] = static_cast<uint16_t>((data[i * 2] << 8) | data[i * 2 + 1]);
+                }
+            }
+        } else if (std::memcmp(type, "IEND", 4) == 0) {
+            break;
+        }
+    }
+    if (!hasHeader || ifs.fail()) {
+        std::cerr << "Invalid PNG: " << filename << std::endl;
+        return false;
+    }
+
+    channels = channelsOf(colorType);
+    rowBytes = (static_cast<size_t>(width) * channels * bitDepth + 7) / 8;
+    filterStride = std::max<size_t>(1, static_cast<size_t>(channels) * bitDepth / 8);
+    currentRow.assign(rowBytes + 1, 0);
+    previousRow.assign(rowBytes + 1, 0);
+
+    if (inflateInit(&zs) != Z_OK) {
+        std::cerr << "Failed to initialize zlib" << std::endl;
+        return false;
+    }
+    zsInitialized = true;
+    return true;
+}
+
+bool PngReader::loadFallback(const std::string& filename) {
+    TRACE_SCOPE("PngReader::loadFallback");
+    unsigned w = 0;
+    unsigned h = 0;
+    unsigned error = lodepng::decode(fallbackPixels, w, h, filename);
+    if (error) {
+        std::cerr << "Error loading PNG: " << lodepng_error_text(error) << std::endl;
+        return false;
+    }
+    width = static_cast<int>(w);
+    height = static_cast<int>(h);
+    return true;
+}
+
+bool PngReader::nextIdat() {
+    // 現在のチャンクのCRCを飛ばし、続くIDATへ進む(IDAT以外が来たらデータの終わり)
+    uint8_t chunkHeader[8];
+    ifs.seekg(4, std::ios::cur);
+    if (!ifs.read(reinterpret_cast<char*>(chunkHeader), sizeof(chunkHeader))
+        || std::memcmp(chunkHeader + 4, "IDAT", 4) != 0) {
+        return false;
+    }
+    idatRemaining = getU32(chunkHeader);
+    return true;
+}
+
+bool PngReader::inflateRow() {
+    zs.next_out = currentRow.data();
+    zs.avail_out = static_cast<uInt>(currentRow.size());
+    while (zs.avail_out > 0) {
+        if (zs.avail_in == 0) {
+            while (idatRemaining == 0) {
+                if (!nextIdat()) {
+                    return false;
+                }
+            }
+            size_t n = std::min<size_t>(idatRemaining, input.size());
+            if (!ifs.read(reinterpret_cast<char*>(input.data()), n)) {
+                return false;
+            }
+            idatRemaining -= static_cast<uint32_t>(n);
+            zs.next_in = input.data();
+            zs.avail_in = static_cast<uInt>(n);
+        }
+
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            return zs.avail_out == 0;
+        }
+        if (ret != Z_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PngReader::unfilterRow() {
+    uint8_t* cur = currentRow.data() + 1;
+    const uint8_t* prev = previousRow.data() + 1;
+    size_t bpp = filterStride;
+
+    switch (currentRow[0]) {
+        case 1:  // Sub
+            for (size_t i = bpp; i < rowBytes; ++i) {
+                cur[i] = static_cast<uint8_t>(cur[i] + cur[i - bpp]);
+            }
+            break;
+        case 2:  // Up
+            for (size_t i = 0; i < rowBytes; ++i) {
+                cur[i] = static_cast<uint8_t>(cur[i] + prev[i]);
+            }
+            break;
+        case 3:  // Average
+            for (size_t i = 0; i < bpp; ++i) {
+                cur[i] = static_cast<uint8_t>(cur[i] + (prev[i] >> 1));
+            }
+            for (size_t i = bpp; i < rowBytes; ++i) {
+                cur[i] = static_cast<uint8_t>(cur[i] + ((cur[i - bpp] + prev[i]) >> 1));
+            }
+            break;
+        case 4:  // Paeth
+            for (size_t i = 0; i < bpp; ++i) {
+                cur[i] = static_cast<uint8_t>(cur[i] + prev[i]);
+            }
+            for (size_t i = bpp; i < rowBytes; ++i) {
+                cur[i] = static_cast<uint8_t>(cur[i] + paeth(cur[i - bpp], prev[i], prev[i - bpp]));
+            }
+            break;
+        default:  // None
+            break;
+    }
+}
+
+void PngReader::convertRow(uint8_t* dst) const {
+    const uint8_t* data = currentRow.data() + 1;
+
+    if (colorType == 6 && bitDepth == 8) {
+        std::memcpy(dst, data, rowBytes);
+        return;
+    }
+
+    // i番目のサンプル値(ビット深度のまま)
+    auto sample = [&](size_t i) -> uint32_t {
+        if (bitDepth == 8) {
+            return data[i];
+        }
+        if (bitDepth == 16) {
+            return (static_cast<uint32_t>(data[i * 2]) << 8) | data[i * 2 + 1];
+        }
+        size_t perByte = 8 / bitDepth;
+        int shift = 8 - bitDepth * static_cast<int>(i % perByte + 1);
+        return (data[i / perByte] >> shift) & ((1u << bitDepth) - 1);
+    };
+    // 8bitへの変換
+    auto to8 = [&](uint32_t v) -> uint8_t {
+        if (bitDepth == 16) {
+            return static_cast<uint8_t>(v >> 8);
+        }
+        return static_cast<uint8_t>(v * 255 / ((1u << bitDepth) - 1));
+    };
+
+    for (int x = 0; x < width; ++x) {
+        uint8_t* out = dst + x * 4;
+        size_t base = static_cast<size_t>(x) * channels;
+        switch (colorType) {
+            case 0: {
+                uint32_t g = sample(base);
+                out[0] = out[1] = out[2] = to8(g);
+                out[3] = (hasColorKey && g == colorKey[0]) ? 0 : 255;
+                break;
+            }
+            case 2: {
+                uint32_t r = sample(base);
+                uint32_t g = sample(base + 1);
+                uint32_t b = sample(base + 2);
+                out[0] = to8(r);
+                out[1] = to8(g);
+                out[2] = to8(b);
+                bool keyed = hasColorKey && r == colorKey[0] && g == colorKey[1] && b == colorKey[2];
+                out[3] = keyed ? 0 : 255;
+                break;
+            }
+            case 3:
+                std::memcpy(out, palette + sample(base) * 4, 4);
+                break;
+            case 4:
+                out[0] = out[1] = out[2] = to8(sample(base));
+                out[3] = to8(sample(base + 1));
+                break;
+            case 6:
+                for (int c = 0; c < 4; ++c) {
+                    out[c] = to8(sample(base + c));
+                }
+                break;
+        }
+    }
+}
+
+bool PngReader::readRows(uint8_t* dst, int count, ptrdiff_t stride) {
+    if (!valid) {
+        return false;
+    }
+    TRACE_SCOPE("PngReader::readRows");
+    if (count > height - rowsRead) {
+        std::cerr << "PNG read past end of image" << std::endl;
+        return false;
+    }
+
+    size_t outBytes = static_cast<size_t>(width) * 4;
+    for (int r = 0; r < count; ++r) {
+        uint8_t* row = dst + r * stride;
+        if (!fallbackPixels.empty()) {
+            std::memcpy(row, fallbackPixels.data() + (rowsRead + r) * outBytes, outBytes);
+            continue;
+        }
+        if (!inflateRow()) {
+            std::cerr << "PNG data truncated or corrupt" << std::endl;
+            valid = false;
+            return false;
+        }
+        unfilterRow();
+        convertRow(row);
+        std::swap(currentRow, previousRow);
+    }
+    rowsRead += count;
+    return true;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "ImageReader.hpp"
+#include <zlib.h>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// PNGのストリーミングデコーダ(上から順に行単位で取り出す)
+//
+// IDATをzlibで少しずつ展開し、1行ずつフィルタを戻してRGBAへ変換するため、
+// 画像全体をメモリに展開しない。非インターレースの全カラータイプ・ビット深度に対応し、
+// インターレース画像のみlodepngで全体を展開してから行を返す。
+class PngReader : public ImageReader {
+public:
+    explicit PngReader(const std::string& filename);
+    ~PngReader() override;
+
+    // コピー禁止
+    PngReader(const PngReader&) = delete;
+    PngReader& operator=(const PngReader&) = delete;
+
+    bool isOpen() const override { return valid; }
+    int getWidth() const override { return width; }
+    int getHeight() const override { return height; }
+
+    bool readRows(uint8_t* dst, int count, ptrdiff_t stride) override;
+
+private:
+    std::ifstream ifs;
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    int rowsRead = 0;
+
+    uint8_t bitDepth = 0;
+    uint8_t colorType = 0;
+    int channels = 0;
+    size_t rowBytes = 0;     // フィルタ種別を除いた1行のバイト数
+    size_t filterStride = 0; // フィルタで参照する左隣までのバイト数(最低1)
+
+    uint8_t palette[256 * 4] = {};
+    bool hasColorKey = false;
+    uint16_t colorKey[3] = {};
+
+    // IDATの展開
+    z_stream zs;
+    bool zsInitialized = false;
+    std::vector<uint8_t> input;
+    uint32_t idatRemaining = 0;
+    std::vector<uint8_t> currentRow;   // 先頭1バイトはフィルタ種別
+    std::vector<uint8_t> previousRow;
+
+    // インターレース画像用(lodepngで展開した全体)
+    std::vector<uint8_t> fallbackPixels;
+
+    bool parseHeader(const std::string& filename);
+    bool loadFallback(const std::string& filename);
+    bool nextIdat();
+    bool inflateRow();
+    void unfilterRow();
+    void convertRow(uint8_t* dst) const;
+};
@@ -0,0 +1,375 @@
+#include "PngWriter.hpp"
+#include "Profiling/Trace.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t WINDOW_SIZE = 32768;
+constexpr int BPP = 4;
+
+void putU32(uint8_t* out, uint32_t v) {
+    out[0] = static_cast<uint8_t>(v >> 24);
+    out[1] = static_cast<uint8_t>(v >> 16);
+    out[2] = static_cast<uint8_t>(v >> 8);
+    out[3] = static_cast<uint8_t>(v);
+}
+
+// 分岐を使わないPaeth予測
+inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    int bc = (pb <= pc) ? b : c;
+    return static_cast<uint8_t>((pa <= pb && pa <= pc) ? a : bc);
+}
+
+// フィルタ後の値を符号付きとみなした絶対値和(最小のものを採用するヒューリスティック)
+// 符号付きの絶対値はuint8のmin(v, -v)に等しいため、SSE2ではpsadbwで16バイトずつ足す
+inline uint32_t costOf(const uint8_t* data, size_t n) {
+    uint32_t sum = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(_mm_min_epu8(v, _mm_sub_epi8(zero, v)), zero));
+    }
+    sum = static_cast<uint32_t>(_mm_cvtsi128_si32(total) + _mm_cvtsi128_si32(_mm_srli_si128(total, 8)));
+#endif
+    for (; i < n; ++i) {
+        uint8_t v = data[i];
+        sum += std::min(v, static_cast<uint8_t>(-v));
+    }
+    return sum;
+}
+
+// 1バイト分の5種類のフィルタ(a: 左、b: 上、c: 左上)
+inline void filterByte(const uint8_t* row, size_t i, int a, int b, int c, uint8_t* const* candidates) {
+    candidates[0][i] = row[i];
+    candidates[1][i] = static_cast<uint8_t>(row[i] - a);
+    candidates[2][i] = static_cast<uint8_t>(row[i] - b);
+    candidates[3][i] = static_cast<uint8_t>(row[i] - ((a + b) >> 1));
+    candidates[4][i] = static_cast<uint8_t>(row[i] - paeth(a, b, c));
+}
+
+#if defined(__SSE2__)
+inline __m128i absEpi16(__m128i v) {
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// 8画素分(16bitに広げた8バイト)のPaeth予測
+inline __m128i paethEpi16(__m128i a, __m128i b, __m128i c) {
+    __m128i pa = absEpi16(_mm_sub_epi16(b, c));
+    __m128i pb = absEpi16(_mm_sub_epi16(a, c));
+    __m128i pc = absEpi16(_mm_sub_epi16(_mm_add_epi16(a, b), _mm_add_epi16(c, c)));
+    // pa <= pb && pa <= pc ならa、そうでなくpb <= pcならb、それ以外はc
+    __m128i useA = _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi16(pa, pb), _mm_cmpgt_epi16(pa, pc)), _mm_set1_epi16(-1));
+    __m128i useB = _mm_andnot_si128(_mm_cmpgt_epi16(pb, pc), _mm_set1_epi16(-1));
+    __m128i bc = _mm_or_si128(_mm_and_si128(useB, b), _mm_andnot_si128(useB, c));
+    return _mm_or_si128(_mm_and_si128(useA, a), _mm_andnot_si128(useA, bc));
+}
+#endif
+
+// 1行分の5種類のフィルタを試し、コスト最小のものをoutへ書く(先頭1バイトはフィルタ種別)
+void filterRow(const uint8_t* row, const uint8_t* prev, size_t n, uint8_t* out, uint8_t* scratch) {
+    uint8_t* candidates[5];
+    for (int f = 0; f < 5; ++f) {
+        candidates[f] = scratch + f * n;
+    }
+
+    // 先頭の1画素は左と左上が0。以降は分岐なしで16バイトずつ処理する
+    size_t i = 0;
+    for (; i < BPP && i < n; ++i) {
+        filterByte(row, i, 0, prev[i], 0, candidates);
+    }
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - BPP));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + i - BPP));
+        // pavgbは切り上げのため、(a ^ b)の最下位ビットを引いて切り捨てに直す
+        __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+        __m128i predLo = paethEpi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero));
+        __m128i predHi = paethEpi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero));
+        __m128i predicted = _mm_packus_epi16(predLo, predHi);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates[0] + i), x);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates[1] + i), _mm_sub_epi8(x, a));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates[2] + i), _mm_sub_epi8(x, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates[3] + i), _mm_sub_epi8(x, average));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(candidates[4] + i), _mm_sub_epi8(x, predicted));
+    }
+#endif
+    for (; i < n; ++i) {
+        filterByte(row, i, row[i - BPP], prev[i], prev[i - BPP], candidates);
+    }
+
+    int best = 0;
+    uint32_t bestCost = UINT32_MAX;
+    for (int f = 0; f < 5; ++f) {
+        uint32_t cost = costOf(candidates[f], n);
+        if (cost < bestCost) {
+            bestCost = cost;
+            best = f;
+        }
+    }
+
+    out[0] = static_cast<uint8_t>(best);
+    std::memcpy(out + 1, candidates[best], n);
+}
+
+struct ChunkJob {
+    int firstRow;
+    int rowCount;
+    std::vector<uint8_t> filtered;
+    std::vector<uint8_t> compressed;
+    uint32_t adler;
+    bool ok;
+};
+
+}  // namespace
+
+PngWriter::PngWriter(const std::string& filename, int width, int height, int threads, int level)
+    : ofs(filename, std::ios::binary | std::ios::trunc),
+      width(width), height(height), level(level),
+      rowBytes(static_cast<size_t>(width) * BPP) {
+    this->threads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    prevRow.assign(rowBytes, 0);
+
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to open PNG for writing: " << filename << std::endl;
+        return;
+    }
+
+    static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    ofs.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    uint8_t ihdr[13];
+    putU32(ihdr, static_cast<uint32_t>(width));
+    putU32(ihdr + 4, static_cast<uint32_t>(height));
+    ihdr[8] = 8;   // ビット深度
+    ihdr[9] = 6;   // RGBA
+    ihdr[10] = 0;  // 圧縮方式
+    ihdr[11] = 0;  // フィルタ方式
+    ihdr[12] = 0;  // インターレースなし
+    writeChunk("IHDR", ihdr, sizeof(ihdr));
+
+    // zlibヘッダー(CMF=0x78: deflate/32KB窓、FLGはチェック値を満たすよう選択)
+    uint8_t zlibHeader[2] = {0x78, 0x9C};
+    writeChunk("IDAT", zlibHeader, sizeof(zlibHeader));
+}
+
+PngWriter::~PngWriter() {
+    stopWorkers();
+}
+
+void PngWriter::workerLoop() {
+    TRACE_THREAD_NAME("png-encoder");
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(taskMutex);
+            taskCond.wait(lock, [this]() { return !tasks.empty() || stopping; });
+            if (tasks.empty()) {
+                break;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(taskMutex);
+            if (--unfinished == 0) {
+                doneCond.notify_all();
+            }
+        }
+    }
+}
+
+void PngWriter::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        stopping = true;
+    }
+    taskCond.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void PngWriter::runParallel(size_t count, const std::function<void(size_t)>& fn) {
+    if (count > 1 && workers.empty() && !stopping) {
+        for (int i = 1; i < threads; ++i) {
+            workers.emplace_back(&PngWriter::workerLoop, this);
+        }
+    }
+
+    if (!workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(taskMutex);
+            for (size_t i = 1; i < count; ++i) {
+                tasks.push_back([&fn, i]() { fn(i); });
+            }
+            unfinished += count - 1;
+        }
+        taskCond.notify_all();
+    } else {
+        for (size_t i = 1; i < count; ++i) {
+            fn(i);
+        }
+    }
+    fn(0);
+
+    std::unique_lock<std::mutex> lock(taskMutex);
+    doneCond.wait(lock, [this]() { return unfinished == 0; });
+}
+
+void PngWriter::writeChunk(const char* type, const uint8_t* data, size_t size) {
+    uint8_t header[8];
+    putU32(header, static_cast<uint32_t>(size));
+    std::memcpy(header + 4, type, 4);
+
+    uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+    if (size > 0) {
+        crc = crc32(crc, data, static_cast<uInt>(size));
+    }
+    uint8_t crcBytes[4];
+    putU32(crcBytes, static_cast<uint32_t>(crc));
+
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (size > 0) {
+        ofs.write(reinterpret_cast<const char*>(data), size);
+    }
+    ofs.write(reinterpret_cast<const char*>(crcBytes), sizeof(crcBytes));
+}
+
+bool PngWriter::writeRows(const uint8_t* firstRow, int count, ptrdiff_t stride) {
+    if (!ofs.is_open() || failed) {
+        return false;
+    }
+    TRACE_SCOPE("PngWriter::writeRows");
+    count = std::min(count, height - rowsWritten);
+    if (count <= 0) {
+        return true;
+    }
+
+    // 圧縮率を保つため1チャンクは最低16行
+    int chunkCount = std::max(1, std::min(threads, count / 16));
+    int rowsPerChunk = (count + chunkCount - 1) / chunkCount;
+    std::vector<ChunkJob> jobs;
+    for (int r = 0; r < count; r += rowsPerChunk) {
+        jobs.push_back({r, std::min(rowsPerChunk, count - r), {}, {}, 0, false});
+    }
+
+    auto rowAt = [&](int r) {
+        return firstRow + static_cast<ptrdiff_t>(r) * stride;
+    };
+
+    // 1. 各チャンクの行フィルタ(並列)
+    auto filterJob = [&](ChunkJob& job) {
+        TRACE_SCOPE("PngWriter::filter");
+        job.filtered.resize(static_cast<size_t>(job.rowCount) * (rowBytes + 1));
+        std::vector<uint8_t> scratch(rowBytes * 5);
+        for (int i = 0; i < job.rowCount; ++i) {
+            int r = job.firstRow + i;
+            const uint8_t* prev = (r == 0) ? prevRow.data() : rowAt(r - 1);
+            filterRow(rowAt(r), prev, rowBytes, &job.filtered[i * (rowBytes + 1)], scratch.data());
+        }
+        job.adler = adler32(1L, job.filtered.data(), static_cast<uInt>(job.filtered.size()));
+    };
+
+    // 2. 直前チャンクの末尾を辞書にして圧縮(並列)
+    auto compressJob = [&](size_t index) {
+        TRACE_SCOPE("PngWriter::deflate");
+        ChunkJob& job = jobs[index];
+        const uint8_t* dict = nullptr;
+        size_t dictSize = 0;
+        if (index > 0) {
+            const auto& prev = jobs[index - 1].filtered;
+            dictSize = std::min(prev.size(), WINDOW_SIZE);
+            dict = prev.data() + prev.size() - dictSize;
+        } else if (!dictionary.empty()) {
+            dict = dictionary.data();
+            dictSize = dictionary.size();
+        }
+
+        z_stream zs;
+        std::memset(&zs, 0, sizeof(zs));
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return;
+        }
+        if (dict) {
+            deflateSetDictionary(&zs, dict, static_cast<uInt>(dictSize));
+        }
+
+        job.compressed.resize(deflateBound(&zs, static_cast<uLong>(job.filtered.size())) + 16);
+        zs.next_in = job.filtered.data();
+        zs.avail_in = static_cast<uInt>(job.filtered.size());
+        zs.next_out = job.compressed.data();
+        zs.avail_out = static_cast<uInt>(job.compressed.size());
+
+        // 最終ブロックにせずバイト境界で終える
+        int ret = deflate(&zs, Z_SYNC_FLUSH);
+        job.ok = (ret == Z_OK || ret == Z_BUF_ERROR) && zs.avail_in == 0;
+        job.compressed.resize(job.compressed.size() - zs.avail_out);
+        deflateEnd(&zs);
+    };
+
+    runParallel(jobs.size(), [&](size_t i) { filterJob(jobs[i]); });
+    runParallel(jobs.size(), compressJob);
+
+    // 3. 順番に書き出し、チェックサムを結合
+    for (auto& job : jobs) {
+        if (!job.ok) {
+            failed = true;
+            std::cerr << "PNG compression failed" << std::endl;
+            return false;
+        }
+        adler = adler32_combine(adler, job.adler, static_cast<z_off_t>(job.filtered.size()));
+        writeChunk("IDAT", job.compressed.data(), job.compressed.size());
+    }
+
+    // 次のバッチのための状態
+    std::memcpy(prevRow.data(), rowAt(count - 1), rowBytes);
+    const auto& lastFiltered = jobs.back().filtered;
+    size_t keep = std::min(lastFiltered.size(), WINDOW_SIZE);
+    dictionary.assign(lastFiltered.end() - keep, lastFiltered.end());
+
+    rowsWritten += count;
+    if (progress) {
+        progress->store(static_cast<float>(rowsWritten) / height);
+    }
+    return true;
+}
+
+bool PngWriter::finish() {
+    stopWorkers();
+    if (!ofs.is_open()) {
+        return false;
+    }
+    if (rowsWritten != height) {
+        std::cerr << "PNG incomplete: " << rowsWritten << "/" << height << " rows" << std::endl;
+        failed = true;
+    }
+
+    // 空の最終ブロック(固定ハフマン、BFINAL=1)+ Adler-32
+    uint8_t tail[6] = {0x03, 0x00, 0, 0, 0, 0};
+    putU32(tail + 2, adler);
+    writeChunk("IDAT", tail, sizeof(tail));
+    writeChunk("IEND", nullptr, 0);
+
+    ofs.close();
+    return !failed && !ofs.fail();
+}
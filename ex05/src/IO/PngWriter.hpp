@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 並列圧縮するPNG(8bit RGBA)ライター
+//
+// 行を複数のチャンクに分け、各スレッドでフィルタ選択とDEFLATE圧縮を行う。
+// 各チャンクは直前チャンクの末尾32KBをプリセット辞書とし、Z_SYNC_FLUSHで
+// バイト境界に揃えて終えるため、連結すると単一の有効なzlibストリームになる(pigz方式)。
+// 行は上から順にwriteRowsで何回かに分けて渡せる。
+// 並列処理のスレッドは最初のwriteRowsで作り、finishまで全てのバッチで使い回す。
+class PngWriter {
+public:
+    // threads: 0ならハードウェアスレッド数
+    PngWriter(const std::string& filename, int width, int height, int threads = 0, int level = 6);
+    ~PngWriter();
+
+    // コピー禁止
+    PngWriter(const PngWriter&) = delete;
+    PngWriter& operator=(const PngWriter&) = delete;
+
+    bool isOpen() const { return ofs.is_open(); }
+
+    // 画像の上から順にcount行を追加
+    // stride: 行の先頭間のバイト数(負なら下から上に並んだメモリを上から読む)
+    bool writeRows(const uint8_t* firstRow, int count, ptrdiff_t stride);
+
+    // 残りを書き出してファイルを閉じる
+    bool finish();
+
+    // 進捗の通知先(書き込み済み行数/全行数)
+    void setProgress(std::atomic<float>* target) { progress = target; }
+
+private:
+    std::ofstream ofs;
+    int width;
+    int height;
+    int threads;
+    int level;
+    size_t rowBytes;
+    int rowsWritten = 0;
+    bool failed = false;
+
+    uint32_t adler = 1;
+    std::vector<uint8_t> prevRow;     // 前のバッチの最終行(フィルタ用)
+    std::vector<uint8_t> dictionary;  // 前のバッチのフィルタ後データ末尾(最大32KB)
+    std::atomic<float>* progress = nullptr;
+
+    // 呼び出しスレッドと合わせてthreads本で処理するワーカー(キューのタスクを取り出して実行)
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    size_t unfinished = 0;  // 積んだうち終わっていないタスク数
+    bool stopping = false;
+    std::mutex taskMutex;
+    std::condition_variable taskCond;  // タスクが積まれた・停止する
+    std::condition_variable doneCond;  // 積んだタスクが全て終わった
+
+    void writeChunk(const char* type, const uint8_t* data, size_t size);
+
+    // fn(0)〜fn(count-1)をワーカーと呼び出しスレッドで並列に実行し、全て終わるまで待つ
+    void runParallel(size_t count, const std::function<void(size_t)>& fn);
+    void workerLoop();
+    void stopWorkers();
+};
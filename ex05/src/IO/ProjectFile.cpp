@@ -0,0 +1,625 @@
+#include "ProjectFile.hpp"
+#include "ImageFormat.hpp"
+#include "Profiling/Trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+// 1レイヤー分のINDXの記録: id(i32)、不透明度(f32)、表示(u8)、ブレンドモード(u8)、予約(u16)
+constexpr size_t LAYER_RECORD_SIZE = 12;
+// 1タイル分のINDXの記録: layerID、タイルX、タイルY(各i32)、位置(u64)、長さ(u32)
+constexpr size_t TILE_RECORD_SIZE = 24;
+// TILEのペイロード先頭: layerID、タイルX、タイルY(各i32)、CRC-32(u32)
+constexpr size_t TILE_HEADER_SIZE = 16;
+
+void putU32(uint8_t* out, uint32_t v) {
+    out[0] = static_cast<uint8_t>(v);
+    out[1] = static_cast<uint8_t>(v >> 8);
+    out[2] = static_cast<uint8_t>(v >> 16);
+    out[3] = static_cast<uint8_t>(v >> 24);
+}
+
+uint32_t getU32(const uint8_t* in) {
+    return in[0] | (static_cast<uint32_t>(in[1]) << 8)
+         | (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+void putU64(uint8_t* out, uint64_t v) {
+    putU32(out, static_cast<uint32_t>(v));
+    putU32(out + 4, static_cast<uint32_t>(v >> 32));
+}
+
+uint64_t getU64(const uint8_t* in) {
+    return getU32(in) | (static_cast<uint64_t>(getU32(in + 4)) << 32);
+}
+
+void appendU32(std::vector<uint8_t>& out, uint32_t v) {
+    uint8_t bytes[4];
+    putU32(bytes, v);
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+void appendU64(std::vector<uint8_t>& out, uint64_t v) {
+    uint8_t bytes[8];
+    putU64(bytes, v);
+    out.insert(out.end(), bytes, bytes + 8);
+}
+
+void appendF32(std::vector<uint8_t>& out, float v) {
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    appendU32(out, bits);
+}
+
+// チャンクの種類とペイロード長を書き込む(ペイロード長はpayloadSize)
+void beginChunk(std::vector<uint8_t>& out, const char* type, size_t payloadSize) {
+    out.insert(out.end(), type, type + 4);
+    appendU32(out, static_cast<uint32_t>(payloadSize));
+}
+
+// タイルを圧縮したTILEチャンク(失敗したら空)
+std::vector<uint8_t> buildTileChunk(const ProjectTile& tile) {
+    const Bytef* pixels = tile.pixels.data();
+    uLong rawSize = static_cast<uLong>(tile.pixels.size());
+    uLong bound = compressBound(rawSize);
+
+    std::vector<uint8_t> chunk(ProjectFormat::CHUNK_HEADER_SIZE + TILE_HEADER_SIZE + bound);
+    uint8_t* payload = chunk.data() + ProjectFormat::CHUNK_HEADER_SIZE;
+    putU32(payload, static_cast<uint32_t>(tile.layerID));
+    putU32(payload + 4, static_cast<uint32_t>(tile.tileX));
+    putU32(payload + 8, static_cast<uint32_t>(tile.tileY));
+    putU32(payload + 12, static_cast<uint32_t>(crc32(0L, pixels, static_cast<uInt>(rawSize))));
+
+    // 保存の待ち時間を短くするため速度優先(タイルの大半は単色の広い領域で、これでも十分縮む)
+    uLongf compressedSize = bound;
+    if (compress2(payload + TILE_HEADER_SIZE, &compressedSize, pixels, rawSize, Z_BEST_SPEED) != Z_OK) {
+        return {};
+    }
+    size_t payloadSize = TILE_HEADER_SIZE + compressedSize;
+    std::memcpy(chunk.data(), "TILE", 4);
+    putU32(chunk.data() + 4, static_cast<uint32_t>(payloadSize));
+    chunk.resize(ProjectFormat::CHUNK_HEADER_SIZE + payloadSize);
+    return chunk;
+}
+
+void writeHeader(std::ostream& os, const ProjectInfo& info) {
+    uint8_t header[ProjectFormat::HEADER_SIZE] = {};
+    std::memcpy(header, ProjectFormat::MAGIC, 4);
+    header[4] = static_cast<uint8_t>(ProjectFormat::VERSION);
+    header[5] = static_cast<uint8_t>(ProjectFormat::VERSION >> 8);
+    putU32(header + 8, static_cast<uint32_t>(info.canvasSize));
+    putU32(header + 12, static_cast<uint32_t>(info.tileSize));
+    os.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+void writeTrailer(std::ostream& os, uint64_t indexOffset, size_t indexSize) {
+    uint8_t trailer[ProjectFormat::TRAILER_SIZE];
+    putU64(trailer, indexOffset);
+    putU32(trailer + 8, static_cast<uint32_t>(indexSize));
+    std::memcpy(trailer + 12, ProjectFormat::TRAILER_MAGIC, 4);
+    os.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+}
+
+// 書き込んだ内容をディスクまで書き出す(書き出し済みのストリームを閉じる前に呼ぶ)
+bool syncFile(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+bool fileSizeOf(const std::string& filename, uint64_t& size) {
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open()) {
+        return false;
+    }
+    size = static_cast<uint64_t>(ifs.tellg());
+    return true;
+}
+
+}  // namespace
+
+bool isProjectFilename(const std::string& filename) {
+    return filenameExtension(filename) == "tpp";
+}
+
+// --- ProjectReader ---
+
+bool ProjectReader::open(const std::string& filename) {
+    this->filename = filename;
+    info = ProjectInfo{};
+    index = ProjectIndex{};
+    ifs.close();
+    ifs.clear();
+    ifs.open(filename, std::ios::binary);
+    if (!ifs.is_open()) {
+        std::cerr << "Failed to open project: " << filename << std::endl;
+        return false;
+    }
+
+    ifs.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(ifs.tellg());
+    uint8_t header[ProjectFormat::HEADER_SIZE];
+    ifs.seekg(0);
+    bool ok = fileSize >= ProjectFormat::HEADER_SIZE + ProjectFormat::TRAILER_SIZE
+        && ifs.read(reinterpret_cast<char*>(header), sizeof(header))
+        && std::memcmp(header, ProjectFormat::MAGIC, 4) == 0;
+    if (!ok) {
+        std::cerr << "Not a project file: " << filename << std::endl;
+        return false;
+    }
+    uint16_t version = static_cast<uint16_t>(header[4] | (header[5] << 8));
+    if (version != ProjectFormat::VERSION) {
+        std::cerr << "Unsupported project version " << version << ": " << filename << std::endl;
+        return false;
+    }
+    info.canvasSize = static_cast<int>(getU32(header + 8));
+    info.tileSize = static_cast<int>(getU32(header + 12));
+
+    // 通常は末尾の16バイトが最新の末尾
+    if (readIndex(fileSize)) {
+        index.fileSize = fileSize;
+        return true;
+    }
+
+    // 追記の途中で止まった・末尾が壊れた場合は、後ろから"TPPE"を探して読める最後の末尾を使う
+    // (以降の保存は追記できないため全体保存になり、読めない部分は捨てられる)
+    constexpr size_t BLOCK_SIZE = 1 << 20;
+    std::vector<uint8_t> block(BLOCK_SIZE + 3);
+    uint64_t blockEnd = fileSize;
+    while (blockEnd > ProjectFormat::HEADER_SIZE) {
+        uint64_t blockStart = std::max<uint64_t>(ProjectFormat::HEADER_SIZE,
+                                                 blockEnd > BLOCK_SIZE ? blockEnd - BLOCK_SIZE : 0);
+        // ブロック境界をまたぐマジックも見つけるため、次のブロックの先頭3バイトまで読む
+        size_t length = static_cast<size_t>(std::min<uint64_t>(fileSize, blockEnd + 3) - blockStart);
+        ifs.clear();
+        ifs.seekg(static_cast<std::streamoff>(blockStart));
+        if (!ifs.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(length))) {
+            break;
+        }
+        for (size_t i = length >= 4 ? length - 3 : 0; i-- > 0;) {
+            if (std::memcmp(block.data() + i, ProjectFormat::TRAILER_MAGIC, 4) != 0) {
+                continue;
+            }
+            uint64_t trailerEnd = blockStart + i + 4;
+            if (trailerEnd < fileSize && trailerEnd >= ProjectFormat::HEADER_SIZE + ProjectFormat::TRAILER_SIZE
+                && readIndex(trailerEnd)) {
+                std::cerr << "Project " << filename << ": damaged tail ignored, recovered the save ending at byte "
+                          << trailerEnd << " of " << fileSize << std::endl;
+                index.fileSize = trailerEnd;
+                return true;
+            }
+        }
+        blockEnd = blockStart;
+    }
+
+    std::cerr << "Corrupt project index: " << filename << std::endl;
+    return false;
+}
+
+bool ProjectReader::readIndex(uint64_t trailerEnd) {
+    info.activeIndex = 0;
+    info.layers.clear();
+    index = ProjectIndex{};
+
+    uint8_t trailer[ProjectFormat::TRAILER_SIZE];
+    ifs.clear();
+    ifs.seekg(static_cast<std::streamoff>(trailerEnd - ProjectFormat::TRAILER_SIZE));
+    if (!ifs.read(reinterpret_cast<char*>(trailer), sizeof(trailer))
+        || std::memcmp(trailer + 12, ProjectFormat::TRAILER_MAGIC, 4) != 0) {
+        return false;
+    }
+
+    // INDXは常に末尾の直前に書く
+    uint64_t indexOffset = getU64(trailer);
+    uint32_t indexSize = getU32(trailer + 8);
+    uint64_t indexEnd = trailerEnd - ProjectFormat::TRAILER_SIZE;
+    if (indexOffset < ProjectFormat::HEADER_SIZE || indexSize < ProjectFormat::CHUNK_HEADER_SIZE + 12
+        || indexOffset + indexSize != indexEnd) {
+        return false;
+    }
+    std::vector<uint8_t> chunk(indexSize);
+    ifs.seekg(static_cast<std::streamoff>(indexOffset));
+    if (!ifs.read(reinterpret_cast<char*>(chunk.data()), indexSize)
+        || std::memcmp(chunk.data(), "INDX", 4) != 0
+        || getU32(chunk.data() + 4) != indexSize - ProjectFormat::CHUNK_HEADER_SIZE) {
+        return false;
+    }
+
+    const uint8_t* p = chunk.data() + ProjectFormat::CHUNK_HEADER_SIZE;
+    const uint8_t* end = chunk.data() + chunk.size();
+    info.activeIndex = static_cast<int>(getU32(p));
+    uint32_t layerCount = getU32(p + 4);
+    p += 8;
+    if (layerCount == 0 || static_cast<size_t>(end - p) < layerCount * LAYER_RECORD_SIZE + 4) {
+        return false;
+    }
+    for (uint32_t i = 0; i < layerCount; ++i, p += LAYER_RECORD_SIZE) {
+        ProjectLayer layer;
+        layer.id = static_cast<int>(getU32(p));
+        uint32_t opacityBits = getU32(p + 4);
+        std::memcpy(&layer.opacity, &opacityBits, sizeof(float));
+        layer.visible = p[8] != 0;
+        layer.blendMode = p[9];
+        info.layers.push_back(layer);
+    }
+    uint32_t tileCount = getU32(p);
+    p += 4;
+    if (static_cast<size_t>(end - p) != static_cast<size_t>(tileCount) * TILE_RECORD_SIZE) {
+        return false;
+    }
+    for (uint32_t i = 0; i < tileCount; ++i, p += TILE_RECORD_SIZE) {
+        ProjectTileKey key{static_cast<int>(getU32(p)), static_cast<int>(getU32(p + 4)), static_cast<int>(getU32(p + 8))};
+        ProjectTileEntry entry{getU64(p + 12), getU32(p + 20)};
+        if (entry.offset < ProjectFormat::HEADER_SIZE || entry.offset + entry.size > indexOffset) {
+            return false;
+        }
+        index.tiles[key] = entry;
+        index.tileBytes += entry.size;
+    }
+    return true;
+}
+
+bool ProjectReader::readTiles(const std::function<void(int, int, int, const uint8_t*)>& onTile) {
+    TRACE_SCOPE("ProjectReader::readTiles");
+    size_t tileBytes = static_cast<size_t>(info.tileSize) * info.tileSize * 4;
+    std::vector<uint8_t> chunk;
+    std::vector<uint8_t> pixels(tileBytes);
+    int failures = 0;
+
+    for (const auto& [key, entry] : index.tiles) {
+        chunk.resize(entry.size);
+        ifs.clear();
+        ifs.seekg(static_cast<std::streamoff>(entry.offset));
+        bool ok = entry.size > ProjectFormat::CHUNK_HEADER_SIZE + TILE_HEADER_SIZE
+            && ifs.read(reinterpret_cast<char*>(chunk.data()), entry.size)
+            && std::memcmp(chunk.data(), "TILE", 4) == 0;
+        const uint8_t* payload = chunk.data() + ProjectFormat::CHUNK_HEADER_SIZE;
+        if (ok) {
+            uLongf rawSize = static_cast<uLongf>(tileBytes);
+            ok = uncompress(pixels.data(), &rawSize, payload + TILE_HEADER_SIZE,
+                            static_cast<uLong>(entry.size - ProjectFormat::CHUNK_HEADER_SIZE - TILE_HEADER_SIZE)) == Z_OK
+                && rawSize == tileBytes
+                && crc32(0L, pixels.data(), static_cast<uInt>(tileBytes)) == getU32(payload + 12);
+        }
+        if (!ok) {
+            // 壊れたタイルは初期状態のまま残し、他のタイルは読む
+            failures++;
+            continue;
+        }
+        onTile(key.layerID, key.tileX, key.tileY, pixels.data());
+    }
+
+    if (failures > 0) {
+        std::cerr << "Project " << filename << ": " << failures << " corrupt tiles skipped" << std::endl;
+    }
+    return failures == 0;
+}
+
+// --- ProjectWriter ---
+
+ProjectWriter::~ProjectWriter() {
+    finish();
+    dropPartial();
+}
+
+bool ProjectWriter::canAppend(const std::string& filename) {
+    finish();
+    uint64_t size = 0;
+    return hasFile && filename == this->filename && fileSizeOf(filename, size) && size == index.fileSize;
+}
+
+void ProjectWriter::adopt(const std::string& filename, const ProjectIndex& index) {
+    finish();
+    dropPartial();
+    this->filename = filename;
+    this->index = index;
+    hasFile = true;
+}
+
+bool ProjectWriter::begin(const std::string& filename, const ProjectInfo& info, std::vector<ProjectTile>&& tiles, bool full,
+                          bool last) {
+    // 保存は短いので、前回の保存が残っていれば待ってから始める
+    finish();
+    if (partial && (!full || filename != this->filename)) {
+        // 途中まで書いた全体保存の続きでなければ、書きかけの一時ファイルは捨てる
+        dropPartial();
+    }
+    if (!full && !canAppend(filename)) {
+        std::cerr << "Cannot append to project: " << filename << std::endl;
+        return false;
+    }
+    TRACE_SCOPE("ProjectWriter::begin");
+
+    if (!partial) {
+        startTime = Clock::now();
+        compressMs = 0.0;
+        writtenTiles = 0;
+        writtenBytes = 0;
+    }
+    this->filename = filename;
+    this->info = info;
+    this->tiles = std::move(tiles);
+    this->full = full;
+    this->last = !full || last;
+    busy = true;
+    workerDone = false;
+    worker = std::thread(&ProjectWriter::writeLoop, this);
+    return true;
+}
+
+void ProjectWriter::update() {
+    if (busy && workerDone) {
+        complete();
+    }
+}
+
+void ProjectWriter::finish() {
+    if (busy) {
+        complete();
+    }
+}
+
+void ProjectWriter::complete() {
+    if (worker.joinable()) {
+        worker.join();
+    }
+    busy = false;
+    // 全体保存の途中なら、置き換えるまで元のファイル(またはファイル無し)のまま
+    partial = succeeded && !last;
+    hasFile = succeeded && last;
+    if (partial) {
+        tiles.clear();
+        return;
+    }
+
+    double totalMs = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+    if (succeeded) {
+        std::cout << label << ": " << filename << " (" << (full ? "full" : "incremental") << ", "
+                  << writtenTiles << " tiles, " << writtenBytes / 1024 << " KB written"
+                  << (compacted ? ", compacted" : "") << ", total " << totalMs
+                  << " ms, compress " << compressMs << " ms)" << std::endl;
+    } else {
+        std::cerr << "Failed to save project: " << filename << std::endl;
+    }
+    tiles.clear();
+    tiles.shrink_to_fit();
+}
+
+void ProjectWriter::writeLoop() {
+    TRACE_THREAD_NAME("project-writer");
+    TRACE_SCOPE("ProjectWriter::write");
+
+    // 1. タイルを並列に圧縮(初期状態に戻ったタイルは空のまま)
+    Clock::time_point compressStart = Clock::now();
+    std::vector<std::vector<uint8_t>> chunks(tiles.size());
+    std::atomic<size_t> next{0};
+    std::atomic<bool> compressFailed{false};
+    auto compressJob = [&]() {
+        TRACE_SCOPE("ProjectWriter::compress");
+        for (size_t i = next++; i < tiles.size(); i = next++) {
+            if (tiles[i].pixels.empty()) {
+                continue;
+            }
+            chunks[i] = buildTileChunk(tiles[i]);
+            if (chunks[i].empty()) {
+                compressFailed = true;
+            }
+        }
+    };
+    size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), tiles.size() / 8 + 1);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threadCount; ++i) {
+        workers.emplace_back(compressJob);
+    }
+    compressJob();
+    for (auto& t : workers) {
+        t.join();
+    }
+    compressMs += std::chrono::duration<double, std::milli>(Clock::now() - compressStart).count();
+
+    // 2. 書き込み、3. 必要なら詰め直し
+    compacted = false;
+    succeeded = !compressFailed && (full ? writeFull(chunks) : appendChunks(chunks));
+    if (succeeded && last) {
+        uint64_t live = ProjectFormat::HEADER_SIZE + index.tileBytes + buildIndexChunk().size() + ProjectFormat::TRAILER_SIZE;
+        if (index.fileSize - live > live) {
+            succeeded = compact();
+            compacted = succeeded;
+        }
+    }
+    workerDone = true;
+}
+
+bool ProjectWriter::writeFull(std::vector<std::vector<uint8_t>>& chunks) {
+    // 一時ファイルに書いてから置き換える(前の回の続きなら、その末尾へ書き足す)
+    std::string tmpName = filename + ".tmp";
+    std::ofstream ofs(tmpName, std::ios::binary | (partial ? std::ios::app : std::ios::trunc));
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to open project for writing: " << tmpName << std::endl;
+        return false;
+    }
+
+    uint64_t offset = ProjectFormat::HEADER_SIZE;
+    if (partial) {
+        offset = index.fileSize;
+    } else {
+        index = ProjectIndex{};
+        writeHeader(ofs, info);
+    }
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        // 前の回の後に描き変わったタイルは、前のチャンクの参照を外す
+        ProjectTileKey key{tiles[i].layerID, tiles[i].tileX, tiles[i].tileY};
+        auto it = index.tiles.find(key);
+        if (it != index.tiles.end()) {
+            index.tileBytes -= it->second.size;
+            index.tiles.erase(it);
+        }
+        if (chunks[i].empty()) {
+            continue;
+        }
+        ofs.write(reinterpret_cast<const char*>(chunks[i].data()), static_cast<std::streamsize>(chunks[i].size()));
+        ProjectTileEntry entry{offset, static_cast<uint32_t>(chunks[i].size())};
+        index.tiles[key] = entry;
+        index.tileBytes += entry.size;
+        offset += entry.size;
+        writtenTiles++;
+    }
+    if (!last) {
+        // INDXと末尾は最後の回で書く
+        index.fileSize = offset;
+        writtenBytes = offset;
+        ofs.close();
+        if (ofs.fail()) {
+            std::remove(tmpName.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> indexChunk = buildIndexChunk();
+    ofs.write(reinterpret_cast<const char*>(indexChunk.data()), static_cast<std::streamsize>(indexChunk.size()));
+    writeTrailer(ofs, offset, indexChunk.size());
+    index.fileSize = offset + indexChunk.size() + ProjectFormat::TRAILER_SIZE;
+    writtenBytes = index.fileSize;
+    ofs.close();
+
+    // 中身がディスクに届く前に置き換えると、電源断で空のファイルが残ることがある
+    if (ofs.fail() || !syncFile(tmpName) || std::rename(tmpName.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool ProjectWriter::appendChunks(std::vector<std::vector<uint8_t>>& chunks) {
+    std::fstream fs(filename, std::ios::binary | std::ios::in | std::ios::out);
+    if (!fs.is_open()) {
+        std::cerr << "Failed to open project for appending: " << filename << std::endl;
+        return false;
+    }
+
+    // 差し替えたタイル・初期状態に戻ったタイルの古いチャンクは参照を外すだけ
+    uint64_t offset = index.fileSize;
+    fs.seekp(static_cast<std::streamoff>(offset));
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        ProjectTileKey key{tiles[i].layerID, tiles[i].tileX, tiles[i].tileY};
+        auto it = index.tiles.find(key);
+        if (it != index.tiles.end()) {
+            index.tileBytes -= it->second.size;
+            index.tiles.erase(it);
+        }
+        if (chunks[i].empty()) {
+            continue;
+        }
+        fs.write(reinterpret_cast<const char*>(chunks[i].data()), static_cast<std::streamsize>(chunks[i].size()));
+        ProjectTileEntry entry{offset, static_cast<uint32_t>(chunks[i].size())};
+        index.tiles[key] = entry;
+        index.tileBytes += entry.size;
+        offset += entry.size;
+        writtenTiles++;
+    }
+
+    // タイルをディスクまで書き出してから末尾を書く(末尾だけが先に届くと、書かれていないタイルを指してしまう)
+    fs.flush();
+    if (fs.fail() || !syncFile(filename)) {
+        std::cerr << "Failed to sync project: " << filename << std::endl;
+        return false;
+    }
+
+    // 新しいINDXと末尾を書き足した時点で、追記したタイルが有効になる
+    std::vector<uint8_t> indexChunk = buildIndexChunk();
+    fs.write(reinterpret_cast<const char*>(indexChunk.data()), static_cast<std::streamsize>(indexChunk.size()));
+    writeTrailer(fs, offset, indexChunk.size());
+    uint64_t newSize = offset + indexChunk.size() + ProjectFormat::TRAILER_SIZE;
+    writtenBytes = newSize - index.fileSize;
+    index.fileSize = newSize;
+    fs.close();
+    return !fs.fail() && syncFile(filename);
+}
+
+bool ProjectWriter::compact() {
+    TRACE_SCOPE("ProjectWriter::compact");
+    std::ifstream src(filename, std::ios::binary);
+    std::string tmpName = filename + ".tmp";
+    std::ofstream ofs(tmpName, std::ios::binary | std::ios::trunc);
+    if (!src.is_open() || !ofs.is_open()) {
+        std::cerr << "Failed to compact project: " << filename << std::endl;
+        return false;
+    }
+
+    // 有効なチャンクを圧縮し直さずに写す
+    writeHeader(ofs, info);
+    ProjectIndex compactIndex;
+    uint64_t offset = ProjectFormat::HEADER_SIZE;
+    std::vector<uint8_t> chunk;
+    for (const auto& [key, entry] : index.tiles) {
+        chunk.resize(entry.size);
+        src.seekg(static_cast<std::streamoff>(entry.offset));
+        if (!src.read(reinterpret_cast<char*>(chunk.data()), entry.size)) {
+            std::remove(tmpName.c_str());
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(chunk.data()), entry.size);
+        compactIndex.tiles[key] = {offset, entry.size};
+        compactIndex.tileBytes += entry.size;
+        offset += entry.size;
+    }
+    index = compactIndex;
+
+    std::vector<uint8_t> indexChunk = buildIndexChunk();
+    ofs.write(reinterpret_cast<const char*>(indexChunk.data()), static_cast<std::streamsize>(indexChunk.size()));
+    writeTrailer(ofs, offset, indexChunk.size());
+    index.fileSize = offset + indexChunk.size() + ProjectFormat::TRAILER_SIZE;
+    ofs.close();
+    src.close();
+
+    if (ofs.fail() || !syncFile(tmpName) || std::rename(tmpName.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        return false;
+    }
+    return true;
+}
+
+void ProjectWriter::dropPartial() {
+    if (partial) {
+        std::remove((filename + ".tmp").c_str());
+        partial = false;
+    }
+}
+
+std::vector<uint8_t> ProjectWriter::buildIndexChunk() const {
+    size_t payloadSize = 8 + info.layers.size() * LAYER_RECORD_SIZE + 4 + index.tiles.size() * TILE_RECORD_SIZE;
+    std::vector<uint8_t> chunk;
+    chunk.reserve(ProjectFormat::CHUNK_HEADER_SIZE + payloadSize);
+    beginChunk(chunk, "INDX", payloadSize);
+
+    appendU32(chunk, static_cast<uint32_t>(info.activeIndex));
+    appendU32(chunk, static_cast<uint32_t>(info.layers.size()));
+    for (const ProjectLayer& layer : info.layers) {
+        appendU32(chunk, static_cast<uint32_t>(layer.id));
+        appendF32(chunk, layer.opacity);
+        chunk.push_back(layer.visible ? 1 : 0);
+        chunk.push_back(layer.blendMode);
+        chunk.push_back(0);
+        chunk.push_back(0);
+    }
+    appendU32(chunk, static_cast<uint32_t>(index.tiles.size()));
+    for (const auto& [key, entry] : index.tiles) {
+        appendU32(chunk, static_cast<uint32_t>(key.layerID));
+        appendU32(chunk, static_cast<uint32_t>(key.tileX));
+        appendU32(chunk, static_cast<uint32_t>(key.tileY));
+        appendU64(chunk, entry.offset);
+        appendU32(chunk, entry.size);
+    }
+    return chunk;
+}
@@ -0,0 +1,184 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// tinyPaintのプロジェクトファイル(.tpp)
+//
+// ヘッダー16バイト: "TPPJ"、バージョン(u16)、予約(u16)、キャンバスサイズ(u32)、タイルサイズ(u32)
+// 以降はチャンクの並び。チャンク = 種類(4文字) + ペイロード長(u32) + ペイロード
+//   TILE: layerID、タイルX、タイルY(タイル単位、GL座標で下が0)(各i32) + 展開後のCRC-32(u32) + zlibで圧縮したRGBA
+//   INDX: アクティブレイヤー、レイヤー一覧(id、不透明度、表示、ブレンドモード)、有効なTILEチャンクの位置の一覧
+// 末尾16バイト: 最新のINDXチャンクの位置(u64)、その長さ(u32)、"TPPE"
+//
+// 保存はチャンクを追記してfsyncし、その後で新しいINDXと末尾を書き足す。
+// 差し替えられたTILEや古いINDXはファイルに残るが参照されなくなるだけ。
+// 追記の途中で止まって末尾16バイトが末尾でなくなった場合、読み込みは後ろから"TPPE"を探し、
+// 直前のINDXと整合する最後の末尾(前回の保存)を使う。参照されない部分が増えたら詰め直す。
+// インデックスに無いタイルはレイヤーの初期状態(白の透明)。数値はすべてリトルエンディアン。
+namespace ProjectFormat {
+constexpr char MAGIC[4] = {'T', 'P', 'P', 'J'};
+constexpr char TRAILER_MAGIC[4] = {'T', 'P', 'P', 'E'};
+constexpr uint16_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 16;
+constexpr size_t TRAILER_SIZE = 16;
+constexpr size_t CHUNK_HEADER_SIZE = 8;
+}  // namespace ProjectFormat
+
+// 拡張子が.tppか
+bool isProjectFilename(const std::string& filename);
+
+struct ProjectLayer {
+    int id = 0;
+    float opacity = 1.0f;
+    bool visible = true;
+    uint8_t blendMode = 0;
+};
+
+// キャンバス全体の情報(INDXのタイル以外)
+struct ProjectInfo {
+    int canvasSize = 0;
+    int tileSize = 0;
+    int activeIndex = 0;
+    std::vector<ProjectLayer> layers;  // 下から上の順
+};
+
+// 保存するタイル(pixelsが空なら初期状態に戻ったタイル)
+struct ProjectTile {
+    int layerID = 0;
+    int tileX = 0;
+    int tileY = 0;
+    std::vector<uint8_t> pixels;  // tileSize*tileSize*4、GLの行順
+};
+
+struct ProjectTileKey {
+    int layerID;
+    int tileX;
+    int tileY;
+
+    bool operator<(const ProjectTileKey& other) const {
+        if (layerID != other.layerID) {
+            return layerID < other.layerID;
+        }
+        if (tileX != other.tileX) {
+            return tileX < other.tileX;
+        }
+        return tileY < other.tileY;
+    }
+};
+
+// 有効なTILEチャンクの位置(チャンク先頭からの長さを含む)
+struct ProjectTileEntry {
+    uint64_t offset = 0;
+    uint32_t size = 0;
+};
+
+// ファイル内の有効な内容の一覧と、追記・詰め直しの判断に使う大きさ
+struct ProjectIndex {
+    std::map<ProjectTileKey, ProjectTileEntry> tiles;
+    uint64_t fileSize = 0;
+    uint64_t tileBytes = 0;  // 有効なTILEチャンクの合計
+};
+
+// プロジェクトファイルの読み込み
+class ProjectReader {
+public:
+    // 末尾とINDXを読み、レイヤー情報とタイルの位置を取得(失敗したらfalse)
+    // ファイルの最後が壊れていれば、それより前で読める最後の末尾を使う(index.fileSizeはその末尾の終わり)
+    bool open(const std::string& filename);
+
+    const ProjectInfo& getInfo() const { return info; }
+    const ProjectIndex& getIndex() const { return index; }
+
+    // 全タイルを展開してonTileへ渡す(pixelsは呼び出しの間だけ有効)
+    bool readTiles(const std::function<void(int layerID, int tileX, int tileY, const uint8_t* pixels)>& onTile);
+
+private:
+    std::ifstream ifs;
+    std::string filename;
+    ProjectInfo info;
+    ProjectIndex index;
+
+    // trailerEndで終わる末尾とそれが指すINDXを読む(整合しなければfalse)
+    bool readIndex(uint64_t trailerEnd);
+};
+
+// 描画を止めないプロジェクトの保存
+//
+// 1. begin: 描画スレッドで読み出したタイル(全体保存なら全タイル、差分保存なら前回から変わったタイル)を受け取る
+// 2. ワーカー: タイルを並列に圧縮し、差分保存ならファイル末尾へ、全体保存なら一時ファイルへ書き込む
+// 3. ワーカー: 参照されない部分がファイルの半分を超えたら、有効なチャンクだけを一時ファイルへ写して詰め直す
+// 一時ファイルはrenameで置き換えるため、途中で止まっても元のファイルは壊れない。
+// 全体保存は何回かのbeginに分けて渡せる(最後の回でINDXと末尾を書き、置き換える)。
+class ProjectWriter {
+public:
+    // label: 完了時に出力する見出し
+    explicit ProjectWriter(const char* label = "Project saved") : label(label) {}
+    ~ProjectWriter();
+
+    // コピー禁止
+    ProjectWriter(const ProjectWriter&) = delete;
+    ProjectWriter& operator=(const ProjectWriter&) = delete;
+
+    // filenameへ差分を追記できるか(前回この書き込み器で保存・読み込みしたファイルがそのまま残っている)
+    // 実行中の保存があれば完了を待つ
+    bool canAppend(const std::string& filename);
+
+    // 保存を開始。fullならtilesは全タイル(初期状態のタイルは省いてよい)、そうでなければ前回から変わったタイル
+    // full && !last: 全体保存の一部として一時ファイルへ書き足すだけにし、続きを次のbeginで受け取る
+    bool begin(const std::string& filename, const ProjectInfo& info, std::vector<ProjectTile>&& tiles, bool full,
+               bool last = true);
+
+    // 読み込んだファイルを以降の差分保存の基準にする
+    void adopt(const std::string& filename, const ProjectIndex& index);
+
+    // 完了していれば結果を出力(毎フレーム描画スレッドから呼ぶ)
+    void update();
+
+    // 完了まで待機(終了時用)
+    void finish();
+
+    bool isBusy() const { return busy; }
+    // 全体保存の途中(一時ファイルに続きを書き足す)
+    bool isPartial() const { return partial; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    const char* label;
+    bool busy = false;
+    std::thread worker;
+    std::atomic<bool> workerDone{false};
+
+    // 前回保存したファイル(ワーカーの実行中はワーカー専用)
+    std::string filename;
+    ProjectIndex index;
+    bool hasFile = false;
+    bool partial = false;  // 一時ファイルに全体保存の途中まで書いた(indexはその内容)
+
+    // 実行中の保存の内容と結果(全体保存を分けたときは書き込み量と時間を最初の回から数える)
+    ProjectInfo info;
+    std::vector<ProjectTile> tiles;
+    bool full = false;
+    bool last = true;
+    bool succeeded = false;
+    bool compacted = false;
+    size_t writtenTiles = 0;
+    uint64_t writtenBytes = 0;
+    Clock::time_point startTime;
+    double compressMs = 0.0;
+
+    void writeLoop();
+    bool writeFull(std::vector<std::vector<uint8_t>>& chunks);
+    bool appendChunks(std::vector<std::vector<uint8_t>>& chunks);
+    bool compact();
+    std::vector<uint8_t> buildIndexChunk() const;
+    void complete();
+    void dropPartial();
+};
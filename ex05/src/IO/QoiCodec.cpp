@@ -0,0 +1,314 @@
+#include "QoiCodec.hpp"
+#include "Profiling/Trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr uint8_t OP_INDEX = 0x00;
+constexpr uint8_t OP_DIFF = 0x40;
+constexpr uint8_t OP_LUMA = 0x80;
+constexpr uint8_t OP_RUN = 0xC0;
+constexpr uint8_t OP_RGB = 0xFE;
+constexpr uint8_t OP_RGBA = 0xFF;
+constexpr uint8_t MASK_2 = 0xC0;
+constexpr int MAX_RUN = 62;
+
+constexpr size_t HEADER_SIZE = 14;
+constexpr uint8_t END_MARKER[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+// ピクセルはメモリ上のRGBA順をそのまま32bitで扱う(リトルエンディアンではRが下位バイト)
+constexpr uint32_t OPAQUE_BLACK = 0xFF000000u;
+
+inline uint32_t loadPixel(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline void storePixel(uint8_t* p, uint32_t v) {
+    std::memcpy(p, &v, 4);
+}
+
+// (r*3 + g*5 + b*7 + a*11) % 64 を1回の乗算で求める
+// R,Bと G,Aを16bitおきに並べ替え、各係数を掛けた和が最上位バイトに集まるようにする
+inline uint32_t hashOf(uint32_t px) {
+    uint64_t v = (px & 0x00FF00FFu) | (static_cast<uint64_t>(px & 0xFF00FF00u) << 24);
+    constexpr uint64_t MUL = (3ull << 56) | (7ull << 40) | (5ull << 24) | (11ull << 8);
+    return static_cast<uint32_t>((v * MUL) >> 56) & 63;
+}
+
+void putU32(uint8_t* out, uint32_t v) {
+    out[0] = static_cast<uint8_t>(v >> 24);
+    out[1] = static_cast<uint8_t>(v >> 16);
+    out[2] = static_cast<uint8_t>(v >> 8);
+    out[3] = static_cast<uint8_t>(v);
+}
+
+uint32_t getU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16)
+         | (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+// 命令の先頭バイトから命令長を求める
+inline size_t opSize(uint8_t b1) {
+    if (b1 == OP_RGB) {
+        return 4;
+    }
+    if (b1 == OP_RGBA) {
+        return 5;
+    }
+    return (b1 & MASK_2) == OP_LUMA ? 2 : 1;
+}
+
+// ランを書き出す(62ピクセルを超える分は複数に分割)
+inline uint8_t* emitRun(uint8_t* out, int run) {
+    while (run >= MAX_RUN) {
+        *out++ = OP_RUN | (MAX_RUN - 1);
+        run -= MAX_RUN;
+    }
+    if (run > 0) {
+        *out++ = static_cast<uint8_t>(OP_RUN | (run - 1));
+    }
+    return out;
+}
+
+}  // namespace
+
+QoiWriter::QoiWriter(const std::string& filename, int width, int height)
+    : ofs(filename, std::ios::binary | std::ios::trunc),
+      width(width), height(height), prev(OPAQUE_BLACK) {
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to open QOI for writing: " << filename << std::endl;
+        return;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    std::memcpy(header, "qoif", 4);
+    putU32(header + 4, static_cast<uint32_t>(width));
+    putU32(header + 8, static_cast<uint32_t>(height));
+    header[12] = 4;  // RGBA
+    header[13] = 0;  // sRGB(アルファは非線形)
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+bool QoiWriter::writeRows(const uint8_t* firstRow, int count, ptrdiff_t stride) {
+    if (!ofs.is_open() || failed) {
+        return false;
+    }
+    TRACE_SCOPE("QoiWriter::writeRows");
+    count = std::min(count, height - rowsWritten);
+    if (count <= 0) {
+        return true;
+    }
+
+    // 最悪ケース(全ピクセルRGBA)に、前のバッチから続くランの分を加えた出力サイズを確保
+    buffer.resize(static_cast<size_t>(count) * width * 5 + run / MAX_RUN + 1);
+    uint8_t* out = buffer.data();
+
+    for (int r = 0; r < count; ++r) {
+        const uint8_t* row = firstRow + static_cast<ptrdiff_t>(r) * stride;
+        int x = 0;
+        while (x < width) {
+            uint32_t px = loadPixel(row + x * 4);
+            if (px == prev) {
+                // ラン: 2ピクセルずつ64bitで比較して読み飛ばす
+                uint64_t pair = (static_cast<uint64_t>(prev) << 32) | prev;
+                int end = x + 1;
+                while (end + 2 <= width) {
+                    uint64_t v;
+                    std::memcpy(&v, row + end * 4, 8);
+                    if (v != pair) {
+                        break;
+                    }
+                    end += 2;
+                }
+                while (end < width && loadPixel(row + end * 4) == prev) {
+                    ++end;
+                }
+                run += end - x;
+                x = end;
+                continue;
+            }
+
+            if (run > 0) {
+                out = emitRun(out, run);
+                run = 0;
+            }
+
+            uint32_t h = hashOf(px);
+            if (index[h] == px) {
+                *out++ = static_cast<uint8_t>(OP_INDEX | h);
+            } else {
+                index[h] = px;
+                if ((px ^ prev) >> 24 == 0) {
+                    // アルファが同じなら差分で表現
+                    int8_t vr = static_cast<int8_t>((px & 0xFF) - (prev & 0xFF));
+                    int8_t vg = static_cast<int8_t>(((px >> 8) & 0xFF) - ((prev >> 8) & 0xFF));
+                    int8_t vb = static_cast<int8_t>(((px >> 16) & 0xFF) - ((prev >> 16) & 0xFF));
+                    int8_t vgr = static_cast<int8_t>(vr - vg);
+                    int8_t vgb = static_cast<int8_t>(vb - vg);
+
+                    if (vr > -3 && vr < 2 && vg > -3 && vg < 2 && vb > -3 && vb < 2) {
+                        *out++ = static_cast<uint8_t>(OP_DIFF | (vr + 2) << 4 | (vg + 2) << 2 | (vb + 2));
+                    } else if (vgr > -9 && vgr < 8 && vg > -33 && vg < 32 && vgb > -9 && vgb < 8) {
+                        *out++ = static_cast<uint8_t>(OP_LUMA | (vg + 32));
+                        *out++ = static_cast<uint8_t>((vgr + 8) << 4 | (vgb + 8));
+                    } else {
+                        *out++ = OP_RGB;
+                        *out++ = static_cast<uint8_t>(px);
+                        *out++ = static_cast<uint8_t>(px >> 8);
+                        *out++ = static_cast<uint8_t>(px >> 16);
+                    }
+                } else {
+                    *out++ = OP_RGBA;
+                    storePixel(out, px);
+                    out += 4;
+                }
+            }
+            prev = px;
+            ++x;
+        }
+    }
+
+    ofs.write(reinterpret_cast<const char*>(buffer.data()), out - buffer.data());
+
+    rowsWritten += count;
+    if (progress) {
+        progress->store(static_cast<float>(rowsWritten) / height);
+    }
+    return !ofs.fail();
+}
+
+bool QoiWriter::finish() {
+    if (!ofs.is_open()) {
+        return false;
+    }
+    if (rowsWritten != height) {
+        std::cerr << "QOI incomplete: " << rowsWritten << "/" << height << " rows" << std::endl;
+        failed = true;
+    }
+
+    // 画像末尾まで続いたランを閉じる
+    buffer.resize(run / MAX_RUN + 1);
+    uint8_t* out = emitRun(buffer.data(), run);
+    ofs.write(reinterpret_cast<const char*>(buffer.data()), out - buffer.data());
+    run = 0;
+    ofs.write(reinterpret_cast<const char*>(END_MARKER), sizeof(END_MARKER));
+
+    ofs.close();
+    return !failed && !ofs.fail();
+}
+
+QoiReader::QoiReader(const std::string& filename)
+    : ifs(filename, std::ios::binary), prev(OPAQUE_BLACK), input(1 << 20) {
+    if (!ifs.is_open()) {
+        std::cerr << "Failed to open QOI: " << filename << std::endl;
+        return;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    if (!ifs.read(reinterpret_cast<char*>(header), sizeof(header))
+        || std::memcmp(header, "qoif", 4) != 0) {
+        std::cerr << "Not a QOI file: " << filename << std::endl;
+        return;
+    }
+    width = static_cast<int>(getU32(header + 4));
+    height = static_cast<int>(getU32(header + 8));
+    if (width <= 0 || height <= 0 || header[12] < 3 || header[12] > 4) {
+        std::cerr << "Invalid QOI header: " << filename << std::endl;
+        return;
+    }
+    valid = true;
+}
+
+bool QoiReader::fill(size_t needed) {
+    if (inputEnd - inputPos >= needed) {
+        return true;
+    }
+    // 未処理分を先頭へ寄せて読み足す
+    std::memmove(input.data(), input.data() + inputPos, inputEnd - inputPos);
+    inputEnd -= inputPos;
+    inputPos = 0;
+    ifs.read(reinterpret_cast<char*>(input.data() + inputEnd), input.size() - inputEnd);
+    inputEnd += static_cast<size_t>(ifs.gcount());
+    return inputEnd - inputPos >= needed;
+}
+
+bool QoiReader::readRows(uint8_t* dst, int count, ptrdiff_t stride) {
+    if (!valid) {
+        return false;
+    }
+    TRACE_SCOPE("QoiReader::readRows");
+    if (count > height - rowsRead) {
+        std::cerr << "QOI read past end of image" << std::endl;
+        return false;
+    }
+
+    for (int r = 0; r < count; ++r) {
+        uint8_t* row = dst + static_cast<ptrdiff_t>(r) * stride;
+        int x = 0;
+        while (x < width) {
+            if (run > 0) {
+                // ランの残りはまとめて埋める
+                int n = std::min(run, width - x);
+                for (int i = 0; i < n; ++i) {
+                    storePixel(row + (x + i) * 4, prev);
+                }
+                run -= n;
+                x += n;
+                continue;
+            }
+
+            // 最長の命令(RGBA)の5バイト分を読み込んでおく(末尾付近では不足しうる)
+            fill(5);
+            const uint8_t* in = input.data() + inputPos;
+            size_t avail = inputEnd - inputPos;
+            if (avail == 0 || avail < opSize(in[0])) {
+                std::cerr << "QOI data truncated" << std::endl;
+                valid = false;
+                return false;
+            }
+            uint8_t b1 = in[0];
+            uint32_t px = prev;
+
+            if (b1 == OP_RGB) {
+                px = (prev & 0xFF000000u) | in[1] | (in[2] << 8) | (in[3] << 16);
+                inputPos += 4;
+            } else if (b1 == OP_RGBA) {
+                px = loadPixel(in + 1);
+                inputPos += 5;
+            } else if ((b1 & MASK_2) == OP_INDEX) {
+                px = index[b1];
+                inputPos += 1;
+            } else if ((b1 & MASK_2) == OP_DIFF) {
+                uint8_t r8 = static_cast<uint8_t>((prev & 0xFF) + ((b1 >> 4) & 3) - 2);
+                uint8_t g8 = static_cast<uint8_t>(((prev >> 8) & 0xFF) + ((b1 >> 2) & 3) - 2);
+                uint8_t b8 = static_cast<uint8_t>(((prev >> 16) & 0xFF) + (b1 & 3) - 2);
+                px = (prev & 0xFF000000u) | r8 | (g8 << 8) | (b8 << 16);
+                inputPos += 1;
+            } else if ((b1 & MASK_2) == OP_LUMA) {
+                int vg = (b1 & 0x3F) - 32;
+                uint8_t b2 = in[1];
+                uint8_t r8 = static_cast<uint8_t>((prev & 0xFF) + vg - 8 + ((b2 >> 4) & 0x0F));
+                uint8_t g8 = static_cast<uint8_t>(((prev >> 8) & 0xFF) + vg);
+                uint8_t b8 = static_cast<uint8_t>(((prev >> 16) & 0xFF) + vg - 8 + (b2 & 0x0F));
+                px = (prev & 0xFF000000u) | r8 | (g8 << 8) | (b8 << 16);
+                inputPos += 2;
+            } else {
+                // OP_RUN: このピクセルを含めて(b1 & 0x3F) + 1個
+                run = b1 & 0x3F;
+                inputPos += 1;
+            }
+
+            index[hashOf(px)] = px;
+            prev = px;
+            storePixel(row + x * 4, px);
+            ++x;
+        }
+    }
+
+    rowsRead += count;
+    return true;
+}
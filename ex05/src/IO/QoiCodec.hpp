@@ -0,0 +1,85 @@
+#pragma once
+#include "ImageReader.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// QOI(Quite OK Image Format、8bit RGBA)のストリーミングエンコーダ
+//
+// PNGより圧縮率は劣るが、1パスの単純な符号化で桁違いに速い。
+// 連続する同色ピクセル(ランの大半を占める透明部分)は8バイト単位で比較して読み飛ばす。
+// 行は上から順にwriteRowsで何回かに分けて渡せる(PngWriterと同じ使い方)。
+class QoiWriter {
+public:
+    QoiWriter(const std::string& filename, int width, int height);
+
+    // コピー禁止
+    QoiWriter(const QoiWriter&) = delete;
+    QoiWriter& operator=(const QoiWriter&) = delete;
+
+    bool isOpen() const { return ofs.is_open(); }
+
+    // 画像の上から順にcount行を追加
+    // stride: 行の先頭間のバイト数(負なら下から上に並んだメモリを上から読む)
+    bool writeRows(const uint8_t* firstRow, int count, ptrdiff_t stride);
+
+    // 残りのランと終端マーカーを書き出してファイルを閉じる
+    bool finish();
+
+    // 進捗の通知先(書き込み済み行数/全行数)
+    void setProgress(std::atomic<float>* target) { progress = target; }
+
+private:
+    std::ofstream ofs;
+    int width;
+    int height;
+    int rowsWritten = 0;
+    bool failed = false;
+
+    // 行をまたいで引き継ぐ符号化状態
+    uint32_t prev;
+    uint32_t index[64] = {};
+    int run = 0;
+
+    std::vector<uint8_t> buffer;
+    std::atomic<float>* progress = nullptr;
+};
+
+// QOIのストリーミングデコーダ(上から順に行単位で取り出す)
+class QoiReader : public ImageReader {
+public:
+    explicit QoiReader(const std::string& filename);
+
+    // コピー禁止
+    QoiReader(const QoiReader&) = delete;
+    QoiReader& operator=(const QoiReader&) = delete;
+
+    // ヘッダーが正しく読めたか
+    bool isOpen() const override { return valid; }
+    int getWidth() const override { return width; }
+    int getHeight() const override { return height; }
+
+    // 次のcount行をRGBAでdstへ展開(stride: dstの行間バイト数)
+    bool readRows(uint8_t* dst, int count, ptrdiff_t stride) override;
+
+private:
+    std::ifstream ifs;
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    int rowsRead = 0;
+
+    uint32_t prev;
+    uint32_t index[64] = {};
+    int run = 0;
+
+    // 入力のバッファリング
+    std::vector<uint8_t> input;
+    size_t inputPos = 0;
+    size_t inputEnd = 0;
+
+    bool fill(size_t needed);
+};
@@ -0,0 +1,112 @@
+#include "RawImage.hpp"
+#include "Profiling/Trace.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+void putU32LE(uint8_t* out, uint32_t v) {
+    out[0] = static_cast<uint8_t>(v);
+    out[1] = static_cast<uint8_t>(v >> 8);
+    out[2] = static_cast<uint8_t>(v >> 16);
+    out[3] = static_cast<uint8_t>(v >> 24);
+}
+
+uint32_t getU32LE(const uint8_t* in) {
+    return in[0] | (static_cast<uint32_t>(in[1]) << 8)
+         | (static_cast<uint32_t>(in[2]) << 16) | (static_cast<uint32_t>(in[3]) << 24);
+}
+
+}  // namespace
+
+RawImageWriter::RawImageWriter(const std::string& filename, int width, int height, uint32_t flags)
+    : ofs(filename, std::ios::binary | std::ios::trunc), width(width), height(height) {
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to open raw image for writing: " << filename << std::endl;
+        return;
+    }
+
+    uint8_t header[RAW_HEADER_SIZE];
+    std::memcpy(header, "TPRW", 4);
+    putU32LE(header + 4, static_cast<uint32_t>(width));
+    putU32LE(header + 8, static_cast<uint32_t>(height));
+    putU32LE(header + 12, flags);
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+bool RawImageWriter::writeRows(const uint8_t* rows, int count) {
+    if (!ofs.is_open()) {
+        return false;
+    }
+    TRACE_SCOPE("RawImageWriter::writeRows");
+    count = std::min(count, height - rowsWritten);
+    ofs.write(reinterpret_cast<const char*>(rows), static_cast<std::streamsize>(count) * width * 4);
+
+    rowsWritten += count;
+    if (progress) {
+        progress->store(static_cast<float>(rowsWritten) / height);
+    }
+    return !ofs.fail();
+}
+
+bool RawImageWriter::finish() {
+    if (!ofs.is_open()) {
+        return false;
+    }
+    bool complete = rowsWritten == height;
+    if (!complete) {
+        std::cerr << "Raw image incomplete: " << rowsWritten << "/" << height << " rows" << std::endl;
+    }
+    ofs.close();
+    return complete && !ofs.fail();
+}
+
+RawImageReader::RawImageReader(const std::string& filename) : ifs(filename, std::ios::binary) {
+    if (!ifs.is_open()) {
+        std::cerr << "Failed to open raw image: " << filename << std::endl;
+        return;
+    }
+
+    uint8_t header[RAW_HEADER_SIZE];
+    if (!ifs.read(reinterpret_cast<char*>(header), sizeof(header))
+        || std::memcmp(header, "TPRW", 4) != 0) {
+        std::cerr << "Not a raw image: " << filename << std::endl;
+        return;
+    }
+    width = static_cast<int>(getU32LE(header + 4));
+    height = static_cast<int>(getU32LE(header + 8));
+    flags = getU32LE(header + 12);
+    if (width <= 0 || height <= 0) {
+        std::cerr << "Invalid raw image header: " << filename << std::endl;
+        return;
+    }
+    valid = true;
+}
+
+bool RawImageReader::readRows(uint8_t* dst, int count, ptrdiff_t stride) {
+    if (!valid) {
+        return false;
+    }
+    TRACE_SCOPE("RawImageReader::readRows");
+    if (count > height - rowsRead) {
+        std::cerr << "Raw image read past end" << std::endl;
+        return false;
+    }
+
+    std::streamsize rowBytes = static_cast<std::streamsize>(width) * 4;
+    bool bottomUp = (flags & RAW_BOTTOM_UP) != 0;
+    for (int r = 0; r < count; ++r) {
+        int fileRow = bottomUp ? height - 1 - (rowsRead + r) : rowsRead + r;
+        if (bottomUp || r == 0) {
+            ifs.seekg(static_cast<std::streamoff>(RAW_HEADER_SIZE) + fileRow * rowBytes);
+        }
+        if (!ifs.read(reinterpret_cast<char*>(dst + r * stride), rowBytes)) {
+            std::cerr << "Raw image data truncated" << std::endl;
+            valid = false;
+            return false;
+        }
+    }
+    rowsRead += count;
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "ImageReader.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// ヘッダー付き無圧縮RGBA(.rgba)
+//
+// ヘッダー(16バイト、リトルエンディアン):
+//   "TPRW" | u32 width | u32 height | u32 flags
+// 続いてwidth*height*4バイトのピクセル(行間の詰め物なし)。
+// flagsのRAW_BOTTOM_UPが立っていれば行は下から上の順(GLの読み出し順そのまま)。
+constexpr size_t RAW_HEADER_SIZE = 16;
+constexpr uint32_t RAW_BOTTOM_UP = 1u << 0;
+
+// 行をメモリ上の並びのまま書き出す(変換やコピーを行わない)
+class RawImageWriter {
+public:
+    RawImageWriter(const std::string& filename, int width, int height, uint32_t flags);
+
+    // コピー禁止
+    RawImageWriter(const RawImageWriter&) = delete;
+    RawImageWriter& operator=(const RawImageWriter&) = delete;
+
+    bool isOpen() const { return ofs.is_open(); }
+
+    // 連続したcount行をファイルの並び順で追加(マップしたPBOを直接渡せる)
+    bool writeRows(const uint8_t* rows, int count);
+
+    bool finish();
+
+    // 進捗の通知先(書き込み済み行数/全行数)
+    void setProgress(std::atomic<float>* target) { progress = target; }
+
+private:
+    std::ofstream ofs;
+    int width;
+    int height;
+    int rowsWritten = 0;
+    std::atomic<float>* progress = nullptr;
+};
+
+// 上から順に行単位で取り出す(下から上の並びのファイルはシークして反転)
+class RawImageReader : public ImageReader {
+public:
+    explicit RawImageReader(const std::string& filename);
+
+    // コピー禁止
+    RawImageReader(const RawImageReader&) = delete;
+    RawImageReader& operator=(const RawImageReader&) = delete;
+
+    bool isOpen() const override { return valid; }
+    int getWidth() const override { return width; }
+    int getHeight() const override { return height; }
+
+    // 次のcount行をdstへ読み込む(stride: dstの行間バイト数)
+    bool readRows(uint8_t* dst, int count, ptrdiff_t stride) override;
+
+private:
+    std::ifstream ifs;
+    bool valid = false;
+    int width = 0;
+    int height = 0;
+    uint32_t flags = 0;
+    int rowsRead = 0;
+};
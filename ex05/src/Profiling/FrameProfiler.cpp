@@ -0,0 +1,229 @@
+#include "FrameProfiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <iostream>
+#include <sstream>
+
+FrameProfiler::FrameProfiler(const std::string& csvPath) {
+    for (auto& slot : slots) {
+        glGenQueries(2, slot.frameQueries);
+        glGenQueries(PHASE_COUNT * MAX_SPANS * 2, &slot.spanQueries[0][0][0]);
+    }
+
+    if (!csvPath.empty()) {
+        csv.open(csvPath, std::ios::trunc);
+        if (!csv.is_open()) {
+            std::cerr << "Failed to open profiler CSV: " << csvPath << std::endl;
+        } else {
+            csv << "frame,cpu_frame_ms,gpu_frame_ms";
+            for (int p = 0; p < PHASE_COUNT; ++p) {
+                const char* name = phaseName(static_cast<FramePhase>(p));
+                csv << "," << name << "_cpu_ms," << name << "_gpu_ms";
+            }
+            csv << "\n";
+        }
+    }
+}
+
+FrameProfiler::~FrameProfiler() {
+    // 未解決のフレームを古い順に読み出す
+    for (int i = 0; i < QUERY_FRAMES; ++i) {
+        FrameSlot& slot = slots[(frameIndex + i) % QUERY_FRAMES];
+        if (slot.pending) {
+            resolve(slot);
+        }
+    }
+    if (!window.empty()) {
+        printSummary();
+    }
+
+    for (auto& slot : slots) {
+        glDeleteQueries(2, slot.frameQueries);
+        glDeleteQueries(PHASE_COUNT * MAX_SPANS * 2, &slot.spanQueries[0][0][0]);
+    }
+}
+
+const char* FrameProfiler::phaseName(FramePhase phase) {
+    switch (phase) {
+        case FramePhase::Stroke: return "stroke";
+        case FramePhase::StrokeEnd: return "stroke_end";
+        case FramePhase::Restore: return "restore";
+        case FramePhase::Export: return "export";
+        case FramePhase::Autosave: return "autosave";
+        case FramePhase::Import: return "import";
+        case FramePhase::Composite: return "composite";
+        case FramePhase::Render: return "render";
+        case FramePhase::Captures: return "captures";
+        case FramePhase::Swap: return "swap";
+        default: return "unknown";
+    }
+}
+
+void FrameProfiler::beginFrame() {
+    FrameSlot& slot = slots[frameIndex % QUERY_FRAMES];
+
+    // QUERY_FRAMES前のフレームの結果を回収してからスロットを再利用
+    if (slot.pending) {
+        resolve(slot);
+    }
+
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        slot.spanCount[p] = 0;
+        slot.cpuMs[p] = 0.0;
+    }
+    slot.frameIndex = frameIndex;
+
+    // GL_TIME_ELAPSEDは最初のフレームで開始時刻が0のまま返るドライバがあり(llvmpipe)、
+    // 区間やStartupProfilerのタイムスタンプとも揃えるため、フレーム全体もタイムスタンプで測る
+    glQueryCounter(slot.frameQueries[0], GL_TIMESTAMP);
+    frameStart = Clock::now();
+    slot.start = frameStart;
+    inFrame = true;
+}
+
+void FrameProfiler::endFrame() {
+    if (!inFrame) {
+        return;
+    }
+    FrameSlot& slot = slots[frameIndex % QUERY_FRAMES];
+    glQueryCounter(slot.frameQueries[1], GL_TIMESTAMP);
+    slot.cpuFrameMs = std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+    slot.pending = true;
+    inFrame = false;
+    frameIndex++;
+
+    if (frameIndex % REPORT_INTERVAL == 0) {
+        printSummary();
+    }
+}
+
+void FrameProfiler::beginPhase(FramePhase phase) {
+    if (!inFrame) {
+        return;
+    }
+    int p = static_cast<int>(phase);
+    FrameSlot& slot = slots[frameIndex % QUERY_FRAMES];
+    if (slot.spanCount[p] < MAX_SPANS) {
+        glQueryCounter(slot.spanQueries[p][slot.spanCount[p]][0], GL_TIMESTAMP);
+    }
+    phaseStart[p] = Clock::now();
+}
+
+void FrameProfiler::endPhase(FramePhase phase) {
+    if (!inFrame) {
+        return;
+    }
+    int p = static_cast<int>(phase);
+    FrameSlot& slot = slots[frameIndex % QUERY_FRAMES];
+    slot.cpuMs[p] += std::chrono::duration<double, std::milli>(Clock::now() - phaseStart[p]).count();
+    if (slot.spanCount[p] < MAX_SPANS) {
+        glQueryCounter(slot.spanQueries[p][slot.spanCount[p]][1], GL_TIMESTAMP);
+        slot.spanCount[p]++;
+    }
+}
+
+void FrameProfiler::resolve(FrameSlot& slot) {
+    FrameRecord record;
+    record.frameIndex = slot.frameIndex;
+    record.cpuFrameMs = slot.cpuFrameMs;
+
+    // GPUの処理はフレームの開始から結果が揃うまでの間に収まるはずなので、それを上限とする
+    const double invalid = std::numeric_limits<double>::quiet_NaN();
+    auto elapsedMs = [&](GLuint startQuery, GLuint endQuery, double limitMs) {
+        GLuint64 start = 0, end = 0;
+        glGetQueryObjectui64v(startQuery, GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &end);
+        double ms = (static_cast<double>(end) - static_cast<double>(start)) / 1e6;
+        return (end < start || ms > limitMs) ? invalid : ms;
+    };
+    double limitMs = std::chrono::duration<double, std::milli>(Clock::now() - slot.start).count();
+    record.gpuFrameMs = elapsedMs(slot.frameQueries[0], slot.frameQueries[1], limitMs);
+
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        record.cpuMs[p] = slot.cpuMs[p];
+        double total = 0.0;
+        for (int i = 0; i < slot.spanCount[p]; ++i) {
+            total += elapsedMs(slot.spanQueries[p][i][0], slot.spanQueries[p][i][1], limitMs);
+        }
+        record.gpuMs[p] = total;
+    }
+    slot.pending = false;
+
+    window.push_back(record);
+    if (window.size() > WINDOW_FRAMES) {
+        window.pop_front();
+    }
+
+    if (csv.is_open()) {
+        // 捨てたGPU時間は空欄
+        auto writeGpu = [&](double ms) {
+            csv << ",";
+            if (!std::isnan(ms)) {
+                csv << ms;
+            }
+        };
+        csv << record.frameIndex << "," << record.cpuFrameMs;
+        writeGpu(record.gpuFrameMs);
+        for (int p = 0; p < PHASE_COUNT; ++p) {
+            csv << "," << record.cpuMs[p];
+            writeGpu(record.gpuMs[p]);
+        }
+        csv << "\n";
+    }
+}
+
+void FrameProfiler::printSummary() {
+    if (window.empty()) {
+        return;
+    }
+
+    // GPU時間は捨てていないフレームだけで集計する
+    double n = static_cast<double>(window.size());
+    double cpuAvg = 0.0, gpuAvg = 0.0, cpuMax = 0.0, gpuMax = 0.0;
+    size_t gpuCount = 0;
+    double phaseCpuAvg[PHASE_COUNT] = {};
+    double phaseGpuAvg[PHASE_COUNT] = {};
+    double phaseCpuMax[PHASE_COUNT] = {};
+    double phaseGpuMax[PHASE_COUNT] = {};
+    size_t phaseGpuCount[PHASE_COUNT] = {};
+
+    for (const auto& r : window) {
+        cpuAvg += r.cpuFrameMs / n;
+        cpuMax = std::max(cpuMax, r.cpuFrameMs);
+        if (!std::isnan(r.gpuFrameMs)) {
+            gpuAvg += r.gpuFrameMs;
+            gpuMax = std::max(gpuMax, r.gpuFrameMs);
+            gpuCount++;
+        }
+        for (int p = 0; p < PHASE_COUNT; ++p) {
+            phaseCpuAvg[p] += r.cpuMs[p] / n;
+            phaseCpuMax[p] = std::max(phaseCpuMax[p], r.cpuMs[p]);
+            if (!std::isnan(r.gpuMs[p])) {
+                phaseGpuAvg[p] += r.gpuMs[p];
+                phaseGpuMax[p] = std::max(phaseGpuMax[p], r.gpuMs[p]);
+                phaseGpuCount[p]++;
+            }
+        }
+    }
+    gpuAvg = gpuCount > 0 ? gpuAvg / gpuCount : 0.0;
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        phaseGpuAvg[p] = phaseGpuCount[p] > 0 ? phaseGpuAvg[p] / phaseGpuCount[p] : 0.0;
+    }
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3)
+        << "[profile] last " << window.size() << " frames: frame cpu avg " << cpuAvg
+        << " ms (max " << cpuMax << "), gpu avg " << gpuAvg << " ms (max " << gpuMax << ")";
+    if (gpuCount < window.size()) {
+        out << ", " << window.size() - gpuCount << " untrustworthy gpu results dropped";
+    }
+    out << "\n";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        out << "[profile]   " << std::setw(10) << phaseName(static_cast<FramePhase>(p))
+            << ": cpu avg " << phaseCpuAvg[p] << " (max " << phaseCpuMax[p] << ")"
+            << ", gpu avg " << phaseGpuAvg[p] << " (max " << phaseGpuMax[p] << ")\n";
+    }
+    std::cout << out.str() << std::flush;
+}
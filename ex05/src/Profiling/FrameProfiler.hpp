@@ -0,0 +1,107 @@
+#pragma once
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+
+// フレーム内の計測区間
+enum class FramePhase {
+    Stroke,     // ブラシ描画(ダーティタイルのマーク、描画前PBOキャプチャ開始を含む)
+    StrokeEnd,  // ストローク終了時の描画後タイル保存
+    Restore,    // Undo/Redoの読み込みとタイル復元
+    Export,     // 画像保存
+    Autosave,   // 自動保存(タイルのコピー、帯の読み出し命令、マップ)
+    Import,     // 画像読み込み(帯のアップロードと履歴保存)
+    Composite,  // レイヤー合成キャッシュと表示用ミップマップの更新
+    Render,     // キャンバスの画面描画
+    Captures,   // processPendingCaptures(PBOマップと履歴キュー投入)
+    Swap,       // バッファスワップ
+    Count
+};
+
+// CPU時間とGPU時間(開始・終了のGL_TIMESTAMPクエリ)をフレーム・区間ごとに計測する
+// クエリ結果は数フレーム遅れて読み出し、GPUの完了待ちでストールしない
+// 終了が開始より前、またはフレーム開始から読み出しまでの実時間より長いGPU時間は信用できないため捨てる(CSVでは空欄)
+class FrameProfiler {
+public:
+    // csvPathが空でなければフレームごとの計測値をCSVに出力
+    explicit FrameProfiler(const std::string& csvPath = "");
+    ~FrameProfiler();
+
+    // コピー禁止
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    void beginFrame();
+    void endFrame();
+
+    // 区間は入れ子にしない(同じ区間を1フレームに複数回計測するのは可)
+    void beginPhase(FramePhase phase);
+    void endPhase(FramePhase phase);
+
+    // 直近フレームの統計を標準出力へ
+    void printSummary();
+
+    static const char* phaseName(FramePhase phase);
+
+    // 区間計測のスコープヘルパー(profilerがnullptrなら何もしない)
+    class Scope {
+    public:
+        Scope(FrameProfiler* profiler, FramePhase phase) : profiler(profiler), phase(phase) {
+            if (profiler) {
+                profiler->beginPhase(phase);
+            }
+        }
+        ~Scope() {
+            if (profiler) {
+                profiler->endPhase(phase);
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        FrameProfiler* profiler;
+        FramePhase phase;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int PHASE_COUNT = static_cast<int>(FramePhase::Count);
+    static constexpr int QUERY_FRAMES = 3;      // 結果待ちのフレーム数
+    static constexpr int MAX_SPANS = 16;        // 1フレーム・1区間あたりのGPU計測回数上限
+    static constexpr size_t WINDOW_FRAMES = 120; // 統計の対象フレーム数
+    static constexpr uint64_t REPORT_INTERVAL = 300;
+
+    struct FrameSlot {
+        GLuint frameQueries[2] = {};  // フレームの開始・終了
+        Clock::time_point start;
+        GLuint spanQueries[PHASE_COUNT][MAX_SPANS][2] = {};
+        int spanCount[PHASE_COUNT] = {};
+        double cpuMs[PHASE_COUNT] = {};
+        double cpuFrameMs = 0.0;
+        uint64_t frameIndex = 0;
+        bool pending = false;
+    };
+
+    struct FrameRecord {
+        uint64_t frameIndex;
+        double cpuFrameMs;
+        double gpuFrameMs;  // 捨てたらNaN
+        double cpuMs[PHASE_COUNT];
+        double gpuMs[PHASE_COUNT];  // 捨てたらNaN
+    };
+
+    FrameSlot slots[QUERY_FRAMES];
+    uint64_t frameIndex = 0;
+    bool inFrame = false;
+    Clock::time_point frameStart;
+    Clock::time_point phaseStart[PHASE_COUNT];
+
+    std::deque<FrameRecord> window;
+    std::ofstream csv;
+
+    void resolve(FrameSlot& slot);
+};
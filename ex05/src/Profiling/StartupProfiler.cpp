@@ -0,0 +1,119 @@
+#include "StartupProfiler.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+// プロセス開始の近似(静的初期化の時点)
+const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now();
+
+double millisecondsSinceStart() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processStart).count();
+}
+
+}
+
+StartupProfiler::~StartupProfiler() {
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        if (queries[p][0] != 0) {
+            glDeleteQueries(2, queries[p]);
+        }
+    }
+}
+
+const char* StartupProfiler::phaseName(StartupPhase phase) {
+    switch (phase) {
+        case StartupPhase::Window: return "window";
+        case StartupPhase::Canvas: return "canvas";
+        case StartupPhase::Renderer: return "renderer";
+        case StartupPhase::Brush: return "brush";
+        case StartupPhase::History: return "history";
+        case StartupPhase::IO: return "io";
+        case StartupPhase::FirstFrame: return "first_frame";
+        default: return "unknown";
+    }
+}
+
+void StartupProfiler::beginPhase(StartupPhase phase) {
+    int p = static_cast<int>(phase);
+    // Windowの開始時点ではまだGLコンテキストが無い
+    hasGpu[p] = phase != StartupPhase::Window;
+    if (hasGpu[p]) {
+        // FrameProfilerのフレーム全体のGL_TIME_ELAPSEDと重なってもよいようタイムスタンプで測る
+        glGenQueries(2, queries[p]);
+        glQueryCounter(queries[p][0], GL_TIMESTAMP);
+    }
+    phaseStart = Clock::now();
+}
+
+void StartupProfiler::endPhase(StartupPhase phase) {
+    int p = static_cast<int>(phase);
+    cpuMs[p] += std::chrono::duration<double, std::milli>(Clock::now() - phaseStart).count();
+    if (hasGpu[p]) {
+        glQueryCounter(queries[p][1], GL_TIMESTAMP);
+    }
+}
+
+void StartupProfiler::frameDone(bool canvasShown) {
+    if (printed) {
+        return;
+    }
+    if (firstFrameMs < 0.0) {
+        endPhase(StartupPhase::FirstFrame);
+        firstFrameMs = millisecondsSinceStart();
+    }
+    if (canvasShown && canvasFrameMs < 0.0) {
+        canvasFrameMs = millisecondsSinceStart();
+    }
+    if (canvasFrameMs >= 0.0 && resultsAvailable()) {
+        print();
+    }
+}
+
+void StartupProfiler::finish() {
+    if (!printed && firstFrameMs >= 0.0) {
+        print();
+    }
+}
+
+bool StartupProfiler::resultsAvailable() const {
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        if (hasGpu[p]) {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(queries[p][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void StartupProfiler::print() {
+    printed = true;
+
+    char line[128];
+    std::cout << "Startup: first frame at " << firstFrameMs << " ms, ";
+    if (canvasFrameMs >= 0.0) {
+        std::cout << "canvas shown at " << canvasFrameMs << " ms";
+    } else {
+        std::cout << "canvas not shown";
+    }
+    std::cout << " (since process start)" << std::endl;
+
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        std::snprintf(line, sizeof(line), "  %-12s cpu %8.2f ms", phaseName(static_cast<StartupPhase>(p)), cpuMs[p]);
+        std::cout << line;
+        if (hasGpu[p]) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[p][0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[p][1], GL_QUERY_RESULT, &end);
+            std::snprintf(line, sizeof(line), "  gpu %8.2f ms", (end - begin) / 1.0e6);
+            std::cout << line;
+        }
+        std::cout << std::endl;
+    }
+    if (firstFrameMs > BUDGET_MS) {
+        std::cerr << "Startup exceeded the " << BUDGET_MS << " ms budget (see the breakdown above)" << std::endl;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <GL/glew.h>
+#include <chrono>
+
+// 起動処理の計測区間
+enum class StartupPhase {
+    Window,     // GLコンテキストの作成(GLEWの初期化、シェーダーのコンパイル用の共有コンテキストを含む)
+    Canvas,     // レイヤー・タイル管理・合成キャッシュ・表示用ミップマップ(シェーダーの発行を含む)
+    Renderer,   // 画面描画用のシェーダーとメッシュ
+    Brush,      // ブラシのシェーダーとメッシュ
+    History,    // 履歴ファイルとワーカースレッド
+    IO,         // 画像保存・読み込み・プロジェクト保存・自動保存
+    FirstFrame, // 描画スレッドの最初のフレーム(スワップまで)
+    Count
+};
+
+// プロセス開始から最初のフレーム、キャンバスが表示されたフレームまでの時間と、
+// 区間ごとのCPU時間・GPU時間(開始・終了のGL_TIMESTAMPクエリ)を記録し、1度だけ出力する
+// クエリ結果は以降のフレームで揃ったときに読み出し、描画を待たせない
+class StartupProfiler {
+public:
+    StartupProfiler() = default;
+    ~StartupProfiler();
+
+    // コピー禁止
+    StartupProfiler(const StartupProfiler&) = delete;
+    StartupProfiler& operator=(const StartupProfiler&) = delete;
+
+    // 区間は入れ子にしない。GLコンテキストが無い区間(Window)はCPU時間のみ
+    void beginPhase(StartupPhase phase);
+    void endPhase(StartupPhase phase);
+
+    // フレームのスワップ後に描画スレッドから呼ぶ
+    // canvasShown: このフレームでキャンバスを描画したか
+    void frameDone(bool canvasShown);
+
+    // 出力前に終了する場合、揃っている分を出力(描画スレッドの終了時)
+    void finish();
+
+    static const char* phaseName(StartupPhase phase);
+
+    // 区間計測のスコープヘルパー
+    class Scope {
+    public:
+        Scope(StartupProfiler& profiler, StartupPhase phase) : profiler(profiler), phase(phase) {
+            profiler.beginPhase(phase);
+        }
+        ~Scope() { profiler.endPhase(phase); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StartupProfiler& profiler;
+        StartupPhase phase;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int PHASE_COUNT = static_cast<int>(StartupPhase::Count);
+    // 最初のフレームまでの目標(超えたら内訳と合わせて警告する)
+    static constexpr double BUDGET_MS = 100.0;
+
+    GLuint queries[PHASE_COUNT][2] = {};
+    double cpuMs[PHASE_COUNT] = {};
+    Clock::time_point phaseStart;
+    bool hasGpu[PHASE_COUNT] = {};
+
+    double firstFrameMs = -1.0;   // プロセス開始から
+    double canvasFrameMs = -1.0;
+    bool printed = false;
+
+    bool resultsAvailable() const;
+    void print();
+};
@@ -0,0 +1,84 @@
+#include "StressReport.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sys/resource.h>
+
+void StressReport::addLatency(LatencyMetric metric, double ms) {
+    latencies[static_cast<int>(metric)].push_back(ms);
+}
+
+void StressReport::sampleFrame(size_t historyQueueDepth, int pendingCaptures) {
+    queueDepths.push_back(static_cast<double>(historyQueueDepth));
+    this->pendingCaptures.push_back(static_cast<double>(pendingCaptures));
+}
+
+const char* StressReport::metricName(LatencyMetric metric) {
+    switch (metric) {
+        case LatencyMetric::Frame: return "frame";
+        case LatencyMetric::StrokeEnd: return "stroke_end";
+        case LatencyMetric::Undo: return "undo";
+        case LatencyMetric::Redo: return "redo";
+        case LatencyMetric::Restore: return "restore";
+        default: return "unknown";
+    }
+}
+
+double StressReport::percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    // 最近傍順位法
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+void StressReport::printRow(const char* name, std::vector<double> values, const char* unit) {
+    std::sort(values.begin(), values.end());
+    // 100件未満のp99は最大値と変わらないため印を付ける
+    char line[160];
+    std::snprintf(line, sizeof(line), "  %-16s n=%-7zu p50 %9.2f  p99 %9.2f%s max %9.2f %s", name, values.size(),
+                  percentile(values, 0.50), percentile(values, 0.99), values.size() < 100 ? "*" : " ",
+                  values.empty() ? 0.0 : values.back(), unit);
+    std::cout << line << std::endl;
+}
+
+void StressReport::print(const Totals& totals) const {
+    std::cout << "Stress report:" << std::endl;
+    for (int m = 0; m < METRIC_COUNT; ++m) {
+        printRow(metricName(static_cast<LatencyMetric>(m)), latencies[m], "ms");
+    }
+    printRow("history_queue", queueDepths, "tiles");
+    printRow("pending_pbos", pendingCaptures, "PBOs");
+    std::cout << "  (n: samples per row; * p99 from fewer than 100 samples is the maximum)" << std::endl;
+
+    // ru_maxrssはLinuxではKB単位
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    char line[160];
+    std::snprintf(line, sizeof(line), "  peak RSS %.1f MB, history file %.1f MB", usage.ru_maxrss / 1024.0,
+                  totals.historyFileBytes / (1024.0 * 1024.0));
+    std::cout << line << std::endl;
+
+    const HistoryQueueStats& queue = totals.historyQueue;
+    std::snprintf(line, sizeof(line),
+                  "  history queue peak %zu tiles / %.1f MB, blocked %zu times (%.1f ms, %zu timed out over budget)",
+                  queue.peakDepth, queue.peakBytes / (1024.0 * 1024.0), queue.blockedEnqueues, queue.blockedMs,
+                  queue.blockTimeouts);
+    std::cout << line << std::endl;
+    if (queue.encodedRawBytes > 0) {
+        std::snprintf(line, sizeof(line), "  history encoded %.1f MB -> %.1f MB", queue.encodedRawBytes / (1024.0 * 1024.0),
+                      queue.encodedBytes / (1024.0 * 1024.0));
+        std::cout << line << std::endl;
+    }
+    if (queue.compressedTiles > 0 || queue.coalescedTiles > 0) {
+        std::snprintf(line, sizeof(line), "  history queue compressed %zu tiles (saved %.1f MB), coalesced %zu tiles",
+                      queue.compressedTiles, queue.compressedSavedBytes / (1024.0 * 1024.0), queue.coalescedTiles);
+        std::cout << line << std::endl;
+    }
+    if (totals.droppedCaptures > 0) {
+        std::cerr << "  " << totals.droppedCaptures << " tile captures dropped (PBO pool full); "
+                  << "those tiles cannot be undone" << std::endl;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <vector>
+#include "History/HistoryTypes.hpp"
+
+// 負荷試験で集計する遅延
+enum class LatencyMetric {
+    Frame,      // フレーム全体(コマンド処理からスワップまで)
+    StrokeEnd,  // ストローク終了(残りの区間の描画と描画後タイルの保存)
+    Undo,       // Undo 1回の要求(PBOの回収とstepIDの移動。タイルは復元スレッドが読み込む)
+    Redo,
+    Restore,    // Undo/Redoの要求から全タイルの反映まで(続けて届いた要求はまとめて1回)
+    Count
+};
+
+// 負荷時の遅延・キューの深さ・メモリを集計し、終了時に出力する(--stress、--stress-report)
+// 値は全て保持し、p50/p99/最大を求める
+class StressReport {
+public:
+    // 終了時の状態
+    struct Totals {
+        size_t historyFileBytes = 0;
+        HistoryQueueStats historyQueue;
+        size_t droppedCaptures = 0;
+    };
+
+    void addLatency(LatencyMetric metric, double ms);
+
+    // フレームの終わりに呼ぶ(その時点の履歴の書き込み待ちタイル数、処理待ちPBO数)
+    void sampleFrame(size_t historyQueueDepth, int pendingCaptures);
+
+    void print(const Totals& totals) const;
+
+    static const char* metricName(LatencyMetric metric);
+
+    // 遅延計測のスコープヘルパー(reportがnullptrなら何もしない)
+    class Scope {
+    public:
+        Scope(StressReport* report, LatencyMetric metric) : report(report), metric(metric) {
+            if (report) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+        ~Scope() {
+            if (report) {
+                report->addLatency(metric, std::chrono::duration<double, std::milli>(
+                                               std::chrono::steady_clock::now() - start).count());
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        StressReport* report;
+        LatencyMetric metric;
+        std::chrono::steady_clock::time_point start;
+    };
+
+private:
+    static constexpr int METRIC_COUNT = static_cast<int>(LatencyMetric::Count);
+
+    std::vector<double> latencies[METRIC_COUNT];
+    std::vector<double> queueDepths;
+    std::vector<double> pendingCaptures;
+
+    // 昇順に並べた値のp(0〜1)分位点
+    static double percentile(const std::vector<double>& sorted, double p);
+    static void printRow(const char* name, std::vector<double> values, const char* unit);
+};
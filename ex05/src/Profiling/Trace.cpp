@@ -0,0 +1,230 @@
+#include "Trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Trace {
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint64_t startNs;
+    uint64_t durationNs;  // カウンターでは未使用
+    int64_t value;        // カウンター値
+    char phase;           // 'X' または 'C'
+};
+
+// スレッドごとのバッファ(書き込みは所有スレッドのみ、読み出しはstop後かスレッドの終了時のみ)
+struct ThreadBuffer {
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    std::unique_ptr<Event[]> events{new Event[CAPACITY]};
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> dropped{0};
+    std::string threadName;
+    int tid = 0;
+};
+
+// 終了したスレッドのイベント(記録された分だけに詰めて保持する)
+struct RetiredThread {
+    int tid;
+    std::string threadName;
+    std::vector<Event> events;
+    size_t dropped;
+};
+
+// 終了したスレッドから保持するイベント数の上限(超えた分は捨てて件数のみ数える)
+constexpr size_t MAX_RETIRED_EVENTS = 1 << 20;
+
+std::atomic<bool> enabled{false};
+std::string outputPath;
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;     // 実行中のスレッドのバッファ
+std::vector<std::unique_ptr<ThreadBuffer>> freeBuffers;  // 終了したスレッドから回収したバッファ
+std::vector<RetiredThread> retired;
+size_t retiredEvents = 0;
+int nextTid = 1;
+const auto epoch = std::chrono::steady_clock::now();
+
+// スレッドの終了時にイベントを詰めて移し、バッファを次のスレッドへ回す
+// (短命なスレッドを多数作っても、バッファは同時に動くスレッド数までしか確保しない)
+void retire(ThreadBuffer* buffer) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = std::find_if(registry.begin(), registry.end(),
+                           [buffer](const std::unique_ptr<ThreadBuffer>& owned) { return owned.get() == buffer; });
+    if (it == registry.end()) {
+        return;
+    }
+
+    size_t count = buffer->count.load(std::memory_order_acquire);
+    size_t kept = std::min(count, MAX_RETIRED_EVENTS - retiredEvents);
+    retired.push_back({buffer->tid, buffer->threadName,
+                       std::vector<Event>(buffer->events.get(), buffer->events.get() + kept),
+                       buffer->dropped.load() + (count - kept)});
+    retiredEvents += kept;
+
+    buffer->count.store(0, std::memory_order_relaxed);
+    buffer->dropped.store(0, std::memory_order_relaxed);
+    buffer->threadName.clear();
+    freeBuffers.push_back(std::move(*it));
+    registry.erase(it);
+}
+
+// スレッドの終了時(thread_localの破棄)にバッファを返す
+struct BufferOwner {
+    ThreadBuffer* buffer = nullptr;
+    ~BufferOwner() {
+        if (buffer) {
+            retire(buffer);
+        }
+    }
+};
+
+// スレッド初回の記録時だけロックして登録し、以降はロックなしで追記
+ThreadBuffer& localBuffer() {
+    thread_local BufferOwner owner;
+    if (!owner.buffer) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        std::unique_ptr<ThreadBuffer> owned;
+        if (!freeBuffers.empty()) {
+            owned = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        } else {
+            owned = std::make_unique<ThreadBuffer>();
+        }
+        owned->tid = nextTid++;
+        owner.buffer = owned.get();
+        registry.push_back(std::move(owned));
+    }
+    return *owner.buffer;
+}
+
+void push(const Event& event) {
+    ThreadBuffer& buffer = localBuffer();
+    size_t index = buffer.count.load(std::memory_order_relaxed);
+    if (index >= ThreadBuffer::CAPACITY) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[index] = event;
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void writeEscaped(std::ofstream& ofs, const std::string& text) {
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            ofs << '\\';
+        }
+        ofs << c;
+    }
+}
+
+// 1スレッド分のスレッド名とイベントを書き出す
+void writeThread(std::ofstream& ofs, int tid, const std::string& threadName, const Event* events, size_t count,
+                 bool& first) {
+    if (!threadName.empty()) {
+        ofs << (first ? "" : ",\n")
+            << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":\"";
+        writeEscaped(ofs, threadName);
+        ofs << "\"}}";
+        first = false;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const Event& e = events[i];
+        ofs << (first ? "" : ",\n") << "{\"name\":\"";
+        writeEscaped(ofs, e.name);
+        ofs << "\",\"ph\":\"" << e.phase << "\",\"pid\":1,\"tid\":" << tid
+            << ",\"ts\":" << e.startNs / 1000.0;
+        if (e.phase == 'X') {
+            ofs << ",\"dur\":" << e.durationNs / 1000.0;
+        } else {
+            ofs << ",\"args\":{\"value\":" << e.value << "}";
+        }
+        ofs << "}";
+        first = false;
+    }
+}
+
+}  // namespace
+
+void start(const std::string& filename) {
+    outputPath = filename;
+    enabled.store(true, std::memory_order_release);
+}
+
+bool isEnabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t nowNs() {
+    // 0は「記録しない」を表すため1から始める
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count()) + 1;
+}
+
+void setThreadName(const char* name) {
+    if (!isEnabled()) {
+        return;
+    }
+    localBuffer().threadName = name;
+}
+
+void recordComplete(const char* name, uint64_t startNs, uint64_t endNs) {
+    if (!isEnabled()) {
+        return;
+    }
+    push({name, startNs, endNs - startNs, 0, 'X'});
+}
+
+void recordCounter(const char* name, int64_t value) {
+    if (!isEnabled()) {
+        return;
+    }
+    push({name, nowNs(), 0, value, 'C'});
+}
+
+void stop() {
+    if (!enabled.exchange(false)) {
+        return;
+    }
+
+    std::ofstream ofs(outputPath, std::ios::trunc);
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to open trace file: " << outputPath << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t total = 0;
+    size_t dropped = 0;
+
+    for (const RetiredThread& thread : retired) {
+        writeThread(ofs, thread.tid, thread.threadName, thread.events.data(), thread.events.size(), first);
+        total += thread.events.size();
+        dropped += thread.dropped;
+    }
+    for (const auto& buffer : registry) {
+        size_t count = buffer->count.load(std::memory_order_acquire);
+        writeThread(ofs, buffer->tid, buffer->threadName, buffer->events.get(), count, first);
+        total += count;
+        dropped += buffer->dropped.load();
+    }
+    ofs << "\n]}\n";
+
+    std::cout << "Trace written to " << outputPath << " (" << total << " events";
+    if (dropped > 0) {
+        std::cout << ", " << dropped << " dropped";
+    }
+    std::cout << ")" << std::endl;
+}
+
+}  // namespace Trace
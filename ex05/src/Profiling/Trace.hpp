@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Chrome trace event形式(Perfettoで表示可能)のスコープトレース
+//
+// -DTINYPAINT_TRACE(make TRACE=1)でビルドした場合のみ計測コードが埋め込まれ、
+// それ以外ではTRACE_*マクロは空になる。
+// 埋め込み時も Trace::start() を呼ぶまでは atomic<bool> の確認だけで何もしない。
+namespace Trace {
+
+// 記録開始(終了時にfilenameへJSONを出力)
+void start(const std::string& filename);
+
+// 記録を止めてJSONを書き出す(全スレッドの停止後に呼ぶ)
+void stop();
+
+bool isEnabled();
+
+// 呼び出しスレッドの表示名を設定
+void setThreadName(const char* name);
+
+// 完了イベント(ph:"X")とカウンター(ph:"C")の記録
+void recordComplete(const char* name, uint64_t startNs, uint64_t endNs);
+void recordCounter(const char* name, int64_t value);
+
+uint64_t nowNs();
+
+// スコープの開始から終了までを1イベントとして記録
+class Scope {
+public:
+    explicit Scope(const char* name) : name(name), startNs(isEnabled() ? nowNs() : 0) {}
+    ~Scope() {
+        if (startNs != 0) {
+            recordComplete(name, startNs, nowNs());
+        }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name;
+    uint64_t startNs;
+};
+
+}  // namespace Trace
+
+#ifdef TINYPAINT_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) \
+    do { if (Trace::isEnabled()) Trace::recordCounter(name, static_cast<int64_t>(value)); } while (0)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#endif
@@ -1,36 +1,236 @@
 #include "Canvas.hpp"
 #include "History/HistoryManager.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "Profiling/Trace.hpp"
 
 Canvas::Canvas(int size, int tileSize)
     : size(size) {
-    // レイヤーテクスチャを作成
-    layerTexture = std::make_unique<LayerTexture>(size, size);
+    // タイルシステムと合成キャッシュを初期化
+    tileSystem = std::make_unique<TileSystem>(size, tileSize);
+    compositor = std::make_unique<Compositor>(size, tileSize);
+    pyramid = std::make_unique<DisplayPyramid>(size, tileSize);
+
+    // 最初のレイヤー
+    layers.push_back(createLayer(nextLayerID++));
+}
 
-    // FBOを作成し、レイヤーテクスチャをアタッチ
-    fbo = std::make_unique<FrameBuffer>(layerTexture->getId());
+Layer Canvas::createLayer(int id) {
+    Layer layer;
+    layer.id = id;
 
-    // タイルシステムを初期化
-    tileSystem = std::make_unique<TileSystem>(size, tileSize);
+    // 画素の領域は最初に書き込むまで確保しない(起動時や追加時にsize*size*4バイトを確保・クリアしない)
+    layer.texture = std::make_unique<LayerTexture>(size, size);
+    return layer;
+}
+
+void Canvas::ensureStorage(Layer& layer) {
+    if (layer.hasPixels()) {
+        return;
+    }
+    TRACE_SCOPE("Canvas::ensureStorage");
+    layer.texture->allocate();
+    layer.fbo = std::make_unique<FrameBuffer>(layer.texture->getId());
 
-    // キャンバスを白(透明)で初期化
-    layerTexture->clear(1.0f, 1.0f, 1.0f, 0.0f);
+    // 白(透明)で初期化
+    layer.texture->clear(1.0f, 1.0f, 1.0f, 0.0f);
 }
 
 void Canvas::bind() {
-    fbo->bind();
+    ensureStorage(layers[activeIndex]);
+    layers[activeIndex].fbo->bind();
     glViewport(0, 0, size, size);
 }
 
 void Canvas::unbind() {
-    fbo->unbind();
+    layers[activeIndex].fbo->unbind();
+}
+
+GLuint Canvas::getTexture() {
+    ensureStorage(layers[activeIndex]);
+    return layers[activeIndex].texture->getId();
+}
+
+bool Canvas::addLayer() {
+    if (getLayerCount() >= MAX_LAYERS) {
+        std::cerr << "Layer limit reached (" << MAX_LAYERS << ")" << std::endl;
+        return false;
+    }
+    layers.insert(layers.begin() + activeIndex + 1, createLayer(nextLayerID++));
+    activeIndex++;
+    compositor->invalidate();
+    tileSystem->markAllDisplayDirty();
+    printLayers();
+    return true;
+}
+
+void Canvas::selectLayer(int delta) {
+    int index = std::max(0, std::min(activeIndex + delta, getLayerCount() - 1));
+    if (index == activeIndex) {
+        return;
+    }
+    activeIndex = index;
+    compositor->invalidate();
+    tileSystem->markAllDisplayDirty();
+    printLayers();
+}
+
+void Canvas::toggleLayerVisibility() {
+    layers[activeIndex].visible = !layers[activeIndex].visible;
+    compositor->invalidateActive();
+    tileSystem->markAllDisplayDirty();
+    printLayers();
+}
+
+void Canvas::adjustLayerOpacity(float delta) {
+    Layer& layer = layers[activeIndex];
+    // 0.1刻みの誤差が溜まらないよう丸める
+    float opacity = std::round((layer.opacity + delta) * 10.0f) / 10.0f;
+    layer.opacity = std::max(0.0f, std::min(opacity, 1.0f));
+    compositor->invalidateActive();
+    tileSystem->markAllDisplayDirty();
+    printLayers();
+}
+
+void Canvas::cycleLayerBlendMode() {
+    Layer& layer = layers[activeIndex];
+    int next = (static_cast<int>(layer.blendMode) + 1) % static_cast<int>(BlendMode::Count);
+    layer.blendMode = static_cast<BlendMode>(next);
+    compositor->invalidateActive();
+    tileSystem->markAllDisplayDirty();
+    printLayers();
+}
+
+void Canvas::updateDisplay(int x, int y, int width, int height) {
+    compositor->update(layers, activeIndex);
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    // 画面の端でも上位レベルのフィルタが正しく読めるよう1タイル広げる
+    int tileSize = tileSystem->getTileSize();
+    std::set<TileCoord> tiles;
+    tileSystem->takeDisplayDirtyTiles(x / tileSize - 1, y / tileSize - 1,
+                                      (x + width - 1) / tileSize + 1, (y + height - 1) / tileSize + 1, tiles);
+    pyramid->update(compositor->getView(), tiles);
+}
+
+GLuint Canvas::flatten() {
+    // 1枚だけのレイヤーはテクスチャがそのまま保存されるため、透明部分の色(白)も含めて確保しておく
+    // 複数枚の合成では、画素を確保していないレイヤーは透明として飛ばすので確保しない
+    int single = Compositor::findPassthrough(layers);
+    if (single >= 0) {
+        ensureStorage(layers[single]);
+    }
+    return compositor->flatten(layers);
 }
 
-GLuint Canvas::getTexture() const {
-    return layerTexture->getId();
+std::vector<LayerProperties> Canvas::getLayerProperties() const {
+    std::vector<LayerProperties> properties;
+    for (const Layer& layer : layers) {
+        properties.push_back({layer.id, layer.opacity, layer.visible, layer.blendMode});
+    }
+    return properties;
+}
+
+void Canvas::resetLayers(const std::vector<LayerProperties>& properties, int activeIndex) {
+    layers.clear();
+    nextLayerID = 0;
+    for (const LayerProperties& p : properties) {
+        Layer layer = createLayer(p.id);
+        layer.opacity = p.opacity;
+        layer.visible = p.visible;
+        layer.blendMode = p.blendMode;
+        layers.push_back(std::move(layer));
+        nextLayerID = std::max(nextLayerID, p.id + 1);
+    }
+    if (layers.empty()) {
+        layers.push_back(createLayer(nextLayerID++));
+    }
+    this->activeIndex = std::max(0, std::min(activeIndex, getLayerCount() - 1));
+
+    for (auto& tiles : unsavedTiles) {
+        tiles.clear();
+    }
+    compositor->invalidate();
+    tileSystem->markAllDisplayDirty();
+    printLayers();
+}
+
+void Canvas::uploadLayerTile(int layerID, int tileX, int tileY, const uint8_t* pixels) {
+    int index = findLayer(layerID);
+    if (index < 0) {
+        return;
+    }
+    int tileSize = tileSystem->getTileSize();
+    ensureStorage(layers[index]);
+    layers[index].texture->updateTile(tileX * tileSize, tileY * tileSize, tileSize, tileSize, pixels);
+
+    // 読み込んだファイル自体が保存先なので、自動保存にだけ知らせる
+    unsavedTiles[static_cast<int>(SaveTarget::Autosave)][layerID].insert({tileX, tileY});
+}
+
+void Canvas::takeUnsavedTiles(SaveTarget target, std::map<int, std::set<TileCoord>>& out) {
+    out.clear();
+    out.swap(unsavedTiles[static_cast<int>(target)]);
+}
+
+bool Canvas::blitLayerTile(int layerID, int tileX, int tileY, int dstX, int dstY) {
+    int index = findLayer(layerID);
+    if (index < 0) {
+        return false;
+    }
+    int tileSize = tileSystem->getTileSize();
+    int x = tileX * tileSize;
+    int y = tileY * tileSize;
+    if (!layers[index].hasPixels()) {
+        // 未確保のレイヤーは白(透明)で埋める
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(dstX, dstY, tileSize, tileSize);
+        glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDisable(GL_SCISSOR_TEST);
+        return true;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, layers[index].fbo->fboId);
+    glBlitFramebuffer(x, y, x + tileSize, y + tileSize, dstX, dstY, dstX + tileSize, dstY + tileSize,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    return true;
+}
+
+void Canvas::markUnsaved(int layerID, const std::vector<TileCoord>& tiles) {
+    for (auto& target : unsavedTiles) {
+        target[layerID].insert(tiles.begin(), tiles.end());
+    }
+}
+
+void Canvas::markActiveLayerRows(int pixelY, int height) {
+    int tileSize = tileSystem->getTileSize();
+    int tileCount = tileSystem->getTileCount();
+    int firstRow = std::max(0, pixelY / tileSize);
+    int lastRow = std::min(tileCount - 1, (pixelY + height - 1) / tileSize);
+
+    std::vector<TileCoord> tiles;
+    for (int ty = firstRow; ty <= lastRow; ++ty) {
+        for (int tx = 0; tx < tileCount; ++tx) {
+            tiles.push_back({tx, ty});
+        }
+    }
+    compositor->markTiles(activeIndex, activeIndex, tiles);
+    tileSystem->markDisplayDirty(tiles);
+    markUnsaved(getActiveLayerID(), tiles);
 }
 
 void Canvas::markDirtyTiles(float startX, float startY, float endX, float endY, float brushRadius) {
-    tileSystem->markDirtyTiles(startX, startY, endX, endY, brushRadius);
+    std::vector<TileCoord> tiles;
+    tileSystem->collectTiles(startX, startY, endX, endY, brushRadius, tiles);
+    tileSystem->markDirtyTiles(tiles);
+
+    // アクティブレイヤーを含む合成(全体合成)を使っていれば、描いたタイルを合成し直させる
+    compositor->markTiles(activeIndex, activeIndex, tiles);
+    markUnsaved(getActiveLayerID(), tiles);
 }
 
 void Canvas::clearDirtyTiles() {
@@ -41,8 +241,8 @@ bool Canvas::hasDirtyTiles() const {
     return tileSystem->hasDirtyTiles();
 }
 
-void Canvas::capturePendingTiles(int stepID) {
-    tileSystem->capturePendingTiles(stepID);
+void Canvas::capturePendingTiles(int stepID, HistoryManager& historyManager) {
+    tileSystem->capturePendingTiles(stepID, getActiveLayerID(), historyManager);
 }
 
 void Canvas::processPendingCaptures(HistoryManager& historyManager) {
@@ -51,17 +251,51 @@ void Canvas::processPendingCaptures(HistoryManager& historyManager) {
 
 void Canvas::saveAfterTiles(HistoryManager& historyManager) {
     bind();
-    tileSystem->saveAfterTiles(historyManager);
+    tileSystem->saveAfterTiles(historyManager, getActiveLayerID());
     unbind();
 }
 
 void Canvas::restoreTiles(const std::vector<TileData>& tiles) {
     int tileSize = tileSystem->getTileSize();
+    std::vector<std::vector<TileCoord>> changed(layers.size());
     for (const auto& tile : tiles) {
-        layerTexture->updateTile(tile.tileX, tile.tileY, tileSize, tileSize, tile.pixels.data());
+        int index = findLayer(tile.layerID);
+        if (index < 0) {
+            std::cerr << "History refers to unknown layer " << tile.layerID << std::endl;
+            continue;
+        }
+        ensureStorage(layers[index]);
+        layers[index].texture->updateTile(tile.tileX, tile.tileY, tileSize, tileSize, tile.pixels.data());
+        changed[index].push_back({tile.tileX / tileSize, tile.tileY / tileSize});
+    }
+
+    // アクティブ以外のレイヤーが変わったタイルだけ合成し直す
+    for (size_t i = 0; i < changed.size(); ++i) {
+        if (!changed[i].empty()) {
+            compositor->markTiles(static_cast<int>(i), activeIndex, changed[i]);
+            tileSystem->markDisplayDirty(changed[i]);
+            markUnsaved(layers[i].id, changed[i]);
+        }
     }
 }
 
-std::vector<uint8_t> Canvas::readPixels() const {
-    return layerTexture->readAllPixels();
+int Canvas::findLayer(int id) const {
+    for (size_t i = 0; i < layers.size(); ++i) {
+        if (layers[i].id == id) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+void Canvas::printLayers() const {
+    // 上から順に表示(*: アクティブ)
+    std::cout << "Layers:" << std::endl;
+    for (int i = getLayerCount() - 1; i >= 0; --i) {
+        const Layer& layer = layers[i];
+        std::cout << (i == activeIndex ? " * " : "   ") << "layer " << layer.id
+                  << " opacity=" << layer.opacity
+                  << " blend=" << blendModeName(layer.blendMode)
+                  << (layer.visible ? "" : " (hidden)") << std::endl;
+    }
 }
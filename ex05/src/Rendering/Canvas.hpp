@@ -1,48 +1,105 @@
 #pragma once
 #include <GL/glew.h>
+#include <map>
 #include <memory>
+#include <set>
 #include <vector>
-#include "Graphics/FrameBuffer.hpp"
-#include "Graphics/LayerTexture.hpp"
+#include "Layer.hpp"
+#include "Compositor.hpp"
+#include "DisplayPyramid.hpp"
 #include "TileSystem.hpp"
 #include "History/HistoryTypes.hpp"
 
 class HistoryManager;
 
-// Canvas: レイヤーテクスチャとタイルシステムを統合管理するファサード
+// 変わったタイルを記録する保存先(それぞれ独立に取り出す)
+enum class SaveTarget {
+    Project,   // Sキーでのプロジェクト保存
+    Autosave,  // 自動保存
+    Count
+};
+
+// Canvas: レイヤー・合成キャッシュ・タイルシステムを統合管理するファサード
+// 描画・読み込み・履歴の保存はアクティブレイヤーに対して行う
 class Canvas {
 public:
+    // レイヤー1枚でsize*size*4バイトのVRAMを使うため上限を設ける
+    static constexpr int MAX_LAYERS = 8;
+
     Canvas(int size, int tileSize);
     ~Canvas() = default;
 
-    // 描画先の切り替え
+    // 描画先の切り替え(アクティブレイヤー)
     void bind();
     void unbind();
 
-    // レイヤーテクスチャアクセス
-    GLuint getTexture() const;
+    // アクティブレイヤーのテクスチャ(書き込み用、未確保なら確保する)
+    GLuint getTexture();
+    int getActiveLayerID() const { return layers[activeIndex].id; }
+    int getLayerCount() const { return static_cast<int>(layers.size()); }
     int getSize() const { return size; }
     int getTileSize() const { return tileSystem->getTileSize(); }
 
+    // レイヤー操作
+    bool addLayer();                       // アクティブの上に追加してアクティブにする
+    void selectLayer(int delta);           // 上(+)・下(-)のレイヤーをアクティブにする
+    void toggleLayerVisibility();
+    void adjustLayerOpacity(float delta);
+    void cycleLayerBlendMode();
+
+    // 合成
+    // 画面描画の前に呼ぶ。画面に映る範囲(キャンバスのピクセル座標)の変わったタイルだけ合成・縮小する
+    void updateDisplay(int x, int y, int width, int height);
+    GLuint getDisplayTexture() const { return pyramid->getTexture(); }  // ミップマップ付き
+    bool isDisplayReady() const { return compositor->isReady() && pyramid->isReady(); }  // 表示用シェーダーのビルド完了
+    GLuint flatten();                      // 全レイヤーを合成したテクスチャ(保存用)
+    // アクティブレイヤーの行範囲(GL座標)がCanvasを通さず書き換えられた
+    void markActiveLayerRows(int pixelY, int height);
+
+    // プロジェクトファイル
+    std::vector<LayerProperties> getLayerProperties() const;
+    int getActiveIndex() const { return activeIndex; }
+    // 全レイヤーを作り直す(透明で初期化、タイルはuploadLayerTileで書き込む)
+    void resetLayers(const std::vector<LayerProperties>& properties, int activeIndex);
+    // タイル座標(GL座標、下が0)のタイルを書き込む
+    void uploadLayerTile(int layerID, int tileX, int tileY, const uint8_t* pixels);
+    // targetへの前回の保存以降に変わったタイル(layerID -> タイル)を取り出して消去
+    void takeUnsavedTiles(SaveTarget target, std::map<int, std::set<TileCoord>>& out);
+    // タイルをバインド中のGL_DRAW_FRAMEBUFFERの(dstX, dstY)へコピー(無いレイヤーならfalse)
+    bool blitLayerTile(int layerID, int tileX, int tileY, int dstX, int dstY);
+
     // タイルシステムへの委譲
     void markDirtyTiles(float startX, float startY, float endX, float endY, float brushRadius);
     void clearDirtyTiles();
     bool hasDirtyTiles() const;
 
     // PBO非同期転送
-    void capturePendingTiles(int stepID);
+    void capturePendingTiles(int stepID, HistoryManager& historyManager);
     void processPendingCaptures(HistoryManager& historyManager);
     void saveAfterTiles(HistoryManager& historyManager);
+    int getPendingCaptures() const { return tileSystem->getPendingCaptures(); }
+    size_t getDroppedCaptures() const { return tileSystem->getDroppedCaptures(); }
+    // 画像読み込みの描画前・描画後タイルも同じPBOの列でキャプチャする
+    TileSystem& getTileSystem() { return *tileSystem; }
 
-    // Undo/Redoタイル復元
+    // Undo/Redoタイル復元(タイルのlayerIDのレイヤーへ書き戻す)
     void restoreTiles(const std::vector<TileData>& tiles);
 
-    // 画像保存
-    std::vector<uint8_t> readPixels() const;
-
 private:
     int size;
-    std::unique_ptr<LayerTexture> layerTexture;
-    std::unique_ptr<FrameBuffer> fbo;
+    std::vector<Layer> layers;  // 下から上の順
+    int activeIndex = 0;
+    int nextLayerID = 0;
+    std::unique_ptr<Compositor> compositor;
+    std::unique_ptr<DisplayPyramid> pyramid;
     std::unique_ptr<TileSystem> tileSystem;
+    // 保存先ごとの layerID -> 前回の保存以降に変わったタイル
+    std::map<int, std::set<TileCoord>> unsavedTiles[static_cast<int>(SaveTarget::Count)];
+
+    Layer createLayer(int id);
+    // レイヤーの画素の領域とFBOを確保し、白(透明)で初期化する(確保済みなら何もしない)
+    void ensureStorage(Layer& layer);
+    void markUnsaved(int layerID, const std::vector<TileCoord>& tiles);
+    int findLayer(int id) const;
+    void printLayers() const;
 };
@@ -0,0 +1,312 @@
+#include "Compositor.hpp"
+#include <string>
+#include "Profiling/Trace.hpp"
+
+const char* const blendLayerShaderSource = R"(
+vec3 blendColor(vec3 cb, vec3 cs, int mode) {
+    if (mode == 1) {
+        return cb * cs;                       // multiply
+    } else if (mode == 2) {
+        return cb + cs - cb * cs;             // screen
+    } else if (mode == 3) {
+        return min(cb + cs, vec3(1.0));       // add
+    }
+    return cs;                                // normal
+}
+
+vec4 blendLayer(vec4 backdrop, vec4 layer, float opacity, int mode) {
+    float as = layer.a * opacity;
+    float ab = backdrop.a;
+    vec3 cb = ab > 0.0 ? backdrop.rgb / ab : vec3(0.0);
+    vec3 color = layer.rgb * as * (1.0 - ab)
+               + backdrop.rgb * (1.0 - as)
+               + as * ab * blendColor(cb, layer.rgb, mode);
+    return vec4(color, as + ab * (1.0 - as));
+}
+)";
+
+namespace {
+
+// 単位正方形をピクセル矩形uRectへ置く
+const char* compositeVertexShaderSource = R"(#version 410 core
+layout(location = 0) in vec2 aPos;
+uniform vec4 uRect;
+uniform vec2 uTargetSize;
+void main() {
+    vec2 p = uRect.xy + aPos * uRect.zw;
+    gl_Position = vec4(p / uTargetSize * 2.0 - 1.0, 0.0, 1.0);
+})";
+
+const char* compositeFragmentHeader = R"(#version 410 core
+uniform sampler2D uBackdrop;
+uniform sampler2D uLayer;
+uniform bool uHasBackdrop;
+uniform bool uUnpremultiply;
+uniform float uOpacity;
+uniform int uBlendMode;
+out vec4 FragColor;
+)";
+
+// 合成先と同じ画素を読むためtexelFetchを使う(フィルタの影響を受けない)
+const char* compositeFragmentMain = R"(
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec4 backdrop = uHasBackdrop ? texelFetch(uBackdrop, p, 0) : vec4(0.0);
+    if (uUnpremultiply) {
+        FragColor = backdrop.a > 0.0 ? vec4(backdrop.rgb / backdrop.a, backdrop.a) : vec4(0.0);
+        return;
+    }
+    FragColor = blendLayer(backdrop, texelFetch(uLayer, p, 0), uOpacity, uBlendMode);
+})";
+
+}  // namespace
+
+Compositor::Compositor(int size, int tileSize)
+    : size(size), tileSize(tileSize) {
+    std::string fragment = std::string(compositeFragmentHeader) + blendLayerShaderSource + compositeFragmentMain;
+    shader = std::make_unique<Shader>(compositeVertexShaderSource, fragment.c_str(), "compositorShader");
+
+    std::vector<float> vertices = {
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+    };
+    mesh = std::make_unique<Mesh>(vertices, MeshFormat::XY);
+
+    const uint8_t transparent[4] = {0, 0, 0, 0};
+    glGenTextures(1, &emptyTexture);
+    glBindTexture(GL_TEXTURE_2D, emptyTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, transparent);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Compositor::~Compositor() {
+    glDeleteTextures(1, &emptyTexture);
+}
+
+void Compositor::invalidate() {
+    belowValid = false;
+    aboveValid = false;
+    flatValid = false;
+    belowDirty.clear();
+    aboveDirty.clear();
+    flatDirty.clear();
+}
+
+void Compositor::invalidateActive() {
+    // below/aboveはアクティブレイヤーを含まない
+    flatValid = false;
+    flatDirty.clear();
+}
+
+void Compositor::markTiles(int layerIndex, int activeIndex, const std::vector<TileCoord>& tiles) {
+    for (const TileCoord& tile : tiles) {
+        if (layerIndex < activeIndex && belowValid) {
+            belowDirty.insert(tile);
+        } else if (layerIndex > activeIndex && aboveValid) {
+            aboveDirty.insert(tile);
+        }
+        if (flatValid) {
+            flatDirty.insert(tile);
+        }
+    }
+}
+
+void Compositor::update(const std::vector<Layer>& layers, int activeIndex) {
+    TRACE_SCOPE("Compositor::update");
+    int count = static_cast<int>(layers.size());
+    const Layer& active = layers[activeIndex];
+
+    bool aboveNormal = true;
+    for (int i = activeIndex + 1; i < count; ++i) {
+        if (layers[i].contributes() && layers[i].blendMode != BlendMode::Normal) {
+            aboveNormal = false;
+        }
+    }
+
+    if (aboveNormal) {
+        view.below = refresh(layers, 0, activeIndex, below, belowValid, belowDirty);
+        view.above = refresh(layers, activeIndex + 1, count, above, aboveValid, aboveDirty);
+        view.active = active.hasPixels() ? active.texture->getId() : emptyTexture;
+        view.activeOpacity = active.visible ? active.opacity : 0.0f;
+        view.activeBlendMode = active.blendMode;
+    } else {
+        // 全体の合成を表示し、アクティブ側は透明にする
+        view.below = refresh(layers, 0, count, flat, flatValid, flatDirty);
+        view.active = emptyTexture;
+        view.above = emptyTexture;
+        view.activeOpacity = 0.0f;
+        view.activeBlendMode = BlendMode::Normal;
+    }
+    view.blank = view.below == emptyTexture && view.active == emptyTexture && view.above == emptyTexture;
+}
+
+int Compositor::findPassthrough(const std::vector<Layer>& layers) {
+    // 不透明度1のレイヤーが1枚だけなら、合成せずそのまま使う(ストレートアルファの値を保つ)
+    int single = -1;
+    int contributing = 0;
+    for (int i = 0; i < static_cast<int>(layers.size()); ++i) {
+        if (layers[i].contributes()) {
+            single = i;
+            contributing++;
+        }
+    }
+    return contributing == 1 && layers[single].opacity >= 1.0f ? single : -1;
+}
+
+GLuint Compositor::flatten(const std::vector<Layer>& layers) {
+    TRACE_SCOPE("Compositor::flatten");
+    int single = findPassthrough(layers);
+    if (single >= 0) {
+        return layers[single].texture->getId();
+    }
+
+    GLuint composite = refresh(layers, 0, static_cast<int>(layers.size()), flat, flatValid, flatDirty);
+
+    // 乗算済みアルファからストレートアルファへ戻す
+    FrameBuffer& out = ensure(scratch);
+    glDisable(GL_BLEND);
+    out.bind();
+    shader->use();
+    glUniform2f(glGetUniformLocation(shader->ID, "uTargetSize"), static_cast<float>(size), static_cast<float>(size));
+    glUniform1i(glGetUniformLocation(shader->ID, "uBackdrop"), 0);
+    glUniform1i(glGetUniformLocation(shader->ID, "uHasBackdrop"), composite != emptyTexture);
+    glUniform1i(glGetUniformLocation(shader->ID, "uUnpremultiply"), 1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, composite);
+    drawRects({{0, 0, size, size}});
+    glBindTexture(GL_TEXTURE_2D, 0);
+    out.unbind();
+    glEnable(GL_BLEND);
+
+    return out.getTexture();
+}
+
+GLuint Compositor::refresh(const std::vector<Layer>& layers, int first, int last,
+                           std::unique_ptr<FrameBuffer>& target, bool& valid, std::set<TileCoord>& dirty) {
+    // 画素を持つレイヤーが無ければ合成結果は全面透明なので、キャッシュを確保・合成しない
+    // (画素を持つレイヤーが現れたときに全体を合成し直す)
+    if (!hasSources(layers, first, last)) {
+        valid = false;
+        dirty.clear();
+        return emptyTexture;
+    }
+    FrameBuffer& fb = ensure(target);
+    if (!valid) {
+        compositeRange(layers, first, last, fb, {{0, 0, size, size}});
+        valid = true;
+        dirty.clear();
+    } else if (!dirty.empty()) {
+        compositeRange(layers, first, last, fb, toRects(dirty));
+        dirty.clear();
+    }
+    return fb.getTexture();
+}
+
+bool Compositor::hasSources(const std::vector<Layer>& layers, int first, int last) {
+    for (int i = first; i < last; ++i) {
+        if (layers[i].contributes() && layers[i].hasPixels()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Compositor::compositeRange(const std::vector<Layer>& layers, int first, int last,
+                                FrameBuffer& target, const std::vector<Rect>& rects) {
+    TRACE_SCOPE("Compositor::compositeRange");
+    std::vector<const Layer*> sources;
+    for (int i = first; i < last; ++i) {
+        if (layers[i].contributes() && layers[i].hasPixels()) {
+            sources.push_back(&layers[i]);
+        }
+    }
+
+    glDisable(GL_BLEND);
+    if (sources.empty()) {
+        target.bind();
+        glEnable(GL_SCISSOR_TEST);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        for (const Rect& rect : rects) {
+            glScissor(rect.x, rect.y, rect.width, rect.height);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+        glDisable(GL_SCISSOR_TEST);
+        target.unbind();
+        glEnable(GL_BLEND);
+        return;
+    }
+
+    shader->use();
+    glUniform2f(glGetUniformLocation(shader->ID, "uTargetSize"), static_cast<float>(size), static_cast<float>(size));
+    glUniform1i(glGetUniformLocation(shader->ID, "uBackdrop"), 0);
+    glUniform1i(glGetUniformLocation(shader->ID, "uLayer"), 1);
+    glUniform1i(glGetUniformLocation(shader->ID, "uUnpremultiply"), 0);
+
+    // 下から1枚ずつ重ねる。読み書きを交互に入れ替え、最後の1枚がtargetに書かれるよう始める
+    FrameBuffer& pong = ensure(scratch);
+    int count = static_cast<int>(sources.size());
+    GLuint backdrop = 0;
+    for (int k = 0; k < count; ++k) {
+        FrameBuffer& dst = ((count - 1 - k) % 2 == 0) ? target : pong;
+        dst.bind();
+
+        glUniform1i(glGetUniformLocation(shader->ID, "uHasBackdrop"), backdrop != 0);
+        glUniform1f(glGetUniformLocation(shader->ID, "uOpacity"), sources[k]->opacity);
+        glUniform1i(glGetUniformLocation(shader->ID, "uBlendMode"), static_cast<int>(sources[k]->blendMode));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, backdrop != 0 ? backdrop : emptyTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, sources[k]->texture->getId());
+
+        drawRects(rects);
+        backdrop = dst.getTexture();
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    target.unbind();
+    glEnable(GL_BLEND);
+}
+
+void Compositor::drawRects(const std::vector<Rect>& rects) {
+    GLint rectLocation = glGetUniformLocation(shader->ID, "uRect");
+    for (const Rect& rect : rects) {
+        glUniform4f(rectLocation, static_cast<float>(rect.x), static_cast<float>(rect.y),
+                    static_cast<float>(rect.width), static_cast<float>(rect.height));
+        mesh->draw(GL_TRIANGLE_STRIP);
+    }
+}
+
+FrameBuffer& Compositor::ensure(std::unique_ptr<FrameBuffer>& target) {
+    if (!target) {
+        target = std::make_unique<FrameBuffer>(size, size);
+
+        // 画面表示で端の画素が反対側と混ざらないようにする
+        glBindTexture(GL_TEXTURE_2D, target->getTexture());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    return *target;
+}
+
+std::vector<Compositor::Rect> Compositor::toRects(const std::set<TileCoord>& tiles) const {
+    // TileCoordはx、yの順に並ぶため、縦に連続するタイルを1つの矩形にまとめる
+    std::vector<Rect> rects;
+    for (const TileCoord& tile : tiles) {
+        if (!rects.empty()) {
+            Rect& last = rects.back();
+            if (last.x == tile.x * tileSize && last.y + last.height == tile.y * tileSize) {
+                last.height += tileSize;
+                continue;
+            }
+        }
+        rects.push_back({tile.x * tileSize, tile.y * tileSize, tileSize, tileSize});
+    }
+    return rects;
+}
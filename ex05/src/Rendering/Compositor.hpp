@@ -0,0 +1,108 @@
+#pragma once
+#include <GL/glew.h>
+#include <memory>
+#include <set>
+#include <vector>
+#include "Graphics/FrameBuffer.hpp"
+#include "Graphics/Mesh.hpp"
+#include "Graphics/Shader.hpp"
+#include "Layer.hpp"
+#include "TileSystem.hpp"
+
+// 1レイヤーを背景へ合成するGLSL関数(Compositor・Rendererで共有)
+//   vec4 blendLayer(vec4 backdrop, vec4 layer, float opacity, int mode)
+//   backdropは乗算済みアルファ、layerはストレートアルファ、戻り値は乗算済みアルファ
+extern const char* const blendLayerShaderSource;
+
+// 画面描画に使う3枚のテクスチャ
+struct CompositeView {
+    GLuint below = 0;   // アクティブより下のレイヤーの合成(乗算済みアルファ)
+    GLuint active = 0;  // アクティブレイヤー(ストレートアルファ)
+    GLuint above = 0;   // アクティブより上のレイヤーの合成(乗算済みアルファ)
+    float activeOpacity = 1.0f;  // 非表示なら0
+    BlendMode activeBlendMode = BlendMode::Normal;
+    bool blank = true;  // 3枚とも全面透明(画素を持つレイヤーが無い)
+};
+
+// レイヤー合成のキャッシュ
+//
+// アクティブレイヤーの下(below)と上(above)をそれぞれ1枚に合成して保持し、
+// 描画中は毎フレーム below・アクティブ・above の3枚だけを画面で合成する。
+// アクティブ以外のレイヤーが変わったとき(Undo/Redo)は、変わったタイルだけを合成し直す。
+//
+// 上側にNormal以外のレイヤーがあると、above単体ではアクティブへの効果を表せないため、
+// 全レイヤーの合成(flat)をキャッシュし、アクティブレイヤーの変わったタイルを毎フレーム合成し直す。
+class Compositor {
+public:
+    Compositor(int size, int tileSize);
+    ~Compositor();
+
+    // コピー禁止
+    Compositor(const Compositor&) = delete;
+    Compositor& operator=(const Compositor&) = delete;
+
+    // レイヤーの構成・属性・アクティブレイヤーが変わった(全キャッシュを作り直す)
+    void invalidate();
+
+    // アクティブレイヤーの属性が変わった(アクティブを含むキャッシュのみ作り直す)
+    void invalidateActive();
+
+    // レイヤー(並び順のindex)の内容がタイル単位で変わった
+    void markTiles(int layerIndex, int activeIndex, const std::vector<TileCoord>& tiles);
+
+    // 無効になったキャッシュを更新(画面描画の前に呼ぶ)
+    void update(const std::vector<Layer>& layers, int activeIndex);
+    const CompositeView& getView() const { return view; }
+
+    // 全レイヤーを合成したテクスチャ(保存用、ストレートアルファ)
+    // 次にCompositorを使うまで有効。画素を確保していないレイヤーは透明として扱う
+    GLuint flatten(const std::vector<Layer>& layers);
+    // flattenが合成せずそのまま返すレイヤーのindex(無ければ-1)
+    // そのレイヤーのテクスチャが返るため、呼び出し側で画素を確保しておく
+    static int findPassthrough(const std::vector<Layer>& layers);
+
+    // シェーダーのビルドが完了したか(待たない)
+    bool isReady() const { return shader->isReady(); }
+
+private:
+    int size;
+    int tileSize;
+
+    std::unique_ptr<Shader> shader;
+    std::unique_ptr<Mesh> mesh;
+    GLuint emptyTexture = 0;  // 1x1の透明(合成するレイヤーが無い側に使う)
+
+    // 合成先(必要になるまで確保しない)
+    std::unique_ptr<FrameBuffer> below;
+    std::unique_ptr<FrameBuffer> above;
+    std::unique_ptr<FrameBuffer> flat;
+    std::unique_ptr<FrameBuffer> scratch;  // ピンポン用
+
+    // valid: キャッシュが有効(dirtyのタイルを除く)
+    bool belowValid = false;
+    bool aboveValid = false;
+    bool flatValid = false;
+    std::set<TileCoord> belowDirty;
+    std::set<TileCoord> aboveDirty;
+    std::set<TileCoord> flatDirty;
+
+    CompositeView view;
+
+    struct Rect {
+        int x, y, width, height;
+    };
+
+    // layers[first, last)をtargetのrectsへ合成する(乗算済みアルファ)
+    void compositeRange(const std::vector<Layer>& layers, int first, int last,
+                        FrameBuffer& target, const std::vector<Rect>& rects);
+
+    // キャッシュを全体またはdirtyのタイルだけ更新し、合成結果のテクスチャを返す
+    // 画素を持つレイヤーが無ければキャッシュを使わずemptyTextureを返す
+    GLuint refresh(const std::vector<Layer>& layers, int first, int last,
+                   std::unique_ptr<FrameBuffer>& target, bool& valid, std::set<TileCoord>& dirty);
+    static bool hasSources(const std::vector<Layer>& layers, int first, int last);
+
+    void drawRects(const std::vector<Rect>& rects);
+    FrameBuffer& ensure(std::unique_ptr<FrameBuffer>& target);
+    std::vector<Rect> toRects(const std::set<TileCoord>& tiles) const;
+};
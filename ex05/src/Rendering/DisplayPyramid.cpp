@@ -0,0 +1,210 @@
+#include "DisplayPyramid.hpp"
+#include <string>
+#include "Profiling/Trace.hpp"
+
+namespace {
+
+// 単位正方形をレベルのピクセル矩形uRectへ置く
+const char* pyramidVertexShaderSource = R"(#version 410 core
+layout(location = 0) in vec2 aPos;
+uniform vec4 uRect;
+uniform vec2 uTargetSize;
+void main() {
+    vec2 p = uRect.xy + aPos * uRect.zw;
+    gl_Position = vec4(p / uTargetSize * 2.0 - 1.0, 0.0, 1.0);
+})";
+
+const char* composeFragmentHeader = R"(#version 410 core
+uniform sampler2D uBelow;
+uniform sampler2D uActive;
+uniform sampler2D uAbove;
+uniform float uActiveOpacity;
+uniform int uActiveBlendMode;
+out vec4 FragColor;
+)";
+
+const char* composeFragmentMain = R"(
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    vec4 color = blendLayer(texelFetch(uBelow, p, 0), texelFetch(uActive, p, 0),
+                            uActiveOpacity, uActiveBlendMode);
+    vec4 above = texelFetch(uAbove, p, 0);
+    color = above + color * (1.0 - above.a);
+
+    vec3 bgColor = vec3(1.0, 1.0, 1.0); // 白背景
+    FragColor = vec4(color.rgb + bgColor * (1.0 - color.a), 1.0);
+})";
+
+// 1つ下のレベル(BASE_LEVELに設定)の2x2を平均する。奇数サイズの端は最後の画素を繰り返す
+const char* downsampleFragmentShaderSource = R"(#version 410 core
+uniform sampler2D uSource;
+out vec4 FragColor;
+void main() {
+    ivec2 p = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = textureSize(uSource, 0) - 1;
+    vec4 sum = texelFetch(uSource, min(p, last), 0)
+             + texelFetch(uSource, min(p + ivec2(1, 0), last), 0)
+             + texelFetch(uSource, min(p + ivec2(0, 1), last), 0)
+             + texelFetch(uSource, min(p + ivec2(1, 1), last), 0);
+    FragColor = sum * 0.25;
+})";
+
+}  // namespace
+
+DisplayPyramid::DisplayPyramid(int size, int tileSize)
+    : size(size), tileSize(tileSize) {
+    levelCount = 1;
+    while ((size >> levelCount) > 0) {
+        levelCount++;
+    }
+
+    std::string composeFragment = std::string(composeFragmentHeader) + blendLayerShaderSource + composeFragmentMain;
+    composeShader = std::make_unique<Shader>(pyramidVertexShaderSource, composeFragment.c_str(), "pyramidComposeShader");
+    downsampleShader = std::make_unique<Shader>(pyramidVertexShaderSource, downsampleFragmentShaderSource, "pyramidDownsampleShader");
+
+    std::vector<float> vertices = {
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
+    };
+    mesh = std::make_unique<Mesh>(vertices, MeshFormat::XY);
+
+    const uint8_t white[4] = {255, 255, 255, 255};
+    glGenTextures(1, &blankTexture);
+    glBindTexture(GL_TEXTURE_2D, blankTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenTextures(1, &texture);
+    glGenFramebuffers(1, &fbo);
+}
+
+DisplayPyramid::~DisplayPyramid() {
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &texture);
+    glDeleteTextures(1, &blankTexture);
+}
+
+void DisplayPyramid::allocate() {
+    TRACE_SCOPE("DisplayPyramid::allocate");
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (int level = 0; level < levelCount; ++level) {
+        int s = levelSize(level);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, s, s, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // 合成していないタイルは白紙のまま(白背景)
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    for (int level = 0; level < levelCount; ++level) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    allocated = true;
+}
+
+void DisplayPyramid::update(const CompositeView& view, const std::set<TileCoord>& tiles) {
+    if (tiles.empty()) {
+        return;
+    }
+    if (!allocated) {
+        // 白紙なら白いテクスチャのままでよい
+        if (view.blank) {
+            return;
+        }
+        allocate();
+    }
+    TRACE_SCOPE("DisplayPyramid::update");
+
+    glDisable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    // レベル0: 3枚を合成
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    composeShader->use();
+    glUniform1f(glGetUniformLocation(composeShader->ID, "uActiveOpacity"), view.activeOpacity);
+    glUniform1i(glGetUniformLocation(composeShader->ID, "uActiveBlendMode"), static_cast<int>(view.activeBlendMode));
+    const GLuint sources[3] = {view.below, view.active, view.above};
+    const char* samplers[3] = {"uBelow", "uActive", "uAbove"};
+    for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, sources[i]);
+        glUniform1i(glGetUniformLocation(composeShader->ID, samplers[i]), i);
+    }
+    drawRects(*composeShader, toRects(tiles, 0), 0);
+    for (int i = 2; i >= 0; --i) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // レベル1以降: 変わった範囲だけ縮小。読むレベルだけをBASE/MAXにして書き込み先と分ける
+    downsampleShader->use();
+    glUniform1i(glGetUniformLocation(downsampleShader->ID, "uSource"), 0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    for (int level = 1; level < levelCount; ++level) {
+        std::set<TileCoord> levelTiles;
+        for (const TileCoord& tile : tiles) {
+            levelTiles.insert({tile.x >> level, tile.y >> level});
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+        drawRects(*downsampleShader, toRects(levelTiles, level), level);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_BLEND);
+}
+
+void DisplayPyramid::drawRects(const Shader& shader, const std::vector<Rect>& rects, int level) {
+    int s = levelSize(level);
+    glViewport(0, 0, s, s);
+    glUniform2f(glGetUniformLocation(shader.ID, "uTargetSize"), static_cast<float>(s), static_cast<float>(s));
+
+    GLint rectLocation = glGetUniformLocation(shader.ID, "uRect");
+    for (const Rect& rect : rects) {
+        glUniform4f(rectLocation, static_cast<float>(rect.x), static_cast<float>(rect.y),
+                    static_cast<float>(rect.width), static_cast<float>(rect.height));
+        mesh->draw(GL_TRIANGLE_STRIP);
+    }
+}
+
+std::vector<DisplayPyramid::Rect> DisplayPyramid::toRects(const std::set<TileCoord>& tiles, int level) const {
+    // 縦に連続するタイルは1つの矩形にまとめる(TileCoordはx、yの順に並ぶ)
+    int s = levelSize(level);
+    std::vector<Rect> rects;
+    for (const TileCoord& tile : tiles) {
+        int x = tile.x * tileSize;
+        int y = tile.y * tileSize;
+        if (x >= s || y >= s) {
+            continue;
+        }
+        int width = std::min(tileSize, s - x);
+        int height = std::min(tileSize, s - y);
+        if (!rects.empty()) {
+            Rect& last = rects.back();
+            if (last.x == x && last.y + last.height == y) {
+                last.height += height;
+                continue;
+            }
+        }
+        rects.push_back({x, y, width, height});
+    }
+    return rects;
+}
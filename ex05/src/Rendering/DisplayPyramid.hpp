@@ -0,0 +1,61 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <memory>
+#include <set>
+#include <vector>
+#include "Graphics/Mesh.hpp"
+#include "Graphics/Shader.hpp"
+#include "Compositor.hpp"
+#include "TileSystem.hpp"
+
+// 画面表示用のミップマップ付きテクスチャ
+//
+// レベル0: below・アクティブ・aboveを白背景に合成した不透明な画像
+// レベル1以降: 1つ下のレベルを2x2の平均で縮小
+// 変わったタイルだけを合成し直し、その範囲の上位レベルだけを縮小し直す。
+// 画面描画はトライリニアフィルタで縮小率に合ったレベルを読むため、
+// 表示のコストはキャンバスではなく画面のピクセル数に比例し、縮小表示のエイリアスも減る。
+// 白紙のキャンバスは白一色なので、描かれるまでは1x1の白いテクスチャを返し、ミップマップを確保・合成しない。
+class DisplayPyramid {
+public:
+    DisplayPyramid(int size, int tileSize);
+    ~DisplayPyramid();
+
+    // コピー禁止
+    DisplayPyramid(const DisplayPyramid&) = delete;
+    DisplayPyramid& operator=(const DisplayPyramid&) = delete;
+
+    // tilesのタイル(レベル0のタイル座標)とその上位レベルを更新
+    void update(const CompositeView& view, const std::set<TileCoord>& tiles);
+
+    GLuint getTexture() const { return allocated ? texture : blankTexture; }
+    int getLevelCount() const { return levelCount; }
+
+    // シェーダーのビルドが完了したか(待たない)
+    bool isReady() const { return composeShader->isReady() && downsampleShader->isReady(); }
+
+private:
+    int size;
+    int tileSize;
+    int levelCount;
+    GLuint texture = 0;
+    GLuint blankTexture = 0;  // 白紙のキャンバスの表示(1x1の白)
+    bool allocated = false;
+    GLuint fbo = 0;
+
+    std::unique_ptr<Shader> composeShader;
+    std::unique_ptr<Shader> downsampleShader;
+    std::unique_ptr<Mesh> mesh;
+
+    struct Rect {
+        int x, y, width, height;
+    };
+
+    // レベルlevelでのタイル(タイルサイズはどのレベルでも同じピクセル数)の矩形
+    // 全レベルを確保して白で初期化
+    void allocate();
+    std::vector<Rect> toRects(const std::set<TileCoord>& tiles, int level) const;
+    void drawRects(const Shader& shader, const std::vector<Rect>& rects, int level);
+    int levelSize(int level) const { return std::max(1, size >> level); }
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include "Graphics/FrameBuffer.hpp"
+#include "Graphics/LayerTexture.hpp"
+
+// レイヤーの合成方法(W3C Compositingの分離可能なブレンドモード)
+enum class BlendMode : uint8_t {
+    Normal,
+    Multiply,
+    Screen,
+    Add,
+    Count
+};
+
+inline const char* blendModeName(BlendMode mode) {
+    switch (mode) {
+        case BlendMode::Normal: return "normal";
+        case BlendMode::Multiply: return "multiply";
+        case BlendMode::Screen: return "screen";
+        case BlendMode::Add: return "add";
+        default: return "unknown";
+    }
+}
+
+// レイヤーの属性(プロジェクトファイルへの保存・読み込み用)
+struct LayerProperties {
+    int id = 0;
+    float opacity = 1.0f;
+    bool visible = true;
+    BlendMode blendMode = BlendMode::Normal;
+};
+
+// 1枚のレイヤー(テクスチャはストレートアルファ)
+// 画素の領域とFBOは最初に書き込むときに確保する(Canvas)。未確保のレイヤーは全面透明として扱う
+struct Layer {
+    int id = 0;  // 履歴が参照する識別子(並び順が変わっても変わらない)
+    std::unique_ptr<LayerTexture> texture;
+    std::unique_ptr<FrameBuffer> fbo;  // 確保するまでnullptr
+    float opacity = 1.0f;
+    bool visible = true;
+    BlendMode blendMode = BlendMode::Normal;
+
+    // 合成結果に影響するか
+    bool contributes() const { return visible && opacity > 0.0f; }
+    // 描いた画素を持ちうるか(画素の領域を確保済みか)
+    bool hasPixels() const { return texture->isAllocated(); }
+};
@@ -1,42 +1,43 @@
 #include "Renderer.hpp"
 #include <vector>
 
+// 単位正方形をキャンバスの矩形uRect(NDC)へ置き、表示の変換を掛ける
 const char* vertexShaderSource = R"(#version 410 core
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec2 aTexCoord;
+layout(location = 0) in vec2 aPos;
 out vec2 TexCoord;
-uniform vec2 uScale;
+uniform vec4 uRect;
+uniform mat2 uView;
+uniform vec2 uCenter;
 void main() {
-    gl_Position = vec4(aPos.x * uScale.x, aPos.y * uScale.y, aPos.z, 1.0);
-    TexCoord = aTexCoord;
+    vec2 canvasPos = uRect.xy + aPos * uRect.zw;
+    gl_Position = vec4(uView * (canvasPos - uCenter), 0.0, 1.0);
+    TexCoord = canvasPos * 0.5 + 0.5;
 })";
 
+// 表示用テクスチャ(白背景と合成済み)をミップマップから読む
+// 縮小率に合ったレベルはトライリニアフィルタが画面上の微分から選ぶ
 const char* fragmentShaderSource = R"(#version 410 core
 in vec2 TexCoord;
 uniform sampler2D uTexture;
 out vec4 FragColor;
 void main() {
-    vec4 texColor = texture(uTexture, TexCoord);
-
-    vec3 bgColor = vec3(1.0, 1.0, 1.0); // 白背景
-    vec3 blendedColor = mix(bgColor, texColor.rgb, texColor.a);
-
-    FragColor = vec4(blendedColor, 1.0);
+    FragColor = vec4(texture(uTexture, TexCoord).rgb, 1.0);
 })";
 
 Renderer::Renderer() {
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    shader = std::make_unique<Shader>(vertexShaderSource, fragmentShaderSource, "rendererShader.bin");
+    // 表示の変換を加えたため、旧シェーダーのキャッシュとは別名にする
+    shader = std::make_unique<Shader>(vertexShaderSource, fragmentShaderSource, "viewShader");
 
     std::vector<float> vertices = {
-        -1.0f, 1.0f, 0.0f, 0.0f, 1.0f,  // 左上
-        -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, // 左下
-        1.0f, 1.0f, 0.0f, 1.0f, 1.0f,   // 右上
-        1.0f, -1.0f, 0.0f, 1.0f, 0.0f,  // 右下
+        0.0f, 0.0f,
+        1.0f, 0.0f,
+        0.0f, 1.0f,
+        1.0f, 1.0f,
     };
-    mesh = std::make_unique<Mesh>(vertices, MeshFormat::XYZ_UV);
+    mesh = std::make_unique<Mesh>(vertices, MeshFormat::XY);
 }
 
 void Renderer::clear(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
@@ -48,13 +49,23 @@ void Renderer::setViewport(int width, int height) {
     glViewport(0, 0, width, height);
 }
 
-void Renderer::renderCanvas(GLuint texture, float scaleX, float scaleY) {
+void Renderer::renderCanvas(GLuint texture, const ViewTransform& view, float scaleX, float scaleY) {
+    // 画面に映る範囲だけを描く(ズームしてもフラグメント数は画面のピクセル数で頭打ち)
+    float minX, minY, maxX, maxY;
+    if (!view.getVisibleBounds(scaleX, scaleY, minX, minY, maxX, maxY)) {
+        return;
+    }
+    float matrix[4];
+    view.getMatrix(scaleX, scaleY, matrix);
+
     shader->use();
-    glUniform2f(glGetUniformLocation(shader->ID, "uScale"), scaleX, scaleY);
+    glUniform4f(glGetUniformLocation(shader->ID, "uRect"), minX, minY, maxX - minX, maxY - minY);
+    glUniformMatrix2fv(glGetUniformLocation(shader->ID, "uView"), 1, GL_FALSE, matrix);
+    glUniform2f(glGetUniformLocation(shader->ID, "uCenter"), view.centerX, view.centerY);
+    glUniform1i(glGetUniformLocation(shader->ID, "uTexture"), 0);
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture);
-    glUniform1i(glGetUniformLocation(shader->ID, "uTexture"), 0);
-
     mesh->draw(GL_TRIANGLE_STRIP);
+    glBindTexture(GL_TEXTURE_2D, 0);
 }
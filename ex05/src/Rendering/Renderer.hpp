@@ -3,6 +3,7 @@
 #include <memory>
 #include "Graphics/Shader.hpp"
 #include "Graphics/Mesh.hpp"
+#include "ViewTransform.hpp"
 
 class Renderer {
 public:
@@ -10,10 +11,15 @@ public:
     ~Renderer() = default;
 
     void clear(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
-    void renderCanvas(GLuint texture, float scaleX, float scaleY);
+    // 表示用テクスチャ(Canvas::getDisplayTexture)を表示の変換を掛けて描画
+    // scaleX, scaleYはキャンバスを画面に収める係数。縮小表示ではミップマップが使われる
+    void renderCanvas(GLuint texture, const ViewTransform& view, float scaleX, float scaleY);
 
     void setViewport(int width, int height);
 
+    // シェーダーのビルドが完了したか(待たない)
+    bool isReady() const { return shader->isReady(); }
+
 private:
     std::unique_ptr<Shader> shader;
     std::unique_ptr<Mesh> mesh;
@@ -2,17 +2,26 @@
 #include "History/HistoryManager.hpp"
 #include <algorithm>
 #include <iostream>
+#include "Profiling/Trace.hpp"
 
 TileSystem::TileSystem(int canvasSize, int tileSize)
-    : canvasSize(canvasSize), tileSize(tileSize) {
-    initPBOs();
+    : canvasSize(canvasSize), tileSize(tileSize),
+      displayDirty(static_cast<size_t>(getTileCount()) * getTileCount(), 1) {
+    // PBOは最初のキャプチャで作る(起動時に描かないうちから確保しない)
 }
 
 TileSystem::~TileSystem() {
-    glDeleteBuffers(PBO_COUNT, pboIds);
+    if (pbosCreated) {
+        glDeleteBuffers(PBO_COUNT, pboIds);
+    }
+    if (rowPbosCreated) {
+        glDeleteBuffers(ROW_PBO_COUNT, rowPboIds);
+    }
 }
 
 void TileSystem::initPBOs() {
+    TRACE_SCOPE("TileSystem::initPBOs");
+    pbosCreated = true;
     glGenBuffers(PBO_COUNT, pboIds);
     for (int i = 0; i < PBO_COUNT; i++) {
         glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[i]);
@@ -21,7 +30,63 @@ void TileSystem::initPBOs() {
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
-void TileSystem::markDirtyTiles(float startX, float startY, float endX, float endY, float brushRadius) {
+void TileSystem::initRowPBOs() {
+    TRACE_SCOPE("TileSystem::initRowPBOs");
+    rowPbosCreated = true;
+    glGenBuffers(ROW_PBO_COUNT, rowPboIds);
+    for (int i = 0; i < ROW_PBO_COUNT; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, rowPboIds[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(canvasSize) * tileSize * channels, nullptr,
+                     GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    tileScratch.resize(static_cast<size_t>(tileSize) * tileSize * channels);
+}
+
+void TileSystem::markDirtyTiles(const std::vector<TileCoord>& tiles) {
+    for (const TileCoord& coord : tiles) {
+        if (dirtyTiles.find(coord) == dirtyTiles.end()) {
+            dirtyTiles.insert(coord);
+            pendingNewTiles.push_back(coord);
+        }
+    }
+    markDisplayDirty(tiles);
+}
+
+void TileSystem::markDisplayDirty(const std::vector<TileCoord>& tiles) {
+    int count = getTileCount();
+    for (const TileCoord& coord : tiles) {
+        if (coord.x >= 0 && coord.x < count && coord.y >= 0 && coord.y < count) {
+            displayDirty[static_cast<size_t>(coord.y) * count + coord.x] = 1;
+        }
+    }
+}
+
+void TileSystem::markAllDisplayDirty() {
+    std::fill(displayDirty.begin(), displayDirty.end(), 1);
+}
+
+void TileSystem::takeDisplayDirtyTiles(int firstX, int firstY, int lastX, int lastY, std::set<TileCoord>& out) {
+    int count = getTileCount();
+    firstX = std::max(firstX, 0);
+    firstY = std::max(firstY, 0);
+    lastX = std::min(lastX, count - 1);
+    lastY = std::min(lastY, count - 1);
+
+    out.clear();
+    for (int tx = firstX; tx <= lastX; ++tx) {
+        for (int ty = firstY; ty <= lastY; ++ty) {
+            uint8_t& dirty = displayDirty[static_cast<size_t>(ty) * count + tx];
+            if (dirty) {
+                out.insert({tx, ty});
+                dirty = 0;
+            }
+        }
+    }
+}
+
+void TileSystem::collectTiles(float startX, float startY, float endX, float endY, float brushRadius,
+                              std::vector<TileCoord>& out) const {
     float radius = brushRadius / 2.0f + 2.0f;
 
     float minX = std::min(startX, endX) - radius;
@@ -42,11 +107,7 @@ void TileSystem::markDirtyTiles(float startX, float startY, float endX, float en
 
     for (int ty = tileStartY; ty <= tileEndY; ++ty) {
         for (int tx = tileStartX; tx <= tileEndX; ++tx) {
-            TileCoord coord = {tx, ty};
-            if (dirtyTiles.find(coord) == dirtyTiles.end()) {
-                dirtyTiles.insert(coord);
-                pendingNewTiles.push_back(coord);
-            }
+            out.push_back({tx, ty});
         }
     }
 }
@@ -56,21 +117,33 @@ void TileSystem::clearDirtyTiles() {
     pendingNewTiles.clear();
 }
 
-void TileSystem::capturePendingTiles(int stepID) {
+void TileSystem::capturePendingTiles(int stepID, int layerID, HistoryManager& historyManager) {
+    TRACE_SCOPE("TileSystem::capturePendingTiles");
     for (const auto& coord : pendingNewTiles) {
-        beginTileCapture(coord.x * tileSize, coord.y * tileSize, stepID);
+        if (pendingPBOs >= PBO_COUNT) {
+            processPendingCaptures(historyManager);
+        }
+        beginTileCapture(coord.x * tileSize, coord.y * tileSize, stepID, layerID);
     }
     pendingNewTiles.clear();
 }
 
-void TileSystem::beginTileCapture(int pixelX, int pixelY, int stepID) {
+void TileSystem::beginTileCapture(int pixelX, int pixelY, int stepID, int layerID) {
+    if (!pbosCreated) {
+        initPBOs();
+    }
     if (pendingPBOs >= PBO_COUNT) {
+        droppedCaptures++;
         return;
     }
 
     pboRequests[pboHead].tileX = pixelX;
     pboRequests[pboHead].tileY = pixelY;
     pboRequests[pboHead].stepID = stepID;
+    pboRequests[pboHead].layerID = layerID;
+    pboRequests[pboHead].tileCount = 1;
+    pboRequests[pboHead].rowPbo = -1;
+    pboRequests[pboHead].after = false;
 
     glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[pboHead]);
     glReadPixels(pixelX, pixelY, tileSize, tileSize, GL_RGBA, GL_UNSIGNED_BYTE, 0);
@@ -80,14 +153,71 @@ void TileSystem::beginTileCapture(int pixelX, int pixelY, int stepID) {
     pendingPBOs++;
 }
 
+void TileSystem::captureTileRow(int pixelX, int pixelY, int count, int stepID, int layerID, bool after,
+                                HistoryManager& historyManager) {
+    TRACE_SCOPE("TileSystem::captureTileRow");
+    if (!pbosCreated) {
+        initPBOs();
+    }
+    if (!rowPbosCreated) {
+        initRowPBOs();
+    }
+    if (pendingPBOs >= PBO_COUNT || pendingRowPBOs >= ROW_PBO_COUNT) {
+        processPendingCaptures(historyManager);
+    }
+
+    // ストロークのキャプチャと同じ列に並べ、届いた順に履歴へ渡す
+    PboRequest& req = pboRequests[pboHead];
+    req.tileX = pixelX;
+    req.tileY = pixelY;
+    req.stepID = stepID;
+    req.layerID = layerID;
+    req.tileCount = count;
+    req.rowPbo = rowPboHead;
+    req.after = after;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, rowPboIds[rowPboHead]);
+    glReadPixels(pixelX, pixelY, count * tileSize, tileSize, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    rowPboHead = (rowPboHead + 1) % ROW_PBO_COUNT;
+    pendingRowPBOs++;
+    pboHead = (pboHead + 1) % PBO_COUNT;
+    pendingPBOs++;
+}
+
 void TileSystem::processPendingCaptures(HistoryManager& historyManager) {
+    TRACE_SCOPE("TileSystem::processPendingCaptures");
+    TRACE_COUNTER("pendingPBOs", pendingPBOs);
+    size_t tileBytes = static_cast<size_t>(tileSize) * tileSize * channels;
     while (pendingPBOs > 0) {
-        glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[pboTail]);
+        PboRequest& req = pboRequests[pboTail];
+        GLuint pbo = req.rowPbo >= 0 ? rowPboIds[req.rowPbo] : pboIds[pboTail];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
 
-        GLubyte* ptr = static_cast<GLubyte*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, tileSize * tileSize * channels, GL_MAP_READ_BIT));
+        GLubyte* ptr = static_cast<GLubyte*>(glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(tileBytes * req.tileCount), GL_MAP_READ_BIT));
         if (ptr) {
-            PboRequest& req = pboRequests[pboTail];
-            historyManager.pushBeforeTile(req.tileX, req.tileY, req.stepID, ptr);
+            if (req.rowPbo < 0) {
+                historyManager.pushBeforeTile(req.layerID, req.tileX, req.tileY, req.stepID, ptr);
+            } else {
+                // タイル1行分から1枚ずつ切り出す(行の長さはタイル数分)
+                size_t rowStride = static_cast<size_t>(req.tileCount) * tileSize * channels;
+                size_t tileRowBytes = static_cast<size_t>(tileSize) * channels;
+                for (int i = 0; i < req.tileCount; ++i) {
+                    for (int row = 0; row < tileSize; ++row) {
+                        std::copy_n(ptr + row * rowStride + i * tileRowBytes, tileRowBytes,
+                                    tileScratch.data() + row * tileRowBytes);
+                    }
+                    int tileX = req.tileX + i * tileSize;
+                    if (req.after) {
+                        historyManager.pushAfterTile(req.layerID, tileX, req.tileY, req.stepID, tileScratch.data());
+                    } else {
+                        historyManager.pushBeforeTile(req.layerID, tileX, req.tileY, req.stepID, tileScratch.data());
+                    }
+                }
+                pendingRowPBOs--;
+            }
 
             glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
             pboTail = (pboTail + 1) % PBO_COUNT;
@@ -100,7 +230,8 @@ void TileSystem::processPendingCaptures(HistoryManager& historyManager) {
     glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 }
 
-void TileSystem::saveAfterTiles(HistoryManager& historyManager) {
+void TileSystem::saveAfterTiles(HistoryManager& historyManager, int layerID) {
+    TRACE_SCOPE("TileSystem::saveAfterTiles");
     std::vector<uint8_t> tilePixels(tileSize * tileSize * 4);
     int currentStepID = historyManager.getCurrentStepID();
 
@@ -109,6 +240,6 @@ void TileSystem::saveAfterTiles(HistoryManager& historyManager) {
         int pixelY = coord.y * tileSize;
 
         glReadPixels(pixelX, pixelY, tileSize, tileSize, GL_RGBA, GL_UNSIGNED_BYTE, tilePixels.data());
-        historyManager.pushAfterTile(pixelX, pixelY, currentStepID, tilePixels.data());
+        historyManager.pushAfterTile(layerID, pixelX, pixelY, currentStepID, tilePixels.data());
     }
 }
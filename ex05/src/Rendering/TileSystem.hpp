@@ -31,41 +31,77 @@ public:
     int getTileSize() const { return tileSize; }
     int getTileCount() const { return canvasSize / tileSize; }
 
-    // ダーティタイル管理
-    void markDirtyTiles(float startX, float startY, float endX, float endY, float brushRadius);
+    // ダーティタイル管理(ストローク単位、履歴用)
+    void markDirtyTiles(const std::vector<TileCoord>& tiles);
+    // 区間の描画で変わるタイルを列挙(ダーティとしては記録しない)
+    void collectTiles(float startX, float startY, float endX, float endY, float brushRadius,
+                      std::vector<TileCoord>& out) const;
     void clearDirtyTiles();
     bool hasDirtyTiles() const { return !dirtyTiles.empty(); }
     const std::set<TileCoord>& getDirtyTiles() const { return dirtyTiles; }
 
+    // 表示が変わったタイル(フレーム単位、表示用ミップマップの更新用)
+    // markDirtyTilesで記録したタイルも含む
+    void markDisplayDirty(const std::vector<TileCoord>& tiles);
+    void markAllDisplayDirty();
+    // 範囲内(タイル座標、両端を含む)で記録したタイルを取り出して消去
+    // 範囲外のタイルは画面に映るまで記録したまま残す
+    void takeDisplayDirtyTiles(int firstX, int firstY, int lastX, int lastY, std::set<TileCoord>& out);
+
     // PBO非同期転送(描画前タイルキャプチャ)
-    void capturePendingTiles(int stepID);
+    static constexpr int PBO_COUNT = 128;
+    // PBOが全て処理待ちなら先に読み出して履歴へ渡す(1フレームに多数のストロークが届いても捨てない)
+    void capturePendingTiles(int stepID, int layerID, HistoryManager& historyManager);
+    // 横に並んだcount枚のタイル(画像読み込みの帯)を1回の読み出しでキャプチャする
+    // 読み出し元は呼び出し時にバインドされているフレームバッファ。afterなら描画後タイル(Redo用)として保存する
+    void captureTileRow(int pixelX, int pixelY, int count, int stepID, int layerID, bool after,
+                        HistoryManager& historyManager);
+    // 届いた順に読み出して履歴へ渡す(ストロークと画像読み込みのキャプチャで共通)
     void processPendingCaptures(HistoryManager& historyManager);
+    // 処理待ちのPBO数と、PBOを読み出せずにキャプチャできなかったタイル数(そのタイルはUndoで戻らない)
+    int getPendingCaptures() const { return pendingPBOs; }
+    size_t getDroppedCaptures() const { return droppedCaptures; }
 
     // 描画後タイル保存
-    void saveAfterTiles(HistoryManager& historyManager);
+    void saveAfterTiles(HistoryManager& historyManager, int layerID);
 
 private:
     int canvasSize;
     int tileSize;
     static constexpr int channels = 4;
 
+    // タイル1行分のPBOの数(画像読み込みは1フレームに1帯で、描画前・描画後の2本を使う)
+    static constexpr int ROW_PBO_COUNT = 4;
+
     // PBO管理
-    static constexpr int PBO_COUNT = 128;
     GLuint pboIds[PBO_COUNT];
+    bool pbosCreated = false;
+    GLuint rowPboIds[ROW_PBO_COUNT];
+    bool rowPbosCreated = false;
+    int rowPboHead = 0;
+    int pendingRowPBOs = 0;
+    std::vector<uint8_t> tileScratch;  // タイル1行分のPBOから切り出したタイル
     int pboHead = 0;
     int pboTail = 0;
     int pendingPBOs = 0;
+    size_t droppedCaptures = 0;
 
     struct PboRequest {
         int tileX, tileY;
         int stepID;
+        int layerID;
+        int tileCount;  // 横に並んだタイル数(1ならpboIdsのタイル1枚)
+        int rowPbo;     // タイル1行分のときrowPboIdsの番号(それ以外は-1)
+        bool after;     // 描画後タイルとして保存する
     };
     PboRequest pboRequests[PBO_COUNT];
 
     // ダーティタイル管理
     std::set<TileCoord> dirtyTiles;
     std::vector<TileCoord> pendingNewTiles;
+    std::vector<uint8_t> displayDirty;  // 表示用のダーティフラグ(y * タイル数 + x)
 
     void initPBOs();
-    void beginTileCapture(int pixelX, int pixelY, int stepID);
+    void initRowPBOs();
+    void beginTileCapture(int pixelX, int pixelY, int stepID, int layerID);
 };
@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+// 画面表示の変換(ズーム・パン・回転)
+//
+// キャンバスのNDC座標cから画面のNDC座標sへ:
+//   s = fit * zoom * R(rotation) * (c - center)
+// fitはウィンドウの縦横比でキャンバスを画面に収める係数(App::computeScaleのscaleX, scaleY)。
+// zoom=1、center=(0,0)、rotation=0で従来の全体表示になる。
+// ストロークのコマンドはキャンバス座標で送るため、表示の変換は描画結果にも記録にも影響しない。
+struct ViewTransform {
+    static constexpr float MIN_ZOOM = 0.25f;
+    static constexpr float MAX_ZOOM = 256.0f;
+
+    float zoom = 1.0f;
+    float centerX = 0.0f;  // 画面中央に来るキャンバスのNDC座標
+    float centerY = 0.0f;
+    float rotation = 0.0f;  // ラジアン(反時計回り)
+
+    // 画面のNDC座標 -> キャンバスのNDC座標
+    void toCanvas(float screenX, float screenY, float scaleX, float scaleY, float& canvasX, float& canvasY) const {
+        float x = screenX / (scaleX * zoom);
+        float y = screenY / (scaleY * zoom);
+        float c = std::cos(rotation);
+        float s = std::sin(rotation);
+        canvasX = centerX + c * x + s * y;
+        canvasY = centerY - s * x + c * y;
+    }
+
+    // キャンバスのNDC座標 -> 画面のNDC座標の線形部分(列優先の2x2、glUniformMatrix2fv用)
+    void getMatrix(float scaleX, float scaleY, float out[4]) const {
+        float c = std::cos(rotation) * zoom;
+        float s = std::sin(rotation) * zoom;
+        out[0] = scaleX * c;
+        out[1] = scaleY * s;
+        out[2] = -scaleX * s;
+        out[3] = scaleY * c;
+    }
+
+    // 画面に映るキャンバスの範囲(キャンバスのNDC座標、[-1, 1]に切り詰め)。映らなければfalse
+    bool getVisibleBounds(float scaleX, float scaleY, float& minX, float& minY, float& maxX, float& maxY) const {
+        minX = minY = 1.0f;
+        maxX = maxY = -1.0f;
+        const float corners[4][2] = {{-1.0f, -1.0f}, {1.0f, -1.0f}, {-1.0f, 1.0f}, {1.0f, 1.0f}};
+        float x0 = 0.0f, y0 = 0.0f, x1 = 0.0f, y1 = 0.0f;
+        for (int i = 0; i < 4; ++i) {
+            float x, y;
+            toCanvas(corners[i][0], corners[i][1], scaleX, scaleY, x, y);
+            x0 = i == 0 ? x : std::min(x0, x);
+            y0 = i == 0 ? y : std::min(y0, y);
+            x1 = i == 0 ? x : std::max(x1, x);
+            y1 = i == 0 ? y : std::max(y1, y);
+        }
+        if (x1 <= -1.0f || y1 <= -1.0f || x0 >= 1.0f || y0 >= 1.0f) {
+            return false;
+        }
+        minX = std::max(x0, -1.0f);
+        minY = std::max(y0, -1.0f);
+        maxX = std::min(x1, 1.0f);
+        maxY = std::min(y1, 1.0f);
+        return true;
+    }
+
+    // 画面のNDC座標(anchorX, anchorY)の下のキャンバス位置を保ったまま拡大率を掛ける
+    void zoomAt(float factor, float anchorX, float anchorY, float scaleX, float scaleY) {
+        float beforeX, beforeY, afterX, afterY;
+        toCanvas(anchorX, anchorY, scaleX, scaleY, beforeX, beforeY);
+        zoom = std::max(MIN_ZOOM, std::min(zoom * factor, MAX_ZOOM));
+        toCanvas(anchorX, anchorY, scaleX, scaleY, afterX, afterY);
+        centerX += beforeX - afterX;
+        centerY += beforeY - afterY;
+    }
+
+    // 画面上で(fromX, fromY)にあったキャンバス位置を(toX, toY)へ動かす
+    void panBy(float fromX, float fromY, float toX, float toY, float scaleX, float scaleY) {
+        float beforeX, beforeY, afterX, afterY;
+        toCanvas(fromX, fromY, scaleX, scaleY, beforeX, beforeY);
+        toCanvas(toX, toY, scaleX, scaleY, afterX, afterY);
+        centerX += beforeX - afterX;
+        centerY += beforeY - afterY;
+    }
+};
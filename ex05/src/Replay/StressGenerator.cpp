@@ -0,0 +1,123 @@
+#include "StressGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+
+StressGenerator::StressGenerator(int canvasSize, uint32_t seed)
+    : canvasSize(canvasSize), state(seed * 0x9E3779B97F4A7C15ull + 1) {
+}
+
+uint32_t StressGenerator::nextRandom() {
+    // PCG32(標準ライブラリの分布は実装ごとに結果が異なるため使わない)
+    uint64_t old = state;
+    state = old * 6364136223846793005ull + 1442695040888963407ull;
+    uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    uint32_t rot = static_cast<uint32_t>(old >> 59);
+    return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+float StressGenerator::uniform(float lo, float hi) {
+    return lo + (hi - lo) * static_cast<float>(nextRandom() >> 8) / static_cast<float>(1u << 24);
+}
+
+int StressGenerator::uniformInt(int lo, int hi) {
+    return lo + static_cast<int>(nextRandom() % static_cast<uint32_t>(hi - lo));
+}
+
+void StressGenerator::emit(StrokeRecorder& recorder, CommandType type, float x, float y) {
+    Command cmd;
+    cmd.type = type;
+    cmd.time = time;
+    cmd.x = std::clamp(x, -1.0f, 1.0f);
+    cmd.y = std::clamp(y, -1.0f, 1.0f);
+    recorder.record(cmd);
+}
+
+void StressGenerator::setBrush(StrokeRecorder& recorder, float size, bool eraser) {
+    Command cmd;
+    cmd.type = CommandType::SetBrush;
+    cmd.time = time;
+    cmd.color[0] = static_cast<uint8_t>(uniformInt(0, 256));
+    cmd.color[1] = static_cast<uint8_t>(uniformInt(0, 256));
+    cmd.color[2] = static_cast<uint8_t>(uniformInt(0, 256));
+    cmd.color[3] = static_cast<uint8_t>(uniformInt(64, 256));
+    cmd.size = size;
+    cmd.eraser = eraser;
+    recorder.record(cmd);
+}
+
+void StressGenerator::walkStroke(StrokeRecorder& recorder) {
+    // 細かい描き込み: 小さいブラシで向きを少しずつ変えながら進む
+    setBrush(recorder, uniform(2.0f, 24.0f), uniformInt(0, 10) == 0);
+    float x = uniform(-0.9f, 0.9f);
+    float y = uniform(-0.9f, 0.9f);
+    float angle = uniform(0.0f, 6.2831853f);
+    float step = uniform(2.0f, 12.0f) * 2.0f / canvasSize;
+    int points = uniformInt(30, 200);
+
+    emit(recorder, CommandType::StrokeBegin, x, y);
+    for (int i = 0; i < points; ++i) {
+        time += POINT_INTERVAL;
+        angle += uniform(-0.4f, 0.4f);
+        x += std::cos(angle) * step;
+        y += std::sin(angle) * step;
+        // 端に当たったら反対向きにする
+        if (x < -1.0f || x > 1.0f || y < -1.0f || y > 1.0f) {
+            angle += 3.1415927f;
+        }
+        emit(recorder, CommandType::StrokePoint, x, y);
+    }
+    time += POINT_INTERVAL;
+    emit(recorder, CommandType::StrokeEnd, x, y);
+}
+
+void StressGenerator::sweepStroke(StrokeRecorder& recorder) {
+    // 広範囲の塗り: 大きいブラシでキャンバスを横切り、多数のタイルを変える
+    setBrush(recorder, uniform(64.0f, 256.0f), false);
+    float x = uniform(-1.0f, -0.5f);
+    float y = uniform(-0.9f, 0.9f);
+    float dy = uniform(-0.3f, 0.3f);
+    int points = uniformInt(20, 60);
+    float dx = uniform(1.0f, 1.8f) / points;
+
+    emit(recorder, CommandType::StrokeBegin, x, y);
+    for (int i = 0; i < points; ++i) {
+        time += POINT_INTERVAL;
+        x += dx;
+        y += dy / points + uniform(-0.02f, 0.02f);
+        emit(recorder, CommandType::StrokePoint, x, y);
+    }
+    time += POINT_INTERVAL;
+    emit(recorder, CommandType::StrokeEnd, x, y);
+}
+
+void StressGenerator::undoBurst(StrokeRecorder& recorder) {
+    // キーの連打を想定して間隔を短くする
+    int undos = uniformInt(5, 40);
+    for (int i = 0; i < undos; ++i) {
+        time += 0.03;
+        emit(recorder, CommandType::Undo);
+    }
+    int redos = uniformInt(0, undos + 1);
+    for (int i = 0; i < redos; ++i) {
+        time += 0.03;
+        emit(recorder, CommandType::Redo);
+    }
+}
+
+void StressGenerator::write(const std::string& filename, int strokes) {
+    StrokeRecorder recorder(filename, canvasSize);
+    time = 0.0;
+
+    for (int i = 0; i < strokes; ++i) {
+        int kind = uniformInt(0, 100);
+        if (kind < 60) {
+            walkStroke(recorder);
+        } else if (kind < 85) {
+            sweepStroke(recorder);
+        } else {
+            undoBurst(recorder);
+        }
+        // ストローク間の間
+        time += uniform(0.05f, 0.3f);
+    }
+}
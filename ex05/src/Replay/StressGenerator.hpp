@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "StrokeRecorder.hpp"
+
+// 負荷試験用の合成ストロークログを生成する(--stress N)
+// 同じシードなら同じログになる(乱数は環境に依存しない自前の生成器を使う)
+// 内訳: 小さいブラシのランダムウォーク、大きいブラシで広範囲をなぞるストローク、Undo/Redoの連打
+class StressGenerator {
+public:
+    StressGenerator(int canvasSize, uint32_t seed);
+
+    // strokes回の操作(ストローク1本またはUndo/Redoの連打1回)を含むログをfilenameに書き出す
+    void write(const std::string& filename, int strokes);
+
+private:
+    // 1点あたりの間隔(秒)。ペンタブレットの入力間隔程度
+    static constexpr double POINT_INTERVAL = 0.008;
+
+    int canvasSize;
+    uint64_t state;
+    double time = 0.0;
+
+    uint32_t nextRandom();
+    // [lo, hi)の一様乱数
+    float uniform(float lo, float hi);
+    int uniformInt(int lo, int hi);
+
+    void setBrush(StrokeRecorder& recorder, float size, bool eraser);
+    void walkStroke(StrokeRecorder& recorder);
+    void sweepStroke(StrokeRecorder& recorder);
+    void undoBurst(StrokeRecorder& recorder);
+    void emit(StrokeRecorder& recorder, CommandType type, float x = 0.0f, float y = 0.0f);
+};
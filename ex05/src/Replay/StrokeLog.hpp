@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// ストロークログのバイナリ形式
+//
+// ヘッダー: magic "TPSL"(4) + version(u16) + 予約(u16) + canvasSize(u32)
+// イベント: type(u8) + 前イベントからの経過時間[μs](varint) + 種類ごとのペイロード
+//   StrokeBegin/StrokePoint/StrokeEnd: 前の点からの差分(1/16ピクセル固定小数、zigzag varint) x, y
+//   SetBrush: RGBA(4) + サイズ(float32) + 消しゴムフラグ(u8)
+//   その他(Undo/Redo/Save/Import/モード切替): ペイロードなし(Importは--openの画像を読み込む)
+namespace StrokeLog {
+
+constexpr char MAGIC[4] = {'T', 'P', 'S', 'L'};
+constexpr uint16_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 12;
+
+// 座標の量子化単位(1/16ピクセル)
+constexpr float POINT_SCALE = 16.0f;
+
+inline void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline uint64_t zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+}  // namespace StrokeLog
@@ -0,0 +1,84 @@
+#include "StrokeRecorder.hpp"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+StrokeRecorder::StrokeRecorder(const std::string& filename, int canvasSize)
+    : ofs(filename, std::ios::binary | std::ios::trunc), canvasSize(canvasSize) {
+    if (!ofs.is_open()) {
+        throw std::runtime_error("Failed to open stroke log for writing: " + filename);
+    }
+
+    uint8_t header[StrokeLog::HEADER_SIZE] = {};
+    std::memcpy(header, StrokeLog::MAGIC, 4);
+    uint16_t version = StrokeLog::VERSION;
+    uint32_t size = static_cast<uint32_t>(canvasSize);
+    std::memcpy(header + 4, &version, sizeof(version));
+    std::memcpy(header + 8, &size, sizeof(size));
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+StrokeRecorder::~StrokeRecorder() {
+    flush();
+    std::cout << "Stroke log recorded: " << eventCount << " events" << std::endl;
+}
+
+void StrokeRecorder::record(const Command& command) {
+    // 再生に不要なコマンドは記録しない(ストロークはキャンバス座標なので表示の変換も不要)
+    if (command.type == CommandType::SetView || command.type == CommandType::Resize
+        || command.type == CommandType::Quit) {
+        return;
+    }
+
+    buffer.push_back(static_cast<uint8_t>(command.type));
+
+    // 経過時間はμs単位の差分(時刻が戻った場合は0)
+    double delta = hasLastTime ? command.time - lastTime : 0.0;
+    uint64_t deltaMicros = delta > 0.0 ? static_cast<uint64_t>(std::llround(delta * 1e6)) : 0;
+    StrokeLog::writeVarint(buffer, deltaMicros);
+    if (!hasLastTime || command.time > lastTime) {
+        lastTime = command.time;
+    }
+    hasLastTime = true;
+
+    switch (command.type) {
+        case CommandType::StrokeBegin:
+        case CommandType::StrokePoint:
+        case CommandType::StrokeEnd: {
+            // キャンバスのNDC座標 -> 1/16ピクセル単位の整数
+            float px = (command.x + 1.0f) / 2.0f * canvasSize;
+            float py = (command.y + 1.0f) / 2.0f * canvasSize;
+            int64_t qx = std::llround(px * StrokeLog::POINT_SCALE);
+            int64_t qy = std::llround(py * StrokeLog::POINT_SCALE);
+            StrokeLog::writeVarint(buffer, StrokeLog::zigzagEncode(qx - lastX));
+            StrokeLog::writeVarint(buffer, StrokeLog::zigzagEncode(qy - lastY));
+            lastX = qx;
+            lastY = qy;
+            break;
+        }
+        case CommandType::SetBrush: {
+            buffer.insert(buffer.end(), command.color, command.color + 4);
+            uint8_t sizeBytes[sizeof(float)];
+            std::memcpy(sizeBytes, &command.size, sizeof(float));
+            buffer.insert(buffer.end(), sizeBytes, sizeBytes + sizeof(float));
+            buffer.push_back(command.eraser ? 1 : 0);
+            break;
+        }
+        default:
+            break;
+    }
+
+    eventCount++;
+    if (buffer.size() >= 64 * 1024) {
+        flush();
+    }
+}
+
+void StrokeRecorder::flush() {
+    if (!buffer.empty()) {
+        ofs.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        buffer.clear();
+    }
+    ofs.flush();
+}
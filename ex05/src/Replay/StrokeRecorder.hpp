@@ -0,0 +1,33 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Core/Command.hpp"
+#include "StrokeLog.hpp"
+
+// 描画スレッドで実行したコマンドをストロークログとして記録する
+class StrokeRecorder {
+public:
+    StrokeRecorder(const std::string& filename, int canvasSize);
+    ~StrokeRecorder();
+
+    // コピー禁止
+    StrokeRecorder(const StrokeRecorder&) = delete;
+    StrokeRecorder& operator=(const StrokeRecorder&) = delete;
+
+    void record(const Command& command);
+    void flush();
+
+    size_t getEventCount() const { return eventCount; }
+
+private:
+    std::ofstream ofs;
+    int canvasSize;
+    std::vector<uint8_t> buffer;
+    size_t eventCount = 0;
+
+    bool hasLastTime = false;
+    double lastTime = 0.0;
+    int64_t lastX = 0;
+    int64_t lastY = 0;
+};
@@ -0,0 +1,129 @@
+#include "StrokeReplayer.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+StrokeReplayer::StrokeReplayer(const std::string& filename, int canvasSize)
+    : canvasSize(canvasSize) {
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.is_open()) {
+        throw std::runtime_error("Failed to open stroke log: " + filename);
+    }
+    data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+    if (data.size() < StrokeLog::HEADER_SIZE || std::memcmp(data.data(), StrokeLog::MAGIC, 4) != 0) {
+        throw std::runtime_error("Not a stroke log: " + filename);
+    }
+
+    uint16_t version;
+    uint32_t size;
+    std::memcpy(&version, data.data() + 4, sizeof(version));
+    std::memcpy(&size, data.data() + 8, sizeof(size));
+    if (version != StrokeLog::VERSION) {
+        throw std::runtime_error("Unsupported stroke log version: " + std::to_string(version));
+    }
+    if (size == 0) {
+        throw std::runtime_error("Stroke log has no canvas size: " + filename);
+    }
+    recordedCanvasSize = static_cast<int>(size);
+
+    // 再生は描画スレッドの起動後に進むため、壊れた・未知のイベントは先に全体を読んでここで弾く
+    rewind();
+    Command command;
+    while (next(command)) {
+    }
+    rewind();
+}
+
+void StrokeReplayer::rewind() {
+    cursor = StrokeLog::HEADER_SIZE;
+    currentTime = 0.0;
+    nextTime = 0.0;
+    lastX = 0;
+    lastY = 0;
+    readNextTime();
+}
+
+uint64_t StrokeReplayer::readVarint() {
+    uint64_t value = 0;
+    int shift = 0;
+    while (cursor < data.size()) {
+        uint8_t byte = data[cursor++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+        shift += 7;
+        if (shift >= 64) {
+            break;
+        }
+    }
+    throw std::runtime_error("Truncated stroke log");
+}
+
+void StrokeReplayer::readNextTime() {
+    if (atEnd()) {
+        return;
+    }
+    // type(u8)の直後の時間差分だけを先読みする
+    size_t saved = cursor;
+    cursor++;
+    nextTime = currentTime + static_cast<double>(readVarint()) / 1e6;
+    cursor = saved;
+}
+
+bool StrokeReplayer::next(Command& command) {
+    if (atEnd()) {
+        return false;
+    }
+
+    command = Command{};
+    command.type = static_cast<CommandType>(data[cursor++]);
+    currentTime += static_cast<double>(readVarint()) / 1e6;
+    command.time = currentTime;
+
+    switch (command.type) {
+        case CommandType::StrokeBegin:
+        case CommandType::StrokePoint:
+        case CommandType::StrokeEnd: {
+            lastX += StrokeLog::zigzagDecode(readVarint());
+            lastY += StrokeLog::zigzagDecode(readVarint());
+            float scale = static_cast<float>(canvasSize) / recordedCanvasSize;
+            float px = lastX / StrokeLog::POINT_SCALE * scale;
+            float py = lastY / StrokeLog::POINT_SCALE * scale;
+            command.x = px / canvasSize * 2.0f - 1.0f;
+            command.y = py / canvasSize * 2.0f - 1.0f;
+            break;
+        }
+        case CommandType::SetBrush: {
+            if (cursor + 4 + sizeof(float) + 1 > data.size()) {
+                throw std::runtime_error("Truncated stroke log");
+            }
+            std::memcpy(command.color, &data[cursor], 4);
+            std::memcpy(&command.size, &data[cursor + 4], sizeof(float));
+            command.eraser = data[cursor + 4 + sizeof(float)] != 0;
+            cursor += 4 + sizeof(float) + 1;
+            break;
+        }
+        case CommandType::ToggleStrokeMode:
+        case CommandType::ToggleSmoothing:
+        case CommandType::Undo:
+        case CommandType::Redo:
+        case CommandType::Save:
+        case CommandType::Import:
+        case CommandType::AddLayer:
+        case CommandType::SelectLayerUp:
+        case CommandType::SelectLayerDown:
+        case CommandType::ToggleLayerVisibility:
+        case CommandType::LayerOpacityUp:
+        case CommandType::LayerOpacityDown:
+        case CommandType::CycleLayerBlendMode:
+            break;
+        default:
+            throw std::runtime_error("Unknown event in stroke log");
+    }
+
+    readNextTime();
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Core/Command.hpp"
+#include "StrokeLog.hpp"
+
+// 再生速度
+enum class ReplaySpeed {
+    WallClock,  // 記録時の時間間隔を再現
+    Frame,      // 描画スレッドの1フレームごとに決まった数だけ投入(負荷試験)
+    Max         // 待たずに最大速度で投入
+};
+
+// ストロークログを読み込み、記録時と同じコマンド列を再構成する
+class StrokeReplayer {
+public:
+    // canvasSize: 再生先のキャンバスサイズ(記録時と異なれば座標をスケール)
+    // ログ全体を読んで確かめ、壊れていれば例外を投げる(nextは以降失敗しない)
+    StrokeReplayer(const std::string& filename, int canvasSize);
+
+    // 次のコマンドを取り出す。終端ならfalse
+    // command.timeは先頭イベントからの経過秒
+    bool next(Command& command);
+
+    // 次のコマンドの経過秒(終端なら負値)
+    double peekTime() const { return atEnd() ? -1.0 : nextTime; }
+
+    bool atEnd() const { return cursor >= data.size(); }
+    int getRecordedCanvasSize() const { return recordedCanvasSize; }
+
+private:
+    std::vector<uint8_t> data;
+    size_t cursor = 0;
+    int canvasSize;
+    int recordedCanvasSize = 0;
+
+    double currentTime = 0.0;
+    double nextTime = 0.0;
+    int64_t lastX = 0;
+    int64_t lastY = 0;
+
+    uint64_t readVarint();
+    void readNextTime();
+    void rewind();  // 先頭のイベントへ戻る
+};
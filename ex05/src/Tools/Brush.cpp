@@ -1,12 +1,13 @@
 #include "Brush.hpp"
 
+// スタンプ: 円の三角形ごとに中心座標を持たせ、1フレーム分をまとめて描画する
 const char* brushVertexShaderSource = R"(#version 410 core
 layout(location = 0) in vec2 aPos;
-uniform vec2 uPos;
+layout(location = 1) in vec2 aCenter;
 uniform vec2 uSize;
 
 void main() {
-    vec2 pos = uPos + (aPos * uSize);
+    vec2 pos = aCenter + (aPos * uSize);
     gl_Position = vec4(pos, 0.0, 1.0);
 })";
 
@@ -17,24 +18,117 @@ void main() {
     FragColor = uColor;
 })";
 
+// カプセルSDF: セグメントを覆う向き付き矩形をピクセル座標で生成
+// セグメントと直前セグメントは頂点属性で渡し、1フレーム分をまとめて描画する
+const char* capsuleVertexShaderSource = R"(#version 410 core
+layout(location = 0) in vec2 aPos;
+layout(location = 1) in vec4 aSegment;
+layout(location = 2) in vec4 aPrev;
+layout(location = 3) in float aHasPrev;
+uniform float uRadius;
+uniform vec2 uTargetSize;
+out vec2 vPos;
+flat out vec4 vSegment;
+flat out vec4 vPrev;
+flat out float vHasPrev;
+
+void main() {
+    vec2 uA = aSegment.xy;
+    vec2 uB = aSegment.zw;
+    vSegment = aSegment;
+    vPrev = aPrev;
+    vHasPrev = aHasPrev;
+    vec2 d = uB - uA;
+    float len = length(d);
+    vec2 dir = len > 1e-4 ? d / len : vec2(1.0, 0.0);
+    vec2 nrm = vec2(-dir.y, dir.x);
+
+    // アンチエイリアス用に1ピクセル分広げる
+    float ext = uRadius + 1.0;
+    vec2 center = (uA + uB) * 0.5;
+    vec2 p = center + dir * aPos.x * (len * 0.5 + ext) + nrm * aPos.y * ext;
+
+    vPos = p;
+    gl_Position = vec4(p / uTargetSize * 2.0 - 1.0, 0.0, 1.0);
+})";
+
+const char* capsuleFragmentShaderSource = R"(#version 410 core
+in vec2 vPos;
+flat in vec4 vSegment;
+flat in vec4 vPrev;
+flat in float vHasPrev;
+uniform float uRadius;
+uniform vec4 uColor;
+out vec4 FragColor;
+
+float capsule(vec2 p, vec2 a, vec2 b, float r) {
+    vec2 pa = p - a;
+    vec2 ba = b - a;
+    float h = clamp(dot(pa, ba) / max(dot(ba, ba), 1e-8), 0.0, 1.0);
+    return length(pa - ba * h) - r;
+}
+
+void main() {
+    // 距離から1ピクセル幅の解析的カバレッジを求める
+    float coverage = clamp(0.5 - capsule(vPos, vSegment.xy, vSegment.zw, uRadius), 0.0, 1.0);
+
+    // 直前セグメントが既に塗った分を差し引き、継ぎ目での二重ブレンドを防ぐ
+    // (2つ以上前のセグメントとの重なりは差し引かないため、折り返しや交差では半透明色が濃くなる)
+    if (vHasPrev > 0.5) {
+        float prevCoverage = clamp(0.5 - capsule(vPos, vPrev.xy, vPrev.zw, uRadius), 0.0, 1.0);
+        coverage = max(coverage - prevCoverage, 0.0);
+    }
+
+    if (coverage <= 0.0) {
+        discard;
+    }
+    FragColor = vec4(uColor.rgb, uColor.a * coverage);
+})";
+
 Brush::Brush() {
     // 1. シェーダー作成
-    shader = new Shader(brushVertexShaderSource, brushFragmentShaderSource, "brushShader.bin");
-    
-    // 2. 円形メッシュ作成 (XY形式)
-    std::vector<float> vertices;
-    vertices.push_back(0.0f); vertices.push_back(0.0f); // 中心
-    
+    shader = new Shader(brushVertexShaderSource, brushFragmentShaderSource, "brushShader");
+
+    // 2. 円形の三角形リスト作成 (中心と円周の隣り合う2点で1枚)
     int segments = 32;
     float radius = 0.5f;
-    for (int i = 0; i <= segments; ++i) {
-        float theta = 2.0f * 3.1415926f * float(i) / float(segments);
-        vertices.push_back(radius * cos(theta));
-        vertices.push_back(radius * sin(theta));
+    for (int i = 0; i < segments; ++i) {
+        float theta0 = 2.0f * 3.1415926f * float(i) / float(segments);
+        float theta1 = 2.0f * 3.1415926f * float(i + 1) / float(segments);
+        circle.push_back(0.0f); circle.push_back(0.0f);
+        circle.push_back(radius * cos(theta0)); circle.push_back(radius * sin(theta0));
+        circle.push_back(radius * cos(theta1)); circle.push_back(radius * sin(theta1));
     }
-    
-    // フォーマットXYを指定してMesh作成
-    mesh = new Mesh(vertices, MeshFormat::XY);
+
+    // 3. カプセル描画用シェーダー
+    capsuleShader = new Shader(capsuleVertexShaderSource, capsuleFragmentShaderSource, "brushCapsuleShader");
+
+    // 4. 頂点バッファ(描画のたびに1フレーム分をまとめて転送)
+    glGenVertexArrays(1, &stampVAO);
+    glGenBuffers(1, &stampVBO);
+    glBindVertexArray(stampVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, stampVBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, STAMP_VERTEX_FLOATS * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, STAMP_VERTEX_FLOATS * sizeof(float), (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glGenVertexArrays(1, &capsuleVAO);
+    glGenBuffers(1, &capsuleVBO);
+    glBindVertexArray(capsuleVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, capsuleVBO);
+    GLsizei stride = CAPSULE_VERTEX_FLOATS * sizeof(float);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(10 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
 
     // デフォルト設定
     color[0] = 0.0f; color[1] = 0.0f; color[2] = 0.0f; color[3] = 1.0f; // 黒
@@ -43,7 +137,11 @@ Brush::Brush() {
 
 Brush::~Brush() {
     delete shader;
-    delete mesh;
+    delete capsuleShader;
+    glDeleteVertexArrays(1, &stampVAO);
+    glDeleteBuffers(1, &stampVBO);
+    glDeleteVertexArrays(1, &capsuleVAO);
+    glDeleteBuffers(1, &capsuleVBO);
 }
 
 void Brush::setColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
@@ -58,8 +156,13 @@ void Brush::setSize(float px) {
 }
 
 void Brush::begin() {
-    shader->use();
-    glUniform4f(glGetUniformLocation(shader->ID, "uColor"), color[0], color[1], color[2], color[3]);
+    Shader* active = (mode == StrokeMode::Capsule) ? capsuleShader : shader;
+    active->use();
+    glUniform4f(glGetUniformLocation(active->ID, "uColor"), color[0], color[1], color[2], color[3]);
+}
+
+void Brush::beginStroke() {
+    hasPrevSegment = false;
 }
 
 float lerp(float a, float b, float f) {
@@ -67,28 +170,97 @@ float lerp(float a, float b, float f) {
 }
 
 void Brush::drawLine(float x1, float y1, float x2, float y2, float fboWidth) {
+    drawSegments({{x1, y1}, {x2, y2}}, fboWidth);
+}
+
+void Brush::drawSegments(const std::vector<StrokePoint>& segments, float fboWidth) {
+    // 全区間の頂点を1つのバッファにまとめ、1回の転送と1回のドローコールで描画する
+    // (プリミティブは並べた順にブレンドされるため、区間ごとに描いたときと結果は変わらない)
+    vertices.clear();
+    for (size_t i = 0; i + 1 < segments.size(); i += 2) {
+        if (mode == StrokeMode::Capsule) {
+            appendCapsule(segments[i].x, segments[i].y, segments[i + 1].x, segments[i + 1].y, fboWidth);
+        } else {
+            appendStamps(segments[i].x, segments[i].y, segments[i + 1].x, segments[i + 1].y, fboWidth);
+        }
+    }
+    if (vertices.empty()) {
+        return;
+    }
+
+    int floatsPerVertex;
+    if (mode == StrokeMode::Capsule) {
+        GLuint id = capsuleShader->ID;
+        glUniform1f(glGetUniformLocation(id, "uRadius"), size * 0.5f);
+        glUniform2f(glGetUniformLocation(id, "uTargetSize"), fboWidth, fboWidth);
+        glBindVertexArray(capsuleVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, capsuleVBO);
+        floatsPerVertex = CAPSULE_VERTEX_FLOATS;
+    } else {
+        float sizeNDC = (size / fboWidth) * 2.0f;
+        glUniform2f(glGetUniformLocation(shader->ID, "uSize"), sizeNDC, sizeNDC);
+        glBindVertexArray(stampVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, stampVBO);
+        floatsPerVertex = STAMP_VERTEX_FLOATS;
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STREAM_DRAW);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size() / floatsPerVertex));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void Brush::appendStamps(float x1, float y1, float x2, float y2, float fboWidth) {
     // ブラシサイズをNDCに変換
     float sizeNDC = (size / fboWidth) * 2.0f;
-    glUniform2f(glGetUniformLocation(shader->ID, "uSize"), sizeNDC, sizeNDC);
 
     // 距離計算
     float dist = sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2));
-    
+
     // 補間ステップ数の計算
-    int steps = (int)(dist / (sizeNDC * 0.1f)); 
+    int steps = (int)(dist / (sizeNDC * 0.1f));
     if (steps < 1) steps = 1;
 
     for (int i = 0; i <= steps; i++) {
         float t = (float)i / steps;
         float drawX = lerp(x1, x2, t);
         float drawY = lerp(y1, y2, t);
-        
-        drawPoint(drawX, drawY, sizeNDC);
+
+        for (size_t v = 0; v < circle.size(); v += 2) {
+            vertices.push_back(circle[v]);
+            vertices.push_back(circle[v + 1]);
+            vertices.push_back(drawX);
+            vertices.push_back(drawY);
+        }
     }
 }
 
-void Brush::drawPoint(float x, float y, float sizeNDC) {
-    glUniform2f(glGetUniformLocation(shader->ID, "uPos"), x, y);
-    // Meshクラスのdrawを呼ぶ (FANモード)
-    mesh->draw(GL_TRIANGLE_FAN);
-}
\ No newline at end of file
+void Brush::appendCapsule(float x1, float y1, float x2, float y2, float fboWidth) {
+    // NDCからピクセル座標に変換
+    float ax = (x1 + 1.0f) / 2.0f * fboWidth;
+    float ay = (y1 + 1.0f) / 2.0f * fboWidth;
+    float bx = (x2 + 1.0f) / 2.0f * fboWidth;
+    float by = (y2 + 1.0f) / 2.0f * fboWidth;
+
+    // 矩形を2枚の三角形で覆う
+    static const float corners[6][2] = {
+        {-1.0f, -1.0f}, {1.0f, -1.0f}, {-1.0f, 1.0f},
+        {-1.0f, 1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f},
+    };
+    for (const auto& corner : corners) {
+        vertices.push_back(corner[0]);
+        vertices.push_back(corner[1]);
+        vertices.push_back(ax);
+        vertices.push_back(ay);
+        vertices.push_back(bx);
+        vertices.push_back(by);
+        vertices.insert(vertices.end(), prevSegment, prevSegment + 4);
+        vertices.push_back(hasPrevSegment ? 1.0f : 0.0f);
+    }
+
+    prevSegment[0] = ax;
+    prevSegment[1] = ay;
+    prevSegment[2] = bx;
+    prevSegment[3] = by;
+    hasPrevSegment = true;
+}
@@ -3,7 +3,14 @@
 #include <vector>
 #include <cmath>
 #include "Graphics/Shader.hpp"
-#include "Graphics/Mesh.hpp"
+#include "StrokeTypes.hpp"
+
+// ストロークの描画方式
+enum class StrokeMode {
+    Stamp,   // 円形メッシュを補間位置にスタンプ
+    Capsule  // セグメントごとに1枚の矩形でカプセルSDFを評価
+             // 重なりを除くのは直前セグメントとだけで、2つ以上前と重なる部分(急な折り返し・自己交差)は二重にブレンドされる
+};
 
 class Brush {
     public:
@@ -15,15 +22,39 @@ class Brush {
         void setSize(float px);
         float getSize() const { return size; }
 
+        void setStrokeMode(StrokeMode m) { mode = m; }
+        StrokeMode getStrokeMode() const { return mode; }
+
         void begin();
 
+        // ストローク開始(直前セグメントとの重なり除去をリセット)
+        void beginStroke();
+
+        // 1区間を1回のドローコールで描画(drawSegmentsとのドローコール数の比較はbenchのbrush.draw_line)
         void drawLine(float startX, float startY, float endX, float endY, float fboWidth);
+
+        // (始点, 終点)の組を並べた区間列を、1回の頂点転送と1回のドローコールで描画
+        void drawSegments(const std::vector<StrokePoint>& segments, float fboWidth);
     
     private:
+        // 1頂点あたりのfloat数(スタンプ: 円上の点+中心、カプセル: 矩形の角+区間+直前区間+直前区間の有無)
+        static constexpr int STAMP_VERTEX_FLOATS = 4;
+        static constexpr int CAPSULE_VERTEX_FLOATS = 11;
+
         Shader* shader;
-        Mesh* mesh;
+        Shader* capsuleShader;
+        std::vector<float> circle;  // 円の三角形リスト(直径1)
+        unsigned int stampVAO, stampVBO;
+        unsigned int capsuleVAO, capsuleVBO;
+        std::vector<float> vertices;  // drawSegmentsで転送する頂点(確保を使い回す)
         float color[4];
         float size;
+        StrokeMode mode = StrokeMode::Stamp;
+
+        // 直前に描画したカプセルセグメント(ピクセル座標)
+        bool hasPrevSegment = false;
+        float prevSegment[4] = {0.0f, 0.0f, 0.0f, 0.0f};
 
-        void drawPoint(float x, float y, float sizeNDC);
+        void appendStamps(float x1, float y1, float x2, float y2, float fboWidth);
+        void appendCapsule(float x1, float y1, float x2, float y2, float fboWidth);
 };
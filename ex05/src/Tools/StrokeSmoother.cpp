@@ -0,0 +1,61 @@
+#include "StrokeSmoother.hpp"
+#include <algorithm>
+#include <cmath>
+
+void StrokeSmoother::reset() {
+    controls.clear();
+}
+
+void StrokeSmoother::push(const StrokePoint& p, float spacing, std::vector<StrokePoint>& out) {
+    if (controls.empty()) {
+        // 始点は複製して端点の制御点とする
+        controls.push_back(p);
+        controls.push_back(p);
+        out.push_back(p);
+        return;
+    }
+
+    // 同一座標の連続は無視
+    const StrokePoint& last = controls.back();
+    if (std::fabs(last.x - p.x) < 1e-6f && std::fabs(last.y - p.y) < 1e-6f) {
+        return;
+    }
+
+    controls.push_back(p);
+    if (controls.size() == 4) {
+        emitSegment(controls[0], controls[1], controls[2], controls[3], spacing, out);
+        controls.erase(controls.begin());
+    }
+}
+
+void StrokeSmoother::finish(float spacing, std::vector<StrokePoint>& out) {
+    if (controls.size() == 3) {
+        emitSegment(controls[0], controls[1], controls[2], controls[2], spacing, out);
+    }
+    controls.clear();
+}
+
+void StrokeSmoother::emitSegment(const StrokePoint& p0, const StrokePoint& p1,
+                                 const StrokePoint& p2, const StrokePoint& p3,
+                                 float spacing, std::vector<StrokePoint>& out) const {
+    float len = std::sqrt((p2.x - p1.x) * (p2.x - p1.x) + (p2.y - p1.y) * (p2.y - p1.y));
+    int samples = 1;
+    if (spacing > 0.0f) {
+        samples = std::clamp(static_cast<int>(std::ceil(len / spacing)), 1, 16);
+    }
+
+    // p1は出力済みなので、p1より後からp2までを出力
+    for (int i = 1; i <= samples; ++i) {
+        float t = static_cast<float>(i) / samples;
+        float t2 = t * t;
+        float t3 = t2 * t;
+        StrokePoint q;
+        q.x = 0.5f * (2.0f * p1.x + (-p0.x + p2.x) * t
+                      + (2.0f * p0.x - 5.0f * p1.x + 4.0f * p2.x - p3.x) * t2
+                      + (-p0.x + 3.0f * p1.x - 3.0f * p2.x + p3.x) * t3);
+        q.y = 0.5f * (2.0f * p1.y + (-p0.y + p2.y) * t
+                      + (2.0f * p0.y - 5.0f * p1.y + 4.0f * p2.y - p3.y) * t2
+                      + (-p0.y + 3.0f * p1.y - 3.0f * p2.y + p3.y) * t3);
+        out.push_back(q);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include "StrokeTypes.hpp"
+
+// Catmull-Romスプラインで入力点列を補間する
+// 次の点が届くまで1区間遅れて確定する
+class StrokeSmoother {
+public:
+    void reset();
+
+    // 入力点を追加し、確定した補間点をoutに追加
+    void push(const StrokePoint& p, float spacing, std::vector<StrokePoint>& out);
+
+    // ストローク終了時に残りの区間を確定
+    void finish(float spacing, std::vector<StrokePoint>& out);
+
+private:
+    std::vector<StrokePoint> controls;  // 最大4点の制御点
+
+    void emitSegment(const StrokePoint& p0, const StrokePoint& p1,
+                     const StrokePoint& p2, const StrokePoint& p3,
+                     float spacing, std::vector<StrokePoint>& out) const;
+};
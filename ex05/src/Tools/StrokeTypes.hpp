@@ -0,0 +1,6 @@
+#pragma once
+
+// ストロークの1点(キャンバスのNDC座標)
+struct StrokePoint {
+    float x, y;
+};
@@ -1,12 +1,134 @@
 #include "Core/App.hpp"
+#include "Profiling/Trace.hpp"
+#include <cstdlib>
+#include <cstring>
 
-int main() {
+static void printUsage(const char* name) {
+    std::cerr << "Usage: " << name << " [--headless] [--frames N] [--canvas SIZE]"
+              << " [--open FILE] [--save FILE] [--view ZOOM[,X,Y[,DEG]]]"
+              << " [--autosave FILE] [--autosave-interval SEC] [--autosave-steps N]"
+              << " [--smooth] [--record FILE] [--replay FILE] [--replay-speed wall|frame|max]"
+              << " [--history-queue-mb N] [--history-queue-policy block|compress|coalesce]"
+              << " [--history-encoders N] [--no-history-compress]"
+              << " [--stress N] [--stress-seed S] [--stress-log FILE] [--stress-report]"
+              << " [--profile] [--profile-csv FILE] [--trace FILE]"
+              << " [--shader-cache DIR] [--no-shader-cache]"
+              << " [--shader-compile auto|parallel|thread|sync]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    AppConfig config;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            config.headless = true;
+        } else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            config.maxFrames = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--canvas") == 0 && i + 1 < argc) {
+            config.canvasSize = static_cast<float>(std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--open") == 0 && i + 1 < argc) {
+            config.openPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            config.savePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--view") == 0 && i + 1 < argc) {
+            config.view = argv[++i];
+        } else if (std::strcmp(argv[i], "--autosave") == 0 && i + 1 < argc) {
+            config.autosavePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--autosave-interval") == 0 && i + 1 < argc) {
+            config.autosaveInterval = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--autosave-steps") == 0 && i + 1 < argc) {
+            config.autosaveSteps = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--smooth") == 0) {
+            config.smoothStrokes = true;
+        } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            config.recordPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            config.replayPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--history-queue-mb") == 0 && i + 1 < argc) {
+            config.historyQueueMB = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--history-encoders") == 0 && i + 1 < argc) {
+            config.historyEncoders = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--no-history-compress") == 0) {
+            config.historyCompress = false;
+        } else if (std::strcmp(argv[i], "--history-queue-policy") == 0 && i + 1 < argc) {
+            const char* policy = argv[++i];
+            if (std::strcmp(policy, "block") == 0) {
+                config.historyQueuePolicy = QueuePolicy::Block;
+            } else if (std::strcmp(policy, "compress") == 0) {
+                config.historyQueuePolicy = QueuePolicy::Compress;
+            } else if (std::strcmp(policy, "coalesce") == 0) {
+                config.historyQueuePolicy = QueuePolicy::Coalesce;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+            config.stressStrokes = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--stress-seed") == 0 && i + 1 < argc) {
+            config.stressSeed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--stress-log") == 0 && i + 1 < argc) {
+            config.stressLogPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--stress-report") == 0) {
+            config.stressReport = true;
+        } else if (std::strcmp(argv[i], "--shader-cache") == 0 && i + 1 < argc) {
+            config.shaderCacheDir = argv[++i];
+        } else if (std::strcmp(argv[i], "--no-shader-cache") == 0) {
+            config.shaderCacheDir = "";
+        } else if (std::strcmp(argv[i], "--shader-compile") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (std::strcmp(mode, "auto") == 0) {
+                config.shaderCompile = ShaderCompiler::Mode::Auto;
+            } else if (std::strcmp(mode, "parallel") == 0) {
+                config.shaderCompile = ShaderCompiler::Mode::Parallel;
+            } else if (std::strcmp(mode, "thread") == 0) {
+                config.shaderCompile = ShaderCompiler::Mode::Thread;
+            } else if (std::strcmp(mode, "sync") == 0) {
+                config.shaderCompile = ShaderCompiler::Mode::Sync;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            config.tracePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--profile") == 0) {
+            config.profile = true;
+        } else if (std::strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) {
+            config.profileCsvPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc) {
+            const char* speed = argv[++i];
+            if (std::strcmp(speed, "max") == 0) {
+                config.replaySpeed = ReplaySpeed::Max;
+            } else if (std::strcmp(speed, "wall") == 0) {
+                config.replaySpeed = ReplaySpeed::WallClock;
+            } else if (std::strcmp(speed, "frame") == 0) {
+                config.replaySpeed = ReplaySpeed::Frame;
+            } else {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (config.tracePath) {
+#ifdef TINYPAINT_TRACE
+        Trace::start(config.tracePath);
+#else
+        std::cerr << "--trace requires a build with TRACE=1; ignoring" << std::endl;
+#endif
+    }
+
+    int status = 0;
     try {
-        App app(800, 600, "tinyPaint", 4096.0f);
+        // 全スレッドを停止してからトレースを書き出すためスコープで破棄
+        App app(config);
         app.run();
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
+        status = 1;
     }
-    return 0;
+    Trace::stop();
+    return status;
 }
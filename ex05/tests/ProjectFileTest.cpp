@@ -0,0 +1,207 @@
+#include "IO/ProjectFile.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// 自動保存(ProjectWriterの差分追記)の途中で止まったファイルから、直前の保存を読み戻せるかの確認
+//
+// 1回目に全体保存、2回目に一部のタイルを差分で追記したファイルを作り、
+// 最後の追記の末尾を切り詰めたり書き換えたりしても1回目の内容が読めることを確かめる。
+// 何回かに分けた全体保存が、最後の回まで元のファイルを置き換えないことも確かめる。
+
+namespace {
+
+constexpr int CANVAS_SIZE = 64;
+constexpr int TILE_SIZE = 16;
+const char* const FILENAME = "project_test_auto.tpp";
+
+using Snapshot = std::map<ProjectTileKey, std::vector<uint8_t>>;
+
+int failures = 0;
+
+void check(bool condition, const std::string& message) {
+    if (!condition) {
+        std::cerr << "FAIL: " << message << std::endl;
+        failures++;
+    }
+}
+
+std::vector<uint8_t> makeTile(int seed) {
+    std::vector<uint8_t> pixels(static_cast<size_t>(TILE_SIZE) * TILE_SIZE * 4);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        pixels[i] = static_cast<uint8_t>(seed * 31 + i * 7);
+    }
+    return pixels;
+}
+
+ProjectInfo makeInfo() {
+    ProjectInfo info;
+    info.canvasSize = CANVAS_SIZE;
+    info.tileSize = TILE_SIZE;
+    info.activeIndex = 0;
+    info.layers.push_back(ProjectLayer{});
+    return info;
+}
+
+void save(ProjectWriter& writer, const Snapshot& changed, bool full) {
+    std::vector<ProjectTile> tiles;
+    for (const auto& [key, pixels] : changed) {
+        tiles.push_back({key.layerID, key.tileX, key.tileY, pixels});
+    }
+    writer.begin(FILENAME, makeInfo(), std::move(tiles), full);
+    writer.finish();
+}
+
+uint64_t fileSize(const std::string& filename) {
+    std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+    return ifs.is_open() ? static_cast<uint64_t>(ifs.tellg()) : 0;
+}
+
+std::vector<uint8_t> readFile(const std::string& filename) {
+    std::ifstream ifs(filename, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string& filename, const std::vector<uint8_t>& data) {
+    std::ofstream ofs(filename, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+}
+
+bool sameTiles(const Snapshot& a, const Snapshot& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (const auto& [key, pixels] : a) {
+        auto it = b.find(key);
+        if (it == b.end() || it->second != pixels) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// filenameを開いて全タイルがexpectedと一致するか
+void expectSnapshot(const std::string& filename, const Snapshot& expected, const std::string& label) {
+    ProjectReader reader;
+    if (!reader.open(filename)) {
+        check(false, label + ": could not open");
+        return;
+    }
+    Snapshot loaded;
+    size_t tileBytes = static_cast<size_t>(TILE_SIZE) * TILE_SIZE * 4;
+    bool ok = reader.readTiles([&](int layerID, int tileX, int tileY, const uint8_t* pixels) {
+        loaded[{layerID, tileX, tileY}] = std::vector<uint8_t>(pixels, pixels + tileBytes);
+    });
+    check(ok, label + ": corrupt tiles");
+    check(sameTiles(loaded, expected), label + ": tiles differ from the expected save");
+}
+
+}  // namespace
+
+int main() {
+    // 1回目: 全体保存
+    Snapshot first;
+    for (int i = 0; i < 6; ++i) {
+        first[{0, i % 4, i / 4}] = makeTile(i);
+    }
+    // 2回目: 1枚を差し替え、1枚を追加
+    Snapshot changed;
+    changed[{0, 1, 0}] = makeTile(100);
+    changed[{0, 3, 3}] = makeTile(101);
+    Snapshot second = first;
+    for (const auto& [key, pixels] : changed) {
+        second[key] = pixels;
+    }
+
+    ProjectWriter writer("Autosave written");
+    save(writer, first, true);
+    uint64_t firstSize = fileSize(FILENAME);
+    check(writer.canAppend(FILENAME), "second save should append");
+    save(writer, changed, false);
+    uint64_t secondSize = fileSize(FILENAME);
+    check(secondSize > firstSize, "append did not grow the file");
+
+    std::vector<uint8_t> intact = readFile(FILENAME);
+    const std::string damaged = std::string(FILENAME) + ".damaged";
+    expectSnapshot(FILENAME, second, "intact");
+
+    // 2回目の追記の途中(タイル・INDX・末尾のどこか)で止まった
+    for (uint64_t cut : {uint64_t{1}, uint64_t{7}, uint64_t{16}, (secondSize - firstSize) / 2, secondSize - firstSize - 1}) {
+        writeFile(damaged, std::vector<uint8_t>(intact.begin(), intact.end() - static_cast<ptrdiff_t>(cut)));
+        expectSnapshot(damaged, first, "truncated by " + std::to_string(cut) + " bytes");
+    }
+
+    // 末尾が書きかけのまま上書きされた
+    std::vector<uint8_t> garbled = intact;
+    std::memset(garbled.data() + garbled.size() - 10, 0xA5, 10);
+    writeFile(damaged, garbled);
+    expectSnapshot(damaged, first, "garbled trailer");
+
+    // 3回目の追記がタイルの途中で止まった(2回目の末尾の後ろにゴミが残る)
+    std::vector<uint8_t> appended = intact;
+    appended.insert(appended.end(), {'T', 'I', 'L', 'E', 0xFF, 0x00, 0x12});
+    writeFile(damaged, appended);
+    expectSnapshot(damaged, second, "garbage after the last trailer");
+
+    // 復旧したファイルへの次の保存は全体保存になり、壊れた部分は消える
+    writeFile(FILENAME, garbled);
+    ProjectReader reader;
+    if (reader.open(FILENAME)) {
+        ProjectWriter recovered("Autosave written");
+        recovered.adopt(FILENAME, reader.getIndex());
+        check(!recovered.canAppend(FILENAME), "recovered file must not be appended to");
+        save(recovered, second, true);
+        expectSnapshot(FILENAME, second, "rewritten after recovery");
+    } else {
+        check(false, "recovery before rewrite: could not open");
+    }
+
+    // 全体保存を2回に分ける(2回目で1枚を描き直し、1枚を初期状態に戻す)
+    Snapshot firstPart;
+    Snapshot lastPart;
+    for (const auto& [key, pixels] : second) {
+        (key.tileY < 2 ? firstPart : lastPart)[key] = pixels;
+    }
+    lastPart[{0, 1, 0}] = makeTile(200);
+    lastPart[{0, 2, 0}] = {};
+    Snapshot split = second;
+    split[{0, 1, 0}] = makeTile(200);
+    split.erase({0, 2, 0});
+    ProjectWriter splitWriter("Project saved");
+    {
+        std::vector<ProjectTile> tiles;
+        for (const auto& [key, pixels] : firstPart) {
+            tiles.push_back({key.layerID, key.tileX, key.tileY, pixels});
+        }
+        splitWriter.begin(FILENAME, makeInfo(), std::move(tiles), true, false);
+        splitWriter.finish();
+    }
+    check(splitWriter.isPartial(), "first part of a split save should leave the save open");
+    check(!splitWriter.canAppend(FILENAME), "split save in progress must not be appended to");
+    expectSnapshot(FILENAME, second, "before the last part of a split save");
+    {
+        std::vector<ProjectTile> tiles;
+        for (const auto& [key, pixels] : lastPart) {
+            tiles.push_back({key.layerID, key.tileX, key.tileY, pixels});
+        }
+        splitWriter.begin(FILENAME, makeInfo(), std::move(tiles), true, true);
+        splitWriter.finish();
+    }
+    check(!splitWriter.isPartial(), "last part should close the split save");
+    check(splitWriter.canAppend(FILENAME), "split save should be appendable after the last part");
+    expectSnapshot(FILENAME, split, "split full save");
+
+    std::remove(FILENAME);
+    std::remove(damaged.c_str());
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "ProjectFileTest: all checks passed" << std::endl;
+    return 0;
+}